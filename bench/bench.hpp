@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace freecube::bench {
+
+    /**
+     * @brief Heap allocations made so far by this process (operator new calls)
+     */
+    std::uint64_t allocations();
+
+    struct Result {
+        std::string name;
+        std::uint64_t iterations;       //< Of the fastest repetition
+        double ns_per_op;
+        double bytes_per_sec;           //< 0 if the benchmark doesn't move bytes
+        double allocs_per_op;
+    };
+
+    /**
+     * @brief Times registered benchmarks and collects their results
+     *
+     * Each benchmark is a callable running its operation `n` times. The runner doubles
+     * `n` until one call takes at least the minimum time, then repeats that call and keeps
+     * the fastest repetition, which is what the numbers come from.
+     */
+    class Runner {
+    public:
+        using Body = std::function<void(std::uint64_t n)>;
+
+        /**
+         * @param bytes_per_op Bytes one operation reads or writes, for the throughput column
+         */
+        void add(std::string name, Body body, std::uint64_t bytes_per_op = 0);
+
+        /**
+         * @brief Mark the run as failed (a benchmark found its own results wrong)
+         */
+        void fail(const std::string &why);
+
+        /**
+         * @brief Run every benchmark whose name contains `filter`, printing a line for each
+         */
+        void run(const std::string &filter, double min_time_s, unsigned repetitions);
+
+        /**
+         * @return false if the file couldn't be written
+         */
+        bool write_json(const std::string &path) const;
+
+        const std::vector<Result> &results() const { return m_results; }
+        bool failed() const { return m_failed; }
+
+    private:
+        struct Entry {
+            std::string name;
+            Body body;
+            std::uint64_t bytes_per_op;
+        };
+
+        std::vector<Entry> m_entries;
+        std::vector<Result> m_results;
+        bool m_failed = false;
+    };
+
+    /**
+     * @brief Keep a value alive so the measured work isn't optimised away
+     */
+    template<typename T>
+    inline void do_not_optimize(const T &value) {
+#if defined(__GNUC__) || defined(__clang__)
+        asm volatile("" : : "r,m"(value) : "memory");
+#else
+        static volatile const void *sink;
+        sink = &value;
+#endif
+    }
+
+    // One per bench/*_bench.cpp
+    void register_loader_benches(Runner &runner);
+    void register_dol_benches(Runner &runner);
+    void register_log_benches(Runner &runner);
+    void register_scheduler_benches(Runner &runner);
+    void register_state_benches(Runner &runner);
+    void register_hash_benches(Runner &runner);
+    void register_library_benches(Runner &runner);
+}
@@ -0,0 +1,176 @@
+// freecube_bench: microbenchmarks for the loader, DOL and logging paths
+//
+//   freecube_bench [--filter=iso/] [--min-time=0.2] [--repetitions=3] [--json=out.json]
+//
+// Exits nonzero if a benchmark reports a wrong result.
+
+#include "bench.hpp"
+#include "util/log.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+
+#ifndef FREECUBE_CMAKE_BUILD_TIME
+    #define FREECUBE_CMAKE_BUILD_TIME "unknown"
+#endif
+
+namespace {
+    std::atomic<std::uint64_t> g_allocations{0};
+}
+
+// Counting every allocation in the process is what makes allocs/op possible
+void *operator new(std::size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+namespace freecube::bench {
+
+    std::uint64_t allocations() {
+        return g_allocations.load(std::memory_order_relaxed);
+    }
+
+    void Runner::add(std::string name, Body body, std::uint64_t bytes_per_op) {
+        m_entries.push_back({ std::move(name), std::move(body), bytes_per_op });
+    }
+
+    void Runner::fail(const std::string &why) {
+        std::fprintf(stderr, "FAILED: %s\n", why.c_str());
+        m_failed = true;
+    }
+
+    void Runner::run(const std::string &filter, double min_time_s, unsigned repetitions) {
+        using Clock = std::chrono::steady_clock;
+
+        auto time = [](const Body &body, std::uint64_t n) {
+            const auto start = Clock::now();
+            body(n);
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        };
+
+        std::printf("%-36s %12s %14s %14s %12s\n", "benchmark", "iterations", "ns/op", "MB/s", "allocs/op");
+
+        for (const Entry &e : m_entries) {
+            if (e.name.find(filter) == std::string::npos)
+                continue;
+
+            // Also warms caches and whatever the body sets up lazily
+            std::uint64_t n = 1;
+            while (time(e.body, n) < min_time_s && n < (std::uint64_t(1) << 40))
+                n *= 2;
+
+            double best = 0;
+            std::uint64_t allocs = 0;
+            for (unsigned r = 0; r < repetitions; r++) {
+                const std::uint64_t before = allocations();
+                const double t = time(e.body, n);
+                const std::uint64_t used = allocations() - before;
+                if (r == 0 || t < best) {
+                    best = t;
+                    allocs = used;
+                }
+            }
+
+            Result res;
+            res.name = e.name;
+            res.iterations = n;
+            res.ns_per_op = best * 1e9 / static_cast<double>(n);
+            res.bytes_per_sec = e.bytes_per_op ? static_cast<double>(e.bytes_per_op) * static_cast<double>(n) / best : 0;
+            res.allocs_per_op = static_cast<double>(allocs) / static_cast<double>(n);
+            m_results.push_back(res);
+
+            if (res.bytes_per_sec)
+                std::printf("%-36s %12llu %14.2f %14.1f %12.2f\n", res.name.c_str(),
+                            static_cast<unsigned long long>(n), res.ns_per_op, res.bytes_per_sec / 1e6, res.allocs_per_op);
+            else
+                std::printf("%-36s %12llu %14.2f %14s %12.2f\n", res.name.c_str(),
+                            static_cast<unsigned long long>(n), res.ns_per_op, "-", res.allocs_per_op);
+            std::fflush(stdout);
+        }
+    }
+
+    bool Runner::write_json(const std::string &path) const {
+        std::ofstream f(path, std::ios::trunc);
+        if (!f)
+            return false;
+
+        f << "{\n  \"build_time\": \"" << FREECUBE_CMAKE_BUILD_TIME << "\",\n"
+          << "  \"log_level\": " << FREECUBE_LOG_LEVEL << ",\n"
+          << "  \"benchmarks\": [\n";
+
+        char line[512];
+        for (std::size_t i = 0; i < m_results.size(); i++) {
+            const Result &r = m_results[i];
+            // Names are ours ("iso/open_small"), nothing in them needs escaping
+            std::snprintf(line, sizeof(line),
+                          "    {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.3f, "
+                          "\"bytes_per_second\": %.0f, \"allocs_per_op\": %.3f}%s\n",
+                          r.name.c_str(), static_cast<unsigned long long>(r.iterations), r.ns_per_op,
+                          r.bytes_per_sec, r.allocs_per_op, i + 1 < m_results.size() ? "," : "");
+            f << line;
+        }
+        f << "  ]\n}\n";
+        return static_cast<bool>(f);
+    }
+}
+
+int main(int argc, char **argv) {
+    using namespace freecube;
+
+    std::string filter;
+    std::string json_path;
+    double min_time_s = 0.2;
+    unsigned repetitions = 3;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--filter=", 0) == 0) {
+            filter = arg.substr(9);
+        } else if (arg.rfind("--json=", 0) == 0) {
+            json_path = arg.substr(7);
+        } else if (arg.rfind("--min-time=", 0) == 0) {
+            min_time_s = std::stod(arg.substr(11));
+        } else if (arg.rfind("--repetitions=", 0) == 0) {
+            repetitions = std::max(1u, static_cast<unsigned>(std::stoul(arg.substr(14))));
+        } else {
+            std::fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+            return 2;
+        }
+    }
+
+    // Only the log benchmarks want output, and they set their own level
+    util::LogCFG::min_level = util::LogLevel::FC_CRITICAL;
+
+    bench::Runner runner;
+    bench::register_loader_benches(runner);
+    bench::register_dol_benches(runner);
+    bench::register_log_benches(runner);
+    bench::register_scheduler_benches(runner);
+    bench::register_state_benches(runner);
+    bench::register_hash_benches(runner);
+    bench::register_library_benches(runner);
+
+    runner.run(filter, min_time_s, repetitions);
+
+    if (!json_path.empty() && !runner.write_json(json_path)) {
+        std::fprintf(stderr, "Failed to write %s\n", json_path.c_str());
+        return 1;
+    }
+
+    return runner.failed() ? 1 : 0;
+}
@@ -0,0 +1,73 @@
+// DOL header parsing, validation and placement in guest RAM
+
+#include "bench.hpp"
+#include "dol/dol_gen.hpp"
+#include "dol/dol_loader.hpp"
+#include "dol/validate.hpp"
+#include "util/mapped_file.hpp"
+#include <filesystem>
+#include <fstream>
+#include <memory>
+
+namespace freecube::bench {
+
+    void register_dol_benches(Runner &runner) {
+        auto dol = std::make_shared<std::vector<std::uint8_t>>(dol::build_dol(dol::DolLayout::retail_like()));
+
+        runner.add("dol/read_header", [dol](std::uint64_t n) {
+            dol::DolHeader hdr;
+            for (std::uint64_t i = 0; i < n; i++) {
+                dol::readDolHeader(*dol, hdr);
+                do_not_optimize(hdr);
+            }
+        });
+
+        auto hdr = std::make_shared<dol::DolHeader>();
+        dol::readDolHeader(*dol, *hdr);
+
+        runner.add("dol/validate", [dol, hdr](std::uint64_t n) {
+            for (std::uint64_t i = 0; i < n; i++)
+                do_not_optimize(dol::validateDol(*hdr, dol->size()).status);
+        });
+
+        runner.add("dol/construct", [dol](std::uint64_t n) {
+            for (std::uint64_t i = 0; i < n; i++) {
+                dol::DOLLoader loader(*dol);
+                do_not_optimize(loader.image().entry_point);
+            }
+        });
+
+        auto loader = std::make_shared<dol::DOLLoader>(*dol);
+        auto mem = std::make_shared<memory::Memory>();
+
+        runner.add("dol/load_into", [dol, loader, mem](std::uint64_t n) {
+            for (std::uint64_t i = 0; i < n; i++)
+                loader->load_into(*mem);
+        }, dol->size() - 0x100);
+
+        // What --dol does up to the first instruction, less creating the guest memory
+        const auto path = std::filesystem::temp_directory_path() / "freecube_bench.dol";
+        {
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char *>(dol->data()), static_cast<std::streamsize>(dol->size()));
+        }
+        auto file = std::shared_ptr<const std::filesystem::path>(new std::filesystem::path(path), [](const auto *p) {
+            std::error_code ec;
+            std::filesystem::remove(*p, ec);
+            delete p;
+        });
+
+        runner.add("dol/boot_file", [file, mem](std::uint64_t n) {
+            for (std::uint64_t i = 0; i < n; i++) {
+                util::MappedFile mapped(file->string());
+                dol::DolHeader header;
+                dol::readDolHeader(mapped.bytes(), header);
+                if (dol::validateDol(header, mapped.size()).status != dol::DolStatus::OK)
+                    return;
+                dol::DOLLoader loader(mapped.bytes(), header);
+                loader.load_into(*mem);
+                do_not_optimize(loader.image().entry_point);
+            }
+        }, dol->size() - 0x100);
+    }
+}
@@ -0,0 +1,74 @@
+// Disc digests: each hash on its own over a buffer in cache, then the whole-image pass
+// over a generated disc.
+
+#include "bench.hpp"
+#include "loader/disc_gen.hpp"
+#include "loader/iso.hpp"
+#include "loader/verify.hpp"
+#include "util/hash.hpp"
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+namespace freecube::bench {
+
+    namespace {
+        constexpr std::size_t BUFFER = 1024 * 1024;
+
+        struct Disc {
+            std::filesystem::path path;
+            std::unique_ptr<ISOLoader::ISOImage> iso;
+
+            explicit Disc(const ISOLoader::DiscSpec &spec)
+                : path(std::filesystem::temp_directory_path() / "freecube_bench_hash.iso") {
+                ISOLoader::generate_disc(spec, path.string());
+                iso = std::make_unique<ISOLoader::ISOImage>(path.string());
+            }
+
+            ~Disc() {
+                iso.reset();
+                std::error_code ec;
+                std::filesystem::remove(path, ec);
+            }
+        };
+    }
+
+    void register_hash_benches(Runner &runner) {
+        auto buffer = std::make_shared<std::vector<std::uint8_t>>(BUFFER);
+        for (std::size_t i = 0; i < BUFFER; i++)
+            (*buffer)[i] = ISOLoader::disc_pattern(i, 1);
+
+        runner.add("hash/crc32", [buffer](std::uint64_t n) {
+            for (std::uint64_t i = 0; i < n; i++)
+                do_not_optimize(util::Crc32::compute(buffer->data(), buffer->size()));
+        }, BUFFER);
+
+        runner.add("hash/md5", [buffer](std::uint64_t n) {
+            for (std::uint64_t i = 0; i < n; i++) {
+                util::Md5 md5;
+                md5.update(buffer->data(), buffer->size());
+                do_not_optimize(md5.finish());
+            }
+        }, BUFFER);
+
+        runner.add("hash/sha1", [buffer](std::uint64_t n) {
+            for (std::uint64_t i = 0; i < n; i++) {
+                util::Sha1 sha1;
+                sha1.update(buffer->data(), buffer->size());
+                do_not_optimize(sha1.finish());
+            }
+        }, BUFFER);
+
+        // All three at once, as --verify runs them; bounded by the slowest of MD5 and SHA-1
+        ISOLoader::DiscSpec spec;
+        spec.files = 512;
+        spec.min_file_size = 64 * 1024;
+        spec.max_file_size = 192 * 1024;
+        auto disc = std::make_shared<Disc>(spec);
+
+        runner.add("hash/image", [disc](std::uint64_t n) {
+            for (std::uint64_t i = 0; i < n; i++)
+                do_not_optimize(ISOLoader::hash_image(*disc->iso).crc32);
+        }, disc->iso->size());
+    }
+}
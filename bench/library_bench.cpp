@@ -0,0 +1,72 @@
+// Library scans over a directory of 1000 images
+//
+// The images are sparse files holding just a disc header, the scanner never reads
+// further than that anyway.
+
+#include "bench.hpp"
+#include "library/library.hpp"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+
+namespace freecube::bench {
+
+    namespace {
+        constexpr std::size_t IMAGES = 1000;
+
+        struct Library {
+            std::filesystem::path dir = std::filesystem::temp_directory_path() / "freecube_bench_library";
+            std::string cache_path = (std::filesystem::temp_directory_path() / "freecube_bench_library.fcl").string();
+
+            Library() {
+                std::filesystem::create_directories(dir);
+                for (std::size_t i = 0; i < IMAGES; i++) {
+                    char name[32], header[0x440] = {};
+                    std::snprintf(name, sizeof(name), "game%04zu.iso", i);
+                    std::snprintf(header, 7, "G%03zuE8", i % 1000);
+                    std::snprintf(header + 0x20, 0x3E0, "Benchmark disc %zu", i);
+
+                    const auto path = dir / name;
+                    {
+                        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+                        out.write(header, sizeof(header));
+                    }
+                    std::filesystem::resize_file(path, 0x8000 * 16);
+                }
+            }
+
+            ~Library() {
+                std::error_code ec;
+                std::filesystem::remove_all(dir, ec);
+                std::filesystem::remove(cache_path, ec);
+            }
+        };
+    }
+
+    void register_library_benches(Runner &runner) {
+        auto lib = std::make_shared<Library>();
+
+        // Every header read, as on the first scan of a library
+        runner.add("library/scan_cold", [lib](std::uint64_t n) {
+            for (std::uint64_t i = 0; i < n; i++) {
+                library::LibraryCache cache("");
+                do_not_optimize(library::scan({ lib->dir.string() }, cache).size());
+            }
+        });
+
+        // Nothing changed: loading the cache, a stat per image and saving it again
+        {
+            library::LibraryCache cache(lib->cache_path);
+            library::scan({ lib->dir.string() }, cache);
+            cache.save();
+        }
+        runner.add("library/rescan", [lib](std::uint64_t n) {
+            for (std::uint64_t i = 0; i < n; i++) {
+                library::LibraryCache cache(lib->cache_path);
+                do_not_optimize(library::scan({ lib->dir.string() }, cache).size());
+                cache.save();
+            }
+        });
+    }
+}
@@ -0,0 +1,123 @@
+// Disc image open, FST lookup and DOL extraction
+//
+// Runs against two images generated into the temp directory: a small one shaped like a
+// typical disc and one with a 100k entry FST.
+
+#include "bench.hpp"
+#include "loader/disc_gen.hpp"
+#include "loader/iso.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+
+namespace freecube::bench {
+
+    namespace {
+        using ISOLoader::ISOImage;
+        using ISOLoader::StorageMode;
+
+        /**
+         * @brief A generated disc image, deleted again when the last benchmark using it goes
+         */
+        struct Disc {
+            std::filesystem::path path;
+            ISOLoader::GeneratedDisc layout;
+            ISOLoader::GeneratedFile biggest;
+
+            Disc(const char *name, const ISOLoader::DiscSpec &spec)
+                : path(std::filesystem::temp_directory_path() / name),
+                  layout(ISOLoader::generate_disc(spec, path.string())) {
+                const auto &files = layout.files;
+                biggest = *std::max_element(files.begin(), files.end(), [](const auto &a, const auto &b) {
+                    return a.size < b.size;
+                });
+            }
+
+            ~Disc() {
+                std::error_code ec;
+                std::filesystem::remove(path, ec);
+            }
+        };
+    }
+
+    void register_loader_benches(Runner &runner) {
+        ISOLoader::DiscSpec small_spec;
+        small_spec.files = 500;
+        small_spec.max_file_size = 0x20000;
+
+        // Tiny files so the image stays small, it's the FST that matters
+        ISOLoader::DiscSpec huge_spec;
+        huge_spec.files = 100000;
+        huge_spec.depth = 3;
+        huge_spec.fanout = 8;
+        huge_spec.max_file_size = 64;
+
+        auto small = std::make_shared<Disc>("freecube_bench_small.iso", small_spec);
+        auto huge = std::make_shared<Disc>("freecube_bench_huge.iso", huge_spec);
+
+        const std::pair<const char *, std::shared_ptr<Disc>> discs[] = { { "small", small }, { "huge", huge } };
+
+        for (const auto &[label, disc_ptr] : discs) {
+            auto disc = disc_ptr;
+            runner.add(std::string("iso/open_") + label, [disc](std::uint64_t n) {
+                for (std::uint64_t i = 0; i < n; i++) {
+                    ISOImage iso(disc->path.string());
+                    do_not_optimize(iso.fst().size());
+                }
+            });
+        }
+
+        runner.add("iso/open_small_buffered", [small](std::uint64_t n) {
+            for (std::uint64_t i = 0; i < n; i++) {
+                ISOImage iso(small->path.string(), StorageMode::BUFFERED);
+                do_not_optimize(iso.size());
+            }
+        }, small->layout.size);
+
+        for (const auto &[label, disc_ptr] : discs) {
+            auto disc = disc_ptr;
+            auto iso = std::make_shared<ISOImage>(disc->path.string());
+
+            // Walk the file list so the lookups don't all hit the same cache lines
+            runner.add(std::string("fst/find_path_") + label, [disc, iso](std::uint64_t n) {
+                const auto &files = disc->layout.files;
+                for (std::uint64_t i = 0; i < n; i++)
+                    do_not_optimize(iso->fst().find_file(files[(i * 7919) % files.size()].path));
+            });
+
+            // Bare names have to be matched back up the tree
+            runner.add(std::string("fst/find_basename_") + label, [disc, iso](std::uint64_t n) {
+                const auto &files = disc->layout.files;
+                std::vector<std::string> names;
+                for (std::size_t i = 0; i < 64; i++) {
+                    const std::string &p = files[(i * 7919) % files.size()].path;
+                    names.push_back(p.substr(p.rfind('/') + 1));
+                }
+                for (std::uint64_t i = 0; i < n; i++)
+                    do_not_optimize(iso->fst().find_file(names[i % names.size()]));
+            });
+
+            runner.add(std::string("fst/find_miss_") + label, [iso](std::uint64_t n) {
+                for (std::uint64_t i = 0; i < n; i++)
+                    do_not_optimize(iso->fst().find_file("dir00/missing.bin"));
+            });
+        }
+
+        auto iso = std::make_shared<ISOImage>(small->path.string());
+
+        runner.add("iso/get_dol", [iso](std::uint64_t n) {
+            for (std::uint64_t i = 0; i < n; i++)
+                do_not_optimize(iso->get_dol().size());
+        }, small->layout.dol_size);
+
+        runner.add("iso/dol_span", [iso](std::uint64_t n) {
+            for (std::uint64_t i = 0; i < n; i++)
+                do_not_optimize(iso->dol_span().size());
+        });
+
+        runner.add("iso/extract_file", [small, iso](std::uint64_t n) {
+            for (std::uint64_t i = 0; i < n; i++)
+                do_not_optimize(iso->extract_file(small->biggest.path)->size());
+        }, small->biggest.size);
+    }
+}
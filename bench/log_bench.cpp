@@ -0,0 +1,114 @@
+// Logging: what a switched off site costs, and throughput of the ones that print
+//
+// A site compiled out (below FREECUBE_LOG_LEVEL) must cost exactly nothing, and one
+// that's only below LogCFG::min_level at runtime must not evaluate its arguments.
+// Printing sites write into a discarding stream, so the numbers are formatting cost.
+
+#include "bench.hpp"
+#include "util/log.hpp"
+#include <string>
+
+namespace freecube::bench {
+
+    namespace {
+        using namespace util;
+
+        volatile std::uint64_t g_sink;          // Keeps the loops from being optimised away
+        std::uint64_t g_evaluated = 0;          // Times an argument was actually computed
+
+        // Stands in for an argument that's expensive to produce
+        std::string costly(std::uint64_t i) {
+            g_evaluated++;
+            return std::to_string(i);
+        }
+
+        void check_not_evaluated(Runner &runner, const char *name) {
+            if (g_evaluated) {
+                runner.fail(std::string(name) + ": a switched off log site evaluated its arguments");
+                g_evaluated = 0;
+            }
+        }
+
+        class NullBuffer : public std::streambuf {
+        protected:
+            int overflow(int c) override { return c; }
+            std::streamsize xsputn(const char *, std::streamsize n) override { return n; }
+        };
+
+        // Points cout/cerr at nothing and sets min_level for the lifetime of a measurement
+        class Silenced {
+        public:
+            explicit Silenced(LogLevel level) : m_level(LogCFG::min_level) {
+                static NullBuffer null;
+                m_out = std::cout.rdbuf(&null);
+                m_err = std::cerr.rdbuf(&null);
+                LogCFG::min_level = level;
+            }
+
+            ~Silenced() {
+                std::cout.rdbuf(m_out);
+                std::cerr.rdbuf(m_err);
+                LogCFG::min_level = m_level;
+            }
+
+        private:
+            LogLevel m_level;
+            std::streambuf *m_out;
+            std::streambuf *m_err;
+        };
+
+        // A typical message: text, a couple of integers and a string
+#define FREECUBE_BENCH_LOG_LEVEL(level)                                                          \
+        [](std::uint64_t n) {                                                                    \
+            Silenced quiet(LogLevel::FC_TRACE);                                                  \
+            for (std::uint64_t i = 0; i < n; i++)                                                \
+                FREECUBE_LOG_AT(level, "Block @ ", static_cast<std::uint32_t>(i), " (",         \
+                                static_cast<std::uint32_t>(n), " instructions) in ", "main.dol"); \
+        }
+    }
+
+    void register_log_benches(Runner &runner) {
+        runner.add("log/no_site", [](std::uint64_t n) {
+            for (std::uint64_t i = 0; i < n; i++)
+                g_sink = i;
+        });
+
+        // Exactly what LOG_TRACE expands to when FREECUBE_LOG_LEVEL is above TRACE
+        runner.add("log/compiled_out", [&runner](std::uint64_t n) {
+            for (std::uint64_t i = 0; i < n; i++) {
+                g_sink = i;
+                FREECUBE_LOG_ELIDED("elided ", i, " ", costly(i));
+            }
+            check_not_evaluated(runner, "log/compiled_out");
+        });
+
+        // Compiled in, but below LogCFG::min_level
+        runner.add("log/below_min_level", [&runner](std::uint64_t n) {
+            Silenced quiet(LogLevel::FC_INFO);
+            for (std::uint64_t i = 0; i < n; i++) {
+                g_sink = i;
+                FREECUBE_LOG_AT(FC_DEBUG, "runtime off ", i, " ", costly(i));
+            }
+            check_not_evaluated(runner, "log/below_min_level");
+        });
+
+        runner.add("log/trace", FREECUBE_BENCH_LOG_LEVEL(FC_TRACE));
+        runner.add("log/debug", FREECUBE_BENCH_LOG_LEVEL(FC_DEBUG));
+        runner.add("log/info", FREECUBE_BENCH_LOG_LEVEL(FC_INFO));
+        runner.add("log/warn", FREECUBE_BENCH_LOG_LEVEL(FC_WARN));
+        runner.add("log/error", FREECUBE_BENCH_LOG_LEVEL(FC_ERROR));
+        runner.add("log/critical", FREECUBE_BENCH_LOG_LEVEL(FC_CRITICAL));
+
+        // Producer side only; whatever the writer can't keep up with is dropped
+        runner.add("log/async_info", [](std::uint64_t n) {
+            Silenced quiet(LogLevel::FC_TRACE);
+            AsyncLog::start();
+            for (std::uint64_t i = 0; i < n; i++)
+                FREECUBE_LOG_AT(FC_INFO, "Block @ ", static_cast<std::uint32_t>(i), " (",
+                                static_cast<std::uint32_t>(n), " instructions) in ", "main.dol");
+            AsyncLog::stop();
+        });
+    }
+}
+
+#undef FREECUBE_BENCH_LOG_LEVEL
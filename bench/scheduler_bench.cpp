@@ -0,0 +1,90 @@
+// Event scheduler: the operations devices and the CPU loop hit on every slice
+//
+// Each benchmark keeps LIVE events pending, spread over about a frame of guest time,
+// which is far more than real hardware ever has in flight.
+
+#include "bench.hpp"
+#include "timing/scheduler.hpp"
+#include <memory>
+#include <vector>
+
+namespace freecube::bench {
+
+    namespace {
+        constexpr std::size_t LIVE = 4096;
+        constexpr std::uint64_t SPREAD = timing::CPU_CLOCK_HZ / 60;
+
+        std::uint64_t next_random(std::uint64_t &state) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            return state;
+        }
+
+        struct Fixture {
+            timing::Scheduler scheduler;
+            timing::EventType type;
+            std::vector<timing::EventId> live;
+            std::uint64_t rng = 0x9E3779B97F4A7C15ull;
+            std::uint64_t fired = 0;
+
+            Fixture() {
+                type = scheduler.register_event("bench", [this](std::uint64_t, std::int64_t) { fired++; });
+                for (std::size_t i = 0; i < LIVE; i++)
+                    live.push_back(scheduler.schedule(type, 1 + next_random(rng) % SPREAD));
+            }
+        };
+    }
+
+    void register_scheduler_benches(Runner &runner) {
+        auto f = std::make_shared<Fixture>();
+
+        runner.add("scheduler/cycles_until_next", [f](std::uint64_t n) {
+            for (std::uint64_t i = 0; i < n; i++)
+                do_not_optimize(f->scheduler.cycles_until_next());
+        });
+
+        // A device replacing one of its pending events, e.g. a register write moving a timer
+        runner.add("scheduler/schedule_cancel", [f](std::uint64_t n) {
+            for (std::uint64_t i = 0; i < n; i++) {
+                const std::size_t victim = next_random(f->rng) % LIVE;
+                f->scheduler.cancel(f->live[victim]);
+                f->live[victim] = f->scheduler.schedule(f->type, 1 + next_random(f->rng) % SPREAD);
+            }
+        });
+
+        // Periodic events: each one fires and comes straight back a period later
+        auto periodic = std::make_shared<timing::Scheduler>();
+        const timing::EventType tick = periodic->register_event("periodic", [s = periodic.get()](std::uint64_t period, std::int64_t) {
+            s->schedule(0, period, period);    // The only type registered on it
+        });
+        std::uint64_t rng = 1;
+        for (std::size_t i = 0; i < LIVE; i++) {
+            const std::uint64_t period = 1 + next_random(rng) % SPREAD;
+            periodic->schedule(tick, period, period);
+        }
+
+        runner.add("scheduler/fire_periodic", [periodic](std::uint64_t n) {
+            for (std::uint64_t i = 0; i < n; i++)
+                periodic->advance(periodic->cycles_until_next());
+            do_not_optimize(periodic->now());
+        });
+
+        // What run_scheduled() does per slice, with a device reprogramming an event each time
+        runner.add("scheduler/slice", [f](std::uint64_t n) {
+            for (std::uint64_t i = 0; i < n; i++) {
+                const std::uint64_t slice = f->scheduler.cycles_until_next();
+                f->scheduler.advance(slice);
+
+                const std::size_t victim = next_random(f->rng) % LIVE;
+                f->scheduler.cancel(f->live[victim]);
+                f->live[victim] = f->scheduler.schedule(f->type, 1 + next_random(f->rng) % SPREAD);
+
+                // Keep LIVE events pending: top up whatever fired
+                while (f->scheduler.pending() < LIVE)
+                    f->scheduler.schedule(f->type, 1 + next_random(f->rng) % SPREAD);
+            }
+            do_not_optimize(f->fired);
+        });
+    }
+}
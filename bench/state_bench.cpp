@@ -0,0 +1,98 @@
+// Save states and rewind: what taking and restoring one costs once a game is running
+//
+// The first capture stores every page; these measure the ones after it, with a frame's
+// worth of stores spread over DIRTY pages of MEM1.
+
+#include "bench.hpp"
+#include "cpu/core.hpp"
+#include "memory/memory.hpp"
+#include "state/rewind.hpp"
+#include "state/save_state.hpp"
+#include <memory>
+
+namespace freecube::bench {
+
+    namespace {
+        constexpr std::uint32_t DIRTY = 64;
+        constexpr std::uint32_t STRIDE = 0x00100000 / DIRTY * 16;    // Over 16 MiB of MEM1
+
+        struct Fixture {
+            memory::Memory mem;
+            cpu::CPUState cpu;
+            state::StateManager states{ mem };
+            std::uint32_t frame = 0;
+
+            Fixture() {
+                cpu.reset();
+                states.add_section("cpu", 1,
+                    [this](state::StateWriter &w) { state::save_cpu(w, cpu); },
+                    [this](state::StateReader &r, std::uint32_t) { state::load_cpu(r, cpu); });
+
+                // Something compressible in every page, like a booted game has
+                for (std::uint32_t off = 0; off < memory::MEM1_SIZE; off += 64)
+                    mem.write<std::uint32_t>(memory::CACHED_BASE + off, off);
+                states.capture();
+                states.wait();
+            }
+
+            void store_frame() {
+                frame++;
+                for (std::uint32_t i = 0; i < DIRTY; i++)
+                    mem.write<std::uint32_t>(memory::CACHED_BASE + i * STRIDE, frame * i);
+            }
+        };
+    }
+
+    void register_state_benches(Runner &runner) {
+        auto f = std::make_shared<Fixture>();
+
+        // Emulation only waits for the copy, compression runs in the background
+        runner.add("state/capture", [f](std::uint64_t n) {
+            for (std::uint64_t i = 0; i < n; i++) {
+                f->store_frame();
+                do_not_optimize(f->states.capture()->fresh_pages());
+            }
+            f->states.wait();
+        }, DIRTY * memory::PAGE_SIZE);
+
+        runner.add("state/capture_compressed", [f](std::uint64_t n) {
+            for (std::uint64_t i = 0; i < n; i++) {
+                f->store_frame();
+                auto snap = f->states.capture();
+                f->states.wait();
+                do_not_optimize(snap->fresh_bytes());
+            }
+        }, DIRTY * memory::PAGE_SIZE);
+
+        // Going back a frame: only the pages written since are decoded
+        runner.add("state/restore", [f](std::uint64_t n) {
+            auto snap = f->states.capture();
+            for (std::uint64_t i = 0; i < n; i++) {
+                f->store_frame();
+                f->states.restore(*snap);
+            }
+        }, DIRTY * memory::PAGE_SIZE);
+
+        // A rewind capture XORs each written page against its shadow copy. Back to back like
+        // this, each one also waits for the one before to finish compressing
+        auto rewind = std::make_shared<state::RewindBuffer>(f->states, std::size_t(64) << 20);
+        runner.add("state/rewind_capture", [f, rewind](std::uint64_t n) {
+            for (std::uint64_t i = 0; i < n; i++) {
+                f->store_frame();
+                rewind->capture();
+            }
+            rewind->wait();
+        }, DIRTY * memory::PAGE_SIZE);
+
+        // Stepping back one capture decodes one frame's deltas
+        runner.add("state/rewind_step", [f, rewind](std::uint64_t n) {
+            for (std::uint64_t i = 0; i < n; i++) {
+                f->store_frame();
+                rewind->capture();
+                f->store_frame();
+                rewind->capture();
+                rewind->rewind(1);
+            }
+        }, DIRTY * memory::PAGE_SIZE);
+    }
+}
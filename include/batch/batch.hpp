@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "cpu/engine.hpp"
+#include "loader/iso.hpp"
+
+namespace freecube::batch {
+
+    struct Options {
+        std::uint64_t budget = 0;                                   //< Instructions to run per image
+        cpu::EngineKind engine = cpu::EngineKind::JIT;
+        ISOLoader::StorageMode storage = ISOLoader::StorageMode::MAPPED;
+        unsigned workers = 0;                                       //< 0 for one per hardware thread
+    };
+
+    /**
+     * @brief How one image did
+     *
+     * Hashes are 64-bit FNV-1a over the final contents of MEM1 and ARAM, so two runs
+     * that ended in the same machine state hash the same.
+     */
+    struct Result {
+        std::string image;
+        bool ok = false;
+        std::string error;                  //< Why it didn't boot, if !ok
+
+        std::string game_id;
+        double boot_us = 0;                 //< Opening the image up to the first instruction
+        double run_seconds = 0;
+        std::uint64_t instructions = 0;
+        std::uint64_t cycles = 0;           //< Guest time, idle skips included
+        double cycles_per_second = 0;
+        std::uint32_t final_pc = 0;
+        std::uint64_t ram_hash = 0;
+        std::uint64_t aram_hash = 0;
+    };
+
+    /**
+     * @brief Images named by a manifest, or found in a directory
+     *
+     * A manifest has one path per line, relative to the manifest's directory unless
+     * absolute; blank lines and lines starting with '#' are skipped. A directory is
+     * scanned (not recursively) for .iso, .gcm and .fcb files, in name order.
+     *
+     * @throws std::runtime_error if the path can't be read
+     */
+    std::vector<std::string> collect_images(const std::string &manifest_or_dir);
+
+    /**
+     * @brief Boot and run every image, each on its own machine
+     *
+     * Images are dealt out to one worker per core. Each worker keeps its guest memory
+     * from image to image and takes work from the others once its own share is done,
+     * so a few slow images don't leave cores idle at the end. An image listed more than
+     * once is opened once while workers use it at the same time.
+     *
+     * Failures are reported in the image's Result, never thrown.
+     *
+     * @return One result per image, in the order given
+     */
+    std::vector<Result> run(const std::vector<std::string> &images, const Options &options);
+
+    /**
+     * @brief Write results as a JSON document
+     */
+    void write_json(std::ostream &out, const std::vector<Result> &results, const Options &options, double wall_seconds);
+
+} // namespace freecube::batch
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "cpu/core.hpp"
+#include "cpu/engine.hpp"
+#include "memory/memory.hpp"
+
+namespace freecube::cpu {
+
+    /**
+     * @brief A run of instructions decoded once and executed many times
+     *
+     * Ends at the first instruction flagged INST_ENDS_BLOCK, or after MAX_BLOCK_INSTRUCTIONS.
+     */
+    struct Block {
+        uint32_t address;                   //< Guest PC of the first instruction
+        uint32_t ram_offset;                //< MEM1 offset of the first instruction
+        uint32_t length;                    //< Number of instructions
+        uint64_t exec_count = 0;            //< Times the block has been entered
+        bool idle_loop = false;             //< Spins in place until something else changes memory, see is_idle_loop()
+        std::unique_ptr<Instruction[]> code;
+
+        uint32_t byte_size() const { return length * 4; }
+    };
+
+    struct BlockCacheStats {
+        uint64_t compiled = 0;      //< Blocks decoded
+        uint64_t invalidated = 0;   //< Blocks thrown away by code writes/icbi/clear()
+        uint64_t slow_retries = 0;  //< Instructions re-run on the checked path after a fastmem fault
+        uint64_t idle_loops = 0;    //< Blocks recognised as idle loops
+        uint64_t idle_skipped = 0;  //< Instructions fast-forwarded over in idle loops
+    };
+
+    /**
+     * @brief Whether a block is a loop that can't get anywhere by itself
+     *
+     * Matches blocks ending in a branch back to their own start, without link or CTR
+     * decrement, whose body only loads, compares and does register arithmetic, and where
+     * no register or CR field carries a value from one iteration into the next: the
+     * branch-to-self of an OS idle loop, or a flag or MMIO register polled until it
+     * changes. Nothing but an interrupt or a device writing memory can let such a loop
+     * out, and neither happens while the CPU runs, so once it branches back every later
+     * iteration does exactly the same.
+     */
+    bool is_idle_loop(const Instruction *code, uint32_t length, uint32_t address);
+
+    /**
+     * @brief Pre-decoded basic blocks keyed by guest PC
+     *
+     * Each block is decoded once, with every handler resolved up front, and then run in a
+     * straight loop of indirect calls. Blocks are found through a small direct-mapped table
+     * in front of a hash map, so a hot loop costs one compare per block entry.
+     *
+     * The RAM pages a block was decoded from are flagged in Memory; any write to them (guest
+     * stores, copy_to_guest DMA) drops the blocks overlapping the write, as does icbi.
+     */
+    class BlockCache : public ExecutionEngine {
+    public:
+        static constexpr uint32_t MAX_BLOCK_INSTRUCTIONS = 256;
+
+        /**
+         * @brief Attach to a guest memory, taking over its code write hook
+         */
+        explicit BlockCache(memory::Memory &mem);
+        ~BlockCache() override;
+
+        BlockCache(const BlockCache &) = delete;
+        BlockCache &operator=(const BlockCache &) = delete;
+
+        /**
+         * @brief Point a CPU at this cache's memory and route its icbi here
+         */
+        void attach(CPUState &cpu) override;
+
+        /**
+         * @brief Run from cpu.pc until at least `budget` instructions have executed
+         *
+         * Stops early if execution leaves RAM (there is nothing to decode).
+         * Fastmem faults are recovered by re-running the faulting instruction on the
+         * checked path. An idle loop that goes round once uses up the rest of the budget
+         * without running again.
+         *
+         * @return Instructions executed (whole blocks, so it may overshoot `budget`),
+         *         idle loop iterations skipped included
+         */
+        uint64_t run(CPUState &cpu, uint64_t budget) override;
+
+        /**
+         * @brief Cached block starting at `pc`, decoding it if needed
+         *
+         * @return nullptr if `pc` isn't word aligned RAM
+         */
+        const Block *get(uint32_t pc);
+
+        /**
+         * @brief Drop every block overlapping [address, address + size) of guest RAM
+         */
+        void invalidate(uint32_t address, uint32_t size) override;
+
+        /**
+         * @brief Drop every block
+         */
+        void clear() override;
+
+        std::size_t size() const { return m_blocks.size(); }
+        const BlockCacheStats &stats() const { return m_stats; }
+
+    private:
+        static constexpr uint32_t FAST_ENTRIES = 0x4000;
+
+        memory::Memory &m_mem;
+
+        std::unordered_map<uint32_t, std::unique_ptr<Block>> m_blocks;
+        std::unordered_map<uint32_t, std::vector<uint32_t>> m_page_blocks;     // RAM page -> block PCs
+        std::vector<Block *> m_fast;                                            // (pc >> 2) % FAST_ENTRIES
+
+        // A store can invalidate the block that is executing it, so blocks are only freed
+        // between blocks, never from inside the hook
+        std::vector<std::unique_ptr<Block>> m_retired;
+
+        Block *m_current = nullptr;     // Block being executed, for fault recovery
+
+        BlockCacheStats m_stats;
+
+        Block *lookup(uint32_t pc) {
+            Block *b = m_fast[(pc >> 2) & (FAST_ENTRIES - 1)];
+            return (b && b->address == pc) ? b : nullptr;
+        }
+
+        Block *fetch(uint32_t pc);
+        Block *compile(uint32_t pc);
+        void invalidate_ram(uint32_t offset, uint32_t size);
+        void retire(uint32_t pc);
+    };
+}
@@ -2,54 +2,256 @@
 
 #include <cstdint>
 #include <array>
+#include <functional>
+
+#include "cpu/opcodes.hpp"
+
+namespace freecube::memory {
+    class Memory;
+}
 
 namespace freecube::cpu {
 
+    /**
+     * @brief Floating point register with the Gekko's second paired-single lane
+     *
+     * Classic FPU instructions only see ps0 (as a double). Paired-single instructions
+     * work on both lanes at once, and single precision results land in both.
+     */
+    struct alignas(16) FPR {
+        double ps0;     //< The FPR proper / first paired single
+        double ps1;     //< Second paired single
+    };
+
+    /**
+     * @brief SPR numbers (as encoded in mfspr/mtspr) we treat specially or name elsewhere
+     */
+    namespace spr {
+        constexpr uint32_t XER    = 1;
+        constexpr uint32_t LR     = 8;
+        constexpr uint32_t CTR    = 9;
+        constexpr uint32_t DSISR  = 18;
+        constexpr uint32_t DAR    = 19;
+        constexpr uint32_t DEC    = 22;
+        constexpr uint32_t SDR1   = 25;
+        constexpr uint32_t SRR0   = 26;
+        constexpr uint32_t SRR1   = 27;
+        constexpr uint32_t TBL    = 268;    //< Read port (mftb)
+        constexpr uint32_t TBU    = 269;
+        constexpr uint32_t SPRG0  = 272;    //< SPRG0-3
+        constexpr uint32_t EAR    = 282;
+        constexpr uint32_t TBL_W  = 284;    //< Write port (mtspr)
+        constexpr uint32_t TBU_W  = 285;
+        constexpr uint32_t PVR    = 287;
+        constexpr uint32_t IBAT0U = 528;    //< IBAT0U/L-IBAT3U/L
+        constexpr uint32_t DBAT0U = 536;    //< DBAT0U/L-DBAT3U/L
+        constexpr uint32_t GQR0   = 912;    //< GQR0-7
+        constexpr uint32_t HID2   = 920;
+        constexpr uint32_t WPAR   = 921;
+        constexpr uint32_t DMAU   = 922;
+        constexpr uint32_t DMAL   = 923;
+        constexpr uint32_t UMMCR0 = 936;    //< User-mode read ports of MMCR0-PMC4
+        constexpr uint32_t MMCR0  = 952;    //< MMCR0, PMC1, PMC2, SIA, MMCR1, PMC3, PMC4
+        constexpr uint32_t HID0   = 1008;
+        constexpr uint32_t HID1   = 1009;
+        constexpr uint32_t IABR   = 1010;
+        constexpr uint32_t DABR   = 1013;
+        constexpr uint32_t L2CR   = 1017;
+        constexpr uint32_t ICTC   = 1019;
+        constexpr uint32_t THRM1  = 1020;   //< THRM1-3
+
+        constexpr uint8_t UNIMPLEMENTED = 0xFF;
+
+        struct Index {
+            uint8_t slot[1024];
+            uint8_t count;
+        };
+
+        // SPR number -> slot in SprFile. XER/LR/CTR live in CPUState itself, and the
+        // read/write ports of one register share a slot.
+        constexpr Index make_index() {
+            Index idx{};
+            for (auto &s : idx.slot)
+                s = UNIMPLEMENTED;
+
+            uint8_t next = 0;
+            auto add = [&](uint32_t first, uint32_t n) {
+                for (uint32_t i = 0; i < n; i++)
+                    idx.slot[first + i] = next++;
+            };
+
+            add(DSISR, 2);
+            add(DEC, 1);
+            add(SDR1, 3);
+            add(TBL, 2);
+            add(SPRG0, 4);
+            add(EAR, 1);
+            add(PVR, 1);
+            add(IBAT0U, 16);
+            add(GQR0, 8);
+            add(HID2, 4);
+            add(MMCR0, 7);
+            add(HID0, 3);
+            add(DABR, 1);
+            add(L2CR, 1);
+            add(ICTC, 4);
+            idx.count = next;
+
+            idx.slot[TBL_W] = idx.slot[TBL];
+            idx.slot[TBU_W] = idx.slot[TBU];
+            for (uint32_t i = 0; i < 7; i++)
+                idx.slot[UMMCR0 + i] = idx.slot[MMCR0 + i];
+            return idx;
+        }
+
+        inline constexpr Index INDEX = make_index();
+        constexpr uint32_t COUNT = INDEX.count;
+    }
+
+    /**
+     * @brief The SPRs the Gekko implements, packed, indexed by SPR number
+     *
+     * Numbers map to slots through a constexpr table, so constant lookups like
+     * spr[spr::SRR0] cost nothing. Unimplemented numbers share a scratch slot that
+     * mfspr never reads back.
+     */
+    class SprFile {
+    public:
+        uint32_t &operator[](uint32_t n) { return m_regs[slot(n)]; }
+        uint32_t operator[](uint32_t n) const { return m_regs[slot(n)]; }
+
+        static constexpr bool implemented(uint32_t n) { return spr::INDEX.slot[n & 1023] != spr::UNIMPLEMENTED; }
+
+        void fill(uint32_t v) { m_regs.fill(v); }
+
+    private:
+        std::array<uint32_t, spr::COUNT + 1> m_regs;
+
+        static constexpr uint32_t slot(uint32_t n) {
+            const uint8_t s = spr::INDEX.slot[n & 1023];
+            return s == spr::UNIMPLEMENTED ? spr::COUNT : s;
+        }
+    };
+
     /**
      * @brief PowerPC 750CL CPU state
-     * 
+     *
      * Represents the complete architectural state (approx) of the GameCube's CPU.
-     * 
+     *
+     * The first cache line holds everything a typical block touches besides the GPRs
+     * (which fill the next two), the FPRs and rarely used registers come after.
+     *
+     * CR0 and XER[SO,OV,CA] are kept in pieces: record-form instructions only store
+     * their result, and CR0 is worked out from it when something reads the CR. Go
+     * through read_cr()/write_cr() and read_xer()/write_xer() for the full registers.
+     *
      * @note Inaccuracies should be repored ASAP to prevent poor performance of content!
      */
-    struct CPUState {
-        std::array<uint32_t, 32> gpr;   //< General purpose registers (32x32-bit)
-
+    struct alignas(64) CPUState {
         uint32_t pc;                    //< Program Counter
+        uint32_t npc;                   //< Where execution continues after the current instruction (host-side)
         uint32_t lr;                    //< Link Register
         uint32_t ctr;                   //< Count Register
-        uint32_t xer;                   //< Fixed-Point Exception Register
-        uint32_t cr;                    //< Condition Register (8x4-bit fields)
+        uint32_t cr;                    //< Condition Register (8x4-bit fields), CR0 stale while cr0_lazy is set
 
-        std::array<double, 32> fpr;     //< General FloatingPoint Registers (32x64-bit)
-        uint32_t fpscr;                 //< FloatingPoint Status and Control Register
+        uint32_t cr0_result;            //< Last record-form result
+        uint8_t cr0_lazy;               //< Nonzero: CR0 is pending from cr0_result; bit 1 holds SO as of then
+        uint8_t xer_ca;                 //< XER[CA]
+        uint8_t xer_so_ov;              //< XER[SO] << 1 | XER[OV]
+        bool slow_access;               //< Route loads/stores through the checked path (fastmem fault retry, host-side)
+        uint32_t xer;                   //< XER without SO/OV/CA
 
         uint32_t msr;                   //< Machine State Register
+        uint32_t fpscr;                 //< FloatingPoint Status and Control Register
+
+        // lwarx/stwcx. reservation
+        bool reserve;
+        uint32_t reserve_address;
 
+        memory::Memory *mem = nullptr;  //< Guest memory loads and stores go to (host-side)
+
+        alignas(64) std::array<uint32_t, 32> gpr;   //< General purpose registers (32x32-bit)
+
+        std::array<FPR, 32> fpr;        //< FloatingPoint Registers (32x 2x64-bit)
         std::array<uint32_t, 16> sr;    //< Segment Registers (16x32-bit)
+        SprFile spr;                    //< Everything else mfspr/mtspr can reach
+        bool dec_pending;               //< DEC went negative, the exception waits for MSR[EE]
+
+        std::function<void(uint32_t)> on_icbi;  //< Instruction cache block invalidate hook (host-side)
+
+        uint32_t read_cr() const {
+            if (!cr0_lazy)
+                return cr;
+            const int32_t r = static_cast<int32_t>(cr0_result);
+            const uint32_t f = (r < 0 ? 0x8u : r > 0 ? 0x4u : 0x2u) | (cr0_lazy >> 1);
+            return (cr & 0x0FFFFFFF) | (f << 28);
+        }
 
-        uint32_t spr[1024];             //< Sparse array for various other SPRs we may need
+        void write_cr(uint32_t v) {
+            cr = v;
+            cr0_lazy = 0;
+        }
+
+        /**
+         * @brief CR0 from a record-form result, worked out when the CR is next read
+         */
+        void record_cr0(uint32_t result) {
+            cr0_result = result;
+            cr0_lazy = static_cast<uint8_t>(1 | (xer_so_ov & 2));
+        }
+
+        uint32_t read_xer() const {
+            return xer | (static_cast<uint32_t>(xer_so_ov) << 30) | (static_cast<uint32_t>(xer_ca) << 29);
+        }
+
+        void write_xer(uint32_t v) {
+            xer = v & 0x1FFFFFFF;
+            xer_so_ov = static_cast<uint8_t>(v >> 30);
+            xer_ca = (v >> 29) & 1;
+        }
 
         /**
          * @brief Init CPU to power-on state
+         *
+         * Leaves the host-side hooks (mem, on_icbi) alone.
          */
         void reset() {
-            gpr.fill(0);
-            fpr.fill(0.0);
-            sr.fill(0);
-            
             pc = 0;
+            npc = 0;
             lr = 0;
             ctr = 0;
-            xer = 0;
             cr = 0;
-            fpscr = 0;
+            cr0_result = 0;
+            cr0_lazy = 0;
+            xer_ca = 0;
+            xer_so_ov = 0;
+            slow_access = false;
+            xer = 0;
             msr = 0;
-            
-            for (auto& s : spr) s = 0;
+            fpscr = 0;
+
+            reserve = false;
+            reserve_address = 0;
+
+            gpr.fill(0);
+            fpr.fill(FPR{ 0.0, 0.0 });
+            sr.fill(0);
+            spr.fill(0);
+            dec_pending = false;
         }
     };
 
+    struct Instruction;
+
+    /**
+     * @brief Interpreter routine for one instruction form
+     *
+     * Handlers read cpu.pc as their own address and redirect control flow by writing
+     * cpu.npc. Loads and stores must happen before any register is written, so an
+     * access that faults can re-run the whole instruction.
+     */
+    using Handler = void (*)(CPUState &cpu, const Instruction &inst);
+
     /**
      * @brief Decoded PowerPC instruction
      */
@@ -62,7 +264,10 @@ namespace freecube::cpu {
         uint8_t rB;             //< Source reg B
         int16_t simm;           //< Signed immediate val
         uint16_t uimm;          //< Unsigned immediate val
-        uint16_t extended;      //< Extended opcode (varies on instr)
+        isa::Op op;             //< Which instruction (indexes isa::OPCODES)
+        uint8_t flags;          //< InstFlags
+
+        Handler handler;        //< Pre-resolved interpreter routine
 
         /**
          * @todo Expand on this as we need!
@@ -71,7 +276,7 @@ namespace freecube::cpu {
 
     /**
      * @brief Decode a raw 32-bit instruction word
-     * 
+     *
      * @param raw The raw instruction bytes (big-endian)
      * @return Decoded instruction
      */
@@ -79,9 +284,9 @@ namespace freecube::cpu {
 
     /**
      * @brief Execute a single instruction
-     * 
+     *
      * @param cpu CPU state to modify
      * @param inst Decoded instruction to execute
      */
     void execute(CPUState& cpu, const Instruction& inst);
-}
\ No newline at end of file
+}
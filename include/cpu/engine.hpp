@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include "cpu/core.hpp"
+
+namespace freecube::memory {
+    class Memory;
+}
+
+namespace freecube::timing {
+    class Scheduler;
+}
+
+namespace freecube::cpu {
+
+    /**
+     * @brief Something that runs guest code: the cached interpreter or the JIT
+     *
+     * An engine owns the translated code for one guest memory and takes over its code
+     * write hook, so only one engine may be attached to a Memory at a time.
+     */
+    class ExecutionEngine {
+    public:
+        virtual ~ExecutionEngine() = default;
+
+        /**
+         * @brief Point a CPU at the engine's memory and route its icbi to the engine
+         */
+        virtual void attach(CPUState &cpu) = 0;
+
+        /**
+         * @brief Run from cpu.pc until at least `budget` instructions have executed
+         *
+         * Engines work in whole blocks, so the count returned can overshoot `budget`.
+         * Returns early if execution leaves RAM. A loop that can only spin until something
+         * outside the CPU happens is skipped to the end of the budget, and the skipped
+         * iterations count as executed.
+         */
+        virtual uint64_t run(CPUState &cpu, uint64_t budget) = 0;
+
+        /**
+         * @brief Drop translations overlapping [address, address + size)
+         */
+        virtual void invalidate(uint32_t address, uint32_t size) = 0;
+
+        /**
+         * @brief Drop every translation (not from inside run())
+         */
+        virtual void clear() = 0;
+    };
+
+    enum class EngineKind {
+        INTERPRETER,
+        JIT,
+    };
+
+    /**
+     * @brief Create an engine, falling back to the interpreter where there's no JIT for the host
+     */
+    std::unique_ptr<ExecutionEngine> make_engine(EngineKind kind, memory::Memory &mem);
+
+    /**
+     * @brief Run the CPU against the scheduler for about `budget` cycles
+     *
+     * The engine runs uninterrupted up to the next scheduled event (or the decrementer
+     * underflowing, if it can interrupt), then guest time advances by what ran and due
+     * events fire. The time base and decrementer follow guest time at their 1/12 rate,
+     * and a decrementer exception is taken between slices once MSR[EE] allows it. Idle
+     * loops fast-forward straight to whichever comes next.
+     *
+     * One instruction counts as one cycle for now.
+     *
+     * @return Instructions executed
+     */
+    uint64_t run_scheduled(ExecutionEngine &engine, CPUState &cpu, timing::Scheduler &scheduler, uint64_t budget);
+}
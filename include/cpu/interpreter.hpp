@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+
+#include "cpu/core.hpp"
+
+namespace freecube::cpu {
+
+    constexpr uint32_t XER_SO = 0x80000000;
+    constexpr uint32_t XER_OV = 0x40000000;
+    constexpr uint32_t XER_CA = 0x20000000;
+
+    constexpr uint32_t MSR_EE = 0x00008000;     //< External and decrementer interrupts enabled
+    constexpr uint32_t MSR_IP = 0x00000040;     //< Exception vectors at 0xFFF00000
+
+    /**
+     * @brief Exception vector offsets
+     */
+    enum class Exception : uint32_t {
+        SYSTEM_RESET   = 0x100,
+        MACHINE_CHECK  = 0x200,
+        DSI            = 0x300,
+        ISI            = 0x400,
+        EXTERNAL       = 0x500,
+        ALIGNMENT      = 0x600,
+        PROGRAM        = 0x700,
+        FP_UNAVAILABLE = 0x800,
+        DECREMENTER    = 0x900,
+        SYSCALL        = 0xC00,
+    };
+
+    /**
+     * @brief Take an exception
+     *
+     * Saves `return_pc` and the MSR to SRR0/SRR1 (ORing in `srr1_cause`), drops into
+     * supervisor mode with translation off and continues at the vector via cpu.npc.
+     */
+    void raise_exception(CPUState &cpu, Exception ex, uint32_t return_pc, uint32_t srr1_cause = 0);
+
+    /**
+     * @brief Execute one instruction with every memory access on the checked path
+     *
+     * Used to retry an instruction whose fastmem access faulted; safe to call without a
+     * FaultGuard. Advances cpu.pc like execute().
+     */
+    void execute_slow(CPUState &cpu, const Instruction &inst);
+}
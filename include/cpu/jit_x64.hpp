@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "cpu/core.hpp"
+#include "cpu/engine.hpp"
+#include "memory/memory.hpp"
+
+#if (defined(__x86_64__) || defined(_M_X64)) && !defined(_WIN32) && !defined(_WIN64)
+    #define FREECUBE_JIT 1
+#else
+    #define FREECUBE_JIT 0
+#endif
+
+namespace freecube::cpu {
+
+    struct JitStats {
+        uint64_t compiled = 0;          //< Blocks translated
+        uint64_t invalidated = 0;       //< Blocks dropped by code writes/icbi
+        uint64_t native = 0;            //< Instructions translated to host code
+        uint64_t fallbacks = 0;         //< Instructions translated as interpreter calls
+        uint64_t links = 0;             //< Block exits patched to jump straight to their target
+        uint64_t idle_loops = 0;        //< Blocks recognised as idle loops (see is_idle_loop())
+        uint64_t flushes = 0;           //< Times the code buffer filled up and was reset
+        std::size_t code_bytes = 0;     //< Code buffer in use
+    };
+
+#if FREECUBE_JIT
+    /**
+     * @brief x86-64 recompiler for Gekko integer, load/store and branch code (SysV hosts)
+     *
+     * Blocks are cut at the same points as the BlockCache and translated to host code.
+     * Guest GPRs are cached in host registers for the length of a block and written
+     * back at exits and before interpreter calls. Anything without a native translation
+     * is emitted as a call to its interpreter handler, so every instruction runs.
+     *
+     * Exits to a known PC are linked: once the target is translated the exit becomes a
+     * direct jump, and it's unlinked again if the target is invalidated. Indirect
+     * branches (blr, bctr, rfi) return to run(), which looks the target up. An idle
+     * loop (see is_idle_loop()) branching back to itself uses up the rest of the budget.
+     *
+     * Guest memory accesses check the address inline and take MEM1 directly, anything
+     * else (MMIO, stores to code pages) calls out to Memory's checked path. Generated
+     * code never faults.
+     */
+    class Jit : public ExecutionEngine {
+    public:
+        static constexpr std::size_t DEFAULT_CODE_SIZE = 32 * 1024 * 1024;
+
+        /**
+         * @throws std::runtime_error if executable memory can't be allocated
+         */
+        explicit Jit(memory::Memory &mem, std::size_t code_size = DEFAULT_CODE_SIZE);
+        ~Jit() override;
+
+        Jit(const Jit &) = delete;
+        Jit &operator=(const Jit &) = delete;
+
+        void attach(CPUState &cpu) override;
+        uint64_t run(CPUState &cpu, uint64_t budget) override;
+        void invalidate(uint32_t address, uint32_t size) override;
+        void clear() override;
+
+        const JitStats &stats() const { return m_stats; }
+
+    private:
+        struct Block {
+            uint32_t address;
+            uint32_t ram_offset;
+            uint32_t length;
+            uint8_t *entry;
+            std::unique_ptr<Instruction[]> insts;   // Interpreter calls point in here
+            std::vector<uint32_t> targets;          // PCs this block has link sites for
+
+            uint32_t byte_size() const { return length * 4; }
+        };
+
+        struct Link {
+            uint8_t *site;      // The jmp rel32
+            uint32_t source;    // PC of the block it's in
+        };
+
+        using EnterFn = int64_t (*)(CPUState *cpu, const uint8_t *entry, int64_t budget);
+
+        static constexpr uint32_t FAST_ENTRIES = 0x4000;
+
+        memory::Memory &m_mem;
+
+        uint8_t *m_code = nullptr;
+        std::size_t m_code_size = 0;
+        std::size_t m_code_used = 0;    // Stubs live in front, blocks after m_stubs_end
+        std::size_t m_stubs_end = 0;
+
+        EnterFn m_enter = nullptr;
+        uint8_t *m_exit = nullptr;
+
+        std::unordered_map<uint32_t, std::unique_ptr<Block>> m_blocks;
+        std::unordered_map<uint32_t, std::vector<uint32_t>> m_page_blocks;
+        std::unordered_map<uint32_t, std::vector<Link>> m_links;        // Target PC -> exits to it
+        std::vector<Block *> m_fast;
+        std::vector<std::unique_ptr<Block>> m_retired;
+
+        JitStats m_stats;
+
+        void emit_stubs();
+        Block *fetch(uint32_t pc);
+        Block *compile(uint32_t pc);
+        void invalidate_ram(uint32_t offset, uint32_t size);
+        void retire(uint32_t pc);
+        void link(uint32_t target, uint8_t *site, uint32_t source);
+
+        friend class JitCompiler;
+    };
+
+    struct LockstepReport {
+        uint64_t blocks = 0;
+        uint64_t instructions = 0;
+        bool diverged = false;
+        uint32_t pc = 0;            //< Start of the first block that disagreed
+        std::string detail;         //< What disagreed
+    };
+
+    /**
+     * @brief Run the JIT and the plain interpreter side by side and diff them
+     *
+     * The JIT runs on `mem`, the interpreter on a private copy of it, one block at a
+     * time from `cpu`. Registers are compared after every block and RAM at the end.
+     * `cpu` is left in the JIT's final state.
+     */
+    LockstepReport run_lockstep(CPUState &cpu, memory::Memory &mem, uint64_t budget);
+#endif
+}
@@ -0,0 +1,492 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <iterator>
+#include <string>
+
+namespace freecube::cpu {
+
+    /**
+     * @brief Properties of a decoded instruction the dispatchers care about
+     */
+    enum InstFlags : uint8_t {
+        INST_ENDS_BLOCK = 1 << 0,   //< Control flow, or changes state later instructions were decoded under
+        INST_INVALID    = 1 << 1,   //< Not an instruction we know
+        INST_MEMORY     = 1 << 2,   //< Loads or stores guest memory
+        INST_SLOW_ACCESS = 1 << 3,  //< Faulted on fastmem before (MMIO), always use the checked path
+    };
+
+    /**
+     * @brief The Gekko instruction set, described once
+     *
+     * FREECUBE_GEKKO_OPCODES is the only list of instructions in the tree. The Op enum,
+     * the OPCODES spec table, the decode tables and the interpreter's handler table are
+     * all expanded from it, so nothing can drift out of sync. Each entry is
+     *
+     *     OP(ID, mnemonic, form, primary, extended, (operands...), flags, handler)
+     *
+     * `extended` is matched against as many bits as the form has (see xo_bits()).
+     * `handler` is only expanded by the interpreter, where the op_* routines live;
+     * instructions we know but don't implement use op_invalid.
+     */
+#define FREECUBE_GEKKO_OPCODES(OP) \
+    OP(TWI,       "twi",        D_FORM,   3,  0,    (TO, RA, SIMM),             BRANCH, op_twi) \
+    OP(MULLI,     "mulli",      D_FORM,   7,  0,    (RD, RA, SIMM),             0,      op_mulli) \
+    OP(SUBFIC,    "subfic",     D_FORM,   8,  0,    (RD, RA, SIMM),             0,      op_subfic) \
+    OP(CMPLI,     "cmpli",      D_FORM,   10, 0,    (CRFD, RA, UIMM),           0,      op_cmpli) \
+    OP(CMPI,      "cmpi",       D_FORM,   11, 0,    (CRFD, RA, SIMM),           0,      op_cmpi) \
+    OP(ADDIC,     "addic",      D_FORM,   12, 0,    (RD, RA, SIMM),             0,      op_addic) \
+    OP(ADDIC_RC,  "addic.",     D_FORM,   13, 0,    (RD, RA, SIMM),             0,      op_addic) \
+    OP(ADDI,      "addi",       D_FORM,   14, 0,    (RD, RA, SIMM),             0,      op_addi) \
+    OP(ADDIS,     "addis",      D_FORM,   15, 0,    (RD, RA, SIMM),             0,      op_addis) \
+    OP(BC,        "bc",         B_FORM,   16, 0,    (BO, BI, BD),               BRANCH, op_bc) \
+    OP(SC,        "sc",         SC_FORM,  17, 0,    (),                         BRANCH, op_sc) \
+    OP(B,         "b",          I_FORM,   18, 0,    (LI),                       BRANCH, op_b) \
+    OP(RLWIMI,    "rlwimi",     M_FORM,   20, 0,    (RA, RS, SH, MB, ME),       0,      op_rlwimi) \
+    OP(RLWINM,    "rlwinm",     M_FORM,   21, 0,    (RA, RS, SH, MB, ME),       0,      op_rlwinm) \
+    OP(RLWNM,     "rlwnm",      M_FORM,   23, 0,    (RA, RS, RB, MB, ME),       0,      op_rlwnm) \
+    OP(ORI,       "ori",        D_FORM,   24, 0,    (RA, RS, UIMM),             0,      op_ori) \
+    OP(ORIS,      "oris",       D_FORM,   25, 0,    (RA, RS, UIMM),             0,      op_oris) \
+    OP(XORI,      "xori",       D_FORM,   26, 0,    (RA, RS, UIMM),             0,      op_xori) \
+    OP(XORIS,     "xoris",      D_FORM,   27, 0,    (RA, RS, UIMM),             0,      op_xoris) \
+    OP(ANDI_RC,   "andi.",      D_FORM,   28, 0,    (RA, RS, UIMM),             0,      op_andi_rc) \
+    OP(ANDIS_RC,  "andis.",     D_FORM,   29, 0,    (RA, RS, UIMM),             0,      op_andis_rc) \
+    OP(LWZ,       "lwz",        D_FORM,   32, 0,    (RD, DISP),                 MEM,    (op_load<uint32_t, false, false>)) \
+    OP(LWZU,      "lwzu",       D_FORM,   33, 0,    (RD, DISP),                 MEM,    (op_load<uint32_t, false, true>)) \
+    OP(LBZ,       "lbz",        D_FORM,   34, 0,    (RD, DISP),                 MEM,    (op_load<uint8_t, false, false>)) \
+    OP(LBZU,      "lbzu",       D_FORM,   35, 0,    (RD, DISP),                 MEM,    (op_load<uint8_t, false, true>)) \
+    OP(STW,       "stw",        D_FORM,   36, 0,    (RS, DISP),                 MEM,    (op_store<uint32_t, false, false>)) \
+    OP(STWU,      "stwu",       D_FORM,   37, 0,    (RS, DISP),                 MEM,    (op_store<uint32_t, false, true>)) \
+    OP(STB,       "stb",        D_FORM,   38, 0,    (RS, DISP),                 MEM,    (op_store<uint8_t, false, false>)) \
+    OP(STBU,      "stbu",       D_FORM,   39, 0,    (RS, DISP),                 MEM,    (op_store<uint8_t, false, true>)) \
+    OP(LHZ,       "lhz",        D_FORM,   40, 0,    (RD, DISP),                 MEM,    (op_load<uint16_t, false, false>)) \
+    OP(LHZU,      "lhzu",       D_FORM,   41, 0,    (RD, DISP),                 MEM,    (op_load<uint16_t, false, true>)) \
+    OP(LHA,       "lha",        D_FORM,   42, 0,    (RD, DISP),                 MEM,    (op_load<uint16_t, false, false, true>)) \
+    OP(LHAU,      "lhau",       D_FORM,   43, 0,    (RD, DISP),                 MEM,    (op_load<uint16_t, false, true, true>)) \
+    OP(STH,       "sth",        D_FORM,   44, 0,    (RS, DISP),                 MEM,    (op_store<uint16_t, false, false>)) \
+    OP(STHU,      "sthu",       D_FORM,   45, 0,    (RS, DISP),                 MEM,    (op_store<uint16_t, false, true>)) \
+    OP(LMW,       "lmw",        D_FORM,   46, 0,    (RD, DISP),                 MEM,    op_lmw) \
+    OP(STMW,      "stmw",       D_FORM,   47, 0,    (RS, DISP),                 MEM,    op_stmw) \
+    OP(LFS,       "lfs",        D_FORM,   48, 0,    (FD, DISP),                 MEM,    (op_lfs<false, false>)) \
+    OP(LFSU,      "lfsu",       D_FORM,   49, 0,    (FD, DISP),                 MEM,    (op_lfs<false, true>)) \
+    OP(LFD,       "lfd",        D_FORM,   50, 0,    (FD, DISP),                 MEM,    (op_lfd<false, false>)) \
+    OP(LFDU,      "lfdu",       D_FORM,   51, 0,    (FD, DISP),                 MEM,    (op_lfd<false, true>)) \
+    OP(STFS,      "stfs",       D_FORM,   52, 0,    (FS, DISP),                 MEM,    (op_stfs<false, false>)) \
+    OP(STFSU,     "stfsu",      D_FORM,   53, 0,    (FS, DISP),                 MEM,    (op_stfs<false, true>)) \
+    OP(STFD,      "stfd",       D_FORM,   54, 0,    (FS, DISP),                 MEM,    (op_stfd<false, false>)) \
+    OP(STFDU,     "stfdu",      D_FORM,   55, 0,    (FS, DISP),                 MEM,    (op_stfd<false, true>)) \
+    OP(PSQ_L,     "psq_l",      PSQ_FORM, 56, 0,    (FD, PS_DISP, PS_W, PS_I),  MEM,    (op_psq_l<false, false>)) \
+    OP(PSQ_LU,    "psq_lu",     PSQ_FORM, 57, 0,    (FD, PS_DISP, PS_W, PS_I),  MEM,    (op_psq_l<false, true>)) \
+    OP(PSQ_ST,    "psq_st",     PSQ_FORM, 60, 0,    (FS, PS_DISP, PS_W, PS_I),  MEM,    (op_psq_st<false, false>)) \
+    OP(PSQ_STU,   "psq_stu",    PSQ_FORM, 61, 0,    (FS, PS_DISP, PS_W, PS_I),  MEM,    (op_psq_st<false, true>)) \
+    \
+    OP(PS_SUM0,   "ps_sum0",    A_FORM,   4,  10,   (FD, FA, FC, FB),           0,      op_ps_sum<0>) \
+    OP(PS_SUM1,   "ps_sum1",    A_FORM,   4,  11,   (FD, FA, FC, FB),           0,      op_ps_sum<1>) \
+    OP(PS_MULS0,  "ps_muls0",   A_FORM,   4,  12,   (FD, FA, FC),               0,      op_ps_muls<0>) \
+    OP(PS_MULS1,  "ps_muls1",   A_FORM,   4,  13,   (FD, FA, FC),               0,      op_ps_muls<1>) \
+    OP(PS_MADDS0, "ps_madds0",  A_FORM,   4,  14,   (FD, FA, FC, FB),           0,      op_ps_madds<0>) \
+    OP(PS_MADDS1, "ps_madds1",  A_FORM,   4,  15,   (FD, FA, FC, FB),           0,      op_ps_madds<1>) \
+    OP(PS_DIV,    "ps_div",     A_FORM,   4,  18,   (FD, FA, FB),               0,      op_ps_div) \
+    OP(PS_SUB,    "ps_sub",     A_FORM,   4,  20,   (FD, FA, FB),               0,      op_ps_sub) \
+    OP(PS_ADD,    "ps_add",     A_FORM,   4,  21,   (FD, FA, FB),               0,      op_ps_add) \
+    OP(PS_SEL,    "ps_sel",     A_FORM,   4,  23,   (FD, FA, FC, FB),           0,      op_ps_sel) \
+    OP(PS_RES,    "ps_res",     A_FORM,   4,  24,   (FD, FB),                   0,      op_ps_res) \
+    OP(PS_MUL,    "ps_mul",     A_FORM,   4,  25,   (FD, FA, FC),               0,      op_ps_mul) \
+    OP(PS_RSQRTE, "ps_rsqrte",  A_FORM,   4,  26,   (FD, FB),                   0,      op_ps_rsqrte) \
+    OP(PS_MSUB,   "ps_msub",    A_FORM,   4,  28,   (FD, FA, FC, FB),           0,      op_ps_msub) \
+    OP(PS_MADD,   "ps_madd",    A_FORM,   4,  29,   (FD, FA, FC, FB),           0,      op_ps_madd) \
+    OP(PS_NMSUB,  "ps_nmsub",   A_FORM,   4,  30,   (FD, FA, FC, FB),           0,      op_ps_nmsub) \
+    OP(PS_NMADD,  "ps_nmadd",   A_FORM,   4,  31,   (FD, FA, FC, FB),           0,      op_ps_nmadd) \
+    OP(PSQ_LX,    "psq_lx",     PSQX_FORM, 4, 6,    (FD, RA, RB, PSX_W, PSX_I), MEM,    (op_psq_l<true, false>)) \
+    OP(PSQ_STX,   "psq_stx",    PSQX_FORM, 4, 7,    (FS, RA, RB, PSX_W, PSX_I), MEM,    (op_psq_st<true, false>)) \
+    OP(PSQ_LUX,   "psq_lux",    PSQX_FORM, 4, 38,   (FD, RA, RB, PSX_W, PSX_I), MEM,    (op_psq_l<true, true>)) \
+    OP(PSQ_STUX,  "psq_stux",   PSQX_FORM, 4, 39,   (FS, RA, RB, PSX_W, PSX_I), MEM,    (op_psq_st<true, true>)) \
+    OP(PS_CMPU0,  "ps_cmpu0",   X_FORM,   4,  0,    (CRFD, FA, FB),             0,      op_ps_cmp<0>) \
+    OP(PS_CMPO0,  "ps_cmpo0",   X_FORM,   4,  32,   (CRFD, FA, FB),             0,      op_ps_cmp<0>) \
+    OP(PS_NEG,    "ps_neg",     X_FORM,   4,  40,   (FD, FB),                   0,      op_ps_neg) \
+    OP(PS_CMPU1,  "ps_cmpu1",   X_FORM,   4,  64,   (CRFD, FA, FB),             0,      op_ps_cmp<1>) \
+    OP(PS_MR,     "ps_mr",      X_FORM,   4,  72,   (FD, FB),                   0,      op_ps_mr) \
+    OP(PS_CMPO1,  "ps_cmpo1",   X_FORM,   4,  96,   (CRFD, FA, FB),             0,      op_ps_cmp<1>) \
+    OP(PS_NABS,   "ps_nabs",    X_FORM,   4,  136,  (FD, FB),                   0,      op_ps_nabs) \
+    OP(PS_ABS,    "ps_abs",     X_FORM,   4,  264,  (FD, FB),                   0,      op_ps_abs) \
+    OP(PS_MERGE00, "ps_merge00", X_FORM,  4,  528,  (FD, FA, FB),               0,      op_ps_merge00) \
+    OP(PS_MERGE01, "ps_merge01", X_FORM,  4,  560,  (FD, FA, FB),               0,      op_ps_merge01) \
+    OP(PS_MERGE10, "ps_merge10", X_FORM,  4,  592,  (FD, FA, FB),               0,      op_ps_merge10) \
+    OP(PS_MERGE11, "ps_merge11", X_FORM,  4,  624,  (FD, FA, FB),               0,      op_ps_merge11) \
+    OP(DCBZ_L,    "dcbz_l",     X_FORM,   4,  1014, (RA, RB),                   UNIMPLEMENTED, op_invalid) \
+    \
+    OP(MCRF,      "mcrf",       XL_FORM,  19, 0,    (CRFD, CRFS),               0,      op_mcrf) \
+    OP(BCLR,      "bclr",       XL_FORM,  19, 16,   (BO, BI),                   BRANCH, op_bclr) \
+    OP(CRNOR,     "crnor",      XL_FORM,  19, 33,   (CRBD, CRBA, CRBB),         0,      op_crlogical<c_nor>) \
+    OP(RFI,       "rfi",        XL_FORM,  19, 50,   (),                         BRANCH, op_rfi) \
+    OP(CRANDC,    "crandc",     XL_FORM,  19, 129,  (CRBD, CRBA, CRBB),         0,      op_crlogical<c_andc>) \
+    OP(ISYNC,     "isync",      XL_FORM,  19, 150,  (),                         BRANCH, op_nop) \
+    OP(CRXOR,     "crxor",      XL_FORM,  19, 193,  (CRBD, CRBA, CRBB),         0,      op_crlogical<c_xor>) \
+    OP(CRNAND,    "crnand",     XL_FORM,  19, 225,  (CRBD, CRBA, CRBB),         0,      op_crlogical<c_nand>) \
+    OP(CRAND,     "crand",      XL_FORM,  19, 257,  (CRBD, CRBA, CRBB),         0,      op_crlogical<c_and>) \
+    OP(CREQV,     "creqv",      XL_FORM,  19, 289,  (CRBD, CRBA, CRBB),         0,      op_crlogical<c_eqv>) \
+    OP(CRORC,     "crorc",      XL_FORM,  19, 417,  (CRBD, CRBA, CRBB),         0,      op_crlogical<c_orc>) \
+    OP(CROR,      "cror",       XL_FORM,  19, 449,  (CRBD, CRBA, CRBB),         0,      op_crlogical<c_or>) \
+    OP(BCCTR,     "bcctr",      XL_FORM,  19, 528,  (BO, BI),                   BRANCH, op_bcctr) \
+    \
+    OP(SUBFC,     "subfc",      XO_FORM,  31, 8,    (RD, RA, RB),               0,      op_subfc) \
+    OP(ADDC,      "addc",       XO_FORM,  31, 10,   (RD, RA, RB),               0,      op_addc) \
+    OP(MULHWU,    "mulhwu",     XO_FORM,  31, 11,   (RD, RA, RB),               0,      op_mulhwu) \
+    OP(SUBF,      "subf",       XO_FORM,  31, 40,   (RD, RA, RB),               0,      op_subf) \
+    OP(MULHW,     "mulhw",      XO_FORM,  31, 75,   (RD, RA, RB),               0,      op_mulhw) \
+    OP(NEG,       "neg",        XO_FORM,  31, 104,  (RD, RA),                   0,      op_neg) \
+    OP(SUBFE,     "subfe",      XO_FORM,  31, 136,  (RD, RA, RB),               0,      op_subfe) \
+    OP(ADDE,      "adde",       XO_FORM,  31, 138,  (RD, RA, RB),               0,      op_adde) \
+    OP(SUBFZE,    "subfze",     XO_FORM,  31, 200,  (RD, RA),                   0,      op_subfze) \
+    OP(ADDZE,     "addze",      XO_FORM,  31, 202,  (RD, RA),                   0,      op_addze) \
+    OP(SUBFME,    "subfme",     XO_FORM,  31, 232,  (RD, RA),                   0,      op_subfme) \
+    OP(ADDME,     "addme",      XO_FORM,  31, 234,  (RD, RA),                   0,      op_addme) \
+    OP(MULLW,     "mullw",      XO_FORM,  31, 235,  (RD, RA, RB),               0,      op_mullw) \
+    OP(ADD,       "add",        XO_FORM,  31, 266,  (RD, RA, RB),               0,      op_add) \
+    OP(DIVWU,     "divwu",      XO_FORM,  31, 459,  (RD, RA, RB),               0,      op_divwu) \
+    OP(DIVW,      "divw",       XO_FORM,  31, 491,  (RD, RA, RB),               0,      op_divw) \
+    OP(CMP,       "cmp",        X_FORM,   31, 0,    (CRFD, RA, RB),             0,      op_cmp) \
+    OP(TW,        "tw",         X_FORM,   31, 4,    (TO, RA, RB),               BRANCH, op_tw) \
+    OP(MFCR,      "mfcr",       X_FORM,   31, 19,   (RD),                       0,      op_mfcr) \
+    OP(LWARX,     "lwarx",      X_FORM,   31, 20,   (RD, RA, RB),               MEM,    op_lwarx) \
+    OP(LWZX,      "lwzx",       X_FORM,   31, 23,   (RD, RA, RB),               MEM,    (op_load<uint32_t, true, false>)) \
+    OP(SLW,       "slw",        X_FORM,   31, 24,   (RA, RS, RB),               0,      op_logical<l_slw>) \
+    OP(CNTLZW,    "cntlzw",     X_FORM,   31, 26,   (RA, RS),                   0,      op_cntlzw) \
+    OP(AND,       "and",        X_FORM,   31, 28,   (RA, RS, RB),               0,      op_logical<l_and>) \
+    OP(CMPL,      "cmpl",       X_FORM,   31, 32,   (CRFD, RA, RB),             0,      op_cmpl) \
+    OP(DCBST,     "dcbst",      X_FORM,   31, 54,   (RA, RB),                   0,      op_nop) \
+    OP(LWZUX,     "lwzux",      X_FORM,   31, 55,   (RD, RA, RB),               MEM,    (op_load<uint32_t, true, true>)) \
+    OP(ANDC,      "andc",       X_FORM,   31, 60,   (RA, RS, RB),               0,      op_logical<l_andc>) \
+    OP(MFMSR,     "mfmsr",      X_FORM,   31, 83,   (RD),                       0,      op_mfmsr) \
+    OP(DCBF,      "dcbf",       X_FORM,   31, 86,   (RA, RB),                   0,      op_nop) \
+    OP(LBZX,      "lbzx",       X_FORM,   31, 87,   (RD, RA, RB),               MEM,    (op_load<uint8_t, true, false>)) \
+    OP(LBZUX,     "lbzux",      X_FORM,   31, 119,  (RD, RA, RB),               MEM,    (op_load<uint8_t, true, true>)) \
+    OP(NOR,       "nor",        X_FORM,   31, 124,  (RA, RS, RB),               0,      op_logical<l_nor>) \
+    OP(MTCRF,     "mtcrf",      XFX_FORM, 31, 144,  (CRM, RS),                  0,      op_mtcrf) \
+    OP(MTMSR,     "mtmsr",      X_FORM,   31, 146,  (RS),                       BRANCH, op_mtmsr) \
+    OP(STWCX_RC,  "stwcx.",     X_FORM,   31, 150,  (RS, RA, RB),               MEM,    op_stwcx) \
+    OP(STWX,      "stwx",       X_FORM,   31, 151,  (RS, RA, RB),               MEM,    (op_store<uint32_t, true, false>)) \
+    OP(STWUX,     "stwux",      X_FORM,   31, 183,  (RS, RA, RB),               MEM,    (op_store<uint32_t, true, true>)) \
+    OP(MTSR,      "mtsr",       X_FORM,   31, 210,  (SR, RS),                   0,      op_mtsr) \
+    OP(STBX,      "stbx",       X_FORM,   31, 215,  (RS, RA, RB),               MEM,    (op_store<uint8_t, true, false>)) \
+    OP(MTSRIN,    "mtsrin",     X_FORM,   31, 242,  (RS, RB),                   0,      op_mtsrin) \
+    OP(DCBTST,    "dcbtst",     X_FORM,   31, 246,  (RA, RB),                   0,      op_nop) \
+    OP(STBUX,     "stbux",      X_FORM,   31, 247,  (RS, RA, RB),               MEM,    (op_store<uint8_t, true, true>)) \
+    OP(DCBT,      "dcbt",       X_FORM,   31, 278,  (RA, RB),                   0,      op_nop) \
+    OP(LHZX,      "lhzx",       X_FORM,   31, 279,  (RD, RA, RB),               MEM,    (op_load<uint16_t, true, false>)) \
+    OP(EQV,       "eqv",        X_FORM,   31, 284,  (RA, RS, RB),               0,      op_logical<l_eqv>) \
+    OP(TLBIE,     "tlbie",      X_FORM,   31, 306,  (RB),                       UNIMPLEMENTED, op_invalid) \
+    OP(ECIWX,     "eciwx",      X_FORM,   31, 310,  (RD, RA, RB),               UNIMPLEMENTED, op_invalid) \
+    OP(LHZUX,     "lhzux",      X_FORM,   31, 311,  (RD, RA, RB),               MEM,    (op_load<uint16_t, true, true>)) \
+    OP(XOR,       "xor",        X_FORM,   31, 316,  (RA, RS, RB),               0,      op_logical<l_xor>) \
+    OP(MFSPR,     "mfspr",      XFX_FORM, 31, 339,  (RD, SPR),                  0,      op_mfspr) \
+    OP(LHAX,      "lhax",       X_FORM,   31, 343,  (RD, RA, RB),               MEM,    (op_load<uint16_t, true, false, true>)) \
+    OP(MFTB,      "mftb",       XFX_FORM, 31, 371,  (RD, TBR),                  0,      op_mftb) \
+    OP(LHAUX,     "lhaux",      X_FORM,   31, 375,  (RD, RA, RB),               MEM,    (op_load<uint16_t, true, true, true>)) \
+    OP(STHX,      "sthx",       X_FORM,   31, 407,  (RS, RA, RB),               MEM,    (op_store<uint16_t, true, false>)) \
+    OP(ORC,       "orc",        X_FORM,   31, 412,  (RA, RS, RB),               0,      op_logical<l_orc>) \
+    OP(ECOWX,     "ecowx",      X_FORM,   31, 438,  (RS, RA, RB),               UNIMPLEMENTED, op_invalid) \
+    OP(STHUX,     "sthux",      X_FORM,   31, 439,  (RS, RA, RB),               MEM,    (op_store<uint16_t, true, true>)) \
+    OP(OR,        "or",         X_FORM,   31, 444,  (RA, RS, RB),               0,      op_logical<l_or>) \
+    OP(MTSPR,     "mtspr",      XFX_FORM, 31, 467,  (SPR, RS),                  0,      op_mtspr) \
+    OP(DCBI,      "dcbi",       X_FORM,   31, 470,  (RA, RB),                   0,      op_nop) \
+    OP(NAND,      "nand",       X_FORM,   31, 476,  (RA, RS, RB),               0,      op_logical<l_nand>) \
+    OP(MCRXR,     "mcrxr",      X_FORM,   31, 512,  (CRFD),                     0,      op_mcrxr) \
+    OP(LSWX,      "lswx",       X_FORM,   31, 533,  (RD, RA, RB),               UNIMPLEMENTED, op_invalid) \
+    OP(LWBRX,     "lwbrx",      X_FORM,   31, 534,  (RD, RA, RB),               MEM,    op_lwbrx) \
+    OP(LFSX,      "lfsx",       X_FORM,   31, 535,  (FD, RA, RB),               MEM,    (op_lfs<true, false>)) \
+    OP(SRW,       "srw",        X_FORM,   31, 536,  (RA, RS, RB),               0,      op_logical<l_srw>) \
+    OP(TLBSYNC,   "tlbsync",    X_FORM,   31, 566,  (),                         UNIMPLEMENTED, op_invalid) \
+    OP(LFSUX,     "lfsux",      X_FORM,   31, 567,  (FD, RA, RB),               MEM,    (op_lfs<true, true>)) \
+    OP(MFSR,      "mfsr",       X_FORM,   31, 595,  (RD, SR),                   0,      op_mfsr) \
+    OP(LSWI,      "lswi",       X_FORM,   31, 597,  (RD, RA, NB),               UNIMPLEMENTED, op_invalid) \
+    OP(SYNC,      "sync",       X_FORM,   31, 598,  (),                         0,      op_nop) \
+    OP(LFDX,      "lfdx",       X_FORM,   31, 599,  (FD, RA, RB),               MEM,    (op_lfd<true, false>)) \
+    OP(LFDUX,     "lfdux",      X_FORM,   31, 631,  (FD, RA, RB),               MEM,    (op_lfd<true, true>)) \
+    OP(MFSRIN,    "mfsrin",     X_FORM,   31, 659,  (RD, RB),                   0,      op_mfsrin) \
+    OP(STSWX,     "stswx",      X_FORM,   31, 661,  (RS, RA, RB),               UNIMPLEMENTED, op_invalid) \
+    OP(STWBRX,    "stwbrx",     X_FORM,   31, 662,  (RS, RA, RB),               MEM,    op_stwbrx) \
+    OP(STFSX,     "stfsx",      X_FORM,   31, 663,  (FS, RA, RB),               MEM,    (op_stfs<true, false>)) \
+    OP(STFSUX,    "stfsux",     X_FORM,   31, 695,  (FS, RA, RB),               MEM,    (op_stfs<true, true>)) \
+    OP(STSWI,     "stswi",      X_FORM,   31, 725,  (RS, RA, NB),               UNIMPLEMENTED, op_invalid) \
+    OP(STFDX,     "stfdx",      X_FORM,   31, 727,  (FS, RA, RB),               MEM,    (op_stfd<true, false>)) \
+    OP(STFDUX,    "stfdux",     X_FORM,   31, 759,  (FS, RA, RB),               MEM,    (op_stfd<true, true>)) \
+    OP(LHBRX,     "lhbrx",      X_FORM,   31, 790,  (RD, RA, RB),               MEM,    op_lhbrx) \
+    OP(SRAW,      "sraw",       X_FORM,   31, 792,  (RA, RS, RB),               0,      op_sraw) \
+    OP(SRAWI,     "srawi",      X_FORM,   31, 824,  (RA, RS, SH),               0,      op_srawi) \
+    OP(EIEIO,     "eieio",      X_FORM,   31, 854,  (),                         0,      op_nop) \
+    OP(STHBRX,    "sthbrx",     X_FORM,   31, 918,  (RS, RA, RB),               MEM,    op_sthbrx) \
+    OP(EXTSH,     "extsh",      X_FORM,   31, 922,  (RA, RS),                   0,      op_extsh) \
+    OP(EXTSB,     "extsb",      X_FORM,   31, 954,  (RA, RS),                   0,      op_extsb) \
+    OP(ICBI,      "icbi",       X_FORM,   31, 982,  (RA, RB),                   0,      op_icbi) \
+    OP(STFIWX,    "stfiwx",     X_FORM,   31, 983,  (FS, RA, RB),               MEM,    op_stfiwx) \
+    OP(DCBZ,      "dcbz",       X_FORM,   31, 1014, (RA, RB),                   MEM,    op_dcbz) \
+    \
+    OP(FDIVS,     "fdivs",      A_FORM,   59, 18,   (FD, FA, FB),               0,      op_fdiv<true>) \
+    OP(FSUBS,     "fsubs",      A_FORM,   59, 20,   (FD, FA, FB),               0,      op_fsub<true>) \
+    OP(FADDS,     "fadds",      A_FORM,   59, 21,   (FD, FA, FB),               0,      op_fadd<true>) \
+    OP(FRES,      "fres",       A_FORM,   59, 24,   (FD, FB),                   0,      op_fres) \
+    OP(FMULS,     "fmuls",      A_FORM,   59, 25,   (FD, FA, FC),               0,      op_fmul<true>) \
+    OP(FMSUBS,    "fmsubs",     A_FORM,   59, 28,   (FD, FA, FC, FB),           0,      op_fmsub<true>) \
+    OP(FMADDS,    "fmadds",     A_FORM,   59, 29,   (FD, FA, FC, FB),           0,      op_fmadd<true>) \
+    OP(FNMSUBS,   "fnmsubs",    A_FORM,   59, 30,   (FD, FA, FC, FB),           0,      op_fnmsub<true>) \
+    OP(FNMADDS,   "fnmadds",    A_FORM,   59, 31,   (FD, FA, FC, FB),           0,      op_fnmadd<true>) \
+    \
+    OP(FDIV,      "fdiv",       A_FORM,   63, 18,   (FD, FA, FB),               0,      op_fdiv<false>) \
+    OP(FSUB,      "fsub",       A_FORM,   63, 20,   (FD, FA, FB),               0,      op_fsub<false>) \
+    OP(FADD,      "fadd",       A_FORM,   63, 21,   (FD, FA, FB),               0,      op_fadd<false>) \
+    OP(FSEL,      "fsel",       A_FORM,   63, 23,   (FD, FA, FC, FB),           0,      op_fsel) \
+    OP(FMUL,      "fmul",       A_FORM,   63, 25,   (FD, FA, FC),               0,      op_fmul<false>) \
+    OP(FRSQRTE,   "frsqrte",    A_FORM,   63, 26,   (FD, FB),                   0,      op_frsqrte) \
+    OP(FMSUB,     "fmsub",      A_FORM,   63, 28,   (FD, FA, FC, FB),           0,      op_fmsub<false>) \
+    OP(FMADD,     "fmadd",      A_FORM,   63, 29,   (FD, FA, FC, FB),           0,      op_fmadd<false>) \
+    OP(FNMSUB,    "fnmsub",     A_FORM,   63, 30,   (FD, FA, FC, FB),           0,      op_fnmsub<false>) \
+    OP(FNMADD,    "fnmadd",     A_FORM,   63, 31,   (FD, FA, FC, FB),           0,      op_fnmadd<false>) \
+    OP(FCMPU,     "fcmpu",      X_FORM,   63, 0,    (CRFD, FA, FB),             0,      op_fcmp) \
+    OP(FRSP,      "frsp",       X_FORM,   63, 12,   (FD, FB),                   0,      op_frsp) \
+    OP(FCTIW,     "fctiw",      X_FORM,   63, 14,   (FD, FB),                   0,      op_fctiw<false>) \
+    OP(FCTIWZ,    "fctiwz",     X_FORM,   63, 15,   (FD, FB),                   0,      op_fctiw<true>) \
+    OP(FCMPO,     "fcmpo",      X_FORM,   63, 32,   (CRFD, FA, FB),             0,      op_fcmp) \
+    OP(MTFSB1,    "mtfsb1",     X_FORM,   63, 38,   (CRBD),                     0,      op_mtfsb1) \
+    OP(FNEG,      "fneg",       X_FORM,   63, 40,   (FD, FB),                   0,      op_fneg) \
+    OP(MCRFS,     "mcrfs",      X_FORM,   63, 64,   (CRFD, CRFS),               UNIMPLEMENTED, op_invalid) \
+    OP(MTFSB0,    "mtfsb0",     X_FORM,   63, 70,   (CRBD),                     0,      op_mtfsb0) \
+    OP(FMR,       "fmr",        X_FORM,   63, 72,   (FD, FB),                   0,      op_fmr) \
+    OP(MTFSFI,    "mtfsfi",     X_FORM,   63, 134,  (CRFD, FP_IMM),             0,      op_mtfsfi) \
+    OP(FNABS,     "fnabs",      X_FORM,   63, 136,  (FD, FB),                   0,      op_fnabs) \
+    OP(FABS,      "fabs",       X_FORM,   63, 264,  (FD, FB),                   0,      op_fabs) \
+    OP(MFFS,      "mffs",       X_FORM,   63, 583,  (FD),                       0,      op_mffs) \
+    OP(MTFSF,     "mtfsf",      XFL_FORM, 63, 711,  (FM, FB),                   0,      op_mtfsf)
+
+    namespace isa {
+
+        /**
+         * @brief Instruction encoding forms (PowerPC manual naming)
+         *
+         * The form says where the extended opcode sits and how wide it is. The
+         * Gekko adds PSQ (psq_l/psq_st) and PSQX (indexed psq_lx/psq_stx).
+         */
+        enum Form : uint8_t {
+            I_FORM, B_FORM, SC_FORM, D_FORM, M_FORM,    // Primary opcode only
+            PSQ_FORM,
+            X_FORM, XL_FORM, XFX_FORM, XFL_FORM,        // 10-bit extended opcode
+            XO_FORM,                                    // 9 bits, OE sits above it
+            A_FORM,                                     // 5 bits, register C above it
+            PSQX_FORM,                                  // 6 bits, W and I above it
+        };
+
+        /**
+         * @brief Bits of the extended opcode a form matches on (0: primary only)
+         */
+        constexpr unsigned xo_bits(Form form) {
+            switch (form) {
+                case X_FORM: case XL_FORM: case XFX_FORM: case XFL_FORM: return 10;
+                case XO_FORM:   return 9;
+                case PSQX_FORM: return 6;
+                case A_FORM:    return 5;
+                default:        return 0;
+            }
+        }
+
+        /**
+         * @brief Operand fields, as named in the PowerPC manual
+         */
+        enum Field : uint8_t {
+            NONE,
+            RD, RS, RA, RB,             // GPRs (RD/RS share bits 6-10)
+            FD, FS, FA, FB, FC,         // FPRs
+            SIMM, UIMM,                 // 16-bit immediates
+            DISP,                       // d(rA)
+            PS_DISP,                    // 12-bit d(rA) of psq_l/psq_st
+            PS_W, PS_I,                 // psq_l/psq_st quantization
+            PSX_W, PSX_I,               // psq_lx/psq_stx quantization
+            CRFD, CRFS,                 // CR fields
+            CRBD, CRBA, CRBB,           // CR bits
+            BO, BI, BD, LI,             // Branches
+            SH, MB, ME,                 // Rotates
+            SPR, TBR,                   // mfspr/mtspr/mftb (halves swapped)
+            SR, CRM, FM, TO, NB, FP_IMM,
+            FIELD_COUNT
+        };
+
+        /**
+         * @brief How a field is laid out in the word and how it reads back
+         *
+         * Bit numbers are the manual's: bit 0 is the MSB.
+         */
+        struct FieldBits {
+            uint8_t first;          //< First bit
+            uint8_t last;           //< Last bit, inclusive
+            bool is_signed;         //< Sign extend from the top bit
+            uint8_t shift;          //< Scale after extracting (branch displacements are words)
+            bool swapped;           //< Two 5-bit halves, low half first (SPR/TBR)
+        };
+
+        inline constexpr std::array<FieldBits, FIELD_COUNT> FIELD_BITS = [] {
+            std::array<FieldBits, FIELD_COUNT> t{};
+            auto set = [&t](Field f, uint8_t first, uint8_t last, bool is_signed = false, uint8_t shift = 0, bool swapped = false) {
+                t[f] = FieldBits{ first, last, is_signed, shift, swapped };
+            };
+            set(RD, 6, 10);     set(RS, 6, 10);     set(RA, 11, 15);    set(RB, 16, 20);
+            set(FD, 6, 10);     set(FS, 6, 10);     set(FA, 11, 15);    set(FB, 16, 20);    set(FC, 21, 25);
+            set(SIMM, 16, 31, true);    set(UIMM, 16, 31);  set(DISP, 16, 31, true);
+            set(PS_DISP, 20, 31, true); set(PS_W, 16, 16);  set(PS_I, 17, 19);
+            set(PSX_W, 21, 21);         set(PSX_I, 22, 24);
+            set(CRFD, 6, 8);    set(CRFS, 11, 13);
+            set(CRBD, 6, 10);   set(CRBA, 11, 15);  set(CRBB, 16, 20);
+            set(BO, 6, 10);     set(BI, 11, 15);    set(BD, 16, 29, true, 2);   set(LI, 6, 29, true, 2);
+            set(SH, 16, 20);    set(MB, 21, 25);    set(ME, 26, 30);
+            set(SPR, 11, 20, false, 0, true);       set(TBR, 11, 20, false, 0, true);
+            set(SR, 12, 15);    set(CRM, 12, 19);   set(FM, 7, 14);     set(TO, 6, 10);
+            set(NB, 16, 20);    set(FP_IMM, 16, 19);
+            return t;
+        }();
+
+        /**
+         * @brief Extract field `f` from `raw` (sign extended where the field is signed)
+         */
+        constexpr uint32_t extract(Field f, uint32_t raw) {
+            const FieldBits &b = FIELD_BITS[f];
+            const unsigned width = b.last - b.first + 1;
+            uint32_t v = (raw >> (31 - b.last)) & ((1u << width) - 1);
+            if (b.swapped)
+                v = ((v & 0x1F) << 5) | (v >> 5);
+            if (b.is_signed && (v >> (width - 1)))
+                v |= ~((1u << width) - 1);
+            return v << b.shift;
+        }
+
+        /**
+         * @brief extract() for a field known at compile time
+         */
+        template<Field F>
+        constexpr uint32_t extract(uint32_t raw) {
+            constexpr FieldBits b = FIELD_BITS[F];
+            constexpr unsigned width = b.last - b.first + 1;
+            constexpr uint32_t mask = (1u << width) - 1;
+            if constexpr (b.swapped) {
+                const uint32_t v = (raw >> (31 - b.last)) & mask;
+                return ((v & 0x1F) << 5) | (v >> 5);
+            } else if constexpr (b.is_signed) {
+                return static_cast<uint32_t>(static_cast<int32_t>(raw << b.first) >> (31 - width + 1)) << b.shift;
+            } else {
+                return ((raw >> (31 - b.last)) & mask) << b.shift;
+            }
+        }
+
+        /**
+         * @brief Instruction identity, one per FREECUBE_GEKKO_OPCODES entry
+         */
+        enum class Op : uint16_t {
+            INVALID,
+#define FREECUBE_OP_ENUM(id, ...) id,
+            FREECUBE_GEKKO_OPCODES(FREECUBE_OP_ENUM)
+#undef FREECUBE_OP_ENUM
+            COUNT
+        };
+
+        constexpr uint8_t BRANCH = INST_ENDS_BLOCK;
+        constexpr uint8_t MEM = INST_MEMORY;
+        constexpr uint8_t UNIMPLEMENTED = INST_INVALID | INST_ENDS_BLOCK;
+
+        /**
+         * @brief One row of the instruction set
+         */
+        struct OpSpec {
+            const char *mnemonic;
+            Form form;
+            uint8_t primary;                    //< Primary opcode (bits 0-5)
+            uint16_t extended;                  //< Extended opcode, xo_bits(form) wide
+            std::array<Field, 5> operands;      //< In assembler order, NONE padded
+            uint8_t flags;                      //< InstFlags
+        };
+
+        inline constexpr OpSpec OPCODES[] = {
+            { ".long", D_FORM, 0, 0, {}, UNIMPLEMENTED },
+#define FREECUBE_OP_SPEC(id, mnemonic, form, primary, extended, operands, flags, handler) \
+            { mnemonic, form, primary, extended, { FREECUBE_OP_OPERANDS operands }, flags },
+#define FREECUBE_OP_OPERANDS(...) __VA_ARGS__
+            FREECUBE_GEKKO_OPCODES(FREECUBE_OP_SPEC)
+#undef FREECUBE_OP_OPERANDS
+#undef FREECUBE_OP_SPEC
+        };
+
+        static_assert(std::size(OPCODES) == static_cast<std::size_t>(Op::COUNT), "OPCODES out of step with Op");
+
+        constexpr const OpSpec &spec(Op op) {
+            return OPCODES[static_cast<std::size_t>(op)];
+        }
+
+        /**
+         * @brief Two-level decode tables generated from OPCODES
+         *
+         * The primary opcode picks a base and a mask; the op is then
+         * ops[base + (extended & mask)]. Primaries without extended opcodes have a mask
+         * of 0 and their own slot at ops[primary]; the five that do get 1024 slots each,
+         * with narrower extended opcodes repeated over every value of the bits above them.
+         */
+        struct DecodeTables {
+            static constexpr uint32_t EXTENDED_PRIMARIES = 5;   // 4, 19, 31, 59, 63
+
+            struct Primary {
+                uint16_t base;
+                uint16_t mask;
+            };
+
+            std::array<Primary, 64> primary{};
+            std::array<Op, 64 + EXTENDED_PRIMARIES * 1024> ops{};
+        };
+
+        constexpr DecodeTables build_decode_tables() {
+            DecodeTables t{};
+            for (uint32_t p = 0; p < 64; p++)
+                t.primary[p] = { static_cast<uint16_t>(p), 0 };
+
+            uint16_t next = 64;
+            for (std::size_t i = 1; i < std::size(OPCODES); i++) {
+                const OpSpec &s = OPCODES[i];
+                if (xo_bits(s.form) && t.primary[s.primary].mask == 0) {
+                    t.primary[s.primary] = { next, 0x3FF };
+                    next += 1024;
+                }
+            }
+            if (next != t.ops.size())
+                throw "DecodeTables::EXTENDED_PRIMARIES is wrong";
+
+            // Narrow extended opcodes repeat over all the bits above them. Two specs
+            // claiming the same slot is an error in the table, so it fails to compile.
+            for (std::size_t i = 1; i < std::size(OPCODES); i++) {
+                const OpSpec &s = OPCODES[i];
+                const unsigned bits = xo_bits(s.form);
+                const auto &p = t.primary[s.primary];
+                const uint32_t count = bits ? 1024u >> bits : 1;
+                for (uint32_t hi = 0; hi < count; hi++) {
+                    Op &slot = t.ops[p.base + ((hi << bits) | s.extended)];
+                    if (slot != Op::INVALID)
+                        throw "FREECUBE_GEKKO_OPCODES has overlapping encodings";
+                    slot = static_cast<Op>(i);
+                }
+            }
+            return t;
+        }
+
+        inline constexpr DecodeTables DECODE_TABLES = build_decode_tables();
+
+        /**
+         * @brief Identify an instruction word: two table loads
+         */
+        constexpr Op lookup(uint32_t raw) {
+            const DecodeTables::Primary p = DECODE_TABLES.primary[raw >> 26];
+            return DECODE_TABLES.ops[p.base + ((raw >> 1) & p.mask)];
+        }
+
+        /**
+         * @brief Disassemble one instruction word
+         *
+         * Plain mnemonics with ./o/l/a suffixes, no simplified forms. `pc` is used to
+         * resolve relative branch targets.
+         */
+        std::string disassemble(uint32_t raw, uint32_t pc = 0);
+    }
+}
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "cpu/core.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #if defined(__FMA__)
+        #include <immintrin.h>
+    #endif
+    #define FREECUBE_PS_SSE2 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    #include <arm_neon.h>
+    #define FREECUBE_PS_NEON 1
+#endif
+
+/**
+ * @brief Paired-single kernels: both lanes of an FPR in one host vector
+ *
+ * An FPR is two doubles, so a whole paired single is one SSE2 / NEON register and
+ * every ps_* arithmetic op is a single host instruction (plus the round to single
+ * precision every result gets). Hosts without either fall back to plain scalar code
+ * with the same results.
+ */
+namespace freecube::cpu::ps {
+
+#if FREECUBE_PS_SSE2
+    using Vec = __m128d;
+
+    inline Vec load(const FPR &r) { return _mm_load_pd(&r.ps0); }
+    inline void store(FPR &r, Vec v) { _mm_store_pd(&r.ps0, v); }
+    inline Vec make(double ps0, double ps1) { return _mm_set_pd(ps1, ps0); }
+    inline double lane0(Vec v) { return _mm_cvtsd_f64(v); }
+    inline double lane1(Vec v) { return _mm_cvtsd_f64(_mm_unpackhi_pd(v, v)); }
+
+    inline Vec add(Vec a, Vec b) { return _mm_add_pd(a, b); }
+    inline Vec sub(Vec a, Vec b) { return _mm_sub_pd(a, b); }
+    inline Vec mul(Vec a, Vec b) { return _mm_mul_pd(a, b); }
+    inline Vec div(Vec a, Vec b) { return _mm_div_pd(a, b); }
+    inline Vec sqrt(Vec v) { return _mm_sqrt_pd(v); }
+
+    // a * c + b, fused like the scalar fmadd
+    inline Vec madd(Vec a, Vec c, Vec b) {
+    #if defined(__FMA__)
+        return _mm_fmadd_pd(a, c, b);
+    #else
+        return _mm_set_pd(std::fma(lane1(a), lane1(c), lane1(b)), std::fma(lane0(a), lane0(c), lane0(b)));
+    #endif
+    }
+
+    inline Vec sign_mask() { return _mm_castsi128_pd(_mm_set1_epi64x(static_cast<int64_t>(1ull << 63))); }
+    inline Vec neg(Vec v) { return _mm_xor_pd(v, sign_mask()); }
+    inline Vec abs(Vec v) { return _mm_andnot_pd(sign_mask(), v); }
+    inline Vec nabs(Vec v) { return _mm_or_pd(v, sign_mask()); }
+
+    inline Vec round_single(Vec v) { return _mm_cvtps_pd(_mm_cvtpd_ps(v)); }
+
+    inline Vec splat0(Vec v) { return _mm_unpacklo_pd(v, v); }
+    inline Vec splat1(Vec v) { return _mm_unpackhi_pd(v, v); }
+    inline Vec merge00(Vec a, Vec b) { return _mm_unpacklo_pd(a, b); }
+    inline Vec merge01(Vec a, Vec b) { return _mm_move_sd(b, a); }
+    inline Vec merge10(Vec a, Vec b) { return _mm_shuffle_pd(a, b, 1); }
+    inline Vec merge11(Vec a, Vec b) { return _mm_unpackhi_pd(a, b); }
+
+    // Per lane a >= 0 ? c : b (NaN picks b)
+    inline Vec select(Vec a, Vec c, Vec b) {
+        const Vec ge = _mm_cmpge_pd(a, _mm_setzero_pd());
+        return _mm_or_pd(_mm_and_pd(ge, c), _mm_andnot_pd(ge, b));
+    }
+
+    // Per lane v > lo ? v : lo, then v < hi ? v : hi, so NaN clamps to lo
+    inline Vec clamp(Vec v, Vec lo, Vec hi) { return _mm_min_pd(_mm_max_pd(v, lo), hi); }
+
+    inline Vec from_int(int32_t ps0, int32_t ps1) { return _mm_cvtepi32_pd(_mm_setr_epi32(ps0, ps1, 0, 0)); }
+
+    // Truncating, the values must already be in int32 range
+    inline void to_int(Vec v, int32_t out[2]) {
+        const __m128i i = _mm_cvttpd_epi32(v);
+        out[0] = _mm_cvtsi128_si32(i);
+        out[1] = _mm_cvtsi128_si32(_mm_srli_si128(i, 4));
+    }
+
+    inline void to_single(Vec v, float out[2]) {
+        const __m128 f = _mm_cvtpd_ps(v);
+        out[0] = _mm_cvtss_f32(f);
+        out[1] = _mm_cvtss_f32(_mm_shuffle_ps(f, f, 1));
+    }
+#elif FREECUBE_PS_NEON
+    using Vec = float64x2_t;
+
+    inline Vec load(const FPR &r) { return vld1q_f64(&r.ps0); }
+    inline void store(FPR &r, Vec v) { vst1q_f64(&r.ps0, v); }
+    inline Vec make(double ps0, double ps1) { return vcombine_f64(vdup_n_f64(ps0), vdup_n_f64(ps1)); }
+    inline double lane0(Vec v) { return vgetq_lane_f64(v, 0); }
+    inline double lane1(Vec v) { return vgetq_lane_f64(v, 1); }
+
+    inline Vec add(Vec a, Vec b) { return vaddq_f64(a, b); }
+    inline Vec sub(Vec a, Vec b) { return vsubq_f64(a, b); }
+    inline Vec mul(Vec a, Vec b) { return vmulq_f64(a, b); }
+    inline Vec div(Vec a, Vec b) { return vdivq_f64(a, b); }
+    inline Vec sqrt(Vec v) { return vsqrtq_f64(v); }
+    inline Vec madd(Vec a, Vec c, Vec b) { return vfmaq_f64(b, a, c); }
+
+    inline Vec neg(Vec v) { return vnegq_f64(v); }
+    inline Vec abs(Vec v) { return vabsq_f64(v); }
+    inline Vec nabs(Vec v) { return vnegq_f64(vabsq_f64(v)); }
+
+    inline Vec round_single(Vec v) { return vcvt_f64_f32(vcvt_f32_f64(v)); }
+
+    inline Vec splat0(Vec v) { return vdupq_laneq_f64(v, 0); }
+    inline Vec splat1(Vec v) { return vdupq_laneq_f64(v, 1); }
+    inline Vec merge00(Vec a, Vec b) { return vzip1q_f64(a, b); }
+    inline Vec merge01(Vec a, Vec b) { return vcopyq_laneq_f64(b, 0, a, 0); }
+    inline Vec merge10(Vec a, Vec b) { return vextq_f64(a, b, 1); }
+    inline Vec merge11(Vec a, Vec b) { return vzip2q_f64(a, b); }
+
+    inline Vec select(Vec a, Vec c, Vec b) { return vbslq_f64(vcgeq_f64(a, vdupq_n_f64(0.0)), c, b); }
+
+    inline Vec clamp(Vec v, Vec lo, Vec hi) {
+        v = vbslq_f64(vcgtq_f64(v, lo), v, lo);
+        return vbslq_f64(vcltq_f64(v, hi), v, hi);
+    }
+
+    inline Vec from_int(int32_t ps0, int32_t ps1) { return vcvtq_f64_s64(vcombine_s64(vdup_n_s64(ps0), vdup_n_s64(ps1))); }
+
+    inline void to_int(Vec v, int32_t out[2]) { vst1_s32(out, vmovn_s64(vcvtq_s64_f64(v))); }
+
+    inline void to_single(Vec v, float out[2]) { vst1_f32(out, vcvt_f32_f64(v)); }
+#else
+    struct Vec {
+        double ps0;
+        double ps1;
+    };
+
+    inline Vec load(const FPR &r) { return { r.ps0, r.ps1 }; }
+    inline void store(FPR &r, Vec v) { r.ps0 = v.ps0; r.ps1 = v.ps1; }
+    inline Vec make(double ps0, double ps1) { return { ps0, ps1 }; }
+    inline double lane0(Vec v) { return v.ps0; }
+    inline double lane1(Vec v) { return v.ps1; }
+
+    inline Vec add(Vec a, Vec b) { return { a.ps0 + b.ps0, a.ps1 + b.ps1 }; }
+    inline Vec sub(Vec a, Vec b) { return { a.ps0 - b.ps0, a.ps1 - b.ps1 }; }
+    inline Vec mul(Vec a, Vec b) { return { a.ps0 * b.ps0, a.ps1 * b.ps1 }; }
+    inline Vec div(Vec a, Vec b) { return { a.ps0 / b.ps0, a.ps1 / b.ps1 }; }
+    inline Vec sqrt(Vec v) { return { std::sqrt(v.ps0), std::sqrt(v.ps1) }; }
+    inline Vec madd(Vec a, Vec c, Vec b) { return { std::fma(a.ps0, c.ps0, b.ps0), std::fma(a.ps1, c.ps1, b.ps1) }; }
+
+    inline Vec neg(Vec v) { return { -v.ps0, -v.ps1 }; }
+    inline Vec abs(Vec v) { return { std::fabs(v.ps0), std::fabs(v.ps1) }; }
+    inline Vec nabs(Vec v) { return { -std::fabs(v.ps0), -std::fabs(v.ps1) }; }
+
+    inline Vec round_single(Vec v) { return { static_cast<float>(v.ps0), static_cast<float>(v.ps1) }; }
+
+    inline Vec splat0(Vec v) { return { v.ps0, v.ps0 }; }
+    inline Vec splat1(Vec v) { return { v.ps1, v.ps1 }; }
+    inline Vec merge00(Vec a, Vec b) { return { a.ps0, b.ps0 }; }
+    inline Vec merge01(Vec a, Vec b) { return { a.ps0, b.ps1 }; }
+    inline Vec merge10(Vec a, Vec b) { return { a.ps1, b.ps0 }; }
+    inline Vec merge11(Vec a, Vec b) { return { a.ps1, b.ps1 }; }
+
+    inline Vec select(Vec a, Vec c, Vec b) { return { a.ps0 >= 0.0 ? c.ps0 : b.ps0, a.ps1 >= 0.0 ? c.ps1 : b.ps1 }; }
+
+    inline Vec clamp(Vec v, Vec lo, Vec hi) {
+        v = { v.ps0 > lo.ps0 ? v.ps0 : lo.ps0, v.ps1 > lo.ps1 ? v.ps1 : lo.ps1 };
+        return { v.ps0 < hi.ps0 ? v.ps0 : hi.ps0, v.ps1 < hi.ps1 ? v.ps1 : hi.ps1 };
+    }
+
+    inline Vec from_int(int32_t ps0, int32_t ps1) { return { static_cast<double>(ps0), static_cast<double>(ps1) }; }
+
+    inline void to_int(Vec v, int32_t out[2]) {
+        out[0] = static_cast<int32_t>(v.ps0);
+        out[1] = static_cast<int32_t>(v.ps1);
+    }
+
+    inline void to_single(Vec v, float out[2]) {
+        out[0] = static_cast<float>(v.ps0);
+        out[1] = static_cast<float>(v.ps1);
+    }
+#endif
+
+    // ---- GQR quantization ----
+
+    /**
+     * @brief Element types of the GQR LD_TYPE/ST_TYPE fields (1-3 are reserved, treated as float)
+     */
+    enum QuantType : uint32_t {
+        QUANT_FLOAT = 0,
+        QUANT_U8    = 4,
+        QUANT_U16   = 5,
+        QUANT_S8    = 6,
+        QUANT_S16   = 7,
+    };
+
+    inline constexpr unsigned QUANT_SIZE[8] = { 4, 4, 4, 4, 1, 2, 1, 2 };
+    inline constexpr double QUANT_MIN[8] = { 0, 0, 0, 0, 0, 0, -128, -32768 };
+    inline constexpr double QUANT_MAX[8] = { 0, 0, 0, 0, 255, 65535, 127, 32767 };
+
+    struct ScaleTables {
+        double dequantize[64];  //< 2^-scale, indexed by the raw six-bit (signed) GQR field
+        double quantize[64];    //< 2^scale
+    };
+
+    constexpr ScaleTables make_scale_tables() {
+        ScaleTables t{};
+        for (int raw = 0; raw < 64; raw++) {
+            const int scale = raw < 32 ? raw : raw - 64;
+            double up = 1.0;
+            for (int i = 0; i < (scale < 0 ? -scale : scale); i++)
+                up *= 2.0;
+            t.quantize[raw] = scale < 0 ? 1.0 / up : up;
+            t.dequantize[raw] = scale < 0 ? up : 1.0 / up;
+        }
+        return t;
+    }
+
+    inline constexpr ScaleTables SCALES = make_scale_tables();
+
+    inline bool is_float(uint32_t type) { return type < QUANT_U8; }
+
+    /**
+     * @brief Two raw guest elements of `type` (zero extended, as loaded) to paired-single lanes
+     */
+    inline Vec dequantize(uint32_t type, uint32_t scale, uint32_t e0, uint32_t e1) {
+        if (is_float(type)) {
+            float f0, f1;
+            std::memcpy(&f0, &e0, 4);
+            std::memcpy(&f1, &e1, 4);
+            return make(f0, f1);
+        }
+
+        int32_t i0, i1;
+        switch (type) {
+            case QUANT_S8:  i0 = static_cast<int8_t>(e0);  i1 = static_cast<int8_t>(e1);  break;
+            case QUANT_S16: i0 = static_cast<int16_t>(e0); i1 = static_cast<int16_t>(e1); break;
+            default:        i0 = static_cast<int32_t>(e0); i1 = static_cast<int32_t>(e1); break;
+        }
+
+        const double s = SCALES.dequantize[scale];
+        return mul(from_int(i0, i1), make(s, s));
+    }
+
+    /**
+     * @brief Both lanes to raw guest elements of `type`, saturating integers to the type's range
+     */
+    inline void quantize(Vec v, uint32_t type, uint32_t scale, uint32_t out[2]) {
+        if (is_float(type)) {
+            float f[2];
+            to_single(v, f);
+            std::memcpy(&out[0], &f[0], 4);
+            std::memcpy(&out[1], &f[1], 4);
+            return;
+        }
+
+        const double s = SCALES.quantize[scale];
+        v = clamp(mul(v, make(s, s)), make(QUANT_MIN[type], QUANT_MIN[type]), make(QUANT_MAX[type], QUANT_MAX[type]));
+
+        int32_t i[2];
+        to_int(v, i);
+        out[0] = static_cast<uint32_t>(i[0]);
+        out[1] = static_cast<uint32_t>(i[1]);
+    }
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace freecube::cpu::x64 {
+
+    enum Reg : uint8_t {
+        RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+        R8, R9, R10, R11, R12, R13, R14, R15,
+    };
+
+    enum Cond : uint8_t {
+        CC_O = 0x0, CC_NO = 0x1, CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_BE = 0x6, CC_A = 0x7,
+        CC_S = 0x8, CC_NS = 0x9, CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF,
+    };
+
+    // Group 1 ALU ops: the /digit for the imm forms, and (op << 3) | 1 for reg, reg
+    enum Alu : uint8_t {
+        ALU_ADD = 0, ALU_OR = 1, ALU_AND = 4, ALU_SUB = 5, ALU_XOR = 6, ALU_CMP = 7,
+    };
+
+    /**
+     * @brief Just enough of an x86-64 assembler for the JIT
+     *
+     * Writes straight into a caller owned buffer. Memory operands are always
+     * [base + disp32] or [base + index], which is all the generated code needs.
+     * Sizes are 32-bit unless the name says otherwise.
+     */
+    class Emitter {
+    public:
+        Emitter(uint8_t *code, std::size_t capacity) : m_start(code), m_ptr(code), m_end(code + capacity) {}
+
+        uint8_t *ptr() const { return m_ptr; }
+        std::size_t size() const { return static_cast<std::size_t>(m_ptr - m_start); }
+        bool overflowed() const { return m_ptr > m_end; }
+
+        // ---- Moves ----
+
+        void mov(Reg dst, Reg src) { rex(false, src, dst); byte(0x89); modrm_reg(src, dst); }
+        void mov64(Reg dst, Reg src) { rex(true, src, dst); byte(0x89); modrm_reg(src, dst); }
+        void mov(Reg dst, uint32_t imm) { rex(false, 0, dst); byte(0xB8 + (dst & 7)); u32(imm); }
+        void mov64(Reg dst, uint64_t imm) { rex(true, 0, dst); byte(0xB8 + (dst & 7)); u64(imm); }
+        void load(Reg dst, Reg base, int32_t disp) { rex(false, dst, base); byte(0x8B); modrm_disp(dst, base, disp); }
+        void store(Reg base, int32_t disp, Reg src) { rex(false, src, base); byte(0x89); modrm_disp(src, base, disp); }
+        void store_imm(Reg base, int32_t disp, uint32_t imm) { rex(false, 0, base); byte(0xC7); modrm_disp(0, base, disp); u32(imm); }
+        void store8_imm(Reg base, int32_t disp, uint8_t imm) { rex(false, 0, base); byte(0xC6); modrm_disp(0, base, disp); byte(imm); }
+        void load8z(Reg dst, Reg base, int32_t disp) { rex(false, dst, base); byte(0x0F); byte(0xB6); modrm_disp(dst, base, disp); }
+        // src must be AL/CL/DL/BL, as for store8_idx
+        void store8(Reg base, int32_t disp, Reg src) { rex(false, src, base); byte(0x88); modrm_disp(src, base, disp); }
+
+        // [base + index] forms, used for guest memory
+        void load_idx(Reg dst, Reg base, Reg index) { rex(false, dst, base, index); byte(0x8B); modrm_sib(dst, base, index); }
+        void load16z_idx(Reg dst, Reg base, Reg index) { rex(false, dst, base, index); byte(0x0F); byte(0xB7); modrm_sib(dst, base, index); }
+        void load8z_idx(Reg dst, Reg base, Reg index) { rex(false, dst, base, index); byte(0x0F); byte(0xB6); modrm_sib(dst, base, index); }
+        void store_idx(Reg base, Reg index, Reg src) { rex(false, src, base, index); byte(0x89); modrm_sib(src, base, index); }
+        void store16_idx(Reg base, Reg index, Reg src) { byte(0x66); rex(false, src, base, index); byte(0x89); modrm_sib(src, base, index); }
+        // src must be AL/CL/DL/BL, we never force a REX for the low byte registers
+        void store8_idx(Reg base, Reg index, Reg src) { rex(false, src, base, index); byte(0x88); modrm_sib(src, base, index); }
+        void test8_idx_imm(Reg base, Reg index, uint8_t imm) { rex(false, 0, base, index); byte(0xF6); modrm_sib(0, base, index); byte(imm); }
+        void or8_idx_imm(Reg base, Reg index, uint8_t imm) { rex(false, 0, base, index); byte(0x80); modrm_sib(1, base, index); byte(imm); }
+
+        void movzx8(Reg dst, Reg src) { rex(false, dst, src); byte(0x0F); byte(0xB6); modrm_reg(dst, src); }
+        void movsx8(Reg dst, Reg src) { rex(false, dst, src); byte(0x0F); byte(0xBE); modrm_reg(dst, src); }
+        void movsx16(Reg dst, Reg src) { rex(false, dst, src); byte(0x0F); byte(0xBF); modrm_reg(dst, src); }
+
+        // ---- Arithmetic ----
+
+        void alu(Alu op, Reg dst, Reg src) { rex(false, src, dst); byte(static_cast<uint8_t>((op << 3) | 1)); modrm_reg(src, dst); }
+        void alu(Alu op, Reg dst, uint32_t imm) { rex(false, 0, dst); byte(0x81); modrm_reg(op, dst); u32(imm); }
+        void alu64(Alu op, Reg dst, uint32_t imm) { rex(true, 0, dst); byte(0x81); modrm_reg(op, dst); u32(imm); }
+        void alu_mem(Alu op, Reg base, int32_t disp, uint32_t imm) { rex(false, 0, base); byte(0x81); modrm_disp(op, base, disp); u32(imm); }
+        void test(Reg a, Reg b) { rex(false, b, a); byte(0x85); modrm_reg(b, a); }
+        void test64(Reg a, Reg b) { rex(true, b, a); byte(0x85); modrm_reg(b, a); }
+        void test(Reg a, uint32_t imm) { rex(false, 0, a); byte(0xF7); modrm_reg(0, a); u32(imm); }
+        void imul(Reg dst, Reg src) { rex(false, dst, src); byte(0x0F); byte(0xAF); modrm_reg(dst, src); }
+        void imul(Reg dst, Reg src, int32_t imm) { rex(false, dst, src); byte(0x69); modrm_reg(dst, src); u32(static_cast<uint32_t>(imm)); }
+        void neg(Reg r) { rex(false, 0, r); byte(0xF7); modrm_reg(3, r); }
+        void not_(Reg r) { rex(false, 0, r); byte(0xF7); modrm_reg(2, r); }
+        void rol(Reg r, uint8_t n) { shift(0, r, n); }
+        void shl(Reg r, uint8_t n) { shift(4, r, n); }
+        void shr(Reg r, uint8_t n) { shift(5, r, n); }
+        void sar(Reg r, uint8_t n) { shift(7, r, n); }
+        void rol16(Reg r, uint8_t n) { byte(0x66); shift(0, r, n); }
+        void bswap(Reg r) { rex(false, 0, r); byte(0x0F); byte(0xC8 + (r & 7)); }
+        void setcc(Cond c, Reg r) { rex(false, 0, r); byte(0x0F); byte(0x90 + c); modrm_reg(0, r); }
+
+        // ---- Control flow ----
+
+        void push(Reg r) { if (r & 8) byte(0x41); byte(0x50 + (r & 7)); }
+        void pop(Reg r) { if (r & 8) byte(0x41); byte(0x58 + (r & 7)); }
+        void ret() { byte(0xC3); }
+        void call(Reg r) { rex(false, 0, r); byte(0xFF); modrm_reg(2, r); }
+        void jmp(Reg r) { rex(false, 0, r); byte(0xFF); modrm_reg(4, r); }
+
+        /**
+         * @brief jmp rel32, returns the address of the instruction for patching
+         */
+        uint8_t *jmp(const uint8_t *target) {
+            uint8_t *at = m_ptr;
+            byte(0xE9);
+            rel32(target);
+            return at;
+        }
+
+        /**
+         * @brief Forward jump to be bound later with bind()
+         */
+        uint8_t *jmp_forward() { byte(0xE9); u32(0); return m_ptr; }
+        uint8_t *jcc_forward(Cond c) { byte(0x0F); byte(0x80 + c); u32(0); return m_ptr; }
+        void jcc(Cond c, const uint8_t *target) { byte(0x0F); byte(0x80 + c); rel32(target); }
+
+        // Point a forward jump (the value jmp_forward/jcc_forward returned) here
+        void bind(uint8_t *after_jump) {
+            if (overflowed())
+                return;
+            int32_t rel = static_cast<int32_t>(m_ptr - after_jump);
+            std::memcpy(after_jump - 4, &rel, 4);
+        }
+
+        /**
+         * @brief Retarget an emitted `jmp rel32`
+         */
+        static void patch_jmp(uint8_t *jmp_at, const uint8_t *target) {
+            int32_t rel = static_cast<int32_t>(target - (jmp_at + 5));
+            std::memcpy(jmp_at + 1, &rel, 4);
+        }
+
+    private:
+        uint8_t *m_start;
+        uint8_t *m_ptr;
+        uint8_t *m_end;
+
+        void byte(uint8_t b) {
+            if (m_ptr < m_end)
+                *m_ptr = b;
+            m_ptr++;
+        }
+
+        void u32(uint32_t v) { for (int i = 0; i < 4; i++) byte(static_cast<uint8_t>(v >> (i * 8))); }
+        void u64(uint64_t v) { for (int i = 0; i < 8; i++) byte(static_cast<uint8_t>(v >> (i * 8))); }
+        void rel32(const uint8_t *target) { u32(static_cast<uint32_t>(static_cast<int32_t>(target - (m_ptr + 4)))); }
+
+        void rex(bool w, uint8_t reg, uint8_t rm, uint8_t index = 0) {
+            uint8_t r = static_cast<uint8_t>(0x40 | (w ? 8 : 0) | ((reg & 8) >> 1) | ((index & 8) >> 2) | ((rm & 8) >> 3));
+            if (r != 0x40)
+                byte(r);
+        }
+
+        void modrm_reg(uint8_t reg, uint8_t rm) { byte(static_cast<uint8_t>(0xC0 | ((reg & 7) << 3) | (rm & 7))); }
+
+        void modrm_disp(uint8_t reg, uint8_t base, int32_t disp) {
+            byte(static_cast<uint8_t>(0x80 | ((reg & 7) << 3) | (base & 7)));
+            if ((base & 7) == RSP)
+                byte(0x24);
+            u32(static_cast<uint32_t>(disp));
+        }
+
+        void modrm_sib(uint8_t reg, uint8_t base, uint8_t index) {
+            // RBP/R13 as base has no disp-less encoding, use a zero disp8
+            const bool disp8 = (base & 7) == RBP;
+            byte(static_cast<uint8_t>((disp8 ? 0x40 : 0x00) | ((reg & 7) << 3) | 4));
+            byte(static_cast<uint8_t>(((index & 7) << 3) | (base & 7)));
+            if (disp8)
+                byte(0);
+        }
+
+        void shift(uint8_t digit, Reg r, uint8_t n) { rex(false, 0, r); byte(0xC1); modrm_reg(digit, r); byte(n); }
+    };
+}
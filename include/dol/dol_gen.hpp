@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace freecube::dol {
+
+    /**
+     * @brief Section layout for a synthesized DOL
+     *
+     * Sections are stored back to back after the 0x100 byte header, in the order given.
+     */
+    struct DolLayout {
+        struct Section {
+            uint32_t address;
+            uint32_t size;
+        };
+
+        std::vector<Section> text;          //< Up to 7
+        std::vector<Section> data;          //< Up to 11
+        uint32_t bss_address = 0;
+        uint32_t bss_size = 0;
+        uint32_t entry_point = 0;           //< 0 for the start of the first text section
+
+        /**
+         * @brief Shaped like a retail game: two text sections, six data sections, a BSS
+         */
+        static DolLayout retail_like();
+
+        /**
+         * @brief Parse "address:size[,address:size...]", numbers in any base strtoul takes
+         *
+         * @throws std::invalid_argument if the list is malformed
+         */
+        static std::vector<Section> parse_sections(const std::string &list);
+
+        /**
+         * @brief Bytes the DOL file takes up
+         */
+        uint64_t file_size() const;
+    };
+
+    /**
+     * @brief Build a DOL file that DOLLoader, readDolHeader and validateDol accept
+     *
+     * Text sections are nops ending in a branch back to the section start, so the entry
+     * point spins forever once booted. Data sections hold a byte pattern derived from
+     * `seed` and the file offset.
+     *
+     * @throws std::invalid_argument if there are too many sections, none of them is text,
+     *         or the entry point isn't inside a text section
+     */
+    std::vector<uint8_t> build_dol(const DolLayout &layout, uint64_t seed = 0);
+}
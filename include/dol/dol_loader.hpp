@@ -4,12 +4,22 @@
 #include <vector>
 #include <array>
 
+#include "util/span.hpp"
+#include "memory/memory.hpp"
+#include "dol/validate.hpp"
+
 namespace freecube::dol {
+    /**
+     * @brief One text/data section of a DOL
+     *
+     * `data` points into the bytes the DOLLoader was given, nothing is copied. Those
+     * bytes (the mapped disc, or a buffer from ISOImage::get_dol()) must outlive the image.
+     */
     struct Section {
         uint32_t file_offset;
         uint32_t load_address;
         uint32_t size;
-        std::vector<uint8_t> data;
+        util::ByteSpan data;
     };
 
     struct DOLImage {
@@ -23,15 +33,40 @@ namespace freecube::dol {
 
     class DOLLoader {
         public:
-            explicit DOLLoader(const std::vector<uint8_t> &bytes);
+            /**
+             * @brief Parse a DOL in place
+             *
+             * @param bytes The whole DOL file, borrowed for the lifetime of image()
+             * @throws std::runtime_error if the header is truncated or a section is out of bounds
+             */
+            explicit DOLLoader(util::ByteSpan bytes);
+
+            /**
+             * @brief Take the layout from a header readDolHeader() already parsed
+             *
+             * For callers that validated the header first, so it's only read once.
+             *
+             * @throws std::runtime_error if a section is out of bounds
+             */
+            DOLLoader(util::ByteSpan bytes, const DolHeader &header);
 
             const DOLImage &image() const { return m_image; }
 
+            /**
+             * @brief Place the sections in guest RAM and clear BSS
+             *
+             * BSS is cleared first: it usually spans the small data sections, which must survive.
+             *
+             * @throws std::runtime_error if a section or BSS doesn't fit in MEM1
+             */
+            void load_into(memory::Memory &mem) const;
+
         private:
             DOLImage m_image;
 
             static uint32_t be32(const uint8_t *p);
             void parse_header(const uint8_t *header);
-            void load_sections(const std::vector<uint8_t> &bytes);
+            void take_header(const DolHeader &header);
+            void load_sections(util::ByteSpan bytes);
     };
 }
\ No newline at end of file
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "util/span.hpp"
+#include "memory/memory.hpp"
+
+namespace freecube::dol {
+    /**
+     * @brief One PT_LOAD segment of an ELF
+     *
+     * Like DOL sections, `data` points into the bytes the ELFLoader was given. The
+     * part of the segment past `data` (mem_size - data.size() bytes) is zero filled.
+     */
+    struct Segment {
+        uint32_t file_offset;
+        uint32_t load_address;
+        uint32_t mem_size;
+        bool executable;
+        util::ByteSpan data;
+    };
+
+    struct ELFImage {
+        std::vector<Segment> segments;
+        uint32_t entry_point;
+    };
+
+    /**
+     * @brief Loader for 32-bit big-endian PowerPC ELF executables, as homebrew toolchains link them
+     *
+     * Only program headers are looked at; sections and symbols are ignored.
+     */
+    class ELFLoader {
+        public:
+            /**
+             * @brief Check whether bytes start with the ELF magic
+             */
+            static bool is_elf(util::ByteSpan bytes);
+
+            /**
+             * @brief Parse and check an ELF in place
+             *
+             * @param bytes The whole ELF file, borrowed for the lifetime of image()
+             * @throws std::runtime_error if it isn't a PowerPC executable, a header or
+             *         segment is out of bounds, or the entry point isn't in an executable segment
+             */
+            explicit ELFLoader(util::ByteSpan bytes);
+
+            const ELFImage &image() const { return m_image; }
+
+            /**
+             * @brief Place the segments in guest RAM and zero their tails
+             *
+             * @throws std::runtime_error if a segment doesn't fit in MEM1
+             */
+            void load_into(memory::Memory &mem) const;
+
+        private:
+            ELFImage m_image;
+    };
+}
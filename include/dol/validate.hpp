@@ -12,6 +12,7 @@
 #include <string>
 #include <vector>
 #include "util/log.hpp"
+#include "util/span.hpp"
 
 namespace freecube::dol {
 
@@ -50,7 +51,7 @@ namespace freecube::dol {
     
     DolValidationResult validateDol(const DolHeader& hdr, size_t filesize);
 
-    bool readDolHeader(const std::vector<uint8_t>& data, DolHeader& out);
+    bool readDolHeader(util::ByteSpan data, DolHeader& out);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <vector>
+
+#include "loader/iso.hpp"
+#include "memory/memory.hpp"
+#include "timing/scheduler.hpp"
+#include "util/thread_pool.hpp"
+
+namespace freecube::dvd {
+
+    /**
+     * @brief Outcome of one DVD read, handed to the completion callback
+     */
+    struct ReadResult {
+        std::uint64_t id;
+        std::uint64_t disc_offset;
+        std::uint32_t address;      //< Guest RAM the data was copied to
+        std::uint32_t length;
+        std::size_t bytes_read;     //< Short if the read ran off the end of the disc
+        std::uint64_t ready_cycle;  //< Guest cycle the drive would have finished at
+    };
+
+    using ReadCallback = std::function<void(const ReadResult &)>;
+
+    /**
+     * @brief Rough drive timing, in guest CPU cycles
+     *
+     * Defaults approximate the drive's ~3 MB/s sustained rate against the 486 MHz Gekko
+     * clock, with a flat cost for reads that aren't a continuation of the previous one.
+     */
+    struct DriveTiming {
+        std::uint64_t seek_cycles = 486000 * 10;    //< ~10 ms for a non-sequential read
+        std::uint64_t cycles_per_byte = 162;        //< ~3 MB/s
+        std::uint64_t host_retry_cycles = 4860;     //< How long to wait when the host read is behind the model (~10 us)
+    };
+
+    struct QueueOptions {
+        std::size_t threads = 2;                    //< Host I/O workers
+        std::uint32_t prefetch_blocks = 4;          //< Blocks warmed ahead of a sequential stream
+        std::uint32_t block_size = 0x8000;          //< Prefetch granularity, one disc sector
+        DriveTiming timing;
+    };
+
+    /**
+     * @brief Asynchronous read queue for the DVD interface
+     *
+     * submit() returns immediately and the host read happens on a worker, into a buffer
+     * the queue owns. The emulation thread calls poll() with the current guest cycle;
+     * reads whose modeled completion time has passed are copied into guest RAM and their
+     * callbacks run, so it never blocks on host I/O and the guest can't see the data any
+     * earlier than the drive would have delivered it. If the host is slower than the
+     * model, the completion simply lands on a later poll. Completions are delivered in
+     * the order the drive finishes them, a read still running on the host holds back the
+     * ones behind it. Reads that continue the previous one are treated as a stream, and
+     * the blocks after it are warmed in the background.
+     *
+     * Guest RAM is only written, and callbacks only run, on whichever thread calls poll().
+     */
+    class DVDReadQueue {
+    public:
+        /**
+         * @param memory Guest RAM reads are delivered to, has to outlive the queue
+         */
+        DVDReadQueue(const ISOLoader::ISOImage &image, memory::Memory &memory, const QueueOptions &options = {});
+
+        /**
+         * @brief Waits for in-flight host reads, undelivered reads are dropped without touching guest RAM
+         */
+        ~DVDReadQueue();
+
+        DVDReadQueue(const DVDReadQueue &) = delete;
+        DVDReadQueue &operator=(const DVDReadQueue &) = delete;
+
+        /**
+         * @brief Queue a read of disc bytes into guest RAM at address
+         *
+         * @param now_cycle Current guest cycle, the drive model starts from here
+         * @return Request id, also carried in the ReadResult
+         * @throws std::out_of_range if [address, address + length) isn't entirely RAM
+         */
+        std::uint64_t submit(std::uint64_t disc_offset, std::uint32_t address, std::uint32_t length,
+                             std::uint64_t now_cycle, ReadCallback callback);
+
+        /**
+         * @brief Deliver reads that are done on the host and due by now_cycle
+         *
+         * Each one is copied into guest RAM, then its callback runs.
+         *
+         * @return Number of reads delivered
+         */
+        std::size_t poll(std::uint64_t now_cycle);
+
+        /**
+         * @brief Earliest modeled completion among undelivered reads
+         *
+         * This is known as soon as a read is submitted, so a scheduler can plan an event for it.
+         */
+        std::optional<std::uint64_t> next_ready_cycle() const;
+
+        /**
+         * @brief Deliver completions from a scheduler event instead of polling
+         *
+         * The queue keeps one event planned at next_ready_cycle(), and the event polls.
+         * Once attached, submit() and poll() belong to the emulation thread like the
+         * scheduler itself, and now_cycle should be scheduler.now(). The scheduler has to
+         * outlive the queue.
+         */
+        void attach(timing::Scheduler &scheduler);
+
+        /**
+         * @brief Block until every submitted read is done on the host (not delivered)
+         */
+        void wait_host_idle();
+
+        std::size_t pending() const;
+
+    private:
+        struct Completion {
+            ReadResult result;
+            ReadCallback callback;
+            std::vector<std::uint8_t> data;     // Read on the host, not yet in guest RAM
+        };
+
+        const ISOLoader::ISOImage &m_image;
+        memory::Memory &m_memory;
+        QueueOptions m_options;
+
+        mutable std::mutex m_lock;
+        std::uint64_t m_next_id = 1;
+        std::uint64_t m_drive_free_cycle = 0;       // The drive serves one read at a time
+        std::uint64_t m_stream_end = ~0ull;         // Disc offset the last read ended at
+        std::uint64_t m_prefetched_end = 0;         // How far ahead the current stream is warmed
+
+        // (ready_cycle, id) of every read that hasn't been delivered yet, and of those the
+        // ones done on the host. Delivery stops at the first entry the two disagree on
+        std::set<std::pair<std::uint64_t, std::uint64_t>> m_undelivered;
+        std::map<std::pair<std::uint64_t, std::uint64_t>, Completion> m_done;
+
+        timing::Scheduler *m_scheduler = nullptr;
+        timing::EventType m_event_type = 0;
+        timing::EventId m_event = 0;
+
+        // Declared last so workers stop before the state above goes away
+        std::unique_ptr<util::ThreadPool> m_pool;
+
+        void schedule_prefetch_locked(std::uint64_t from);
+        void plan_event();
+    };
+
+} // namespace freecube::dvd
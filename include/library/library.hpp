@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace freecube::library {
+
+    /**
+     * @brief What the disc header says about one image
+     *
+     * Everything comes from boot.bin and the start of bi2.bin, the first 0x460 bytes of
+     * the disc, so describing an image costs one small read however big it is.
+     */
+    struct GameInfo {
+        std::string path;
+        std::uint64_t file_size = 0;
+        std::int64_t mtime = 0;             //< Host file time, only ever compared for equality
+
+        bool ok = false;
+        std::string error;                  //< Why the header was rejected, if !ok
+
+        bool compressed = false;            //< .fcb container
+        std::uint64_t disc_size = 0;        //< Uncompressed
+        std::string game_id;
+        std::uint8_t disc_number = 0;
+        std::uint8_t version = 0;
+        std::string title;                  //< As stored, Shift-JIS on Japanese discs
+        std::uint32_t region = 0;           //< bi2.bin country code: 0 JPN, 1 USA, 2 PAL, 4 KOR
+        std::uint32_t dol_offset = 0;
+        std::uint32_t fst_offset = 0;
+        std::uint32_t fst_size = 0;
+    };
+
+    /**
+     * @brief Read an image's header and check it the way ISOImage does
+     *
+     * Never throws; a file that can't be read or isn't a GameCube disc comes back with
+     * ok unset and the reason in error.
+     */
+    GameInfo read_game_info(const std::string &path);
+
+    /**
+     * @brief GameInfo of images seen before, keyed by path, size and modification time
+     *
+     * Stored as a small binary file:
+     *
+     *   0x00  magic "FCLB"
+     *   0x04  u32 version
+     *   0x08  u32 entry count
+     *   0x0C  entries, little-endian fields as state::StateWriter writes them
+     *
+     * A missing, truncated or outdated cache file is treated as empty and rebuilt on
+     * the next save().
+     */
+    class LibraryCache {
+    public:
+        static constexpr std::uint32_t VERSION = 1;
+
+        explicit LibraryCache(std::string path);
+
+        /**
+         * @brief The cached entry for path, if the file hasn't changed since
+         */
+        const GameInfo *find(const std::string &path, std::uint64_t file_size, std::int64_t mtime) const;
+
+        void store(const GameInfo &info) { m_entries[info.path] = info; }
+
+        /**
+         * @brief Drop entries not in keep (deleted or moved images)
+         */
+        void retain(const std::vector<GameInfo> &keep);
+
+        /**
+         * @brief Write the cache back, through a temporary file renamed into place
+         *
+         * @throws std::runtime_error if it can't be written
+         */
+        void save() const;
+
+        std::size_t size() const { return m_entries.size(); }
+
+    private:
+        std::string m_path;
+        std::unordered_map<std::string, GameInfo> m_entries;
+    };
+
+    struct ScanStats {
+        std::size_t images = 0;             //< Candidate files found
+        std::size_t cached = 0;             //< Answered from the cache
+        std::size_t read = 0;               //< Headers actually read
+        std::size_t failed = 0;             //< Not GameCube images
+    };
+
+    /**
+     * @brief Find every .iso, .gcm and .fcb file under the given directories and describe it
+     *
+     * Directories are walked recursively, each one a job on a thread pool, and the
+     * images found are checked against the cache in chunks on the same pool. Only
+     * images that are new or changed have their headers read; the cache is updated
+     * with them (and forgets images that are gone) but not saved.
+     *
+     * @param threads Workers, 0 for one per hardware thread
+     * @return One entry per image, failures included, sorted by path
+     */
+    std::vector<GameInfo> scan(const std::vector<std::string> &roots, LibraryCache &cache, std::size_t threads = 0,
+                               ScanStats *stats = nullptr);
+
+} // namespace freecube::library
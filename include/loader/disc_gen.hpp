@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "dol/dol_gen.hpp"
+
+namespace freecube::ISOLoader {
+
+    /**
+     * @brief What a synthesized disc image looks like
+     *
+     * Directories form a tree `depth` levels deep with `fanout` subdirectories each, and
+     * files are dealt round-robin across every directory (the root included). File sizes
+     * are drawn uniformly from [min_file_size, max_file_size] with `seed`.
+     */
+    struct DiscSpec {
+        std::string game_id = "GSYE01";         //< 6 printable characters, 'G' or 'D' first
+        std::string title = "FreeCube synthetic disc";
+        std::uint32_t files = 1000;
+        std::uint32_t depth = 2;
+        std::uint32_t fanout = 4;
+        std::uint64_t min_file_size = 32;
+        std::uint64_t max_file_size = 64 * 1024;
+        std::uint32_t file_alignment = 4;       //< Power of two; retail discs use 4, streamed audio 32 KiB
+        std::uint64_t seed = 1;
+        bool zero_fill = false;                 //< Leave file data zero (written sparse) instead of a pattern
+        dol::DolLayout dol = dol::DolLayout::retail_like();
+    };
+
+    struct GeneratedFile {
+        std::string path;                       //< Full path, as FSTIndex::path() gives it
+        std::uint32_t offset;
+        std::uint32_t size;
+    };
+
+    struct GeneratedDisc {
+        std::uint64_t size = 0;                 //< Image size, a multiple of 32 KiB
+        std::uint32_t dol_offset = 0;
+        std::uint32_t dol_size = 0;
+        std::uint32_t fst_entries = 0;
+        std::uint32_t directories = 0;
+        std::vector<GeneratedFile> files;       //< In FST (and disc) order
+    };
+
+    /**
+     * @brief Byte `offset` of a generated disc's file data, unless it was zero filled
+     *
+     * Lets readers check what they got back without keeping the image around.
+     */
+    inline std::uint8_t disc_pattern(std::uint64_t offset, std::uint64_t seed) {
+        std::uint64_t x = (offset >> 3) * 0x9E3779B97F4A7C15ull + seed;
+        x ^= x >> 29;
+        return static_cast<std::uint8_t>(x >> (8 * (offset & 7)));
+    }
+
+    /**
+     * @brief Write a disc image that ISOImage opens and whose FST parses
+     *
+     * The layout (boot.bin, bi2.bin, DOL, FST, then file data in FST order) is worked out
+     * up front, then the image is streamed out in one pass, so only the FST and the DOL
+     * are ever held in memory however large the disc is.
+     *
+     * @throws std::invalid_argument if the spec is inconsistent or the disc would need
+     *         offsets past 4 GiB
+     * @throws std::runtime_error on I/O failure
+     */
+    GeneratedDisc generate_disc(const DiscSpec &spec, const std::string &out_path);
+
+} // namespace freecube::ISOLoader
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <future>
+#include <vector>
+
+#include "util/mapped_file.hpp"
+#include "util/thread_pool.hpp"
+
+namespace freecube::ISOLoader {
+
+    /**
+     * @brief FreeCube Block image (.fcb) layout
+     *
+     * All fields are little-endian, this is our own container and not a console format.
+     *
+     *   0x00  magic "FCBK"
+     *   0x04  u32 version
+     *   0x08  u32 block size (multiple of the 32 KiB disc sector)
+     *   0x0C  u32 block count
+     *   0x10  u64 uncompressed disc size
+     *   0x18  u64 reserved
+     *   0x20  block table, 16 bytes per block: u64 file offset, u32 stored size, u32 kind
+     *
+     * Block data follows the table. Zero-filled blocks are elided from the data entirely.
+     */
+    namespace fcb {
+        constexpr std::uint8_t MAGIC[4] = { 'F', 'C', 'B', 'K' };
+        constexpr std::uint32_t VERSION = 1;
+        constexpr std::uint32_t HEADER_SIZE = 0x20;
+        constexpr std::uint32_t TABLE_ENTRY_SIZE = 16;
+        constexpr std::uint32_t DEFAULT_BLOCK_SIZE = 0x20000;   // 128 KiB, 4 disc sectors
+
+        enum class BlockKind : std::uint32_t {
+            ZERO = 0,   //< All zero, nothing stored
+            RAW  = 1,   //< Stored uncompressed (didn't shrink)
+            LZ   = 2    //< util::lz stream
+        };
+
+        struct BlockEntry {
+            std::uint64_t offset;
+            std::uint32_t size;
+            BlockKind kind;
+        };
+    }
+
+    struct FCBOptions {
+        std::size_t cache_blocks = 256;     //< LRU capacity in decompressed blocks (32 MiB at the default block size)
+        std::size_t read_ahead = 4;         //< Blocks decompressed ahead of a sequential reader
+        std::size_t threads = 0;            //< Decompression workers, 0 for one per hardware thread
+    };
+
+    /**
+     * @brief Random-access reader for .fcb images
+     *
+     * Blocks are decompressed on demand into a bounded LRU cache. When reads walk the
+     * disc sequentially the next few blocks are decompressed ahead on the worker pool,
+     * so a streaming reader mostly hits blocks that are already waiting in the cache.
+     * Safe to read from several threads at once.
+     */
+    class FCBImage {
+    public:
+        /**
+         * @brief Check a file's magic without mapping it
+         */
+        static bool is_fcb(const std::string &path);
+
+        /**
+         * @throws std::runtime_error if the file can't be mapped or isn't a valid .fcb
+         */
+        explicit FCBImage(const std::string &path, const FCBOptions &options = {});
+        ~FCBImage();
+
+        FCBImage(const FCBImage &) = delete;
+        FCBImage &operator=(const FCBImage &) = delete;
+
+        std::uint64_t size() const noexcept { return m_disc_size; }
+        std::uint32_t block_size() const noexcept { return m_block_size; }
+        std::uint32_t block_count() const noexcept { return static_cast<std::uint32_t>(m_blocks.size()); }
+
+        /**
+         * @brief Copy uncompressed disc bytes
+         *
+         * @return Number of bytes copied, short when the range runs past the end of the disc
+         * @throws std::runtime_error if a block fails to decompress
+         */
+        std::size_t read(std::uint64_t offset, void *dst, std::size_t len) const;
+
+        struct CacheStats {
+            std::uint64_t hits;
+            std::uint64_t misses;
+            std::uint64_t prefetches;
+        };
+
+        CacheStats stats() const;
+
+    private:
+        using BlockPtr = std::shared_ptr<const std::vector<std::uint8_t>>;
+
+        struct CacheSlot {
+            BlockPtr data;
+            std::list<std::uint32_t>::iterator lru;
+        };
+
+        util::MappedFile m_file;
+        std::vector<fcb::BlockEntry> m_blocks;
+        std::uint64_t m_disc_size = 0;
+        std::uint32_t m_block_size = 0;
+        FCBOptions m_options;
+
+        mutable std::mutex m_lock;
+        mutable std::list<std::uint32_t> m_lru;     // front is most recently used
+        mutable std::unordered_map<std::uint32_t, CacheSlot> m_cache;
+        mutable std::unordered_map<std::uint32_t, std::shared_future<BlockPtr>> m_inflight;
+        mutable std::uint32_t m_last_block = 0xFFFFFFFFu;
+        mutable std::uint64_t m_prefetched = 0;     // furthest block read ahead so far
+        mutable CacheStats m_stats{};
+
+        // Declared last so it's torn down (and its jobs drained) before the cache
+        std::unique_ptr<util::ThreadPool> m_pool;
+
+        BlockPtr get_block(std::uint32_t block) const;
+        BlockPtr decode_block(std::uint32_t block) const;
+        void prefetch(std::uint32_t block) const;
+        void insert_locked(std::uint32_t block, BlockPtr data) const;
+    };
+
+    struct FCBConvertStats {
+        std::uint32_t blocks = 0;
+        std::uint32_t zero_blocks = 0;
+        std::uint32_t raw_blocks = 0;
+        std::uint64_t input_bytes = 0;
+        std::uint64_t output_bytes = 0;
+    };
+
+    /**
+     * @brief Convert a raw disc image to .fcb, compressing blocks on every core
+     *
+     * @param iso_path Raw image to read
+     * @param out_path Destination .fcb
+     * @param block_size Block size, must be a non-zero multiple of 32 KiB
+     * @param threads Compression workers, 0 for one per hardware thread
+     * @throws std::runtime_error on I/O failure or a bad block size
+     */
+    FCBConvertStats convert_to_fcb(const std::string &iso_path, const std::string &out_path,
+                                   std::uint32_t block_size = fcb::DEFAULT_BLOCK_SIZE, std::size_t threads = 0);
+
+} // namespace freecube::ISOLoader
@@ -0,0 +1,292 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "util/log.hpp"
+
+namespace freecube::ISOLoader {
+
+    /**
+     * @brief One parsed FST entry
+     *
+     * Directories keep their raw FST meaning: `next` is one past their last descendant,
+     * so [index + 1, next) is the directory's subtree.
+     */
+    struct FSTNode {
+        std::string_view name;
+        std::uint32_t parent;   //< Index of the enclosing directory (root is its own parent)
+        std::uint32_t offset;   //< Files: disc offset of the data
+        std::uint32_t size;     //< Files: size in bytes
+        std::uint32_t next;     //< Index of the first entry after this one's subtree
+        bool is_dir;
+    };
+
+    /**
+     * @brief File System Table parsed once into a lookup index
+     *
+     * Full paths hash straight to an entry, bare file names map to every entry that
+     * carries them, and directory children are walked by skipping whole subtrees so a
+     * listing only touches the directory's direct children.
+     */
+    class FSTIndex {
+    public:
+        static constexpr std::uint32_t NPOS = 0xFFFFFFFFu;
+
+        FSTIndex() = default;
+
+        // m_by_name keys into m_names' buffer and m_lookup into the strings in m_paths,
+        // a copy wouldn't share them. A move keeps both buffers where they are
+        FSTIndex(const FSTIndex &) = delete;
+        FSTIndex &operator=(const FSTIndex &) = delete;
+        FSTIndex(FSTIndex &&) noexcept = default;
+        FSTIndex &operator=(FSTIndex &&) noexcept = default;
+
+        /**
+         * @brief Parse a raw big-endian FST
+         *
+         * @param fst Pointer to the start of the FST (root entry)
+         * @param fst_size Size of the FST in bytes, as given by the disc header
+         * @return The index, or std::nullopt if the table is malformed
+         */
+        static std::optional<FSTIndex> parse(const std::uint8_t *fst, std::size_t fst_size) {
+            if (fst_size < 12) {
+                LOG_ERROR("FST too small for a root entry");
+                return std::nullopt;
+            }
+
+            // Root entry's file_size field -> number of entries
+            std::uint32_t entry_count = read_be32(fst + 8);
+
+            if (entry_count == 0 || static_cast<std::uint64_t>(entry_count) * 12 > fst_size) {
+                LOG_ERROR("FST entry count invalid or out of bounds");
+                return std::nullopt;
+            }
+
+            FSTIndex idx;
+
+            // Own a copy of the string table and make sure the last name is terminated
+            const char *strings = reinterpret_cast<const char *>(fst + entry_count * 12);
+            idx.m_names.assign(strings, strings + (fst_size - entry_count * 12));
+            idx.m_names.push_back('\0');
+
+            idx.m_nodes.resize(entry_count);
+            idx.m_paths.resize(entry_count);
+
+            // Pre-order walk, the stack holds the directories enclosing the current entry
+            std::vector<std::uint32_t> dirs;
+            dirs.push_back(0);
+
+            idx.m_nodes[0] = { std::string_view(), 0, 0, 0, entry_count, true };
+
+            for (std::uint32_t i = 1; i < entry_count; ++i) {
+                while (dirs.size() > 1 && i >= idx.m_nodes[dirs.back()].next)
+                    dirs.pop_back();
+
+                const std::uint8_t *p = fst + static_cast<std::size_t>(i) * 12;
+                std::uint32_t name_off_flags = read_be32(p + 0);
+                std::uint32_t off            = read_be32(p + 4);
+                std::uint32_t len            = read_be32(p + 8);
+
+                // flags in MSB, name offset in low 24 bits
+                bool is_dir = ((name_off_flags >> 24) & 1) != 0;
+                std::uint32_t name_off = name_off_flags & 0x00FFFFFFu;
+
+                if (name_off >= idx.m_names.size() - 1) {
+                    LOG_ERROR("FST entry ", i, " name outside string table");
+                    return std::nullopt;
+                }
+
+                const char *name = idx.m_names.data() + name_off;
+                std::uint32_t parent = dirs.back();
+
+                FSTNode &node = idx.m_nodes[i];
+                node.name   = std::string_view(name, std::strlen(name));
+                node.parent = parent;
+                node.is_dir = is_dir;
+
+                if (is_dir) {
+                    // A directory's subtree can't escape the one enclosing it
+                    if (len <= i || len > idx.m_nodes[parent].next) {
+                        LOG_ERROR("FST directory ", i, " has an invalid end index");
+                        return std::nullopt;
+                    }
+                    node.offset = 0;
+                    node.size   = 0;
+                    node.next   = len;
+                    dirs.push_back(i);
+                } else {
+                    node.offset = off;
+                    node.size   = len;
+                    node.next   = i + 1;
+                }
+
+                if (parent == 0)
+                    idx.m_paths[i] = std::string(node.name);
+                else
+                    idx.m_paths[i] = idx.m_paths[parent] + "/" + std::string(node.name);
+
+                idx.m_by_name.emplace(node.name, i);
+            }
+
+            // Only now, m_paths doesn't change from here on
+            idx.m_lookup.reserve(entry_count);
+            for (std::uint32_t i = 1; i < entry_count; ++i)
+                idx.m_lookup.emplace(idx.m_paths[i], i);
+
+            return idx;
+        }
+
+        std::size_t size() const noexcept { return m_nodes.size(); }
+        bool empty() const noexcept { return m_nodes.empty(); }
+
+        const FSTNode &node(std::uint32_t i) const { return m_nodes.at(i); }
+
+        /**
+         * @brief Full path of an entry, without a leading slash ("audio/bgm.adp")
+         */
+        const std::string &path(std::uint32_t i) const { return m_paths.at(i); }
+
+        /**
+         * @brief Look up a file by path
+         *
+         * Accepts the same forms as ISOImage::extract_file: a full path is a single hash
+         * lookup, a partial path ("main.dol", "sys/main.dol") matches the first file whose
+         * path ends with the given components.
+         *
+         * @return Entry index or NPOS
+         */
+        std::uint32_t find_file(std::string_view path) const {
+            while (!path.empty() && path.front() == '/')
+                path.remove_prefix(1);
+
+            if (path.empty())
+                return NPOS;
+
+            auto it = m_lookup.find(path);
+            if (it != m_lookup.end() && !m_nodes[it->second].is_dir)
+                return it->second;
+
+            auto slash = path.rfind('/');
+            std::string_view base = slash == std::string_view::npos ? path : path.substr(slash + 1);
+
+            std::uint32_t best = NPOS;
+            auto range = m_by_name.equal_range(base);
+            for (auto c = range.first; c != range.second; ++c) {
+                std::uint32_t i = c->second;
+                if (m_nodes[i].is_dir || i >= best)
+                    continue;
+
+                if (ends_with_components(i, path))
+                    best = i;
+            }
+
+            return best;
+        }
+
+        /**
+         * @brief Look up a directory by full path, "" or "/" being the root
+         *
+         * @return Entry index or NPOS
+         */
+        std::uint32_t find_dir(std::string_view path) const {
+            while (!path.empty() && path.front() == '/')
+                path.remove_prefix(1);
+            while (!path.empty() && path.back() == '/')
+                path.remove_suffix(1);
+
+            if (m_nodes.empty())
+                return NPOS;
+            if (path.empty())
+                return 0;
+
+            auto it = m_lookup.find(path);
+            if (it == m_lookup.end() || !m_nodes[it->second].is_dir)
+                return NPOS;
+            return it->second;
+        }
+
+        /**
+         * @brief Iterable over the direct children of a directory
+         *
+         * Subdirectories are stepped over using their end index, so iterating costs
+         * one step per direct child.
+         */
+        class Children {
+        public:
+            class iterator {
+            public:
+                iterator(const std::vector<FSTNode> *nodes, std::uint32_t i) : m_nodes(nodes), m_i(i) {}
+
+                std::uint32_t operator*() const { return m_i; }
+                iterator &operator++() { m_i = (*m_nodes)[m_i].next; return *this; }
+                bool operator!=(const iterator &o) const { return m_i != o.m_i; }
+                bool operator==(const iterator &o) const { return m_i == o.m_i; }
+
+            private:
+                const std::vector<FSTNode> *m_nodes;
+                std::uint32_t m_i;
+            };
+
+            Children(const std::vector<FSTNode> *nodes, std::uint32_t first, std::uint32_t last)
+                : m_nodes(nodes), m_first(first), m_last(last) {}
+
+            iterator begin() const { return iterator(m_nodes, m_first); }
+            iterator end() const { return iterator(m_nodes, m_last); }
+
+        private:
+            const std::vector<FSTNode> *m_nodes;
+            std::uint32_t m_first;
+            std::uint32_t m_last;
+        };
+
+        /**
+         * @throws std::out_of_range if dir isn't a directory entry
+         */
+        Children children(std::uint32_t dir) const {
+            const FSTNode &d = m_nodes.at(dir);
+            if (!d.is_dir)
+                throw std::out_of_range("FSTIndex: not a directory");
+            return Children(&m_nodes, dir + 1, d.next);
+        }
+
+    private:
+        std::vector<FSTNode> m_nodes;
+        std::vector<std::string> m_paths;
+        std::vector<char> m_names;
+
+        std::unordered_map<std::string_view, std::uint32_t> m_lookup;
+        std::unordered_multimap<std::string_view, std::uint32_t> m_by_name;
+
+        static std::uint32_t read_be32(const std::uint8_t *p) {
+            return (static_cast<std::uint32_t>(p[0]) << 24) |
+                   (static_cast<std::uint32_t>(p[1]) << 16) |
+                   (static_cast<std::uint32_t>(p[2]) << 8)  |
+                    static_cast<std::uint32_t>(p[3]);
+        }
+
+        // Walk parent links from i, matching `path` one component at a time from the back
+        bool ends_with_components(std::uint32_t i, std::string_view path) const {
+            while (!path.empty()) {
+                auto slash = path.rfind('/');
+                std::string_view comp = slash == std::string_view::npos ? path : path.substr(slash + 1);
+
+                if (i == 0 || m_nodes[i].name != comp)
+                    return false;
+
+                if (slash == std::string_view::npos)
+                    return true;
+
+                path = path.substr(0, slash);
+                i = m_nodes[i].parent;
+            }
+            return true;
+        }
+    };
+
+} // namespace freecube::ISOLoader
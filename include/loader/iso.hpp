@@ -5,27 +5,115 @@
 #include <string>
 #include <fstream>
 #include <optional>
+#include <memory>
+#include <utility>
 #include <stdexcept>
 #include <algorithm>
 #include <cstdio>
+#include <cstring>
 
 #include "util/log.hpp"
+#include "util/profile.hpp"
+#include "util/span.hpp"
+#include "util/mapped_file.hpp"
+#include "loader/fst.hpp"
+#include "loader/fcb.hpp"
 
 namespace freecube::ISOLoader {
 
+    /**
+     * @brief How the disc bytes are held in host memory
+     */
+    enum class StorageMode {
+        MAPPED,     //< Read-only shared mapping, pages faulted in on demand
+        BUFFERED,   //< Whole image read into a private heap buffer
+        COMPRESSED  //< .fcb block image, picked automatically from the file's magic
+    };
+
+    class ISOImage;
+
+    /**
+     * @brief Handle to one file on the disc
+     *
+     * Cheap to copy, it's just the file's extent on the disc. Reads copy only the bytes
+     * asked for, and span() gives a zero-copy view straight into the image's storage.
+     *
+     * @note The handle borrows the ISOImage it came from; it must not outlive it, and the
+     *       image must not be moved while handles are in use.
+     */
+    class ISOFile {
+    public:
+        std::uint32_t index() const noexcept { return m_index; }
+        std::uint32_t disc_offset() const noexcept { return m_offset; }
+        std::uint32_t size() const noexcept { return m_size; }
+
+        /**
+         * @brief Copy up to len bytes starting at offset into dst
+         *
+         * @return Number of bytes copied, short (or 0) when the range runs past EOF
+         */
+        std::size_t read_at(std::uint64_t offset, void *dst, std::size_t len) const;
+
+        /**
+         * @brief Zero-copy view of [offset, offset + len), clamped to the end of the file
+         *
+         * Empty when the image has no flat view (compressed images), use read_at() there.
+         */
+        util::ByteSpan span(std::uint64_t offset, std::size_t len) const;
+
+        /**
+         * @brief Zero-copy view of the whole file
+         */
+        util::ByteSpan span() const { return span(0, m_size); }
+
+    private:
+        friend class ISOImage;
+
+        ISOFile(const ISOImage *image, std::uint32_t index, std::uint32_t offset, std::uint32_t size)
+            : m_image(image), m_index(index), m_offset(offset), m_size(size) {}
+
+        const ISOImage *m_image;
+        std::uint32_t m_index;
+        std::uint32_t m_offset;
+        std::uint32_t m_size;
+
+        // Clamp a file-relative range to the file, returns the usable length
+        std::size_t clamp(std::uint64_t offset, std::size_t len) const noexcept {
+            if (offset >= m_size)
+                return 0;
+            return static_cast<std::size_t>(std::min<std::uint64_t>(len, m_size - offset));
+        }
+    };
+
     class ISOImage {
     public:
-        explicit ISOImage(const std::string &path) {
-            load_file(path);
+        explicit ISOImage(const std::string &path, StorageMode mode = StorageMode::MAPPED) {
+            load_file(path, mode);
             validate();
+            build_fst_index();
         }
 
-        const std::vector<std::uint8_t>& data() const noexcept {
-            return m_data;
+        // m_bytes points into our own storage, a copy would dangle
+        ISOImage(const ISOImage &) = delete;
+        ISOImage &operator=(const ISOImage &) = delete;
+        ISOImage(ISOImage &&) noexcept = default;
+        ISOImage &operator=(ISOImage &&) noexcept = default;
+
+        /**
+         * @brief Read-only view over the whole disc, valid for the lifetime of the image
+         *
+         * Compressed images have no flat view and return an empty span; read() works on every backend.
+         */
+        util::ByteSpan data() const noexcept {
+            return m_bytes ? util::ByteSpan(m_bytes, m_size) : util::ByteSpan();
         }
 
         std::size_t size() const noexcept {
-            return m_data.size();
+            return m_size;
+        }
+
+        StorageMode storage_mode() const noexcept {
+            return m_mode;
         }
 
         /**
@@ -37,248 +125,175 @@ namespace freecube::ISOLoader {
          *  - "/sys/main.dol"
          *
          * NOTE: GameCube FST stores only final name components in entries;
-         *       we reconstruct parent directories by walking enclosing directory entries.
+         *       the FST index resolves full paths once at load, so this is a hash lookup.
          */
         std::optional<std::vector<std::uint8_t>>
         extract_file(const std::string& path) const
         {
-            // Put per-file dump under a very verbose gate, that being debug/trace only
-            if(util::LogCFG::min_level < util::LogLevel::FC_DEBUG) {
-                dump_fst_header();
-                dump_fst();
-            }
-
-            LOG_TRACE("Extracting file: ", path);
+            PROFILE_ZONE("ISOImage::extract_file");
 
-            if (m_data.size() < 0x430) {
-                LOG_ERROR("ISO too small for FST");
+            auto file = open(path);
+            if (!file)
                 return std::nullopt;
-            }
 
-            // Normalise requested path: remove leading slash
-            std::string clean = path;
-            if (!clean.empty() && clean.front() == '/')
-                clean.erase(0,1);
-
-            // Split by '/'
-            std::vector<std::string> comps;
-            {
-                std::size_t pos = 0;
-                while (pos < clean.size()) {
-                    auto nxt = clean.find('/', pos);
-                    if (nxt == std::string::npos) {
-                        comps.emplace_back(clean.substr(pos));
-                        break;
-                    } else {
-                        comps.emplace_back(clean.substr(pos, nxt - pos));
-                        pos = nxt + 1;
-                    }
-                }
-            }
+            std::vector<std::uint8_t> out(file->size());
+            file->read_at(0, out.data(), out.size());
+            return out;
+        }
+
+        /**
+         * @brief Open a file on the disc without reading it
+         *
+         * Accepts the same path forms as extract_file().
+         *
+         * @return A handle to the file, or std::nullopt if it doesn't exist or lies outside the image
+         */
+        std::optional<ISOFile> open(const std::string &path) const {
+            LOG_TRACE("Opening file: ", path);
 
-            if (comps.empty()) {
-                LOG_WARN("Empty filename requested.");
+            if (m_fst.empty()) {
+                LOG_ERROR("No usable FST on this disc");
                 return std::nullopt;
             }
 
-            const std::string target_name = comps.back();
-
-            // Header offsets (big-endian)
-            uint32_t fst_offset = read_be32(m_data.data() + 0x424);
-            uint32_t fst_size   = read_be32(m_data.data() + 0x428);
-
-            LOG_DEBUG("FST offset: ", fst_offset);
-            LOG_DEBUG("FST size: ", fst_size);
-
-            if (fst_offset + fst_size > m_data.size()) {
-                LOG_ERROR("FST outside ISO bounds");
+            std::uint32_t idx = m_fst.find_file(path);
+            if (idx == FSTIndex::NPOS) {
+                LOG_WARN("File not found: ", path);
                 return std::nullopt;
             }
 
-            const uint8_t* entries_base = m_data.data() + fst_offset;
+            const FSTNode &node = m_fst.node(idx);
 
-            // Read root entry's file_size field (big-endian) -> number of entries
-            uint32_t entry_count = read_be32(entries_base + 8);
+            LOG_DEBUG("Found file ", node.name, " offset=", node.offset, " size=", node.size);
 
-            LOG_DEBUG("FST entry count: ", entry_count);
-
-            // Sanity check
-            if (entry_count == 0 || static_cast<uint64_t>(entry_count) * 12 > fst_size) {
-                LOG_ERROR("FST entry count invalid or out of bounds");
+            if (static_cast<uint64_t>(node.offset) + node.size > m_size) {
+                LOG_ERROR("File exceeds ISO bounds");
                 return std::nullopt;
             }
 
-            // string table begins after entry_count * 12 bytes
-            const char* string_table = reinterpret_cast<const char*>(entries_base + entry_count * 12);
-
-            // Helper to read an entry (name+flags, offset, size) in BE form
-            auto read_entry = [&](uint32_t idx) -> std::tuple<uint32_t,uint32_t,uint32_t> {
-                const uint8_t* p = entries_base + static_cast<size_t>(idx) * 12;
-                uint32_t name_off_flags = read_be32(p + 0);
-                uint32_t off            = read_be32(p + 4);
-                uint32_t len            = read_be32(p + 8);
-                return { name_off_flags, off, len };
-            };
-
-            // Helper: reconstruct path components for a given entry index by walking parent directories
-            auto build_entry_path = [&](uint32_t idx)->std::vector<std::string> {
-                std::vector<std::string> parts;
-
-                auto [nf_be, off, len] = read_entry(idx);
-                // correct decode: flags in MSB, name offset in low 24 bits
-                uint8_t flags = static_cast<uint8_t>((nf_be >> 24) & 0xFF);
-                uint32_t name_off = nf_be & 0x00FFFFFFu;
-                const char* name = string_table + name_off;
-                parts.emplace_back(name);
-
-                // Walk backward to find directories that enclose idx
-                for (int32_t j = static_cast<int32_t>(idx) - 1; j >= 0; --j) {
-                    auto [nfj_be, off_j, len_j] = read_entry(static_cast<uint32_t>(j));
-                    uint8_t flagsj = static_cast<uint8_t>((nfj_be >> 24) & 0xFF);
-                    if ((flagsj & 1) == 0)
-                        continue; // not a directory
-
-                    uint32_t dir_end = len_j; // for directories, file_size stores last index
-                    if (dir_end > idx) {
-                        uint32_t name_off_j = nfj_be & 0x00FFFFFFu;
-                        const char* name_j = string_table + name_off_j;
-                        parts.emplace_back(name_j);
-                    }
-                }
-
-                std::reverse(parts.begin(), parts.end());
-                return parts;
-            };
-
-            // Walk entries and find candidate files named target_name
-            for (uint32_t i = 0; i < entry_count; ++i) {
-                auto [nf_be, off, len] = read_entry(i);
-
-                // decode correctly: MSB = flags/type, low 24 bits = name offset
-                uint8_t flags = static_cast<uint8_t>((nf_be >> 24) & 0xFF);
-                uint32_t name_off = nf_be & 0x00FFFFFFu;
-                bool is_dir = (flags & 1) != 0;
-                const char* name = string_table + name_off;
-
-                // only care about files
-                if (is_dir)
-                    continue;
-
-                if (target_name != name)
-                    continue;
-
-                // If user requested a path with parents, validate parent chain
-                if (comps.size() > 1) {
-                    auto entry_parts = build_entry_path(i);
-
-                    if (entry_parts.size() < comps.size())
-                        continue;
-
-                    bool ok = true;
-                    size_t offset_idx = entry_parts.size() - comps.size();
-                    for (size_t k = 0; k < comps.size(); ++k) {
-                        if (entry_parts[offset_idx + k] != comps[k]) {
-                            ok = false;
-                            break;
-                        }
-                    }
-                    if (!ok) continue;
-                }
+            return ISOFile(this, idx, node.offset, node.size);
+        }
 
-                uint32_t file_off = off;
-                uint32_t file_sz  = len;
+        /**
+         * @brief Copy raw disc bytes, the way the DVD interface addresses the disc
+         *
+         * @return Number of bytes copied, short (or 0) when the range runs past the end of the disc
+         */
+        std::size_t read(std::uint64_t offset, void *dst, std::size_t len) const {
+            if (offset >= m_size)
+                return 0;
 
-                LOG_INFO("Found file ", name, " offset=", file_off, " size=", file_sz);
+            if (m_fcb)
+                return m_fcb->read(offset, dst, len);
 
-                if (static_cast<uint64_t>(file_off) + file_sz > m_data.size()) {
-                    LOG_ERROR("File exceeds ISO bounds");
-                    return std::nullopt;
-                }
+            std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(len, m_size - offset));
+            std::memcpy(dst, m_bytes + offset, n);
+            return n;
+        }
 
-                return std::vector<std::uint8_t>(
-                    m_data.begin() + file_off,
-                    m_data.begin() + file_off + file_sz
-                );
+        /**
+         * @brief Warm [offset, offset + len) so a later read() doesn't stall on host I/O
+         *
+         * Mapped images hand the range to the OS readahead, compressed images decompress the
+         * blocks into their cache. Blocks the caller, so run it off the emulation thread.
+         */
+        void prefetch(std::uint64_t offset, std::size_t len) const {
+            if (offset >= m_size)
+                return;
+            len = static_cast<std::size_t>(std::min<std::uint64_t>(len, m_size - offset));
+
+            if (m_mode == StorageMode::MAPPED) {
+                m_mapping.prefetch(static_cast<std::size_t>(offset), len);
+            } else if (m_fcb) {
+                thread_local std::vector<std::uint8_t> scratch;
+                scratch.resize(len);
+                m_fcb->read(offset, scratch.data(), len);
             }
-
-            LOG_WARN("File not found: ", path);
-            return std::nullopt;
         }
 
-        void dump_fst() const {
-            LOG_INFO("---- BEGIN FST DUMP ----");
-
-            uint32_t fst_offset = read_be32(m_data.data() + 0x424);
-            uint32_t fst_size   = read_be32(m_data.data() + 0x428);
-
-            const uint8_t* entries_base = m_data.data() + fst_offset;
-
-            uint32_t entry_count = read_be32(entries_base + 8);
+        /**
+         * @brief Parsed FST of this disc, empty if the disc has no usable FST
+         */
+        const FSTIndex &fst() const noexcept {
+            return m_fst;
+        }
 
-            const char* string_table = reinterpret_cast<const char*>(entries_base + entry_count * 12);
+        /**
+         * @brief Entry indices of the direct children of a directory
+         *
+         * @param path Directory path, "" or "/" for the root
+         * @return std::nullopt if there's no such directory
+         */
+        std::optional<std::vector<std::uint32_t>> list_dir(const std::string &path) const {
+            std::uint32_t dir = m_fst.find_dir(path);
+            if (dir == FSTIndex::NPOS)
+                return std::nullopt;
 
-            for (uint32_t i = 0; i < entry_count; ++i) {
+            std::vector<std::uint32_t> out;
+            for (std::uint32_t child : m_fst.children(dir))
+                out.push_back(child);
+            return out;
+        }
 
-                uint32_t nf_be   = read_be32(entries_base + static_cast<size_t>(i) * 12 + 0);
-                uint32_t off_be  = read_be32(entries_base + static_cast<size_t>(i) * 12 + 4);
-                uint32_t size_be = read_be32(entries_base + static_cast<size_t>(i) * 12 + 8);
+        void dump_fst() const {
+            LOG_INFO("---- BEGIN FST DUMP ----");
 
-                // decode correctly
-                uint8_t flags    = static_cast<uint8_t>((nf_be >> 24) & 0xFF);
-                uint32_t name_off = nf_be & 0x00FFFFFFu;
-                const char* name = string_table + name_off;
+            for (std::uint32_t i = 1; i < m_fst.size(); ++i) {
+                const FSTNode &node = m_fst.node(i);
 
-                if (flags & 1) {
-                    LOG_TRACE("[DIR ] ", name,
+                if (node.is_dir) {
+                    LOG_TRACE("[DIR ] ", m_fst.path(i),
                              " first=", i,
-                             " last=", size_be);
+                             " last=", node.next);
                 } else {
-                    LOG_TRACE("[FILE] ", name,
-                             " offset=0x", std::hex, off_be,
-                             " size=0x", size_be, std::dec);
+                    LOG_TRACE("[FILE] ", m_fst.path(i),
+                             " offset=0x", std::hex, node.offset,
+                             " size=0x", node.size, std::dec);
                 }
             }
         
             LOG_INFO("---- END FST DUMP ----");
         }
 
+        /**
+         * @brief Copy of the boot DOL, exactly as large as its header says
+         *
+         * @throws std::runtime_error if the disc header or DOL header is out of bounds
+         */
         std::vector<uint8_t> get_dol() const {
-            if (m_data.size() < 0x424) {
-                throw std::runtime_error("ISO too small to contain DOL offset");
-            }
-
-            // Read DOL offset from disc header at 0x420
-            uint32_t dol_offset = read_be32(m_data.data() + 0x420);
-
-            LOG_INFO("DOL offset from header: ", dol_offset);
+            auto [dol_offset, dol_size] = locate_dol();
 
-            // DOL header is 0x100 bytes, read it first to get total size
-            if (dol_offset + 0x100 > m_data.size()) {
-                throw std::runtime_error("DOL offset out of bounds");
-            }
-
-            // For now, just return the first ~4MB or calculate actual size from DOL header
-            uint32_t dol_size = 0x400000; // 4MB should be enough for most DOLs
+            std::vector<uint8_t> dol(dol_size);
+            read(dol_offset, dol.data(), dol.size());
+            return dol;
+        }
 
-            if (dol_offset + dol_size > m_data.size()) {
-                dol_size = m_data.size() - dol_offset;
-            }
+        /**
+         * @brief Zero-copy view of the boot DOL
+         *
+         * Empty for compressed images, which have no flat view; use get_dol() there.
+         *
+         * @throws std::runtime_error if the disc header or DOL header is out of bounds
+         */
+        util::ByteSpan dol_span() const {
+            if (!m_bytes)
+                return util::ByteSpan();
 
-            return std::vector<uint8_t>(
-                m_data.begin() + dol_offset,
-                m_data.begin() + dol_offset + dol_size
-            );
+            auto [dol_offset, dol_size] = locate_dol();
+            return data().subspan(dol_offset, dol_size);
         }
 
     private:
-        std::vector<std::uint8_t> m_data;
+        StorageMode m_mode = StorageMode::MAPPED;
+        util::MappedFile m_mapping;
+        std::vector<std::uint8_t> m_buffer;
+        std::unique_ptr<FCBImage> m_fcb;
 
-        // We read raw bytes to avoid endian/UB issues.
-        struct FSTEntry {
-            std::uint32_t name_offset_flags;
-            std::uint32_t file_offset;
-            std::uint32_t file_size;
-        };
+        // Whichever flat storage is active, nullptr for compressed images
+        const std::uint8_t *m_bytes = nullptr;
+        std::size_t m_size = 0;
+
+        FSTIndex m_fst;
 
         static std::uint32_t read_be32(const std::uint8_t* p) {
             return (static_cast<std::uint32_t>(p[0]) << 24) |
@@ -287,7 +302,48 @@ namespace freecube::ISOLoader {
                     static_cast<std::uint32_t>(p[3]);
         }
 
-        void load_file(const std::string &path) {
+        // Big-endian word at a disc offset, through whichever backend is active
+        std::uint32_t disc_be32(std::uint64_t offset) const {
+            std::uint8_t buf[4] = {};
+            read(offset, buf, sizeof(buf));
+            return read_be32(buf);
+        }
+
+        void load_file(const std::string &path, StorageMode mode) {
+            PROFILE_ZONE("ISOImage::load_file");
+
+            if (FCBImage::is_fcb(path)) {
+                try {
+                    m_fcb = std::make_unique<FCBImage>(path);
+                } catch (const std::exception &e) {
+                    LOG_ERROR("ISO image not loaded!");
+                    throw std::runtime_error(std::string("ISOImage: ") + e.what());
+                }
+
+                m_mode = StorageMode::COMPRESSED;
+                m_size = static_cast<std::size_t>(m_fcb->size());
+
+                LOG_TRACE("FCB image opened OK.");
+                return;
+            }
+
+            m_mode = mode;
+
+            if (mode == StorageMode::MAPPED) {
+                try {
+                    m_mapping = util::MappedFile(path);
+                } catch (const std::exception &e) {
+                    LOG_ERROR("ISO image not loaded!");
+                    throw std::runtime_error(std::string("ISOImage: ") + e.what());
+                }
+
+                m_bytes = m_mapping.data();
+                m_size = m_mapping.size();
+
+                LOG_TRACE("ISO mapped OK.");
+                return;
+            }
+
             std::ifstream f(path, std::ios::binary | std::ios::ate);
             if (!f) {
                 LOG_ERROR("ISO image not loaded!");
@@ -300,23 +356,28 @@ namespace freecube::ISOLoader {
                 throw std::runtime_error("ISOImage: File is empty: " + path);
             }
 
-            m_data.resize(static_cast<std::size_t>(sz));
+            m_buffer.resize(static_cast<std::size_t>(sz));
             f.seekg(0, std::ios::beg);
 
-            if (!f.read(reinterpret_cast<char*>(m_data.data()), sz)) {
+            if (!f.read(reinterpret_cast<char*>(m_buffer.data()), sz)) {
                 LOG_ERROR("Failed to read ISO image!");
                 throw std::runtime_error("ISOImage: failed to read file: " + path);
             }
 
+            m_bytes = m_buffer.data();
+            m_size = m_buffer.size();
+
             LOG_TRACE("ISO loaded OK.");
         }
 
         void validate() {
+            PROFILE_ZONE("ISOImage::validate");
+
             LOG_TRACE("Validating ISO image...");
 
             constexpr std::size_t sector = 0x8000;
 
-            if (m_data.size() % sector != 0) {
+            if (m_size % sector != 0) {
                 LOG_ERROR("ISO is not a valid size!");
                 throw std::runtime_error("ISOImage: invalid size (not a multiple of 32kb)");
             }
@@ -326,24 +387,27 @@ namespace freecube::ISOLoader {
             // We just check that it's ASCII printable characters
             // If not, **then** we panic.
 
-            if (m_data.size() < 0x20) {
+            if (m_size < 0x20) {
                 LOG_ERROR("Too small for boot.bin validation");
                 throw std::runtime_error("ISOImage: too small for boot.bin validation");
             }
         
             // Read the game ID (first 6 bytes)
-            std::string game_id(reinterpret_cast<const char*>(m_data.data()), 6);
+            std::uint8_t id[6] = {};
+            read(0, id, sizeof(id));
+
+            std::string game_id(reinterpret_cast<const char*>(id), 6);
             LOG_INFO("Game ID: ", game_id);
 
             // Check if it starts with 'G' (GameCube ROM) or 'D' (Demofile(?))
-            if (m_data[0] != 'G' && m_data[0] != 'D') {
-                LOG_ERROR("Invalid GameCube disc ID! Expected 'G' or 'D', got: ", (char)m_data[0]);
+            if (id[0] != 'G' && id[0] != 'D') {
+                LOG_ERROR("Invalid GameCube disc ID! Expected 'G' or 'D', got: ", (char)id[0]);
                 throw std::runtime_error("ISOImage: invalid boot.bin magic");
             }
 
             // Verify all 6 bytes are printable ASCII
             for (std::size_t i = 0; i < 6; ++i) {
-                if (m_data[i] < 0x20 || m_data[i] > 0x7E) {
+                if (id[i] < 0x20 || id[i] > 0x7E) {
                     LOG_ERROR("Invalid character in game ID at position ", i);
                     throw std::runtime_error("ISOImage: invalid game ID");
                 }
@@ -352,20 +416,103 @@ namespace freecube::ISOLoader {
             LOG_TRACE("ISO validation OK.");
         }
 
+        // A broken FST isn't fatal here, the DOL can still boot without it
+        void build_fst_index() {
+            PROFILE_ZONE("ISOImage::build_fst_index");
+
+            if (m_size < 0x430) {
+                LOG_ERROR("ISO too small for FST");
+                return;
+            }
+
+            uint32_t fst_offset = disc_be32(0x424);
+            uint32_t fst_size   = disc_be32(0x428);
+
+            LOG_DEBUG("FST offset: ", fst_offset);
+            LOG_DEBUG("FST size: ", fst_size);
+
+            if (static_cast<uint64_t>(fst_offset) + fst_size > m_size) {
+                LOG_ERROR("FST outside ISO bounds");
+                return;
+            }
+
+            // Flat images parse in place, compressed ones need the table read out first
+            std::vector<std::uint8_t> scratch;
+            const std::uint8_t *fst = m_bytes ? m_bytes + fst_offset : nullptr;
+            if (!fst) {
+                scratch.resize(fst_size);
+                read(fst_offset, scratch.data(), scratch.size());
+                fst = scratch.data();
+            }
+
+            auto index = FSTIndex::parse(fst, fst_size);
+            if (!index)
+                return;
+
+            m_fst = std::move(*index);
+            LOG_DEBUG("FST entry count: ", m_fst.size());
+
+            // Dump under a very verbose gate, that being trace only
+            if (util::Logger::enabled<util::LogLevel::FC_TRACE>()) {
+                dump_fst_header();
+                dump_fst();
+            }
+        }
+
+        // Disc offset and real size of the boot DOL, the size being the end of its furthest section
+        std::pair<std::uint32_t, std::uint32_t> locate_dol() const {
+            if (m_size < 0x424) {
+                throw std::runtime_error("ISO too small to contain DOL offset");
+            }
+
+            // Read DOL offset from disc header at 0x420
+            uint32_t dol_offset = disc_be32(0x420);
+
+            LOG_INFO("DOL offset from header: ", dol_offset);
+
+            // DOL header is 0x100 bytes
+            if (static_cast<uint64_t>(dol_offset) + 0x100 > m_size) {
+                throw std::runtime_error("DOL offset out of bounds");
+            }
+
+            std::uint8_t header[0x100];
+            read(dol_offset, header, sizeof(header));
+
+            // 7 text + 11 data sections, offsets at 0x00 and sizes at 0x90 are contiguous
+            uint64_t dol_size = 0x100;
+            for (std::size_t i = 0; i < 18; ++i) {
+                uint32_t off = read_be32(header + 0x00 + i * 4);
+                uint32_t len = read_be32(header + 0x90 + i * 4);
+                if (off != 0 && len != 0)
+                    dol_size = std::max<uint64_t>(dol_size, static_cast<uint64_t>(off) + len);
+            }
+
+            if (dol_offset + dol_size > m_size) {
+                LOG_WARN("DOL sections run past the end of the disc, truncating");
+                dol_size = m_size - dol_offset;
+            }
+
+            LOG_DEBUG("DOL size from header: ", static_cast<uint32_t>(dol_size));
+            return { dol_offset, static_cast<uint32_t>(dol_size) };
+        }
+
         void dump_bytes(const char* label, uint32_t offset, uint32_t count) const {
             LOG_INFO(label, " @ 0x", std::hex, offset, std::dec);
+            std::vector<std::uint8_t> bytes(count);
+            read(offset, bytes.data(), bytes.size());
+
             std::string line;
             for (uint32_t i = 0; i < count; i++) {
                 char buf[4];
-                snprintf(buf, sizeof(buf), "%02X ", m_data[offset + i]);
+                snprintf(buf, sizeof(buf), "%02X ", bytes[i]);
                 line += buf;
             }
             LOG_INFO(line);
         }
 
         void dump_fst_header() const {
-            uint32_t fst_offset = read_be32(m_data.data() + 0x424);
-            uint32_t fst_size   = read_be32(m_data.data() + 0x428);
+            uint32_t fst_offset = disc_be32(0x424);
+            uint32_t fst_size   = disc_be32(0x428);
         
             LOG_INFO("fst_offset = 0x", std::hex, fst_offset, "  fst_size = 0x", fst_size, std::dec);
         
@@ -374,4 +521,18 @@ namespace freecube::ISOLoader {
         }
     };
 
+    inline std::size_t ISOFile::read_at(std::uint64_t offset, void *dst, std::size_t len) const {
+        std::size_t n = clamp(offset, len);
+        if (n == 0)
+            return 0;
+        return m_image->read(m_offset + offset, dst, n);
+    }
+
+    inline util::ByteSpan ISOFile::span(std::uint64_t offset, std::size_t len) const {
+        std::size_t n = clamp(offset, len);
+        if (n == 0 || m_image->data().empty())
+            return util::ByteSpan();
+        return m_image->data().subspan(m_offset + static_cast<std::size_t>(offset), n);
+    }
+
 } // namespace freecube::ISOLoader
@@ -2,4 +2,5 @@
 
 #pragma once
 
-#include "iso.hpp"
\ No newline at end of file
+#include "iso.hpp"
+#include "fcb.hpp"
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "loader/iso.hpp"
+#include "util/hash.hpp"
+
+namespace freecube::ISOLoader {
+
+    /**
+     * @brief Whole-image digests, as dump databases list them
+     */
+    struct DiscDigests {
+        std::uint32_t crc32 = 0;
+        util::Md5::Digest md5{};
+        util::Sha1::Digest sha1{};
+    };
+
+    /**
+     * @brief CRC-32, MD5 and SHA-1 of the whole disc in one pass
+     *
+     * The image is walked in 32 MiB windows. In each one MD5 and SHA-1 run on their own
+     * threads, they can't be split, while the CRC is cut into pieces for the remaining
+     * threads and stitched back together with Crc32::combine(). The next window is read
+     * (or faulted in) while the current one hashes. Compressed images hash their
+     * decompressed contents, so they match the original dump.
+     *
+     * @param threads Hashing threads, 0 for one per hardware thread; at least 2 are used
+     */
+    DiscDigests hash_image(const ISOImage &iso, std::size_t threads = 0);
+
+    /**
+     * @brief Compare a digest given as hex against the matching one in digests
+     *
+     * The kind is picked by length: 8 digits for CRC-32, 32 for MD5, 40 for SHA-1.
+     * Case doesn't matter.
+     *
+     * @throws std::runtime_error if expected isn't one of those
+     */
+    bool digest_matches(const DiscDigests &digests, const std::string &expected);
+
+} // namespace freecube::ISOLoader
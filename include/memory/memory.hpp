@@ -0,0 +1,322 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "util/endian.hpp"
+
+#if !defined(_WIN32) && !defined(_WIN64)
+    #include <csetjmp>
+    #define FREECUBE_FASTMEM 1
+#else
+    #define FREECUBE_FASTMEM 0
+#endif
+
+namespace freecube::memory {
+
+    constexpr std::uint32_t MEM1_SIZE      = 0x01800000;    //< 24 MiB main RAM
+    constexpr std::uint32_t ARAM_SIZE      = 0x01000000;    //< 16 MiB auxiliary (DSP) RAM
+    constexpr std::uint32_t CACHED_BASE    = 0x80000000;    //< Cached view of MEM1
+    constexpr std::uint32_t UNCACHED_BASE  = 0xC0000000;    //< Uncached view of MEM1
+    constexpr std::uint64_t GUEST_SPACE    = 0x100000000;   //< Whole 32-bit guest address space
+
+    constexpr std::uint32_t PAGE_SHIFT     = 12;            //< Granularity of the per-page flags
+    constexpr std::uint32_t PAGE_SIZE      = 1u << PAGE_SHIFT;
+
+    using MMIORead  = std::function<std::uint32_t(std::uint32_t address, unsigned size)>;
+    using MMIOWrite = std::function<void(std::uint32_t address, std::uint32_t value, unsigned size)>;
+
+    /**
+     * @brief Called when guest code pages are written, with the MEM1 offset and length touched
+     */
+    using CodeWriteHook = std::function<void(std::uint32_t offset, std::uint32_t size)>;
+
+#if FREECUBE_FASTMEM
+    /**
+     * @brief Per-thread recovery point for fastmem faults
+     *
+     * Arm it with FREECUBE_FASTMEM_GUARD. A guest access that lands on an unmapped part
+     * of the arena (MMIO, unbacked addresses) raises SIGSEGV; the handler jumps back to
+     * the guard, where the caller re-runs the access through read_slow()/write_slow().
+     *
+     * Because the jump skips destructors, nothing between the guard and the access may
+     * own resources, and locals changed after arming must be volatile to be read back.
+     * Instruction handlers keep to this by doing their memory access before writing
+     * any architectural state, so the faulting instruction can simply be re-executed.
+     */
+    class FaultGuard {
+    public:
+        FaultGuard() noexcept;
+        ~FaultGuard();
+
+        FaultGuard(const FaultGuard &) = delete;
+        FaultGuard &operator=(const FaultGuard &) = delete;
+
+        /**
+         * @brief Guest address of the access that faulted
+         */
+        std::uint32_t fault_address() const noexcept { return m_fault_address; }
+
+        sigjmp_buf env;
+
+    private:
+        friend struct FaultHandler;
+
+        FaultGuard *m_prev;
+        volatile std::uint32_t m_fault_address = 0;
+    };
+
+    /**
+     * @brief Arm a FaultGuard; true on the way in, false after a fault jumped back
+     */
+    #define FREECUBE_FASTMEM_GUARD(guard) (sigsetjmp((guard).env, 0) == 0)
+#endif
+
+    /**
+     * @brief Guest physical memory: MEM1 and ARAM
+     *
+     * With fastmem (POSIX hosts) the whole 4 GiB guest address space is reserved as one
+     * host region. MEM1 lives in a shared-memory object that is mapped three times, at
+     * the physical (0x00000000), cached (0x80000000) and uncached (0xC0000000) addresses,
+     * so a guest access is just base + address with no translation and no bounds check.
+     * ARAM sits in the same object, mapped right after the guest space. Everything else
+     * in the reservation is inaccessible, and touching it is caught by the SIGSEGV
+     * handler (see FaultGuard) instead of being checked on every access.
+     *
+     * Without fastmem (Windows for now) MEM1 and ARAM are plain allocations and every
+     * access goes through the checked slow path.
+     */
+    class Memory {
+    public:
+        enum PageFlags : std::uint8_t {
+            PAGE_CODE         = 1 << 0,
+            PAGE_DIRTY_STATE  = 1 << 1,     //< Written since save states last took the dirty pages
+            PAGE_DIRTY_REWIND = 1 << 2,     //< Same, for the rewind buffer
+            PAGE_DIRTY        = PAGE_DIRTY_STATE | PAGE_DIRTY_REWIND,   //< What a write sets
+        };
+
+        /**
+         * @throws std::runtime_error if the address space or backing memory can't be set up
+         */
+        Memory();
+        ~Memory();
+
+        Memory(const Memory &) = delete;
+        Memory &operator=(const Memory &) = delete;
+
+        /**
+         * @brief MEM1 itself
+         *
+         * Writes through this pointer skip code invalidation and dirty tracking, go
+         * through copy_to_guest()/fill() unless neither matters.
+         */
+        std::uint8_t *ram() noexcept { return m_ram; }
+        const std::uint8_t *ram() const noexcept { return m_ram; }
+
+        /**
+         * @brief ARAM; writers have to report what they changed with note_aram_write()
+         */
+        std::uint8_t *aram() noexcept { return m_aram; }
+        const std::uint8_t *aram() const noexcept { return m_aram; }
+
+        /**
+         * @brief Host address guest address 0 maps to (fastmem only, nullptr otherwise)
+         */
+        std::uint8_t *fastmem_base() noexcept { return m_base; }
+
+        /**
+         * @brief Offset into MEM1 for a guest address, or -1 if it isn't RAM
+         */
+        static std::int64_t ram_offset(std::uint32_t address) noexcept {
+            std::uint32_t phys = address & 0x3FFFFFFFu;
+            if ((address >> 30) != 0 && (address >> 30) != 2 && (address >> 30) != 3)
+                return -1;
+            return phys < MEM1_SIZE ? static_cast<std::int64_t>(phys) : -1;
+        }
+
+        /**
+         * @brief Host pointer for a guest RAM range
+         *
+         * @return nullptr if any part of [address, address + size) isn't RAM
+         */
+        std::uint8_t *host_ptr(std::uint32_t address, std::size_t size = 1) noexcept {
+            std::int64_t off = ram_offset(address);
+            if (off < 0 || static_cast<std::uint64_t>(off) + size > MEM1_SIZE)
+                return nullptr;
+            return m_ram + off;
+        }
+
+        /**
+         * @brief Big-endian guest load
+         *
+         * Fastmem: a single host load, faults on non-RAM addresses (run under a FaultGuard).
+         */
+        template<typename T>
+        T read(std::uint32_t address) {
+#if FREECUBE_FASTMEM
+            // The mirrors alias, but the compiler sees distinct addresses and would happily
+            // reorder accesses through different views. The fence is compiler-only, no code.
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+            T v = util::load_be<T>(m_base + address);
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+            return v;
+#else
+            return read_slow<T>(address);
+#endif
+        }
+
+        /**
+         * @brief Big-endian guest store, same rules as read()
+         */
+        template<typename T>
+        void write(std::uint32_t address, T value) {
+#if FREECUBE_FASTMEM
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+            util::store_be<T>(m_base + address, value);
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+            // Only reached if the store hit RAM, so the masked address is a MEM1 offset
+            note_write(address & 0x3FFFFFFFu, sizeof(T));
+#else
+            write_slow<T>(address, value);
+#endif
+        }
+
+        /**
+         * @brief Checked access: RAM through the translation, MMIO through its handlers
+         *
+         * Unmapped addresses read as 0 and drop writes, with a warning.
+         */
+        template<typename T>
+        T read_slow(std::uint32_t address) {
+            if (std::uint8_t *p = host_ptr(address, sizeof(T)))
+                return util::load_be<T>(p);
+            // Devices are at most 32 bits wide, doubleword accesses (lfd, psq_l) are two words
+            if constexpr (sizeof(T) == 8)
+                return static_cast<T>((static_cast<std::uint64_t>(mmio_read(address, 4)) << 32) | mmio_read(address + 4, 4));
+            else
+                return static_cast<T>(mmio_read(address, sizeof(T)));
+        }
+
+        template<typename T>
+        void write_slow(std::uint32_t address, T value) {
+            if (std::uint8_t *p = host_ptr(address, sizeof(T))) {
+                util::store_be<T>(p, value);
+                note_write(static_cast<std::uint32_t>(p - m_ram), sizeof(T));
+                return;
+            }
+            if constexpr (sizeof(T) == 8) {
+                mmio_write(address, static_cast<std::uint32_t>(value >> 32), 4);
+                mmio_write(address + 4, static_cast<std::uint32_t>(value), 4);
+            } else {
+                mmio_write(address, static_cast<std::uint32_t>(value), sizeof(T));
+            }
+        }
+
+        /**
+         * @brief Copy host bytes into guest RAM
+         *
+         * @throws std::out_of_range if the range isn't entirely RAM
+         */
+        void copy_to_guest(std::uint32_t address, const void *src, std::size_t size);
+
+        /**
+         * @brief Fill a guest RAM range with a byte
+         *
+         * @throws std::out_of_range if the range isn't entirely RAM
+         */
+        void fill(std::uint32_t address, std::uint8_t value, std::size_t size);
+
+        /**
+         * @brief Route [base, base + size) to device handlers on the slow path
+         */
+        void map_mmio(std::uint32_t base, std::uint32_t size, MMIORead read, MMIOWrite write);
+
+        /**
+         * @brief Zero MEM1 and ARAM
+         */
+        void clear();
+
+        /**
+         * @brief Flag the RAM pages under [address, address + size) as holding decoded code
+         *
+         * Any later write to a flagged page, by the CPU or by copy_to_guest()/fill(), is
+         * reported to the code write hook. Flags stay set until clear_code_pages().
+         */
+        void mark_code(std::uint32_t address, std::uint32_t size);
+
+        /**
+         * @brief Drop every code page flag
+         */
+        void clear_code_pages();
+
+        void set_code_write_hook(CodeWriteHook hook) { m_code_write_hook = std::move(hook); }
+
+        /**
+         * @brief PageFlags by MEM1 offset >> PAGE_SHIFT, for generated code to test and set inline
+         */
+        std::uint8_t *page_flags() noexcept { return m_page_flags.data(); }
+        const std::uint8_t *page_flags() const noexcept { return m_page_flags.data(); }
+
+        /**
+         * @brief Flag ARAM pages under [offset, offset + size) as changed
+         */
+        void note_aram_write(std::uint32_t offset, std::uint32_t size);
+
+        /**
+         * @brief Collect the MEM1 and ARAM pages written since the last call, and reset them
+         *
+         * Guest stores (interpreter and JIT), copy_to_guest(), fill(), clear() and
+         * note_aram_write() all flag pages. Indices are page numbers (offset >> PAGE_SHIFT)
+         * within MEM1 and ARAM respectively, in ascending order.
+         *
+         * @param channel One of the PAGE_DIRTY_* bits; each user of the flags has its own,
+         *                so taking them doesn't hide writes from the others
+         */
+        void take_dirty_pages(std::vector<std::uint32_t> &ram_pages, std::vector<std::uint32_t> &aram_pages,
+                              std::uint8_t channel);
+
+    private:
+        struct MMIORange {
+            std::uint32_t base;
+            std::uint32_t size;
+            MMIORead read;
+            MMIOWrite write;
+        };
+
+        std::uint8_t *m_base = nullptr;     // Start of the fastmem reservation
+        std::uint8_t *m_ram = nullptr;
+        std::uint8_t *m_aram = nullptr;
+        std::size_t m_reserved = 0;
+        int m_shm_fd = -1;
+
+        std::vector<MMIORange> m_mmio;
+
+        // Indexed by MEM1 offset >> PAGE_SHIFT, sized to a power of two so stores can just mask
+        std::array<std::uint8_t, 0x02000000 / PAGE_SIZE> m_page_flags{};
+        std::array<std::uint8_t, ARAM_SIZE / PAGE_SIZE> m_aram_dirty{};    // PAGE_DIRTY_* bits only
+        CodeWriteHook m_code_write_hook;
+
+        // Single guest store, at most two pages
+        void note_write(std::uint32_t offset, std::uint32_t size) {
+            const std::uint32_t first = (offset & 0x01FFFFFFu) >> PAGE_SHIFT;
+            const std::uint32_t last = ((offset + size - 1) & 0x01FFFFFFu) >> PAGE_SHIFT;
+            const std::uint8_t flags = m_page_flags[first] | m_page_flags[last];
+            m_page_flags[first] |= PAGE_DIRTY;
+            m_page_flags[last] |= PAGE_DIRTY;
+            if (flags & PAGE_CODE)
+                code_written(offset, size);
+        }
+
+        // Bulk copies into RAM
+        void note_range(std::uint32_t offset, std::uint32_t size);
+        void code_written(std::uint32_t offset, std::uint32_t size);
+
+        std::uint32_t mmio_read(std::uint32_t address, unsigned size);
+        void mmio_write(std::uint32_t address, std::uint32_t value, unsigned size);
+    };
+
+} // namespace freecube::memory
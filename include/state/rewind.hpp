@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "state/save_state.hpp"
+#include "util/thread_pool.hpp"
+
+namespace freecube::state {
+
+    /**
+     * @brief Ring of recent machine states to step back through
+     *
+     * Every capture() stores the registered sections (CPU, scheduler, ...) and, for each
+     * page written since the capture before, the XOR of its old and new contents. Most
+     * of a rewritten page usually stays the same, so that delta is mostly zeros and
+     * compresses to a fraction of the page; compression runs on a background thread.
+     *
+     * A shadow copy of MEM1 and ARAM as of the newest capture (40 MiB, on top of the
+     * budget) anchors the chain: stepping back XORs the deltas of the captures in
+     * between into it, newest first, so going back K captures decodes K deltas and only
+     * the pages they touched. The oldest captures are dropped once the deltas and
+     * sections outgrow the budget, which is checked at each capture.
+     *
+     * Pages are found with Memory's PAGE_DIRTY_REWIND flags, so a StateManager on the
+     * same memory keeps working alongside. Like it, this belongs to the emulation thread.
+     */
+    class RewindBuffer {
+    public:
+        /**
+         * @param states Whose memory is tracked and whose sections are saved with each capture
+         * @param budget Bytes the deltas and sections may take
+         */
+        RewindBuffer(StateManager &states, std::size_t budget, std::size_t threads = 1);
+        ~RewindBuffer();
+
+        RewindBuffer(const RewindBuffer &) = delete;
+        RewindBuffer &operator=(const RewindBuffer &) = delete;
+
+        /**
+         * @brief Record the machine as it is now
+         */
+        void capture();
+
+        /**
+         * @brief Go back to an earlier capture, dropping everything after it
+         *
+         * @param steps 0 for the newest capture (undoing whatever ran since), 1 for the
+         *              one before, and so on; clamped to the oldest still held
+         * @return Captures actually stepped over
+         * @throws std::runtime_error if nothing was captured yet
+         */
+        std::size_t rewind(std::size_t steps);
+
+        /**
+         * @brief Captures held, the newest included
+         */
+        std::size_t depth() const { return m_entries.size(); }
+
+        /**
+         * @brief Bytes held by deltas and sections, once compression has caught up
+         */
+        std::size_t bytes();
+
+        std::size_t budget() const { return m_budget; }
+
+        /**
+         * @brief Block until background compression is done
+         */
+        void wait();
+
+    private:
+        struct Delta {
+            std::uint32_t page;                 // fcs numbering: MEM1, then ARAM
+            bool packed = false;                // util::lz stream, else raw XOR
+            std::vector<std::uint8_t> bytes;
+        };
+
+        struct Entry {
+            std::vector<Section> sections;
+            std::vector<Delta> deltas;          // This capture XOR the one before, empty for the oldest
+        };
+
+        StateManager &m_states;
+        std::size_t m_budget;
+
+        std::deque<Entry> m_entries;            // Oldest first
+        std::vector<std::uint8_t> m_shadow;     // Memory as of the newest capture, empty before the first
+        std::vector<std::uint32_t> m_dirty_ram;
+        std::vector<std::uint32_t> m_dirty_aram;
+
+        // Declared last so workers stop before the entries go away
+        std::unique_ptr<util::ThreadPool> m_pool;
+
+        std::uint8_t *live_page(std::uint32_t page);
+        void write_back(std::uint32_t page);
+        void trim();
+        static std::size_t entry_bytes(const Entry &e);
+    };
+
+} // namespace freecube::state
@@ -0,0 +1,253 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "memory/memory.hpp"
+#include "state/serializer.hpp"
+#include "util/mapped_file.hpp"
+#include "util/thread_pool.hpp"
+
+namespace freecube::cpu {
+    struct CPUState;
+}
+
+namespace freecube::state {
+
+    /**
+     * @brief Save state file (.fcs) layout
+     *
+     * All fields are little-endian, like .fcb.
+     *
+     *   0x00  magic "FCST"
+     *   0x04  u32 version
+     *   0x08  u64 state id
+     *   0x10  u64 base state id, 0 if every page is in this file
+     *   0x18  u32 section count
+     *   0x1C  u32 stored page count
+     *   0x20  sections: u32 name length, name, u32 version, u64 size, data
+     *         page table, 20 bytes per stored page: u32 page number, u32 size, u32 kind,
+     *           u64 checksum of the uncompressed page (0 for ZERO)
+     *         page data, in table order
+     *
+     * Page numbers run through MEM1 and then ARAM. A file with a base only holds the
+     * pages that changed since that state, the rest come from the base. The checksums let
+     * a restore leave pages alone that memory already holds, without decompressing them.
+     */
+    namespace fcs {
+        constexpr std::uint8_t MAGIC[4] = { 'F', 'C', 'S', 'T' };
+        constexpr std::uint32_t VERSION = 2;
+        constexpr std::uint32_t HEADER_SIZE = 0x20;
+        constexpr std::uint32_t PAGE_ENTRY_SIZE = 20;
+
+        constexpr std::uint32_t RAM_PAGES = memory::MEM1_SIZE / memory::PAGE_SIZE;
+        constexpr std::uint32_t ARAM_PAGES = memory::ARAM_SIZE / memory::PAGE_SIZE;
+        constexpr std::uint32_t PAGES = RAM_PAGES + ARAM_PAGES;
+
+        enum class PageKind : std::uint32_t {
+            ZERO = 0,   //< All zero, nothing stored
+            RAW  = 1,   //< Stored uncompressed (didn't shrink)
+            LZ   = 2    //< util::lz stream
+        };
+    }
+
+    /**
+     * @brief One guest page as a snapshot holds it, shared by every snapshot it didn't change in
+     */
+    struct Page {
+        fcs::PageKind kind = fcs::PageKind::ZERO;
+        std::vector<std::uint8_t> stored;               //< Captured pages own their bytes...
+        const std::uint8_t *mapped = nullptr;           //< ...pages read from a file point into its mapping
+        std::uint32_t mapped_size = 0;
+        std::shared_ptr<const util::MappedFile> file;   //< Keeps the mapping alive
+        std::uint64_t checksum = 0;                     //< page_checksum() of the uncompressed page
+
+        const std::uint8_t *data() const { return mapped ? mapped : stored.data(); }
+        std::uint32_t size() const { return mapped ? mapped_size : static_cast<std::uint32_t>(stored.size()); }
+
+        /**
+         * @brief Expand into a PAGE_SIZE buffer
+         *
+         * @throws std::runtime_error if the stored bytes are corrupt
+         */
+        void decode(std::uint8_t *dst) const;
+    };
+
+    using PageRef = std::shared_ptr<const Page>;
+
+    /**
+     * @brief 64-bit checksum of a PAGE_SIZE buffer, as stored in .fcs page tables
+     *
+     * Not cryptographic, it only has to make a page that changed unlikely to look unchanged.
+     */
+    std::uint64_t page_checksum(const std::uint8_t *page);
+
+    struct Section {
+        std::string name;
+        std::uint32_t version;
+        std::vector<std::uint8_t> data;
+    };
+
+    /**
+     * @brief Everything needed to put the machine back where it was
+     *
+     * Pages are reference counted and shared with the snapshot taken before, so a
+     * snapshot only costs the pages that changed in between. The pages a capture copied
+     * are checksummed and compressed in place on a background thread after it returns;
+     * fresh_bytes() waits for that, as StateManager does before it reads any page.
+     */
+    class Snapshot {
+    public:
+        std::uint64_t id() const { return m_id; }
+        const std::vector<Section> &sections() const { return m_sections; }
+
+        /**
+         * @brief Pages this snapshot had to store, as opposed to share with the one before
+         */
+        std::uint32_t fresh_pages() const { return static_cast<std::uint32_t>(m_fresh.size()); }
+
+        /**
+         * @brief Bytes held by the fresh pages once compressed, waits for their compression
+         */
+        std::uint64_t fresh_bytes() const;
+
+    private:
+        friend class StateManager;
+
+        std::uint64_t m_id = 0;
+        std::vector<Section> m_sections;
+        std::vector<PageRef> m_pages;       // fcs::PAGES entries, nullptr for a zero page
+        std::vector<std::uint32_t> m_fresh;
+        std::vector<std::shared_future<void>> m_compressing;   // Jobs still rewriting fresh pages
+    };
+
+    /**
+     * @brief Takes, restores, writes and reads save states of one machine
+     *
+     * Guest memory is tracked with Memory's dirty page flags (PAGE_DIRTY_STATE): the
+     * first capture stores every page, later ones copy only the pages written since the
+     * previous capture or restore and share the rest. Copied pages are compressed on a
+     * background thread while emulation carries on; anything that reads them waits for
+     * that first.
+     *
+     * Everything else (CPU, scheduler, devices) is a named, versioned section that its
+     * owner registers with add_section(). Sections a state doesn't have are left alone
+     * when it's restored, ones nobody registered are skipped with a warning.
+     *
+     * Like the scheduler, it belongs to the emulation thread.
+     */
+    class StateManager {
+    public:
+        using SaveFn = std::function<void(StateWriter &)>;
+        using LoadFn = std::function<void(StateReader &, std::uint32_t version)>;
+
+        /**
+         * @param threads Compression workers
+         */
+        explicit StateManager(memory::Memory &mem, std::size_t threads = 1);
+        ~StateManager();
+
+        StateManager(const StateManager &) = delete;
+        StateManager &operator=(const StateManager &) = delete;
+
+        /**
+         * @brief Register a piece of machine state
+         *
+         * @param version Written with the section and handed back to `load`, which should
+         *                refuse versions newer than it knows
+         */
+        void add_section(std::string name, std::uint32_t version, SaveFn save, LoadFn load);
+
+        /**
+         * @brief Save every registered section, without touching memory
+         */
+        std::vector<Section> save_sections() const;
+
+        /**
+         * @brief Hand sections back to whoever registered them, without touching memory
+         *
+         * @throws std::runtime_error if a section is newer than its reader or doesn't decode
+         */
+        void load_sections(const std::vector<Section> &sections);
+
+        memory::Memory &memory() noexcept { return m_mem; }
+
+        /**
+         * @brief Snapshot the machine as it is now
+         */
+        std::shared_ptr<const Snapshot> capture();
+
+        /**
+         * @brief Put the machine back into a snapshot's state
+         *
+         * Pages that can differ from it (written since the last capture or restore, or
+         * where the snapshot holds a different page) are checked against its checksums,
+         * and only those that really differ are decoded and written.
+         *
+         * @return Pages written
+         * @throws std::runtime_error if a page or a section doesn't decode
+         */
+        std::uint32_t restore(const Snapshot &snapshot);
+
+        /**
+         * @brief Write a snapshot to a file
+         *
+         * With a base, only pages that differ from the base's are written, and reading the
+         * file back needs the base.
+         *
+         * @throws std::runtime_error on I/O errors
+         */
+        void write(const Snapshot &snapshot, const std::string &path, const Snapshot *base = nullptr);
+
+        /**
+         * @brief Read a snapshot back from a file
+         *
+         * The file is mapped and nothing is decompressed here. A restore only decodes the
+         * pages whose checksum doesn't match what memory holds.
+         *
+         * @param base The state the file was written against, if it was
+         * @throws std::runtime_error if the file is malformed or its base wasn't given
+         */
+        std::shared_ptr<const Snapshot> read(const std::string &path, const Snapshot *base = nullptr);
+
+        /**
+         * @brief Block until background compression is done
+         */
+        void wait();
+
+    private:
+        struct Registered {
+            std::string name;
+            std::uint32_t version;
+            SaveFn save;
+            LoadFn load;
+        };
+
+        memory::Memory &m_mem;
+        std::vector<Registered> m_sections;
+        std::vector<PageRef> m_current;     // Pages memory held at the last capture or restore, empty before the first
+        std::uint64_t m_next_id;
+
+        std::vector<std::uint32_t> m_dirty_ram;
+        std::vector<std::uint32_t> m_dirty_aram;
+
+        // Declared last so workers stop before the state above goes away
+        std::unique_ptr<util::ThreadPool> m_pool;
+
+        void check_sections(const std::vector<Section> &sections) const;
+        std::uint8_t *page_memory(std::uint32_t page);
+        bool page_matches(std::uint32_t page, const PageRef &ref);
+        void write_page(std::uint32_t page, const PageRef &ref);
+    };
+
+    /**
+     * @brief CPUState serialization for a "cpu" section (architectural state only, no host hooks)
+     */
+    void save_cpu(StateWriter &w, const cpu::CPUState &cpu);
+    void load_cpu(StateReader &r, cpu::CPUState &cpu);
+
+} // namespace freecube::state
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace freecube::state {
+
+    /**
+     * @brief Appends fixed-width little-endian fields to a save state section
+     */
+    class StateWriter {
+    public:
+        void u8(std::uint8_t v) { m_data.push_back(v); }
+
+        void u32(std::uint32_t v) {
+            for (int i = 0; i < 4; i++)
+                m_data.push_back(static_cast<std::uint8_t>(v >> (i * 8)));
+        }
+
+        void u64(std::uint64_t v) {
+            u32(static_cast<std::uint32_t>(v));
+            u32(static_cast<std::uint32_t>(v >> 32));
+        }
+
+        void boolean(bool v) { u8(v ? 1 : 0); }
+
+        // Bit pattern, so NaN payloads survive
+        void f64(double v) {
+            std::uint64_t bits;
+            std::memcpy(&bits, &v, sizeof(bits));
+            u64(bits);
+        }
+
+        void bytes(const void *p, std::size_t n) {
+            const auto *b = static_cast<const std::uint8_t *>(p);
+            m_data.insert(m_data.end(), b, b + n);
+        }
+
+        void string(const std::string &s) {
+            u32(static_cast<std::uint32_t>(s.size()));
+            bytes(s.data(), s.size());
+        }
+
+        const std::vector<std::uint8_t> &data() const { return m_data; }
+        std::vector<std::uint8_t> take() { return std::move(m_data); }
+
+    private:
+        std::vector<std::uint8_t> m_data;
+    };
+
+    /**
+     * @brief Reads back what a StateWriter wrote
+     *
+     * @throws std::runtime_error on reading past the end of the section
+     */
+    class StateReader {
+    public:
+        StateReader(const std::uint8_t *data, std::size_t size) : m_data(data), m_size(size) {}
+
+        std::uint8_t u8() { return *take(1); }
+
+        std::uint32_t u32() {
+            const std::uint8_t *p = take(4);
+            return static_cast<std::uint32_t>(p[0]) | (static_cast<std::uint32_t>(p[1]) << 8) |
+                   (static_cast<std::uint32_t>(p[2]) << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+        }
+
+        std::uint64_t u64() {
+            const std::uint64_t lo = u32();
+            return lo | (static_cast<std::uint64_t>(u32()) << 32);
+        }
+
+        bool boolean() { return u8() != 0; }
+
+        double f64() {
+            const std::uint64_t bits = u64();
+            double v;
+            std::memcpy(&v, &bits, sizeof(v));
+            return v;
+        }
+
+        void bytes(void *dst, std::size_t n) { std::memcpy(dst, take(n), n); }
+
+        std::string string() {
+            const std::uint32_t n = u32();
+            const char *p = reinterpret_cast<const char *>(take(n));
+            return std::string(p, n);
+        }
+
+        std::size_t remaining() const { return m_size - m_pos; }
+
+    private:
+        const std::uint8_t *m_data;
+        std::size_t m_size;
+        std::size_t m_pos = 0;
+
+        const std::uint8_t *take(std::size_t n) {
+            if (n > m_size - m_pos)
+                throw std::runtime_error("save state: section is truncated");
+            const std::uint8_t *p = m_data + m_pos;
+            m_pos += n;
+            return p;
+        }
+    };
+
+} // namespace freecube::state
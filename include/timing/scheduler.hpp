@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace freecube::state {
+    class StateWriter;
+    class StateReader;
+}
+
+namespace freecube::timing {
+
+    constexpr uint64_t CPU_CLOCK_HZ = 486000000;    //< Gekko core clock
+    constexpr uint64_t TIMEBASE_DIVIDER = 12;       //< Time base and decrementer tick at 1/12 of it (40.5 MHz)
+    constexpr uint64_t FRAME_CYCLES = CPU_CLOCK_HZ / 60;    //< One NTSC field, until the video interface counts real ones
+
+    constexpr uint64_t NO_EVENT = std::numeric_limits<uint64_t>::max();
+
+    using EventType = uint32_t;
+
+    /**
+     * @brief Identifies one scheduled occurrence, stays unique after it fires or is cancelled
+     */
+    using EventId = uint64_t;
+
+    /**
+     * @brief Called when an event comes due
+     *
+     * @param userdata What was passed to schedule()
+     * @param cycles_late How far past its cycle the event fired (the CPU runs whole blocks)
+     */
+    using EventCallback = std::function<void(uint64_t userdata, int64_t cycles_late)>;
+
+    /**
+     * @brief Guest time, and the hardware events waiting on it
+     *
+     * Devices register an event type once and schedule occurrences of it at guest cycles.
+     * Pending events sit in an indexed binary min-heap, so the next one is always at the
+     * root: cycles_until_next() is O(1), scheduling and cancelling are O(log n).
+     *
+     * The CPU runs uninterrupted for cycles_until_next() cycles, then calls advance(),
+     * which fires everything due in cycle order. While a callback runs, now() is the
+     * event's own cycle, so a periodic event rescheduling itself doesn't drift by however
+     * late it fired.
+     *
+     * Not thread safe, everything happens on the emulation thread.
+     */
+    class Scheduler {
+    public:
+        /**
+         * @param name For logs and debugging
+         */
+        EventType register_event(std::string name, EventCallback callback);
+
+        /**
+         * @brief Schedule `type` to fire `cycles` from now
+         */
+        EventId schedule(EventType type, uint64_t cycles, uint64_t userdata = 0) {
+            return schedule_at(type, m_now + cycles, userdata);
+        }
+
+        /**
+         * @brief Schedule `type` to fire at an absolute cycle (now, if that's in the past)
+         */
+        EventId schedule_at(EventType type, uint64_t cycle, uint64_t userdata = 0);
+
+        /**
+         * @return false if the event already fired or was cancelled
+         */
+        bool cancel(EventId id);
+
+        /**
+         * @brief Cancel every pending occurrence of `type`
+         */
+        void cancel_all(EventType type);
+
+        bool is_scheduled(EventId id) const;
+
+        /**
+         * @brief Cycle an event is due at, NO_EVENT if it isn't pending
+         */
+        uint64_t cycle_of(EventId id) const;
+
+        uint64_t now() const { return m_now; }
+
+        /**
+         * @brief Cycle the next event is due at, NO_EVENT if nothing is pending
+         */
+        uint64_t next_event_cycle() const {
+            return m_heap.empty() ? NO_EVENT : m_slots[m_heap.front()].cycle;
+        }
+
+        /**
+         * @brief Cycles the CPU can run before something needs to happen (the downcount)
+         */
+        uint64_t cycles_until_next() const {
+            return m_heap.empty() ? NO_EVENT : m_slots[m_heap.front()].cycle - m_now;
+        }
+
+        /**
+         * @brief Move time forward, firing every event due by the new time in cycle order
+         *
+         * Events a callback schedules within the window fire in this call too.
+         */
+        void advance(uint64_t cycles);
+
+        std::size_t pending() const { return m_heap.size(); }
+
+        const std::string &name(EventType type) const { return m_types.at(type).name; }
+
+        /**
+         * @brief Write the time and every pending event to a save state section
+         *
+         * Event types go by name, so a state stays readable if registration order changes.
+         * Slots are kept as they are, so EventIds devices saved are still valid after
+         * load_state().
+         */
+        void save_state(state::StateWriter &w) const;
+
+        /**
+         * @brief Replace the time and the pending events with a saved set, firing nothing
+         *
+         * @throws std::runtime_error if an event type isn't registered here
+         */
+        void load_state(state::StateReader &r);
+
+    private:
+        struct Type {
+            std::string name;
+            EventCallback callback;
+        };
+
+        struct Slot {
+            uint64_t cycle;
+            uint64_t order;         // Tie breaker: same cycle fires in scheduling order
+            uint64_t userdata;
+            EventType type;
+            uint32_t generation;    // Bumped whenever the slot is freed, invalidating old ids
+            uint32_t heap_index;    // NOT_QUEUED when free
+        };
+
+        static constexpr uint32_t NOT_QUEUED = 0xFFFFFFFFu;
+
+        std::vector<Type> m_types;
+        std::vector<Slot> m_slots;
+        std::vector<uint32_t> m_free;
+        std::vector<uint32_t> m_heap;   // Slot indices
+        uint64_t m_now = 0;
+        uint64_t m_order = 0;
+
+        const Slot *find(EventId id) const;
+        bool before(uint32_t a, uint32_t b) const;
+        void place(uint32_t heap_index, uint32_t slot);
+        void sift_up(uint32_t heap_index);
+        void sift_down(uint32_t heap_index);
+        void remove(uint32_t slot);
+    };
+
+} // namespace freecube::timing
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#if defined(_MSC_VER)
+    #include <cstdlib>
+#endif
+
+namespace freecube::util {
+
+    /**
+     * @brief Reverse the bytes of an integer
+     */
+    template<typename T>
+    constexpr T bswap(T v) noexcept {
+        static_assert(std::is_integral_v<T>, "bswap needs an integer");
+
+        if constexpr (sizeof(T) == 1) {
+            return v;
+        } else if constexpr (sizeof(T) == 2) {
+#if defined(_MSC_VER)
+            return static_cast<T>(_byteswap_ushort(static_cast<std::uint16_t>(v)));
+#else
+            return static_cast<T>(__builtin_bswap16(static_cast<std::uint16_t>(v)));
+#endif
+        } else if constexpr (sizeof(T) == 4) {
+#if defined(_MSC_VER)
+            return static_cast<T>(_byteswap_ulong(static_cast<std::uint32_t>(v)));
+#else
+            return static_cast<T>(__builtin_bswap32(static_cast<std::uint32_t>(v)));
+#endif
+        } else {
+            static_assert(sizeof(T) == 8, "unsupported integer size");
+#if defined(_MSC_VER)
+            return static_cast<T>(_byteswap_uint64(static_cast<std::uint64_t>(v)));
+#else
+            return static_cast<T>(__builtin_bswap64(static_cast<std::uint64_t>(v)));
+#endif
+        }
+    }
+
+    /**
+     * @brief Load a big-endian (guest order) integer from unaligned host memory
+     */
+    template<typename T>
+    inline T load_be(const void *p) noexcept {
+        T v;
+        std::memcpy(&v, p, sizeof(T));
+        return bswap(v);
+    }
+
+    /**
+     * @brief Store an integer in big-endian (guest) order to unaligned host memory
+     */
+    template<typename T>
+    inline void store_be(void *p, T v) noexcept {
+        v = bswap(v);
+        std::memcpy(p, &v, sizeof(T));
+    }
+
+} // namespace freecube::util
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace freecube::util {
+
+    /**
+     * @brief CRC-32 (IEEE 802.3, as zlib and dump databases use it)
+     *
+     * On x86-64 hosts with PCLMULQDQ the bulk of the input is folded 64 bytes at a time
+     * with carry-less multiplies, elsewhere it's slice-by-8 tables. Results are the same.
+     */
+    class Crc32 {
+    public:
+        void update(const void *data, std::size_t n) { m_state = extend(m_state, data, n); }
+        std::uint32_t digest() const { return ~m_state; }
+
+        /**
+         * @brief CRC of data, continuing from a previous digest (0 to start)
+         */
+        static std::uint32_t compute(const void *data, std::size_t n, std::uint32_t crc = 0) {
+            return ~extend(~crc, data, n);
+        }
+
+        /**
+         * @brief CRC of A followed by B, from the CRCs of A and B and the length of B
+         *
+         * Lets separate threads hash pieces of one buffer. O(log len_b).
+         */
+        static std::uint32_t combine(std::uint32_t crc_a, std::uint32_t crc_b, std::uint64_t len_b);
+
+        /**
+         * @brief Whether the carry-less multiply path is in use on this host
+         */
+        static bool accelerated();
+
+    private:
+        std::uint32_t m_state = 0xFFFFFFFFu;
+
+        static std::uint32_t extend(std::uint32_t state, const void *data, std::size_t n);
+    };
+
+    /**
+     * @brief MD5 (RFC 1321), streaming
+     */
+    class Md5 {
+    public:
+        using Digest = std::array<std::uint8_t, 16>;
+
+        Md5();
+        void update(const void *data, std::size_t n);
+
+        /**
+         * @brief Pad and finish; the object can't be updated afterwards
+         */
+        Digest finish();
+
+    private:
+        std::array<std::uint32_t, 4> m_h;
+        std::array<std::uint8_t, 64> m_block{};
+        std::uint64_t m_length = 0;
+
+        void compress(const std::uint8_t *blocks, std::size_t count);
+    };
+
+    /**
+     * @brief SHA-1 (FIPS 180-4), streaming
+     *
+     * Uses the x86 SHA extensions where the host has them.
+     */
+    class Sha1 {
+    public:
+        using Digest = std::array<std::uint8_t, 20>;
+
+        Sha1();
+        void update(const void *data, std::size_t n);
+
+        /**
+         * @brief Pad and finish; the object can't be updated afterwards
+         */
+        Digest finish();
+
+    private:
+        std::array<std::uint32_t, 5> m_h;
+        std::array<std::uint8_t, 64> m_block{};
+        std::uint64_t m_length = 0;
+
+        void compress(const std::uint8_t *blocks, std::size_t count);
+    };
+
+    /**
+     * @brief Lowercase hex of a byte string
+     */
+    std::string to_hex(const std::uint8_t *data, std::size_t n);
+
+    template<std::size_t N>
+    std::string to_hex(const std::array<std::uint8_t, N> &digest) {
+        return to_hex(digest.data(), N);
+    }
+
+} // namespace freecube::util
@@ -7,6 +7,33 @@
 #include <chrono>
 #include <iomanip>
 #include <type_traits>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+// Lowest level compiled in; sites below it expand to nothing (set from CMake's FREECUBE_LOG_LEVEL)
+#define FREECUBE_LOG_LEVEL_TRACE    0
+#define FREECUBE_LOG_LEVEL_DEBUG    1
+#define FREECUBE_LOG_LEVEL_INFO     2
+#define FREECUBE_LOG_LEVEL_WARN     3
+#define FREECUBE_LOG_LEVEL_ERROR    4
+#define FREECUBE_LOG_LEVEL_CRITICAL 5
+
+#ifndef FREECUBE_LOG_LEVEL
+    #define FREECUBE_LOG_LEVEL FREECUBE_LOG_LEVEL_TRACE
+#endif
+
+// Keeps the formatting path out of line so a disabled site is just a load and a branch
+#if defined(__GNUC__) || defined(__clang__)
+    #define FREECUBE_LOG_COLD __attribute__((cold, noinline))
+    #define FREECUBE_LOG_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#elif defined(_MSC_VER)
+    #define FREECUBE_LOG_COLD __declspec(noinline)
+    #define FREECUBE_LOG_UNLIKELY(x) (x)
+#else
+    #define FREECUBE_LOG_COLD
+    #define FREECUBE_LOG_UNLIKELY(x) (x)
+#endif
 
 namespace freecube::util {
 
@@ -66,12 +93,241 @@ namespace freecube::util {
     inline bool LogCFG::use_timestamps    = true;
     inline bool LogCFG::show_locations    = false;
 
+    namespace detail {
+        // Integers are always printed as zero padded hex, `width` being the type's size in bytes
+        inline void stream_hex(std::ostream& os, std::uint64_t v, unsigned width) {
+            os << "0x"
+               << std::hex << std::uppercase
+               << std::setw(width * 2)
+               << std::setfill('0')
+               << v
+               << std::dec;
+        }
+
+        // "[12:34:56.789] [INFO] [file:line] ", as configured in LogCFG
+        inline void stream_prefix(std::ostream& os, LogLevel level, std::chrono::system_clock::time_point now,
+                                  const char* file, int line) {
+            if (LogCFG::use_timestamps) {
+                auto time = std::chrono::system_clock::to_time_t(now);
+                auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    now.time_since_epoch()) % 1000;
+                os << "[" << std::put_time(std::localtime(&time), "%H:%M:%S")
+                   << "." << std::setw(3) << std::setfill('0') << ms.count()
+                   << "] ";
+            }
+
+            if (LogCFG::use_colours)
+                os << log_level_colour(level);
+
+            os << "[" << log_level_to_string(level) << "]";
+
+            if (LogCFG::use_colours)
+                os << Colours::RESET_FC;
+
+            os << " ";
+
+            if (LogCFG::show_locations)
+                os << "[" << file << ":" << line << "] ";
+        }
+
+        inline std::atomic<bool> async_log_running{false};
+
+        // Only named inside sizeof() by compiled out log sites, never defined
+        template<typename... Args>
+        char log_discard(Args&&... args);
+    }
+
+    /**
+     * @brief One pending message in an AsyncLog ring
+     *
+     * Arguments are stored raw, each as a tag byte followed by its value, and only
+     * formatted on the writer thread. Strings too long for the slot are copied to the
+     * heap and freed by the writer.
+     */
+    struct LogRecord {
+        static constexpr std::size_t SIZE = 256;
+        static constexpr std::size_t PAYLOAD = SIZE - 32;
+
+        enum Tag : std::uint8_t {
+            U8, U16, U32, U64,      //< Integer of that size
+            F64,                    //< Any floating point value
+            PTR,                    //< Other pointers, printed as addresses
+            STR,                    //< uint16_t length, then the bytes
+            HEAP_STR,               //< char * from new[], then a uint32_t length
+            MANIP,                  //< Stream manipulator (std::hex and friends)
+            TRUNCATED,              //< Out of room, the remaining arguments were dropped
+        };
+
+        using Manipulator = std::ios_base& (*)(std::ios_base&);
+
+        std::int64_t time_ns;       //< system_clock
+        const char* file;
+        std::int32_t line;
+        LogLevel level;
+        std::uint16_t size;         //< Payload bytes in use
+        std::uint8_t payload[PAYLOAD];
+
+        template<typename T>
+        void put(T&& value) {
+            using D = std::decay_t<T>;
+            if constexpr (std::is_integral_v<D>) {
+                using U = std::make_unsigned_t<D>;
+                constexpr Tag tag = sizeof(U) == 1 ? U8 : sizeof(U) == 2 ? U16 : sizeof(U) == 4 ? U32 : U64;
+                put_raw(tag, static_cast<U>(value));
+            } else if constexpr (std::is_floating_point_v<D>) {
+                put_raw(F64, static_cast<double>(value));
+            } else if constexpr (std::is_same_v<D, Manipulator>) {
+                put_raw(MANIP, value);
+            } else if constexpr (std::is_convertible_v<const D&, std::string_view>) {
+                put_string(std::string_view(value));
+            } else if constexpr (std::is_pointer_v<D>) {
+                put_raw(PTR, static_cast<const void*>(value));
+            } else {
+                // Anything else only knows how to print itself
+                std::ostringstream oss;
+                oss << std::forward<T>(value);
+                put_string(oss.str());
+            }
+        }
+
+    private:
+        template<typename V>
+        void put_raw(Tag tag, V v) {
+            if (!reserve(1 + sizeof(V)))
+                return;
+            payload[size++] = tag;
+            std::memcpy(payload + size, &v, sizeof(V));
+            size += sizeof(V);
+        }
+
+        void put_string(std::string_view str) {
+            if (size + 1 + sizeof(std::uint16_t) + str.size() <= PAYLOAD - 1) {
+                const auto len = static_cast<std::uint16_t>(str.size());
+                payload[size++] = STR;
+                std::memcpy(payload + size, &len, sizeof(len));
+                std::memcpy(payload + size + sizeof(len), str.data(), len);
+                size += sizeof(len) + len;
+                return;
+            }
+
+            if (!reserve(1 + sizeof(char*) + sizeof(std::uint32_t)))
+                return;
+            char* copy = new char[str.size()];
+            std::memcpy(copy, str.data(), str.size());
+            const auto len = static_cast<std::uint32_t>(str.size());
+            payload[size++] = HEAP_STR;
+            std::memcpy(payload + size, &copy, sizeof(copy));
+            std::memcpy(payload + size + sizeof(copy), &len, sizeof(len));
+            size += sizeof(copy) + sizeof(len);
+        }
+
+        // One byte is always kept back for TRUNCATED
+        bool reserve(std::size_t n) {
+            if (size + n <= PAYLOAD - 1)
+                return true;
+            if (size < PAYLOAD && (size == 0 || payload[size - 1] != TRUNCATED))
+                payload[size++] = TRUNCATED;
+            return false;
+        }
+    };
+
+    static_assert(sizeof(LogRecord) == LogRecord::SIZE, "LogRecord header grew");
+
+    /**
+     * @brief Background log writer
+     *
+     * While running, log calls don't format anything: they copy their arguments and a
+     * timestamp into a lock-free ring owned by the calling thread and return. A writer
+     * thread drains every ring, puts the messages back in time order, formats them and
+     * writes them out in batches. A full ring drops the message and counts it rather
+     * than blocking; the writer reports the count.
+     *
+     * ERROR and CRITICAL messages wait for the writer, so they're out before whatever
+     * comes next (usually an exit).
+     */
+    class AsyncLog {
+    public:
+        static constexpr std::size_t RING_SLOTS = 1024;     //< Per logging thread
+
+        /**
+         * @brief Start the writer thread and send log calls through it
+         */
+        static void start();
+
+        /**
+         * @brief Write out everything queued, stop the writer and go back to synchronous logging
+         */
+        static void stop();
+
+        /**
+         * @brief Block until everything logged before the call has been written
+         */
+        static void flush();
+
+        /**
+         * @brief Messages dropped to full rings since start()
+         */
+        static std::uint64_t dropped();
+
+        static bool running() { return detail::async_log_running.load(std::memory_order_relaxed); }
+
+        template<LogLevel Level, typename... Args>
+        static void push(const char* file, int line, Args&&... args) {
+            LogRecord* rec = begin();
+            if (!rec)
+                return;
+
+            rec->time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            rec->file = file;
+            rec->line = line;
+            rec->level = Level;
+            rec->size = 0;
+            (rec->put(std::forward<Args>(args)), ...);
+            commit();
+        }
+
+    private:
+        // Next free slot in this thread's ring, nullptr (and a drop counted) if it's full
+        static LogRecord* begin();
+        static void commit();
+    };
+
     class Logger {
     public:
+        /**
+         * @brief Whether a message at `Level` would be written
+         *
+         * False at compile time for levels below FREECUBE_LOG_LEVEL, otherwise checks
+         * LogCFG::min_level.
+         */
+        template<LogLevel Level>
+        static bool enabled() {
+            if constexpr (static_cast<int>(Level) < FREECUBE_LOG_LEVEL)
+                return false;
+            else
+                return Level >= LogCFG::min_level;
+        }
+
         template<LogLevel Level, typename... Args>
         static void log(const char* file, int line, Args&&... args) {
-            if (Level < LogCFG::min_level)
+            if (!enabled<Level>())
+                return;
+            write<Level>(file, line, std::forward<Args>(args)...);
+        }
+
+        /**
+         * @brief Write a message whose level is already known to be enabled
+         */
+        template<LogLevel Level, typename... Args>
+        FREECUBE_LOG_COLD static void write(const char* file, int line, Args&&... args) {
+            if (AsyncLog::running()) {
+                AsyncLog::push<Level>(file, line, std::forward<Args>(args)...);
+                if constexpr (Level >= LogLevel::FC_ERROR)
+                    AsyncLog::flush();
                 return;
+            }
+
             write_log<Level>(file, line, std::forward<Args>(args)...);
         }
 
@@ -88,42 +344,14 @@ namespace freecube::util {
         static std::enable_if_t<std::is_integral_v<std::decay_t<T>>, void>
         stream_arg(std::ostringstream& oss, T value) {
             using U = std::make_unsigned_t<std::decay_t<T>>;
-            U v = static_cast<U>(value);
-            oss << "0x"
-                << std::hex << std::uppercase
-                << std::setw(sizeof(U) * 2)
-                << std::setfill('0')
-                << v
-                << std::dec;
+            detail::stream_hex(oss, static_cast<U>(value), sizeof(U));
         }
 
         template<LogLevel Level, typename... Args>
         static void write_log(const char* file, int line, Args&&... args) {
             std::ostringstream oss;
 
-            if (LogCFG::use_timestamps) {
-                auto now = std::chrono::system_clock::now();
-                auto time = std::chrono::system_clock::to_time_t(now);
-                auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-                    now.time_since_epoch()) % 1000;
-                oss << "[" << std::put_time(std::localtime(&time), "%H:%M:%S")
-                    << "." << std::setw(3) << std::setfill('0') << ms.count()
-                    << "] ";
-            }
-
-            if (LogCFG::use_colours)
-                oss << log_level_colour(Level);
-
-            oss << "[" << log_level_to_string(Level) << "]";
-
-            if (LogCFG::use_colours)
-                oss << Colours::RESET_FC;
-
-            oss << " ";
-
-            if (LogCFG::show_locations)
-                oss << "[" << file << ":" << line << "] ";
-
+            detail::stream_prefix(oss, Level, std::chrono::system_clock::now(), file, line);
             (stream_arg(oss, std::forward<Args>(args)), ...);
             oss << "\n";
 
@@ -139,17 +367,48 @@ namespace freecube::util {
 
 } // namespace freecube::util
 
-#define LOG_TRACE(...) \
-    ::freecube::util::Logger::log<::freecube::util::LogLevel::FC_TRACE>(__FILE__, __LINE__, __VA_ARGS__)
-#define LOG_DEBUG(...) \
-    ::freecube::util::Logger::log<::freecube::util::LogLevel::FC_DEBUG>(__FILE__, __LINE__, __VA_ARGS__)
-#define LOG_INFO(...) \
-    ::freecube::util::Logger::log<::freecube::util::LogLevel::FC_INFO>(__FILE__, __LINE__, __VA_ARGS__)
-#define LOG_WARN(...) \
-    ::freecube::util::Logger::log<::freecube::util::LogLevel::FC_WARN>(__FILE__, __LINE__, __VA_ARGS__)
-#define LOG_ERROR(...) \
-    ::freecube::util::Logger::log<::freecube::util::LogLevel::FC_ERROR>(__FILE__, __LINE__, __VA_ARGS__)
-#define LOG_CRITICAL(...) \
-    ::freecube::util::Logger::log<::freecube::util::LogLevel::FC_CRITICAL>(__FILE__, __LINE__, __VA_ARGS__)
+// Arguments are only evaluated when the level is enabled
+#define FREECUBE_LOG_AT(level, ...) \
+    (FREECUBE_LOG_UNLIKELY(::freecube::util::Logger::enabled<::freecube::util::LogLevel::level>()) \
+        ? ::freecube::util::Logger::write<::freecube::util::LogLevel::level>(__FILE__, __LINE__, __VA_ARGS__) \
+        : void())
+
+// A compiled out site: the arguments sit in an unevaluated operand, so no code is
+// generated but variables only used for logging don't trip unused warnings
+#define FREECUBE_LOG_ELIDED(...) \
+    static_cast<void>(sizeof(::freecube::util::detail::log_discard(__VA_ARGS__)))
+
+#if FREECUBE_LOG_LEVEL <= FREECUBE_LOG_LEVEL_TRACE
+    #define LOG_TRACE(...) FREECUBE_LOG_AT(FC_TRACE, __VA_ARGS__)
+#else
+    #define LOG_TRACE(...) FREECUBE_LOG_ELIDED(__VA_ARGS__)
+#endif
+
+#if FREECUBE_LOG_LEVEL <= FREECUBE_LOG_LEVEL_DEBUG
+    #define LOG_DEBUG(...) FREECUBE_LOG_AT(FC_DEBUG, __VA_ARGS__)
+#else
+    #define LOG_DEBUG(...) FREECUBE_LOG_ELIDED(__VA_ARGS__)
+#endif
+
+#if FREECUBE_LOG_LEVEL <= FREECUBE_LOG_LEVEL_INFO
+    #define LOG_INFO(...) FREECUBE_LOG_AT(FC_INFO, __VA_ARGS__)
+#else
+    #define LOG_INFO(...) FREECUBE_LOG_ELIDED(__VA_ARGS__)
+#endif
+
+#if FREECUBE_LOG_LEVEL <= FREECUBE_LOG_LEVEL_WARN
+    #define LOG_WARN(...) FREECUBE_LOG_AT(FC_WARN, __VA_ARGS__)
+#else
+    #define LOG_WARN(...) FREECUBE_LOG_ELIDED(__VA_ARGS__)
+#endif
+
+#if FREECUBE_LOG_LEVEL <= FREECUBE_LOG_LEVEL_ERROR
+    #define LOG_ERROR(...) FREECUBE_LOG_AT(FC_ERROR, __VA_ARGS__)
+#else
+    #define LOG_ERROR(...) FREECUBE_LOG_ELIDED(__VA_ARGS__)
+#endif
+
+// Never compiled out
+#define LOG_CRITICAL(...) FREECUBE_LOG_AT(FC_CRITICAL, __VA_ARGS__)
 
 #endif
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace freecube::util::lz {
+
+    /**
+     * @brief Small LZ77 byte codec used for disc blocks and snapshots
+     *
+     * The stream is a run of sequences, each one a token byte (high nibble literal
+     * count, low nibble match length - 4, 15 meaning "more length bytes follow"),
+     * the literals, then a little-endian 16-bit match distance. The final sequence
+     * carries literals only. It favours decode speed over ratio; disc padding and
+     * zeroed RAM pages are where the wins are anyway.
+     */
+
+    /**
+     * @brief Worst-case compressed size for n input bytes
+     */
+    constexpr std::size_t compress_bound(std::size_t n) noexcept {
+        return n + n / 255 + 16;
+    }
+
+    /**
+     * @brief Compress src into out (out is overwritten)
+     *
+     * @return Compressed size
+     */
+    std::size_t compress(const std::uint8_t *src, std::size_t n, std::vector<std::uint8_t> &out);
+
+    /**
+     * @brief Decompress exactly dst_len bytes
+     *
+     * Every length and distance is bounds checked, so corrupt input can't write or
+     * read outside the buffers.
+     *
+     * @return false if the stream is malformed or doesn't decode to exactly dst_len bytes
+     */
+    bool decompress(const std::uint8_t *src, std::size_t n, std::uint8_t *dst, std::size_t dst_len);
+
+} // namespace freecube::util::lz
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "util/span.hpp"
+
+namespace freecube::util {
+
+    /**
+     * @brief Read-only memory mapping of a whole file
+     *
+     * The mapping is shared, so every process that maps the same image reuses the
+     * kernel's page cache instead of holding its own private copy. Pages are only
+     * faulted in when touched.
+     */
+    class MappedFile {
+    public:
+        MappedFile() = default;
+
+        /**
+         * @brief Map a file read-only
+         *
+         * @param path Path to the file
+         * @throws std::runtime_error if the file can't be opened, is empty or can't be mapped
+         */
+        explicit MappedFile(const std::string &path);
+        ~MappedFile();
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        MappedFile(MappedFile &&other) noexcept;
+        MappedFile &operator=(MappedFile &&other) noexcept;
+
+        const std::uint8_t *data() const noexcept { return m_data; }
+        std::size_t size() const noexcept { return m_size; }
+        bool is_open() const noexcept { return m_data != nullptr; }
+
+        ByteSpan bytes() const noexcept { return ByteSpan(m_data, m_size); }
+
+        /**
+         * @brief Ask the OS to start reading [offset, offset + len) into the page cache
+         *
+         * Only a hint, it returns without waiting for the I/O.
+         */
+        void prefetch(std::size_t offset, std::size_t len) const noexcept;
+
+    private:
+        const std::uint8_t *m_data = nullptr;
+        std::size_t m_size = 0;
+
+#if defined(_WIN32) || defined(_WIN64)
+        void *m_file = nullptr;
+        void *m_mapping = nullptr;
+#endif
+
+        void close() noexcept;
+    };
+
+} // namespace freecube::util
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Set from CMake's FREECUBE_PROFILER; 0 turns every zone and counter into nothing
+#ifndef FREECUBE_PROFILE
+    #define FREECUBE_PROFILE 1
+#endif
+
+namespace freecube::util {
+
+    namespace detail {
+        inline std::atomic<bool> profile_running{false};
+    }
+
+    /**
+     * @brief One recorded zone or counter sample
+     *
+     * Names are never copied, so they have to outlive the capture (string literals).
+     */
+    struct ProfileEvent {
+        enum Kind : std::uint8_t {
+            ZONE,       //< `value` is the duration in ns
+            COUNTER,    //< `value` is the sample
+        };
+
+        const char* name;
+        std::int64_t start_ns;      //< steady_clock
+        std::int64_t value;
+        Kind kind;
+    };
+
+    /**
+     * @brief Process wide capture of scoped zones and counters
+     *
+     * Each thread appends to its own buffer without locking; nothing is shared until the
+     * capture is written out. While no capture is running a zone costs one relaxed load
+     * and a branch, and building with FREECUBE_PROFILE=0 removes the sites entirely.
+     */
+    class Profiler {
+    public:
+        /**
+         * @brief Start recording on every thread
+         */
+        static void start();
+
+        /**
+         * @brief Stop recording and write everything captured as Chrome trace JSON
+         *
+         * The file loads in chrome://tracing and ui.perfetto.dev.
+         *
+         * @return false if the file couldn't be written
+         */
+        static bool write_chrome_trace(const std::string& path);
+
+        /**
+         * @brief Name the calling thread in the trace
+         */
+        static void set_thread_name(const char* name);
+
+        static bool running() {
+            return detail::profile_running.load(std::memory_order_relaxed);
+        }
+
+        static std::int64_t now_ns() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        static void record(const ProfileEvent& event);
+    };
+
+    /**
+     * @brief Times the enclosing scope, if a capture was running when it was entered
+     */
+    class ProfileZone {
+    public:
+        explicit ProfileZone(const char* name) {
+            if (Profiler::running()) {
+                m_name = name;
+                m_start = Profiler::now_ns();
+            }
+        }
+
+        ~ProfileZone() {
+            if (m_name)
+                Profiler::record({ m_name, m_start, Profiler::now_ns() - m_start, ProfileEvent::ZONE });
+        }
+
+        ProfileZone(const ProfileZone&) = delete;
+        ProfileZone& operator=(const ProfileZone&) = delete;
+
+    private:
+        const char* m_name = nullptr;
+        std::int64_t m_start = 0;
+    };
+
+    /**
+     * @brief Runs a capture for its lifetime and writes it out when destroyed
+     *
+     * An empty path does nothing, so it can be declared unconditionally.
+     */
+    class ProfileCapture {
+    public:
+        explicit ProfileCapture(std::string path);
+        ~ProfileCapture();
+
+        ProfileCapture(const ProfileCapture&) = delete;
+        ProfileCapture& operator=(const ProfileCapture&) = delete;
+
+    private:
+        std::string m_path;
+    };
+}
+
+#define FREECUBE_PROFILE_CONCAT_INNER(a, b) a##b
+#define FREECUBE_PROFILE_CONCAT(a, b) FREECUBE_PROFILE_CONCAT_INNER(a, b)
+
+#if FREECUBE_PROFILE
+    #define PROFILE_ZONE(name) \
+        ::freecube::util::ProfileZone FREECUBE_PROFILE_CONCAT(fc_profile_zone_, __LINE__)(name)
+    #define PROFILE_COUNTER(name, value)                                                           \
+        (::freecube::util::Profiler::running()                                                     \
+            ? ::freecube::util::Profiler::record({ name, ::freecube::util::Profiler::now_ns(),     \
+                  static_cast<std::int64_t>(value), ::freecube::util::ProfileEvent::COUNTER })     \
+            : void())
+#else
+    #define PROFILE_ZONE(name) static_cast<void>(0)
+    #define PROFILE_COUNTER(name, value) static_cast<void>(sizeof(value))
+#endif
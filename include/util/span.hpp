@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+
+namespace freecube::util {
+
+    /**
+     * @brief Minimal non-owning view over contiguous memory
+     *
+     * We're on C++17 so there's no std::span, this covers what the loaders need.
+     * A Span never owns what it points at, whoever hands one out has to outlive it.
+     */
+    template<typename T>
+    class Span {
+    public:
+        constexpr Span() noexcept = default;
+        constexpr Span(T *data, std::size_t size) noexcept : m_data(data), m_size(size) {}
+
+        // Anything with data()/size() (std::vector, std::array, std::string...)
+        template<typename Container,
+                 typename = decltype(static_cast<T *>(std::declval<Container &>().data())),
+                 typename = decltype(std::declval<Container &>().size())>
+        constexpr Span(Container &c) noexcept : m_data(c.data()), m_size(c.size()) {}
+
+        constexpr T *data() const noexcept { return m_data; }
+        constexpr std::size_t size() const noexcept { return m_size; }
+        constexpr bool empty() const noexcept { return m_size == 0; }
+
+        constexpr T *begin() const noexcept { return m_data; }
+        constexpr T *end() const noexcept { return m_data + m_size; }
+
+        constexpr T &operator[](std::size_t i) const noexcept { return m_data[i]; }
+
+        /**
+         * @brief View of [offset, offset + count) inside this span
+         *
+         * @throws std::out_of_range if the range isn't fully inside the span
+         */
+        Span subspan(std::size_t offset, std::size_t count) const {
+            if (offset > m_size || count > m_size - offset)
+                throw std::out_of_range("Span: subspan out of range");
+            return Span(m_data + offset, count);
+        }
+
+    private:
+        T *m_data = nullptr;
+        std::size_t m_size = 0;
+    };
+
+    using ByteSpan = Span<const std::uint8_t>;
+
+} // namespace freecube::util
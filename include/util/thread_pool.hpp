@@ -0,0 +1,126 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace freecube::util {
+
+    /**
+     * @brief Fixed-size pool of worker threads draining a FIFO job queue
+     */
+    class ThreadPool {
+    public:
+        /**
+         * @param threads Number of workers, 0 picks one per hardware thread
+         */
+        explicit ThreadPool(std::size_t threads = 0) {
+            if (threads == 0)
+                threads = default_threads();
+
+            m_workers.reserve(threads);
+            for (std::size_t i = 0; i < threads; ++i)
+                m_workers.emplace_back([this] { worker_loop(); });
+        }
+
+        /**
+         * @brief Finishes every queued job, then joins the workers
+         */
+        ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_stopping = true;
+            }
+            m_wake.notify_all();
+
+            for (auto &t : m_workers)
+                t.join();
+        }
+
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        std::size_t size() const noexcept { return m_workers.size(); }
+
+        /**
+         * @brief Queue a job without caring about its result
+         */
+        void post(std::function<void()> job) {
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_jobs.push_back(std::move(job));
+            }
+            m_wake.notify_one();
+        }
+
+        /**
+         * @brief Queue a job and get a future for its result (or exception)
+         */
+        template<typename F>
+        auto submit(F &&fn) -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+            using R = std::invoke_result_t<std::decay_t<F>>;
+
+            auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(fn));
+            std::future<R> result = task->get_future();
+            post([task] { (*task)(); });
+            return result;
+        }
+
+        /**
+         * @brief Block until the queue is empty and no job is running
+         */
+        void wait_idle() {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_idle.wait(lock, [this] { return m_jobs.empty() && m_active == 0; });
+        }
+
+        static std::size_t default_threads() noexcept {
+            std::size_t n = std::thread::hardware_concurrency();
+            return n == 0 ? 1 : n;
+        }
+
+    private:
+        std::vector<std::thread> m_workers;
+        std::deque<std::function<void()>> m_jobs;
+
+        std::mutex m_lock;
+        std::condition_variable m_wake;
+        std::condition_variable m_idle;
+        std::size_t m_active = 0;
+        bool m_stopping = false;
+
+        void worker_loop() {
+            for (;;) {
+                std::function<void()> job;
+                {
+                    std::unique_lock<std::mutex> lock(m_lock);
+                    m_wake.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+
+                    if (m_jobs.empty())
+                        return;
+
+                    job = std::move(m_jobs.front());
+                    m_jobs.pop_front();
+                    ++m_active;
+                }
+
+                job();
+
+                {
+                    std::lock_guard<std::mutex> lock(m_lock);
+                    --m_active;
+                    if (m_jobs.empty() && m_active == 0)
+                        m_idle.notify_all();
+                }
+            }
+        }
+    };
+
+} // namespace freecube::util
@@ -0,0 +1,351 @@
+#include "batch/batch.hpp"
+#include "dol/dol_loader.hpp"
+#include "memory/memory.hpp"
+#include "timing/scheduler.hpp"
+#include "util/log.hpp"
+#include "util/profile.hpp"
+#include "util/thread_pool.hpp"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace freecube::batch {
+
+    namespace {
+        using Clock = std::chrono::steady_clock;
+        using ISOLoader::ISOImage;
+
+        std::uint64_t fnv1a(const std::uint8_t *p, std::size_t n) {
+            std::uint64_t h = 0xCBF29CE484222325ull;
+            for (std::size_t i = 0; i < n; i++) {
+                h ^= p[i];
+                h *= 0x100000001B3ull;
+            }
+            return h;
+        }
+
+        double seconds_since(Clock::time_point start) {
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+        /**
+         * @brief Opened images, shared by every worker using one at the time
+         *
+         * Only weak references are kept, so an image is unmapped (or its buffer freed) as
+         * soon as the last worker on it is done.
+         */
+        class ImageCache {
+        public:
+            explicit ImageCache(ISOLoader::StorageMode storage) : m_storage(storage) {}
+
+            std::shared_ptr<const ISOImage> open(const std::string &path) {
+                std::unique_lock<std::mutex> lock(m_lock);
+
+                if (auto image = m_open[path].lock())
+                    return image;
+
+                // Someone else is opening it already, wait for theirs
+                auto it = m_inflight.find(path);
+                if (it != m_inflight.end()) {
+                    auto pending = it->second;
+                    lock.unlock();
+                    return pending.get();
+                }
+
+                std::promise<std::shared_ptr<const ISOImage>> promise;
+                m_inflight.emplace(path, promise.get_future().share());
+                lock.unlock();
+
+                std::shared_ptr<const ISOImage> image;
+                std::exception_ptr error;
+                try {
+                    image = std::make_shared<const ISOImage>(path, m_storage);
+                } catch (...) {
+                    error = std::current_exception();
+                }
+
+                lock.lock();
+                m_inflight.erase(path);
+                if (image)
+                    m_open[path] = image;
+                lock.unlock();
+
+                if (error) {
+                    promise.set_exception(error);
+                    std::rethrow_exception(error);
+                }
+                promise.set_value(image);
+                return image;
+            }
+
+        private:
+            ISOLoader::StorageMode m_storage;
+            std::mutex m_lock;
+            std::map<std::string, std::weak_ptr<const ISOImage>> m_open;
+            std::map<std::string, std::shared_future<std::shared_ptr<const ISOImage>>> m_inflight;
+        };
+
+        /**
+         * @brief Per-worker job deques: owners take from the back, thieves from the front
+         *
+         * Jobs are whole guest runs, milliseconds at least, so a lock per deque costs nothing
+         * next to them.
+         */
+        class JobQueues {
+        public:
+            JobQueues(std::size_t jobs, std::size_t workers) : m_queues(workers) {
+                // Contiguous shares, so a worker's own jobs come out in list order
+                for (std::size_t w = 0; w < workers; w++) {
+                    const std::size_t first = jobs * w / workers;
+                    const std::size_t last = jobs * (w + 1) / workers;
+                    for (std::size_t j = last; j > first; j--)
+                        m_queues[w].jobs.push_back(j - 1);
+                }
+            }
+
+            bool next(std::size_t worker, std::size_t &job) {
+                {
+                    Queue &own = m_queues[worker];
+                    std::lock_guard<std::mutex> lock(own.lock);
+                    if (!own.jobs.empty()) {
+                        job = own.jobs.back();
+                        own.jobs.pop_back();
+                        return true;
+                    }
+                }
+
+                for (std::size_t i = 1; i < m_queues.size(); i++) {
+                    Queue &victim = m_queues[(worker + i) % m_queues.size()];
+                    std::lock_guard<std::mutex> lock(victim.lock);
+                    if (!victim.jobs.empty()) {
+                        job = victim.jobs.front();
+                        victim.jobs.pop_front();
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+        private:
+            struct Queue {
+                std::mutex lock;
+                std::deque<std::size_t> jobs;
+            };
+
+            std::deque<Queue> m_queues;     // Mutexes don't move
+        };
+
+        void run_image(const std::string &path, const Options &options, ImageCache &images,
+                       memory::Memory &mem, Result &result) {
+            PROFILE_ZONE("batch::run_image");
+
+            result.image = path;
+            const auto boot_start = Clock::now();
+
+            auto iso = images.open(path);
+
+            char id[6] = {};
+            iso->read(0, id, sizeof(id));
+            result.game_id.assign(id, sizeof(id));
+
+            // Mapped images hand the DOL out in place, compressed ones need a copy
+            std::vector<std::uint8_t> dol_copy;
+            util::ByteSpan dol_data = iso->dol_span();
+            if (dol_data.empty()) {
+                dol_copy = iso->get_dol();
+                dol_data = dol_copy;
+            }
+
+            dol::DOLLoader dol(dol_data);
+            mem.clear();
+            dol.load_into(mem);
+
+            cpu::CPUState cpu;
+            cpu.reset();
+            cpu.pc = dol.image().entry_point;
+            cpu.gpr[1] = 0x816FFFF0;    // Stack at the top of MEM1, where the IPL leaves it
+
+            auto engine = cpu::make_engine(options.engine, mem);
+            engine->attach(cpu);
+            timing::Scheduler scheduler;
+
+            result.boot_us = seconds_since(boot_start) * 1e6;
+
+            const auto run_start = Clock::now();
+            result.instructions = cpu::run_scheduled(*engine, cpu, scheduler, options.budget);
+            result.run_seconds = seconds_since(run_start);
+
+            result.cycles = scheduler.now();
+            result.cycles_per_second = result.run_seconds > 0 ? result.cycles / result.run_seconds : 0;
+            result.final_pc = cpu.pc;
+            result.ram_hash = fnv1a(mem.ram(), memory::MEM1_SIZE);
+            result.aram_hash = fnv1a(mem.aram(), memory::ARAM_SIZE);
+            result.ok = true;
+        }
+
+        void write_string(std::ostream &out, const std::string &s) {
+            out << '"';
+            for (char c : s) {
+                const auto u = static_cast<unsigned char>(c);
+                if (c == '"' || c == '\\') {
+                    out << '\\' << c;
+                } else if (u < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", u);
+                    out << buf;
+                } else {
+                    out << c;
+                }
+            }
+            out << '"';
+        }
+
+        std::string hex(std::uint64_t v, int digits) {
+            char buf[24];
+            std::snprintf(buf, sizeof(buf), "%0*llx", digits, static_cast<unsigned long long>(v));
+            return buf;
+        }
+    }
+
+    std::vector<std::string> collect_images(const std::string &manifest_or_dir) {
+        namespace fs = std::filesystem;
+
+        std::vector<std::string> images;
+        std::error_code ec;
+
+        if (fs::is_directory(manifest_or_dir, ec)) {
+            // Stepped with increment(ec) rather than a range-for, whose operator++ throws. Only
+            // a failure to list the directory ends the scan; an entry that can't be typed
+            // (a dangling or looping symlink) is skipped
+            fs::directory_iterator it(manifest_or_dir, ec);
+            for (; !ec && it != fs::directory_iterator(); it.increment(ec)) {
+                const fs::directory_entry &entry = *it;
+                std::string ext = entry.path().extension().string();
+                std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+                if (ext != ".iso" && ext != ".gcm" && ext != ".fcb")
+                    continue;
+
+                std::error_code type_ec;
+                if (entry.is_regular_file(type_ec))
+                    images.push_back(entry.path().string());
+                else if (type_ec)
+                    LOG_WARN("Batch: skipping ", entry.path().string(), ": ", type_ec.message());
+            }
+            if (ec)
+                throw std::runtime_error("batch: failed to scan " + manifest_or_dir + ": " + ec.message());
+            std::sort(images.begin(), images.end());
+            return images;
+        }
+
+        std::ifstream manifest(manifest_or_dir);
+        if (!manifest)
+            throw std::runtime_error("batch: failed to open manifest: " + manifest_or_dir);
+
+        const fs::path base = fs::path(manifest_or_dir).parent_path();
+        std::string line;
+        while (std::getline(manifest, line)) {
+            line.erase(0, line.find_first_not_of(" \t"));
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            if (line.empty() || line[0] == '#')
+                continue;
+            const fs::path path(line);
+            images.push_back(path.is_absolute() ? line : (base / path).string());
+        }
+        return images;
+    }
+
+    std::vector<Result> run(const std::vector<std::string> &images, const Options &options) {
+        PROFILE_ZONE("batch::run");
+
+        std::vector<Result> results(images.size());
+        if (images.empty())
+            return results;
+
+        std::size_t workers = options.workers ? options.workers : util::ThreadPool::default_threads();
+        workers = std::min(workers, images.size());
+
+        ImageCache cache(options.storage);
+        JobQueues queues(images.size(), workers);
+
+        auto worker = [&](std::size_t index) {
+            // One guest address space per worker, reused for every image it runs
+            std::unique_ptr<memory::Memory> mem;
+            std::size_t job;
+            while (queues.next(index, job)) {
+                Result &result = results[job];
+                try {
+                    if (!mem)
+                        mem = std::make_unique<memory::Memory>();
+                    run_image(images[job], options, cache, *mem, result);
+                } catch (const std::exception &e) {
+                    result.image = images[job];
+                    result.ok = false;
+                    result.error = e.what();
+                    LOG_ERROR("Batch: ", images[job], ": ", e.what());
+                }
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (std::size_t i = 1; i < workers; i++)
+            threads.emplace_back(worker, i);
+        worker(0);
+        for (auto &t : threads)
+            t.join();
+
+        return results;
+    }
+
+    void write_json(std::ostream &out, const std::vector<Result> &results, const Options &options, double wall_seconds) {
+        std::size_t ok = 0;
+        for (const Result &r : results)
+            ok += r.ok;
+
+        char buf[64];
+        out << "{\n  \"budget\": " << options.budget << ",\n"
+            << "  \"engine\": \"" << (options.engine == cpu::EngineKind::JIT ? "jit" : "interpreter") << "\",\n";
+        std::snprintf(buf, sizeof(buf), "%.3f", wall_seconds);
+        out << "  \"wall_seconds\": " << buf << ",\n"
+            << "  \"images\": " << results.size() << ",\n"
+            << "  \"booted\": " << ok << ",\n"
+            << "  \"results\": [\n";
+
+        for (std::size_t i = 0; i < results.size(); i++) {
+            const Result &r = results[i];
+            out << "    {\"image\": ";
+            write_string(out, r.image);
+            out << ", \"ok\": " << (r.ok ? "true" : "false");
+            if (r.ok) {
+                out << ", \"game_id\": ";
+                write_string(out, r.game_id);
+                std::snprintf(buf, sizeof(buf), "%.1f", r.boot_us);
+                out << ", \"boot_us\": " << buf;
+                std::snprintf(buf, sizeof(buf), "%.6f", r.run_seconds);
+                out << ", \"run_seconds\": " << buf
+                    << ", \"instructions\": " << r.instructions
+                    << ", \"cycles\": " << r.cycles;
+                std::snprintf(buf, sizeof(buf), "%.0f", r.cycles_per_second);
+                out << ", \"cycles_per_second\": " << buf
+                    << ", \"final_pc\": \"0x" << hex(r.final_pc, 8) << "\""
+                    << ", \"ram_fnv1a\": \"" << hex(r.ram_hash, 16) << "\""
+                    << ", \"aram_fnv1a\": \"" << hex(r.aram_hash, 16) << "\"";
+            } else {
+                out << ", \"error\": ";
+                write_string(out, r.error);
+            }
+            out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n}\n";
+    }
+
+} // namespace freecube::batch
@@ -0,0 +1,348 @@
+#include "cpu/block_cache.hpp"
+#include "cpu/interpreter.hpp"
+#include "util/endian.hpp"
+#include "util/log.hpp"
+#include "util/profile.hpp"
+#include <algorithm>
+
+namespace freecube::cpu {
+
+    namespace {
+        // What one instruction of a candidate idle loop reads and writes
+        struct Effects {
+            uint32_t gpr_read = 0;
+            uint32_t gpr_written = 0;
+            uint8_t cr_read = 0;        // CR fields
+            uint8_t cr_written = 0;
+        };
+
+        uint32_t gpr_bit(unsigned r) {
+            return 1u << r;
+        }
+
+        // rA as a base register, where r0 reads as zero
+        uint32_t base_bit(unsigned r) {
+            return r ? gpr_bit(r) : 0;
+        }
+
+        // False for anything with side effects or that we don't know well enough
+        bool loop_effects(const Instruction &inst, Effects &fx) {
+            using isa::Op;
+            const bool rc = inst.raw & 1;
+
+            switch (inst.op) {
+            case Op::LWZ: case Op::LHZ: case Op::LHA: case Op::LBZ:
+                fx.gpr_read = base_bit(inst.rA);
+                fx.gpr_written = gpr_bit(inst.rD);
+                return true;
+            case Op::LWZX: case Op::LHZX: case Op::LHAX: case Op::LBZX:
+                fx.gpr_read = base_bit(inst.rA) | gpr_bit(inst.rB);
+                fx.gpr_written = gpr_bit(inst.rD);
+                return true;
+            case Op::ADDI: case Op::ADDIS:
+                fx.gpr_read = base_bit(inst.rA);
+                fx.gpr_written = gpr_bit(inst.rD);
+                return true;
+            case Op::CMPI: case Op::CMPLI:
+                fx.gpr_read = gpr_bit(inst.rA);
+                fx.cr_written = static_cast<uint8_t>(1u << (inst.rD >> 2));
+                return true;
+            case Op::CMP: case Op::CMPL:
+                fx.gpr_read = gpr_bit(inst.rA) | gpr_bit(inst.rB);
+                fx.cr_written = static_cast<uint8_t>(1u << (inst.rD >> 2));
+                return true;
+            // Logical forms write rA from rS (decoded into rD)
+            case Op::ORI: case Op::ORIS: case Op::XORI:
+                fx.gpr_read = gpr_bit(inst.rD);
+                fx.gpr_written = gpr_bit(inst.rA);
+                return true;
+            case Op::ANDI_RC: case Op::ANDIS_RC:
+                fx.gpr_read = gpr_bit(inst.rD);
+                fx.gpr_written = gpr_bit(inst.rA);
+                fx.cr_written = 1;
+                return true;
+            case Op::RLWINM:
+                fx.gpr_read = gpr_bit(inst.rD);
+                fx.gpr_written = gpr_bit(inst.rA);
+                fx.cr_written = rc ? 1 : 0;
+                return true;
+            case Op::OR: case Op::AND:
+                fx.gpr_read = gpr_bit(inst.rD) | gpr_bit(inst.rB);
+                fx.gpr_written = gpr_bit(inst.rA);
+                fx.cr_written = rc ? 1 : 0;
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        // The loop's closing branch: back to `address`, no link, no CTR decrement
+        bool branches_back(const Instruction &inst, uint32_t pc, uint32_t address, Effects &fx) {
+            if (inst.raw & 3)   // LK or AA
+                return false;
+
+            if (inst.op == isa::Op::B) {
+                const int32_t li = static_cast<int32_t>((inst.raw & 0x03FFFFFC) << 6) >> 6;
+                return pc + li == address;
+            }
+
+            if (inst.op == isa::Op::BC) {
+                const uint32_t bo = inst.rD;
+                if (!(bo & 0x04))
+                    return false;
+                if (!(bo & 0x10))
+                    fx.cr_read = static_cast<uint8_t>(1u << (inst.rA >> 2));
+                return pc + static_cast<int16_t>(inst.raw & 0xFFFC) == address;
+            }
+
+            return false;
+        }
+    }
+
+    bool is_idle_loop(const Instruction *code, uint32_t length, uint32_t address) {
+        if (length == 0)
+            return false;
+
+        std::vector<Effects> fx(length);
+        uint32_t gpr_written = 0;
+        uint8_t cr_written = 0;
+        for (uint32_t i = 0; i + 1 < length; i++) {
+            if (!loop_effects(code[i], fx[i]))
+                return false;
+            gpr_written |= fx[i].gpr_written;
+            cr_written |= fx[i].cr_written;
+        }
+        if (!branches_back(code[length - 1], address + (length - 1) * 4, address, fx[length - 1]))
+            return false;
+
+        // Every value read has to come from before the loop or from earlier in the same
+        // iteration, never from the iteration before
+        uint32_t gpr_ready = ~gpr_written;
+        uint8_t cr_ready = static_cast<uint8_t>(~cr_written);
+        for (const Effects &f : fx) {
+            if ((f.gpr_read & ~gpr_ready) || (f.cr_read & ~cr_ready))
+                return false;
+            gpr_ready |= f.gpr_written;
+            cr_ready |= f.cr_written;
+        }
+        return true;
+    }
+
+    BlockCache::BlockCache(memory::Memory &mem) : m_mem(mem), m_fast(FAST_ENTRIES, nullptr) {
+        m_mem.set_code_write_hook([this](uint32_t offset, uint32_t size) { invalidate_ram(offset, size); });
+    }
+
+    BlockCache::~BlockCache() {
+        m_mem.set_code_write_hook(nullptr);
+        m_mem.clear_code_pages();
+    }
+
+    void BlockCache::attach(CPUState &cpu) {
+        cpu.mem = &m_mem;
+        cpu.on_icbi = [this](uint32_t address) { invalidate(address & ~31u, 32); };
+    }
+
+    Block *BlockCache::compile(uint32_t pc) {
+        PROFILE_ZONE("BlockCache::compile");
+
+        const int64_t off = memory::Memory::ram_offset(pc);
+        if (off < 0 || (pc & 3))
+            return nullptr;
+
+        const uint32_t start = static_cast<uint32_t>(off);
+        const uint32_t max_len = std::min<uint32_t>(MAX_BLOCK_INSTRUCTIONS, (memory::MEM1_SIZE - start) / 4);
+
+        Instruction scratch[MAX_BLOCK_INSTRUCTIONS];
+        uint32_t len = 0;
+        while (len < max_len) {
+            scratch[len] = decode(util::load_be<uint32_t>(m_mem.ram() + start + len * 4));
+            if (scratch[len++].flags & INST_ENDS_BLOCK)
+                break;
+        }
+
+        auto block = std::make_unique<Block>();
+        block->address = pc;
+        block->ram_offset = start;
+        block->length = len;
+        block->code = std::make_unique<Instruction[]>(len);
+        std::copy(scratch, scratch + len, block->code.get());
+
+        block->idle_loop = is_idle_loop(scratch, len, pc);
+        if (block->idle_loop) {
+            m_stats.idle_loops++;
+            LOG_DEBUG("Idle loop @ ", pc);
+        }
+
+        m_mem.mark_code(pc, block->byte_size());
+        const uint32_t first_page = start >> memory::PAGE_SHIFT;
+        const uint32_t last_page = (start + block->byte_size() - 1) >> memory::PAGE_SHIFT;
+        for (uint32_t page = first_page; page <= last_page; page++)
+            m_page_blocks[page].push_back(pc);
+
+        Block *raw = block.get();
+        m_fast[(pc >> 2) & (FAST_ENTRIES - 1)] = raw;
+        m_blocks[pc] = std::move(block);
+        m_stats.compiled++;
+
+        LOG_TRACE("Decoded block @ ", pc, " (", len, " instructions)");
+        return raw;
+    }
+
+    const Block *BlockCache::get(uint32_t pc) {
+        return fetch(pc);
+    }
+
+    Block *BlockCache::fetch(uint32_t pc) {
+        if (Block *b = lookup(pc))
+            return b;
+
+        auto it = m_blocks.find(pc);
+        if (it != m_blocks.end()) {
+            m_fast[(pc >> 2) & (FAST_ENTRIES - 1)] = it->second.get();
+            return it->second.get();
+        }
+
+        return compile(pc);
+    }
+
+    void BlockCache::retire(uint32_t pc) {
+        auto it = m_blocks.find(pc);
+        if (it == m_blocks.end())
+            return;
+
+        Block *b = it->second.get();
+        Block *&slot = m_fast[(pc >> 2) & (FAST_ENTRIES - 1)];
+        if (slot == b)
+            slot = nullptr;
+
+        // A block can straddle two pages, unlink it from both
+        const uint32_t first_page = b->ram_offset >> memory::PAGE_SHIFT;
+        const uint32_t last_page = (b->ram_offset + b->byte_size() - 1) >> memory::PAGE_SHIFT;
+        for (uint32_t page = first_page; page <= last_page; page++) {
+            auto pit = m_page_blocks.find(page);
+            if (pit == m_page_blocks.end())
+                continue;
+            auto &list = pit->second;
+            list.erase(std::remove(list.begin(), list.end(), pc), list.end());
+            if (list.empty())
+                m_page_blocks.erase(pit);
+        }
+
+        m_retired.push_back(std::move(it->second));
+        m_blocks.erase(it);
+        m_stats.invalidated++;
+    }
+
+    void BlockCache::invalidate_ram(uint32_t offset, uint32_t size) {
+        if (size == 0 || m_blocks.empty())
+            return;
+
+        const uint64_t end = static_cast<uint64_t>(offset) + size;
+        const uint32_t first_page = offset >> memory::PAGE_SHIFT;
+        const uint32_t last_page = static_cast<uint32_t>((end - 1) >> memory::PAGE_SHIFT);
+
+        std::vector<uint32_t> doomed;
+        for (uint32_t page = first_page; page <= last_page; page++) {
+            auto pit = m_page_blocks.find(page);
+            if (pit == m_page_blocks.end())
+                continue;
+
+            for (uint32_t pc : pit->second) {
+                const Block &b = *m_blocks.at(pc);
+                if (b.ram_offset < end && offset < b.ram_offset + b.byte_size())
+                    doomed.push_back(pc);
+            }
+        }
+
+        for (uint32_t pc : doomed)
+            retire(pc);
+    }
+
+    void BlockCache::invalidate(uint32_t address, uint32_t size) {
+        const int64_t off = memory::Memory::ram_offset(address);
+        if (off >= 0)
+            invalidate_ram(static_cast<uint32_t>(off), size);
+    }
+
+    void BlockCache::clear() {
+        m_stats.invalidated += m_blocks.size();
+        for (auto &entry : m_blocks)
+            m_retired.push_back(std::move(entry.second));
+
+        m_blocks.clear();
+        m_page_blocks.clear();
+        std::fill(m_fast.begin(), m_fast.end(), nullptr);
+        m_mem.clear_code_pages();
+    }
+
+    uint64_t BlockCache::run(CPUState &cpu, uint64_t budget) {
+        PROFILE_ZONE("BlockCache::run");
+
+        // Read back after a fault jumps to the guard, so it has to live in memory
+        volatile uint64_t executed = 0;
+
+#if FREECUBE_FASTMEM
+        memory::FaultGuard guard;
+        if (!FREECUBE_FASTMEM_GUARD(guard)) {
+            // The instruction at cpu.pc touched MMIO or unmapped space. It faulted before
+            // writing anything, so run it again through the checked path and carry on.
+            // It will most likely do that again (a device register poll), so flag it to
+            // skip the fault next time round.
+            Block *b = m_current;
+            if (b && cpu.pc - b->address < b->byte_size()) {
+                Instruction &inst = b->code[(cpu.pc - b->address) / 4];
+                inst.flags |= INST_SLOW_ACCESS;
+                execute_slow(cpu, inst);
+            } else {
+                execute_slow(cpu, decode(m_mem.read_slow<uint32_t>(cpu.pc)));
+            }
+            m_stats.slow_retries++;
+            executed = executed + 1;
+        }
+#endif
+
+        while (executed < budget) {
+            m_retired.clear();
+
+            Block *b = fetch(cpu.pc);
+            if (!b) {
+                LOG_ERROR("Can't fetch instructions @ ", cpu.pc, ", stopping");
+                break;
+            }
+
+            b->exec_count++;
+            m_current = b;
+
+            const Instruction *inst = b->code.get();
+            const Instruction *end = inst + b->length;
+            uint32_t pc = b->address;
+            for (; inst != end; ++inst, pc += 4) {
+                cpu.pc = pc;
+                cpu.npc = pc + 4;
+                if (inst->flags & INST_SLOW_ACCESS) {
+                    cpu.slow_access = true;
+                    inst->handler(cpu, *inst);
+                    cpu.slow_access = false;
+                } else {
+                    inst->handler(cpu, *inst);
+                }
+            }
+            cpu.pc = cpu.npc;
+
+            executed = executed + b->length;
+
+            // Went round an idle loop: nothing changes until the next event, skip to it
+            if (b->idle_loop && cpu.pc == b->address && executed < budget) {
+                m_stats.idle_skipped += budget - executed;
+                executed = budget;
+            }
+        }
+
+        m_current = nullptr;
+        m_retired.clear();
+
+        PROFILE_COUNTER("Instructions executed", executed);
+        PROFILE_COUNTER("Blocks compiled", m_stats.compiled);
+        return executed;
+    }
+}
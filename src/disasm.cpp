@@ -0,0 +1,94 @@
+#include "cpu/opcodes.hpp"
+#include <cstdio>
+
+namespace freecube::cpu::isa {
+
+    // Append one operand; returns false if there was nothing to print (NONE)
+    static bool format_operand(std::string &out, Field f, uint32_t raw, uint32_t pc) {
+        char buf[32];
+        const uint32_t v = extract(f, raw);
+
+        switch (f) {
+            case NONE:
+                return false;
+            case RD: case RS: case RA: case RB:
+                std::snprintf(buf, sizeof(buf), "r%u", v);
+                break;
+            case FD: case FS: case FA: case FB: case FC:
+                std::snprintf(buf, sizeof(buf), "f%u", v);
+                break;
+            case CRFD: case CRFS:
+                std::snprintf(buf, sizeof(buf), "cr%u", v);
+                break;
+            case SIMM:
+                std::snprintf(buf, sizeof(buf), "%d", static_cast<int32_t>(v));
+                break;
+            case UIMM: case CRM: case FM:
+                std::snprintf(buf, sizeof(buf), "0x%X", v);
+                break;
+            case DISP: case PS_DISP:
+                std::snprintf(buf, sizeof(buf), "%d(r%u)", static_cast<int32_t>(v), extract<RA>(raw));
+                break;
+            case BD: case LI: {
+                const bool absolute = raw & 2;
+                std::snprintf(buf, sizeof(buf), "0x%08X", absolute ? v : pc + v);
+                break;
+            }
+            default:
+                std::snprintf(buf, sizeof(buf), "%u", v);
+                break;
+        }
+
+        out += buf;
+        return true;
+    }
+
+    std::string disassemble(uint32_t raw, uint32_t pc) {
+        const Op op = lookup(raw);
+        const OpSpec &s = spec(op);
+
+        if (op == Op::INVALID) {
+            char buf[24];
+            std::snprintf(buf, sizeof(buf), ".long 0x%08X", raw);
+            return buf;
+        }
+
+        std::string out = s.mnemonic;
+        const bool lk = raw & 1;
+        switch (s.form) {
+            case I_FORM:
+            case B_FORM:
+                if (lk) out += 'l';
+                if (raw & 2) out += 'a';
+                break;
+            case XL_FORM:
+                if ((op == Op::BCLR || op == Op::BCCTR) && lk)
+                    out += 'l';
+                break;
+            case XO_FORM:
+                if (raw & 0x400) out += 'o';
+                if (lk) out += '.';
+                break;
+            case D_FORM:
+            case SC_FORM:
+            case PSQ_FORM:
+                break;
+            default:
+                // Rc; loads, stores and cache ops have the bit reserved (stwcx. spells it out)
+                if (lk && !(s.flags & INST_MEMORY) && out.back() != '.')
+                    out += '.';
+                break;
+        }
+
+        const char *sep = " ";
+        for (Field f : s.operands) {
+            std::string operand;
+            if (!format_operand(operand, f, raw, pc))
+                break;
+            out += sep;
+            out += operand;
+            sep = ", ";
+        }
+        return out;
+    }
+}
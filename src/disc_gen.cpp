@@ -0,0 +1,261 @@
+#include "loader/disc_gen.hpp"
+#include "util/endian.hpp"
+#include "util/log.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+namespace freecube::ISOLoader {
+
+    namespace {
+        constexpr std::uint32_t SECTOR = 0x8000;
+        constexpr std::uint32_t DOL_OFFSET = 0x8000;       // Past boot.bin, bi2.bin and room for an apploader
+        constexpr std::uint64_t MAX_DISC = 0x100000000ull;  // FST offsets are 32 bits
+        constexpr std::uint32_t MAX_DIRS = 1u << 20;
+
+        std::uint64_t align_up(std::uint64_t v, std::uint64_t a) {
+            return (v + a - 1) & ~(a - 1);
+        }
+
+        std::uint64_t splitmix64(std::uint64_t &state) {
+            std::uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            return z ^ (z >> 31);
+        }
+
+        struct Dir {
+            std::string name;
+            std::uint32_t parent;
+            std::vector<std::uint32_t> subdirs;
+            std::vector<std::uint32_t> files;
+            std::uint32_t entries = 0;          // FST entries in the subtree, not counting the dir itself
+        };
+
+        // Sequential writer; gaps are skipped over and stay zero (holes where the filesystem can)
+        class DiscWriter {
+        public:
+            DiscWriter(const std::string &path, std::uint64_t seed) : m_path(path), m_seed(seed), m_buffer(1 << 20) {
+                m_out.open(path, std::ios::binary | std::ios::trunc);
+                if (!m_out)
+                    throw std::runtime_error("generate_disc: failed to open output: " + path);
+            }
+
+            void write_at(std::uint64_t offset, const void *data, std::size_t len) {
+                seek(offset);
+                m_out.write(static_cast<const char *>(data), static_cast<std::streamsize>(len));
+                m_pos += len;
+                check();
+            }
+
+            void pattern_at(std::uint64_t offset, std::uint64_t len) {
+                seek(offset);
+                while (len) {
+                    const std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(len, m_buffer.size()));
+                    fill(m_pos, m_buffer.data(), n);
+                    m_out.write(reinterpret_cast<const char *>(m_buffer.data()), static_cast<std::streamsize>(n));
+                    m_pos += n;
+                    len -= n;
+                    check();
+                }
+            }
+
+            void finish(std::uint64_t size) {
+                m_out.close();
+                check();
+                std::error_code ec;
+                std::filesystem::resize_file(m_path, size, ec);
+                if (ec)
+                    throw std::runtime_error("generate_disc: failed to size " + m_path + ": " + ec.message());
+            }
+
+        private:
+            std::string m_path;
+            std::uint64_t m_seed;
+            std::ofstream m_out;
+            std::uint64_t m_pos = 0;
+            std::vector<std::uint8_t> m_buffer;
+
+            void seek(std::uint64_t offset) {
+                if (offset == m_pos)
+                    return;
+                m_out.seekp(static_cast<std::streamoff>(offset));
+                m_pos = offset;
+            }
+
+            // disc_pattern() a word at a time where the range allows it
+            void fill(std::uint64_t offset, std::uint8_t *dst, std::size_t n) const {
+                std::size_t i = 0;
+                for (; i < n && ((offset + i) & 7); i++)
+                    dst[i] = disc_pattern(offset + i, m_seed);
+                for (; i + 8 <= n; i += 8) {
+                    std::uint64_t x = ((offset + i) >> 3) * 0x9E3779B97F4A7C15ull + m_seed;
+                    x ^= x >> 29;
+                    for (unsigned b = 0; b < 8; b++)
+                        dst[i + b] = static_cast<std::uint8_t>(x >> (8 * b));
+                }
+                for (; i < n; i++)
+                    dst[i] = disc_pattern(offset + i, m_seed);
+            }
+
+            void check() {
+                if (!m_out)
+                    throw std::runtime_error("generate_disc: failed writing: " + m_path);
+            }
+        };
+
+        void check_spec(const DiscSpec &spec) {
+            if (spec.game_id.size() != 6 || (spec.game_id[0] != 'G' && spec.game_id[0] != 'D'))
+                throw std::invalid_argument("generate_disc: game ID must be 6 characters starting with G or D");
+            for (char c : spec.game_id)
+                if (c < 0x20 || c > 0x7E)
+                    throw std::invalid_argument("generate_disc: game ID must be printable ASCII");
+            if (spec.min_file_size > spec.max_file_size || spec.max_file_size > 0xFFFFFFFFu)
+                throw std::invalid_argument("generate_disc: bad file size range");
+            if (spec.file_alignment == 0 || (spec.file_alignment & (spec.file_alignment - 1)))
+                throw std::invalid_argument("generate_disc: file alignment must be a power of two");
+        }
+    }
+
+    GeneratedDisc generate_disc(const DiscSpec &spec, const std::string &out_path) {
+        check_spec(spec);
+
+        // Directory tree, one level at a time; every parent comes before its children
+        std::vector<Dir> dirs(1);
+        dirs[0].parent = 0;
+        std::size_t level_begin = 0;
+        char name[32];
+        for (std::uint32_t level = 0; level < spec.depth; level++) {
+            const std::size_t level_end = dirs.size();
+            for (std::size_t d = level_begin; d < level_end; d++) {
+                for (std::uint32_t c = 0; c < spec.fanout; c++) {
+                    if (dirs.size() >= MAX_DIRS)
+                        throw std::invalid_argument("generate_disc: too many directories (depth/fanout)");
+                    std::snprintf(name, sizeof(name), "dir%02u", c);
+                    dirs[d].subdirs.push_back(static_cast<std::uint32_t>(dirs.size()));
+                    dirs.push_back({ name, static_cast<std::uint32_t>(d), {}, {}, 0 });
+                }
+            }
+            level_begin = level_end;
+        }
+
+        std::uint64_t rng = spec.seed;
+        std::vector<std::uint32_t> sizes(spec.files);
+        for (std::uint32_t f = 0; f < spec.files; f++) {
+            dirs[f % dirs.size()].files.push_back(f);
+            const std::uint64_t span = spec.max_file_size - spec.min_file_size + 1;
+            sizes[f] = static_cast<std::uint32_t>(spec.min_file_size + splitmix64(rng) % span);
+        }
+
+        for (std::size_t d = dirs.size(); d-- > 0;) {
+            dirs[d].entries += static_cast<std::uint32_t>(dirs[d].files.size());
+            if (d)
+                dirs[dirs[d].parent].entries += 1 + dirs[d].entries;
+        }
+
+        const std::uint32_t entries = 1 + dirs[0].entries;
+        const auto dol = dol::build_dol(spec.dol, spec.seed);
+
+        // FST in pre-order: each directory's files, then its subdirectories
+        GeneratedDisc disc;
+        disc.fst_entries = entries;
+        disc.directories = static_cast<std::uint32_t>(dirs.size() - 1);
+        disc.dol_offset = DOL_OFFSET;
+        disc.dol_size = static_cast<std::uint32_t>(dol.size());
+        disc.files.reserve(spec.files);
+
+        std::vector<std::uint8_t> fst(static_cast<std::size_t>(entries) * 12);
+        std::vector<std::uint32_t> file_entries;    // FST index of each file, in disc.files order
+        file_entries.reserve(spec.files);
+        std::string names;
+
+        auto add_name = [&](const std::string &n) {
+            const auto off = static_cast<std::uint32_t>(names.size());
+            if (off > 0x00FFFFFFu)
+                throw std::invalid_argument("generate_disc: FST string table past 16 MiB");
+            names += n;
+            names += '\0';
+            return off;
+        };
+
+        util::store_be<std::uint32_t>(fst.data() + 0, 0x01000000);
+        util::store_be<std::uint32_t>(fst.data() + 8, entries);
+
+        struct Frame { std::uint32_t dir; std::string path; };
+        std::vector<Frame> stack{ { 0, "" } };
+        std::uint32_t next = 1;
+        std::vector<std::uint32_t> fst_index(dirs.size(), 0);
+
+        while (!stack.empty()) {
+            Frame frame = std::move(stack.back());
+            stack.pop_back();
+            const Dir &dir = dirs[frame.dir];
+
+            if (frame.dir != 0) {
+                std::uint8_t *e = fst.data() + static_cast<std::size_t>(next) * 12;
+                util::store_be<std::uint32_t>(e + 0, 0x01000000 | add_name(dir.name));
+                util::store_be<std::uint32_t>(e + 4, fst_index[dir.parent]);
+                util::store_be<std::uint32_t>(e + 8, next + 1 + dir.entries);
+                fst_index[frame.dir] = next++;
+            }
+
+            for (std::uint32_t f : dir.files) {
+                std::snprintf(name, sizeof(name), "file%06u.bin", f);
+                util::store_be<std::uint32_t>(fst.data() + static_cast<std::size_t>(next) * 12, add_name(name));
+                disc.files.push_back({ frame.path + name, 0, sizes[f] });
+                file_entries.push_back(next++);
+            }
+
+            // Pushed in reverse so they come off the stack in order
+            for (auto it = dir.subdirs.rbegin(); it != dir.subdirs.rend(); ++it)
+                stack.push_back({ *it, frame.path + dirs[*it].name + "/" });
+        }
+
+        // Now that the FST's size is known, lay the files out after it
+        const std::uint64_t fst_offset = align_up(DOL_OFFSET + dol.size(), 32);
+        const std::uint64_t fst_size = fst.size() + names.size();
+        std::uint64_t cursor = align_up(fst_offset + fst_size, SECTOR);
+
+        for (std::size_t i = 0; i < disc.files.size(); i++) {
+            cursor = align_up(cursor, spec.file_alignment);
+            if (cursor + disc.files[i].size > MAX_DISC)
+                throw std::invalid_argument("generate_disc: files don't fit in a 4 GiB disc");
+            disc.files[i].offset = static_cast<std::uint32_t>(cursor);
+
+            std::uint8_t *e = fst.data() + static_cast<std::size_t>(file_entries[i]) * 12;
+            util::store_be<std::uint32_t>(e + 4, disc.files[i].offset);
+            util::store_be<std::uint32_t>(e + 8, disc.files[i].size);
+            cursor += disc.files[i].size;
+        }
+        disc.size = align_up(std::max<std::uint64_t>(cursor, SECTOR), SECTOR);
+
+        // boot.bin; bi2.bin and the apploader area stay zero
+        std::uint8_t boot[0x440] = {};
+        std::memcpy(boot, spec.game_id.data(), 6);
+        util::store_be<std::uint32_t>(boot + 0x1C, 0xC2339F3D);
+        std::memcpy(boot + 0x20, spec.title.data(), std::min<std::size_t>(spec.title.size(), 0x3DF));
+        util::store_be<std::uint32_t>(boot + 0x420, DOL_OFFSET);
+        util::store_be<std::uint32_t>(boot + 0x424, static_cast<std::uint32_t>(fst_offset));
+        util::store_be<std::uint32_t>(boot + 0x428, static_cast<std::uint32_t>(fst_size));
+        util::store_be<std::uint32_t>(boot + 0x42C, static_cast<std::uint32_t>(fst_size));
+
+        DiscWriter out(out_path, spec.seed);
+        out.write_at(0, boot, sizeof(boot));
+        out.write_at(DOL_OFFSET, dol.data(), dol.size());
+        out.write_at(fst_offset, fst.data(), fst.size());
+        out.write_at(fst_offset + fst.size(), names.data(), names.size());
+        if (!spec.zero_fill) {
+            for (const auto &f : disc.files)
+                out.pattern_at(f.offset, f.size);
+        }
+        out.finish(disc.size);
+
+        LOG_DEBUG("Generated ", out_path, ": ", disc.size, " bytes, ", disc.files.size(), " files in ",
+                  disc.directories, " directories");
+        return disc;
+    }
+
+} // namespace freecube::ISOLoader
@@ -0,0 +1,100 @@
+#include "dol/dol_gen.hpp"
+#include "dol/validate.hpp"
+#include "util/endian.hpp"
+#include <cstdlib>
+#include <stdexcept>
+
+namespace freecube::dol {
+
+    DolLayout DolLayout::retail_like() {
+        DolLayout l;
+        l.text = { { 0x80003100, 0x2000 }, { 0x80005100, 0x300000 } };
+        l.data = { { 0x80305100, 0x100 }, { 0x80305200, 0x100 }, { 0x80305300, 0x40000 },
+                   { 0x80345300, 0x80000 }, { 0x803C5300, 0x2000 }, { 0x803C7300, 0x1000 } };
+        l.bss_address = 0x803C8300;
+        l.bss_size = 0x100000;
+        return l;
+    }
+
+    std::vector<DolLayout::Section> DolLayout::parse_sections(const std::string &list) {
+        std::vector<Section> out;
+        std::size_t pos = 0;
+        while (pos < list.size()) {
+            std::size_t end = list.find(',', pos);
+            if (end == std::string::npos)
+                end = list.size();
+
+            const std::string item = list.substr(pos, end - pos);
+            const std::size_t colon = item.find(':');
+            if (colon == std::string::npos)
+                throw std::invalid_argument("DOL section \"" + item + "\" isn't address:size");
+
+            char *rest = nullptr;
+            const unsigned long address = std::strtoul(item.c_str(), &rest, 0);
+            if (rest != item.c_str() + colon)
+                throw std::invalid_argument("DOL section \"" + item + "\" has a bad address");
+            const unsigned long size = std::strtoul(item.c_str() + colon + 1, &rest, 0);
+            if (*rest != '\0' || colon + 1 == item.size())
+                throw std::invalid_argument("DOL section \"" + item + "\" has a bad size");
+
+            out.push_back({ static_cast<uint32_t>(address), static_cast<uint32_t>(size) });
+            pos = end + 1;
+        }
+        return out;
+    }
+
+    uint64_t DolLayout::file_size() const {
+        uint64_t size = 0x100;
+        for (const Section &s : text) size += s.size;
+        for (const Section &s : data) size += s.size;
+        return size;
+    }
+
+    std::vector<uint8_t> build_dol(const DolLayout &layout, uint64_t seed) {
+        if (layout.text.empty() || layout.text.size() > DolHeader::NUM_TEXT || layout.data.size() > DolHeader::NUM_DATA)
+            throw std::invalid_argument("DOL needs 1-7 text and 0-11 data sections");
+        if (layout.file_size() > 0xFFFFFFFFu)
+            throw std::invalid_argument("DOL sections don't fit in 32-bit file offsets");
+
+        const uint32_t entry = layout.entry_point ? layout.entry_point : layout.text.front().address;
+        bool entry_ok = false;
+        for (const auto &s : layout.text)
+            entry_ok |= entry >= s.address && entry - s.address < s.size;
+        if (!entry_ok)
+            throw std::invalid_argument("DOL entry point isn't inside a text section");
+
+        std::vector<uint8_t> dol(static_cast<std::size_t>(layout.file_size()));
+        uint8_t *p = dol.data();
+        uint32_t offset = 0x100;
+
+        for (std::size_t i = 0; i < layout.text.size(); i++) {
+            const auto &s = layout.text[i];
+            util::store_be<uint32_t>(p + 0x00 + i * 4, s.size ? offset : 0);
+            util::store_be<uint32_t>(p + 0x48 + i * 4, s.address);
+            util::store_be<uint32_t>(p + 0x90 + i * 4, s.size);
+
+            const uint32_t words = s.size / 4;
+            for (uint32_t w = 0; w < words; w++)
+                util::store_be<uint32_t>(p + offset + w * 4, 0x60000000);     // nop
+            if (words)
+                util::store_be<uint32_t>(p + offset + (words - 1) * 4, 0x48000000 | ((-(words - 1) * 4) & 0x03FFFFFC));   // b start
+            offset += s.size;
+        }
+
+        for (std::size_t i = 0; i < layout.data.size(); i++) {
+            const auto &s = layout.data[i];
+            util::store_be<uint32_t>(p + 0x1C + i * 4, s.size ? offset : 0);
+            util::store_be<uint32_t>(p + 0x64 + i * 4, s.address);
+            util::store_be<uint32_t>(p + 0xAC + i * 4, s.size);
+
+            for (uint32_t b = 0; b < s.size; b++)
+                p[offset + b] = static_cast<uint8_t>(((offset + b) * 0x9E3779B1u + seed) >> 24);
+            offset += s.size;
+        }
+
+        util::store_be<uint32_t>(p + 0xD8, layout.bss_address);
+        util::store_be<uint32_t>(p + 0xDC, layout.bss_size);
+        util::store_be<uint32_t>(p + 0xE0, entry);
+        return dol;
+    }
+}
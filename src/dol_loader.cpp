@@ -1,5 +1,6 @@
 #include "dol/dol_loader.hpp"
 #include "util/log.hpp"
+#include "util/profile.hpp"
 #include <stdexcept>
 
 namespace freecube::dol {
@@ -10,7 +11,7 @@ namespace freecube::dol {
                 p[3];
     }
 
-    DOLLoader::DOLLoader(const std::vector<uint8_t> &bytes) {
+    DOLLoader::DOLLoader(util::ByteSpan bytes) {
         if (bytes.size() < 0x100) {
             LOG_ERROR("Header is too small!");
             throw std::runtime_error("DOL: Header too small.");
@@ -20,7 +21,32 @@ namespace freecube::dol {
         load_sections(bytes);
     }
 
+    DOLLoader::DOLLoader(util::ByteSpan bytes, const DolHeader &header) {
+        take_header(header);
+        load_sections(bytes);
+    }
+
+    void DOLLoader::take_header(const DolHeader &header) {
+        for (size_t i = 0; i < DolHeader::NUM_TEXT; i++) {
+            m_image.text[i].file_offset = header.textOffsets[i];
+            m_image.text[i].load_address = header.textAddrs[i];
+            m_image.text[i].size = header.textSizes[i];
+        }
+
+        for (size_t i = 0; i < DolHeader::NUM_DATA; i++) {
+            m_image.data[i].file_offset = header.dataOffsets[i];
+            m_image.data[i].load_address = header.dataAddrs[i];
+            m_image.data[i].size = header.dataSizes[i];
+        }
+
+        m_image.bss_address = header.bssAddr;
+        m_image.bss_size = header.bssSize;
+        m_image.entry_point = header.entryPoint;
+    }
+
     void DOLLoader::parse_header(const uint8_t *header) {
+        PROFILE_ZONE("DOLLoader::parse_header");
+
         // text offsets (0x00 -> 0x1B)
         for (int i = 0; i < 7; i++) {
             m_image.text[i].file_offset = be32(header + 0x00 + i * 4);
@@ -64,17 +90,19 @@ namespace freecube::dol {
         LOG_DEBUG("BSS Size: ", m_image.bss_size);
     }
 
-    void DOLLoader::load_sections(const std::vector<uint8_t> &bytes) {
+    void DOLLoader::load_sections(util::ByteSpan bytes) {
+        PROFILE_ZONE("DOLLoader::load_sections");
+
         auto load = [&](Section &sec, uint32_t offset, uint32_t size, uint32_t load_addr) {
             if (offset == 0 || size == 0)
                 return;
 
-            if (offset + size > bytes.size()) {
+            if (static_cast<uint64_t>(offset) + size > bytes.size()) {
                 LOG_ERROR("Section ran out of bounds!");
                 throw std::runtime_error("DOL: Section out of bounds");
             }
 
-            sec.data.assign(bytes.begin() + offset, bytes.begin() + offset + size);
+            sec.data = bytes.subspan(offset, size);
             sec.size = size;
             sec.load_address = load_addr;
 
@@ -98,4 +126,32 @@ namespace freecube::dol {
         }
     }
 
-} // namespace freecube::dol
\ No newline at end of file
+    void DOLLoader::load_into(memory::Memory &mem) const {
+        if (m_image.bss_size != 0) {
+            if (!mem.host_ptr(m_image.bss_address, m_image.bss_size)) {
+                LOG_ERROR("BSS is outside guest RAM!");
+                throw std::runtime_error("DOL: BSS outside guest RAM");
+            }
+            mem.fill(m_image.bss_address, 0, m_image.bss_size);
+        }
+
+        auto place = [&](const Section &sec) {
+            if (sec.data.empty())
+                return;
+
+            if (!mem.host_ptr(sec.load_address, sec.data.size())) {
+                LOG_ERROR("Section is outside guest RAM!");
+                throw std::runtime_error("DOL: Section outside guest RAM");
+            }
+
+            mem.copy_to_guest(sec.load_address, sec.data.data(), sec.data.size());
+            LOG_TRACE("Placed section at ", sec.load_address);
+        };
+
+        for (const auto &sec : m_image.text)
+            place(sec);
+        for (const auto &sec : m_image.data)
+            place(sec);
+    }
+
+} // namespace freecube::dol
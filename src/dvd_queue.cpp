@@ -0,0 +1,152 @@
+#include "dvd/dvd_queue.hpp"
+#include "util/log.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace freecube::dvd {
+
+    DVDReadQueue::DVDReadQueue(const ISOLoader::ISOImage &image, memory::Memory &memory, const QueueOptions &options)
+        : m_image(image), m_memory(memory), m_options(options) {
+        if (m_options.block_size == 0)
+            m_options.block_size = 0x8000;
+
+        m_pool = std::make_unique<util::ThreadPool>(std::max<std::size_t>(1, m_options.threads));
+    }
+
+    DVDReadQueue::~DVDReadQueue() {
+        if (m_scheduler)
+            m_scheduler->cancel(m_event);
+        m_pool.reset();
+    }
+
+    std::uint64_t DVDReadQueue::submit(std::uint64_t disc_offset, std::uint32_t address, std::uint32_t length,
+                                       std::uint64_t now_cycle, ReadCallback callback) {
+        // Checked now rather than at delivery, where the guest couldn't be told
+        if (!m_memory.host_ptr(address, length))
+            throw std::out_of_range("DVDReadQueue: destination isn't guest RAM");
+
+        std::uint64_t id;
+        std::uint64_t ready;
+
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            id = m_next_id++;
+
+            const bool sequential = disc_offset == m_stream_end;
+            const DriveTiming &t = m_options.timing;
+
+            std::uint64_t start = std::max(now_cycle, m_drive_free_cycle);
+            ready = start + (sequential ? 0 : t.seek_cycles) + static_cast<std::uint64_t>(length) * t.cycles_per_byte;
+            m_drive_free_cycle = ready;
+            m_stream_end = disc_offset + length;
+
+            m_undelivered.emplace(ready, id);
+
+            if (sequential)
+                schedule_prefetch_locked(m_stream_end);
+            else
+                m_prefetched_end = m_stream_end;
+        }
+
+        LOG_TRACE("DVD read #", id, " offset=", disc_offset, " len=", length, " due at cycle ", ready);
+
+        // Guest RAM belongs to the emulation thread, the worker only fills the queue's buffer
+        m_pool->post([this, id, disc_offset, address, length, ready, cb = std::move(callback)]() mutable {
+            std::vector<std::uint8_t> data(length);
+            std::size_t n = m_image.read(disc_offset, data.data(), length);
+
+            if (n != length)
+                LOG_WARN("DVD read #", id, " ran past the end of the disc");
+
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_done.emplace(std::make_pair(ready, id),
+                           Completion{ ReadResult{ id, disc_offset, address, length, n, ready }, std::move(cb), std::move(data) });
+        });
+
+        if (m_scheduler)
+            plan_event();
+
+        return id;
+    }
+
+    void DVDReadQueue::schedule_prefetch_locked(std::uint64_t from) {
+        const std::uint64_t bs = m_options.block_size;
+        const std::uint64_t want = (from / bs + m_options.prefetch_blocks + 1) * bs;
+
+        std::uint64_t start = std::max(from, m_prefetched_end);
+        if (m_options.prefetch_blocks == 0 || start >= want || start >= m_image.size())
+            return;
+
+        m_prefetched_end = want;
+
+        const std::size_t len = static_cast<std::size_t>(want - start);
+        m_pool->post([this, start, len] { m_image.prefetch(start, len); });
+    }
+
+    std::size_t DVDReadQueue::poll(std::uint64_t now_cycle) {
+        std::vector<Completion> due;
+
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            // The drive finishes reads in order, one still running on the host holds back the rest
+            while (!m_done.empty() && m_done.begin()->first == *m_undelivered.begin() &&
+                   m_done.begin()->first.first <= now_cycle) {
+                m_undelivered.erase(m_undelivered.begin());
+                due.push_back(std::move(m_done.begin()->second));
+                m_done.erase(m_done.begin());
+            }
+        }
+
+        // Callbacks may submit follow-up reads, so they run without the lock held
+        for (const auto &c : due) {
+            if (c.result.bytes_read)
+                m_memory.copy_to_guest(c.result.address, c.data.data(), c.result.bytes_read);
+            if (c.callback)
+                c.callback(c.result);
+        }
+
+        return due.size();
+    }
+
+    std::optional<std::uint64_t> DVDReadQueue::next_ready_cycle() const {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_undelivered.empty())
+            return std::nullopt;
+        return m_undelivered.begin()->first;
+    }
+
+    void DVDReadQueue::attach(timing::Scheduler &scheduler) {
+        m_scheduler = &scheduler;
+        m_event_type = scheduler.register_event("DVD read done", [this](std::uint64_t, std::int64_t) {
+            m_event = 0;
+            poll(m_scheduler->now());
+            plan_event();
+        });
+        plan_event();
+    }
+
+    void DVDReadQueue::plan_event() {
+        const auto next = next_ready_cycle();
+        const std::uint64_t now = m_scheduler->now();
+
+        // A read that's due but still running on the host is retried a little later
+        std::uint64_t cycle = timing::NO_EVENT;
+        if (next)
+            cycle = *next > now ? *next : now + m_options.timing.host_retry_cycles;
+
+        if (m_scheduler->cycle_of(m_event) == cycle)
+            return;
+        m_scheduler->cancel(m_event);
+        m_event = cycle == timing::NO_EVENT ? 0 : m_scheduler->schedule_at(m_event_type, cycle);
+    }
+
+    void DVDReadQueue::wait_host_idle() {
+        m_pool->wait_idle();
+    }
+
+    std::size_t DVDReadQueue::pending() const {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_undelivered.size();
+    }
+
+} // namespace freecube::dvd
@@ -0,0 +1,113 @@
+#include "dol/elf_loader.hpp"
+#include "util/log.hpp"
+#include "util/profile.hpp"
+#include <cstring>
+#include <stdexcept>
+
+namespace freecube::dol {
+    namespace {
+        constexpr uint8_t ELF_MAGIC[4] = { 0x7F, 'E', 'L', 'F' };
+        constexpr uint8_t ELFCLASS32 = 1;
+        constexpr uint8_t ELFDATA2MSB = 2;
+        constexpr uint16_t ET_EXEC = 2;
+        constexpr uint16_t EM_PPC = 20;
+        constexpr uint32_t PT_LOAD = 1;
+        constexpr uint32_t PF_X = 1;
+
+        constexpr size_t EHDR_SIZE = 0x34;
+        constexpr size_t PHDR_SIZE = 0x20;
+
+        uint16_t be16(const uint8_t *p) {
+            return static_cast<uint16_t>((p[0] << 8) | p[1]);
+        }
+
+        uint32_t be32(const uint8_t *p) {
+            return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+        }
+    }
+
+    bool ELFLoader::is_elf(util::ByteSpan bytes) {
+        return bytes.size() >= sizeof(ELF_MAGIC) && std::memcmp(bytes.data(), ELF_MAGIC, sizeof(ELF_MAGIC)) == 0;
+    }
+
+    ELFLoader::ELFLoader(util::ByteSpan bytes) {
+        PROFILE_ZONE("ELFLoader::parse");
+
+        if (bytes.size() < EHDR_SIZE || !is_elf(bytes)) {
+            LOG_ERROR("Not an ELF file!");
+            throw std::runtime_error("ELF: bad magic");
+        }
+
+        const uint8_t *p = bytes.data();
+        if (p[4] != ELFCLASS32 || p[5] != ELFDATA2MSB || be16(p + 0x12) != EM_PPC) {
+            LOG_ERROR("ELF is not 32-bit big-endian PowerPC!");
+            throw std::runtime_error("ELF: not a 32-bit big-endian PowerPC file");
+        }
+        if (be16(p + 0x10) != ET_EXEC) {
+            LOG_ERROR("ELF is not an executable!");
+            throw std::runtime_error("ELF: not an executable");
+        }
+
+        m_image.entry_point = be32(p + 0x18);
+        const uint32_t phoff = be32(p + 0x1C);
+        const uint16_t phentsize = be16(p + 0x2A);
+        const uint16_t phnum = be16(p + 0x2C);
+
+        if (phentsize < PHDR_SIZE || static_cast<uint64_t>(phoff) + uint64_t(phnum) * phentsize > bytes.size()) {
+            LOG_ERROR("ELF program headers ran out of bounds!");
+            throw std::runtime_error("ELF: program headers out of bounds");
+        }
+
+        bool entry_ok = false;
+        for (uint16_t i = 0; i < phnum; i++) {
+            const uint8_t *ph = p + phoff + size_t(i) * phentsize;
+            if (be32(ph + 0x00) != PT_LOAD)
+                continue;
+
+            Segment seg;
+            seg.file_offset = be32(ph + 0x04);
+            seg.load_address = be32(ph + 0x08);
+            const uint32_t file_size = be32(ph + 0x10);
+            seg.mem_size = be32(ph + 0x14);
+            seg.executable = (be32(ph + 0x18) & PF_X) != 0;
+
+            if (seg.mem_size == 0)
+                continue;
+
+            if (file_size > seg.mem_size || static_cast<uint64_t>(seg.file_offset) + file_size > bytes.size()) {
+                LOG_ERROR("ELF segment ", i, " ran out of bounds!");
+                throw std::runtime_error("ELF: segment out of bounds");
+            }
+
+            seg.data = bytes.subspan(seg.file_offset, file_size);
+            if (seg.executable && m_image.entry_point - seg.load_address < file_size)
+                entry_ok = true;
+
+            LOG_TRACE("ELF segment at ", seg.load_address, " size ", seg.mem_size);
+            m_image.segments.push_back(seg);
+        }
+
+        if (!entry_ok) {
+            LOG_ERROR("ELF entry point is not in an executable segment!");
+            throw std::runtime_error("ELF: entry point is not in an executable segment");
+        }
+
+        LOG_DEBUG("ELF entrypoint: ", m_image.entry_point);
+    }
+
+    void ELFLoader::load_into(memory::Memory &mem) const {
+        for (const Segment &seg : m_image.segments) {
+            if (!mem.host_ptr(seg.load_address, seg.mem_size)) {
+                LOG_ERROR("Segment is outside guest RAM!");
+                throw std::runtime_error("ELF: segment outside guest RAM");
+            }
+
+            if (!seg.data.empty())
+                mem.copy_to_guest(seg.load_address, seg.data.data(), seg.data.size());
+            if (seg.mem_size > seg.data.size())
+                mem.fill(seg.load_address + static_cast<uint32_t>(seg.data.size()), 0, seg.mem_size - seg.data.size());
+            LOG_TRACE("Placed segment at ", seg.load_address);
+        }
+    }
+
+} // namespace freecube::dol
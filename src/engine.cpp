@@ -0,0 +1,78 @@
+#include "cpu/engine.hpp"
+
+#include "cpu/block_cache.hpp"
+#include "cpu/interpreter.hpp"
+#include "cpu/jit_x64.hpp"
+#include "timing/scheduler.hpp"
+#include "util/log.hpp"
+#include <algorithm>
+
+namespace freecube::cpu {
+
+    std::unique_ptr<ExecutionEngine> make_engine(EngineKind kind, memory::Memory &mem) {
+        if (kind == EngineKind::JIT) {
+#if FREECUBE_JIT
+            return std::make_unique<Jit>(mem);
+#else
+            LOG_WARN("No JIT for this host, using the interpreter");
+#endif
+        }
+
+        return std::make_unique<BlockCache>(mem);
+    }
+
+    namespace {
+        // Time base and DEC tick once every TIMEBASE_DIVIDER cycles, counted from cycle 0
+        void advance_timers(CPUState &cpu, uint64_t from_cycle, uint64_t to_cycle) {
+            const uint64_t ticks = to_cycle / timing::TIMEBASE_DIVIDER - from_cycle / timing::TIMEBASE_DIVIDER;
+            if (!ticks)
+                return;
+
+            const uint64_t tb = ((static_cast<uint64_t>(cpu.spr[spr::TBU]) << 32) | cpu.spr[spr::TBL]) + ticks;
+            cpu.spr[spr::TBL] = static_cast<uint32_t>(tb);
+            cpu.spr[spr::TBU] = static_cast<uint32_t>(tb >> 32);
+
+            // The exception is signalled when DEC's top bit goes from 0 to 1
+            const uint32_t dec = cpu.spr[spr::DEC];
+            if (!(dec & 0x80000000) && ticks > dec)
+                cpu.dec_pending = true;
+            cpu.spr[spr::DEC] = dec - static_cast<uint32_t>(ticks);
+        }
+
+        // Cycles until DEC underflows, if that could interrupt anything
+        uint64_t cycles_until_decrementer(const CPUState &cpu, uint64_t now) {
+            const uint32_t dec = cpu.spr[spr::DEC];
+            if (!(cpu.msr & MSR_EE) || (dec & 0x80000000))
+                return timing::NO_EVENT;
+            const uint64_t tick = now / timing::TIMEBASE_DIVIDER + dec + 1;
+            return tick * timing::TIMEBASE_DIVIDER - now;
+        }
+    }
+
+    uint64_t run_scheduled(ExecutionEngine &engine, CPUState &cpu, timing::Scheduler &scheduler, uint64_t budget) {
+        uint64_t executed = 0;
+
+        while (executed < budget) {
+            if (cpu.dec_pending && (cpu.msr & MSR_EE)) {
+                cpu.dec_pending = false;
+                raise_exception(cpu, Exception::DECREMENTER, cpu.pc);
+                cpu.pc = cpu.npc;
+            }
+
+            const uint64_t now = scheduler.now();
+            const uint64_t slice = std::max<uint64_t>(1, std::min({ budget - executed, scheduler.cycles_until_next(),
+                                                                    cycles_until_decrementer(cpu, now) }));
+
+            const uint64_t ran = engine.run(cpu, slice);
+            if (!ran)
+                break;
+            executed += ran;
+
+            // Timers first, so event handlers see the time base as of the end of the slice
+            advance_timers(cpu, now, now + ran);
+            scheduler.advance(ran);
+        }
+
+        return executed;
+    }
+}
@@ -0,0 +1,381 @@
+#include "loader/fcb.hpp"
+#include "util/log.hpp"
+#include "util/lz.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace freecube::ISOLoader {
+
+    static std::uint32_t get_le32(const std::uint8_t *p) {
+        return static_cast<std::uint32_t>(p[0])        |
+               (static_cast<std::uint32_t>(p[1]) << 8)  |
+               (static_cast<std::uint32_t>(p[2]) << 16) |
+               (static_cast<std::uint32_t>(p[3]) << 24);
+    }
+
+    static std::uint64_t get_le64(const std::uint8_t *p) {
+        return static_cast<std::uint64_t>(get_le32(p)) | (static_cast<std::uint64_t>(get_le32(p + 4)) << 32);
+    }
+
+    static void put_le32(std::uint8_t *p, std::uint32_t v) {
+        p[0] = static_cast<std::uint8_t>(v);
+        p[1] = static_cast<std::uint8_t>(v >> 8);
+        p[2] = static_cast<std::uint8_t>(v >> 16);
+        p[3] = static_cast<std::uint8_t>(v >> 24);
+    }
+
+    static void put_le64(std::uint8_t *p, std::uint64_t v) {
+        put_le32(p, static_cast<std::uint32_t>(v));
+        put_le32(p + 4, static_cast<std::uint32_t>(v >> 32));
+    }
+
+    static bool all_zero(const std::uint8_t *p, std::size_t n) {
+        return n == 0 || (p[0] == 0 && std::memcmp(p, p + 1, n - 1) == 0);
+    }
+
+    static std::uint32_t block_length(std::uint64_t disc_size, std::uint32_t block_size, std::uint32_t block) {
+        std::uint64_t start = static_cast<std::uint64_t>(block) * block_size;
+        return static_cast<std::uint32_t>(std::min<std::uint64_t>(block_size, disc_size - start));
+    }
+
+    bool FCBImage::is_fcb(const std::string &path) {
+        std::ifstream f(path, std::ios::binary);
+        std::uint8_t magic[4] = {};
+        if (!f.read(reinterpret_cast<char *>(magic), sizeof(magic)))
+            return false;
+        return std::memcmp(magic, fcb::MAGIC, sizeof(magic)) == 0;
+    }
+
+    FCBImage::FCBImage(const std::string &path, const FCBOptions &options)
+        : m_file(path), m_options(options) {
+        const std::uint8_t *p = m_file.data();
+        const std::size_t file_size = m_file.size();
+
+        if (file_size < fcb::HEADER_SIZE || std::memcmp(p, fcb::MAGIC, 4) != 0) {
+            LOG_ERROR("Not an FCB image: ", path);
+            throw std::runtime_error("FCBImage: bad magic: " + path);
+        }
+
+        if (get_le32(p + 0x04) != fcb::VERSION) {
+            LOG_ERROR("Unsupported FCB version ", get_le32(p + 0x04));
+            throw std::runtime_error("FCBImage: unsupported version: " + path);
+        }
+
+        m_block_size = get_le32(p + 0x08);
+        std::uint32_t count = get_le32(p + 0x0C);
+        m_disc_size = get_le64(p + 0x10);
+
+        if (m_block_size == 0 || m_block_size % 0x8000 != 0) {
+            LOG_ERROR("FCB block size is not a multiple of 32kb");
+            throw std::runtime_error("FCBImage: invalid block size: " + path);
+        }
+
+        if (count != (m_disc_size + m_block_size - 1) / m_block_size ||
+            fcb::HEADER_SIZE + static_cast<std::uint64_t>(count) * fcb::TABLE_ENTRY_SIZE > file_size) {
+            LOG_ERROR("FCB block table doesn't match the disc size");
+            throw std::runtime_error("FCBImage: invalid block table: " + path);
+        }
+
+        m_blocks.resize(count);
+        for (std::uint32_t i = 0; i < count; ++i) {
+            const std::uint8_t *e = p + fcb::HEADER_SIZE + static_cast<std::size_t>(i) * fcb::TABLE_ENTRY_SIZE;
+            fcb::BlockEntry &b = m_blocks[i];
+            b.offset = get_le64(e);
+            b.size   = get_le32(e + 8);
+            b.kind   = static_cast<fcb::BlockKind>(get_le32(e + 12));
+
+            // LZ blocks are only stored when they came out smaller than the block
+            const std::uint32_t len = block_length(m_disc_size, m_block_size, i);
+            bool ok = false;
+            switch (b.kind) {
+                case fcb::BlockKind::ZERO: ok = true; break;
+                case fcb::BlockKind::RAW:  ok = b.size == len; break;
+                case fcb::BlockKind::LZ:   ok = b.size != 0 && b.size < len; break;
+            }
+
+            // Written so a huge offset can't wrap around past the check
+            if (!ok || b.offset > file_size || b.size > file_size - b.offset) {
+                LOG_ERROR("FCB block ", i, " is invalid");
+                throw std::runtime_error("FCBImage: invalid block entry: " + path);
+            }
+        }
+
+        if (m_options.read_ahead > 0)
+            m_pool = std::make_unique<util::ThreadPool>(m_options.threads);
+
+        LOG_TRACE("FCB mapped OK, ", count, " blocks of ", m_block_size);
+    }
+
+    FCBImage::~FCBImage() {
+        // Outstanding prefetches reference the cache, finish them first
+        m_pool.reset();
+    }
+
+    std::size_t FCBImage::read(std::uint64_t offset, void *dst, std::size_t len) const {
+        if (offset >= m_disc_size)
+            return 0;
+
+        std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(len, m_disc_size - offset));
+        auto *out = static_cast<std::uint8_t *>(dst);
+
+        std::size_t done = 0;
+        while (done < n) {
+            std::uint64_t pos = offset + done;
+            auto block = static_cast<std::uint32_t>(pos / m_block_size);
+            auto in_block = static_cast<std::uint32_t>(pos % m_block_size);
+            std::size_t chunk = std::min<std::size_t>(
+                block_length(m_disc_size, m_block_size, block) - in_block, n - done);
+
+            if (m_blocks[block].kind == fcb::BlockKind::ZERO) {
+                std::memset(out + done, 0, chunk);
+            } else {
+                BlockPtr data = get_block(block);
+                std::memcpy(out + done, data->data() + in_block, chunk);
+            }
+
+            done += chunk;
+        }
+
+        return n;
+    }
+
+    FCBImage::CacheStats FCBImage::stats() const {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_stats;
+    }
+
+    FCBImage::BlockPtr FCBImage::get_block(std::uint32_t block) const {
+        BlockPtr cached;
+        std::shared_future<BlockPtr> pending;
+        std::shared_ptr<std::promise<BlockPtr>> mine;
+        std::uint64_t ahead_first = 1, ahead_last = 0;     // Blocks to read ahead, empty by default
+
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+
+            const bool sequential = block == m_last_block || block == m_last_block + 1;
+            m_last_block = block;
+            if (!sequential)
+                m_prefetched = block;
+
+            auto it = m_cache.find(block);
+            if (it != m_cache.end()) {
+                m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+                cached = it->second.data;
+                ++m_stats.hits;
+            } else if (auto fl = m_inflight.find(block); fl != m_inflight.end()) {
+                pending = fl->second;
+                ++m_stats.hits;
+            } else {
+                mine = std::make_shared<std::promise<BlockPtr>>();
+                m_inflight.emplace(block, mine->get_future().share());
+                ++m_stats.misses;
+            }
+
+            // A miss means the reader outran (or evicted) the read-ahead, so cover the whole
+            // window again. On a hit only the blocks past the high-water mark are new
+            if (sequential && m_options.read_ahead > 0) {
+                ahead_last = std::min<std::uint64_t>(static_cast<std::uint64_t>(block) + m_options.read_ahead,
+                                                     m_blocks.size() - 1);
+                ahead_first = mine ? block + std::uint64_t{ 1 } : std::max<std::uint64_t>(block, m_prefetched) + 1;
+                m_prefetched = std::max(m_prefetched, ahead_last);
+            }
+        }
+
+        for (std::uint64_t b = ahead_first; b <= ahead_last; ++b)
+            prefetch(static_cast<std::uint32_t>(b));
+
+        if (cached)
+            return cached;
+        if (pending.valid())
+            return pending.get();
+
+        // Nobody is working on it, decoding here beats a round trip through the pool
+        BlockPtr data;
+        try {
+            data = decode_block(block);
+        } catch (...) {
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_inflight.erase(block);
+            }
+            mine->set_exception(std::current_exception());
+            throw;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            insert_locked(block, data);
+            m_inflight.erase(block);
+        }
+        mine->set_value(data);
+        return data;
+    }
+
+    void FCBImage::prefetch(std::uint32_t block) const {
+        if (!m_pool || block >= m_blocks.size() || m_blocks[block].kind == fcb::BlockKind::ZERO)
+            return;
+
+        auto promise = std::make_shared<std::promise<BlockPtr>>();
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (m_cache.count(block) || m_inflight.count(block))
+                return;
+            m_inflight.emplace(block, promise->get_future().share());
+            ++m_stats.prefetches;
+        }
+
+        m_pool->post([this, block, promise] {
+            try {
+                BlockPtr data = decode_block(block);
+                {
+                    std::lock_guard<std::mutex> lock(m_lock);
+                    insert_locked(block, data);
+                    m_inflight.erase(block);
+                }
+                promise->set_value(std::move(data));
+            } catch (...) {
+                {
+                    std::lock_guard<std::mutex> lock(m_lock);
+                    m_inflight.erase(block);
+                }
+                promise->set_exception(std::current_exception());
+            }
+        });
+    }
+
+    FCBImage::BlockPtr FCBImage::decode_block(std::uint32_t block) const {
+        const fcb::BlockEntry &e = m_blocks[block];
+        const std::uint8_t *src = m_file.data() + e.offset;
+        std::uint32_t len = block_length(m_disc_size, m_block_size, block);
+
+        if (e.kind == fcb::BlockKind::RAW)
+            return std::make_shared<const std::vector<std::uint8_t>>(src, src + len);
+
+        auto out = std::make_shared<std::vector<std::uint8_t>>(len);
+        if (!util::lz::decompress(src, e.size, out->data(), len)) {
+            LOG_ERROR("FCB block ", block, " failed to decompress");
+            throw std::runtime_error("FCBImage: corrupt block " + std::to_string(block));
+        }
+        return out;
+    }
+
+    void FCBImage::insert_locked(std::uint32_t block, BlockPtr data) const {
+        if (m_options.cache_blocks == 0 || m_cache.count(block))
+            return;
+
+        m_lru.push_front(block);
+        m_cache.emplace(block, CacheSlot{ std::move(data), m_lru.begin() });
+
+        while (m_cache.size() > m_options.cache_blocks) {
+            m_cache.erase(m_lru.back());
+            m_lru.pop_back();
+        }
+    }
+
+    FCBConvertStats convert_to_fcb(const std::string &iso_path, const std::string &out_path,
+                                   std::uint32_t block_size, std::size_t threads) {
+        if (block_size == 0 || block_size % 0x8000 != 0)
+            throw std::runtime_error("convert_to_fcb: block size must be a multiple of 32kb");
+
+        util::MappedFile src(iso_path);
+        const std::uint64_t disc_size = src.size();
+        const auto count = static_cast<std::uint32_t>((disc_size + block_size - 1) / block_size);
+
+        std::ofstream out(out_path, std::ios::binary | std::ios::trunc);
+        if (!out)
+            throw std::runtime_error("convert_to_fcb: failed to open output: " + out_path);
+
+        // Header first, the table gets filled in once every block's size is known
+        std::vector<std::uint8_t> header(fcb::HEADER_SIZE + static_cast<std::size_t>(count) * fcb::TABLE_ENTRY_SIZE, 0);
+        std::memcpy(header.data(), fcb::MAGIC, 4);
+        put_le32(header.data() + 0x04, fcb::VERSION);
+        put_le32(header.data() + 0x08, block_size);
+        put_le32(header.data() + 0x0C, count);
+        put_le64(header.data() + 0x10, disc_size);
+        out.write(reinterpret_cast<const char *>(header.data()), static_cast<std::streamsize>(header.size()));
+
+        FCBConvertStats stats;
+        stats.blocks = count;
+        stats.input_bytes = disc_size;
+
+        util::ThreadPool pool(threads);
+
+        // Work in windows so memory stays bounded no matter how large the disc is
+        const std::size_t window = pool.size() * 8;
+        std::vector<std::vector<std::uint8_t>> packed(window);
+        std::vector<fcb::BlockKind> kinds(window);
+
+        std::uint64_t cursor = header.size();
+
+        for (std::uint32_t first = 0; first < count; first += static_cast<std::uint32_t>(window)) {
+            const std::uint32_t last = static_cast<std::uint32_t>(std::min<std::uint64_t>(count, first + window));
+            std::atomic<std::uint32_t> next{ first };
+
+            auto encode = [&] {
+                for (std::uint32_t b = next++; b < last; b = next++) {
+                    const std::uint8_t *p = src.data() + static_cast<std::uint64_t>(b) * block_size;
+                    std::uint32_t len = block_length(disc_size, block_size, b);
+                    auto &buf = packed[b - first];
+
+                    if (all_zero(p, len)) {
+                        kinds[b - first] = fcb::BlockKind::ZERO;
+                        buf.clear();
+                    } else if (util::lz::compress(p, len, buf) < len) {
+                        kinds[b - first] = fcb::BlockKind::LZ;
+                    } else {
+                        kinds[b - first] = fcb::BlockKind::RAW;
+                        buf.clear();
+                    }
+                }
+            };
+
+            std::vector<std::future<void>> jobs;
+            for (std::size_t w = 0; w < pool.size(); ++w)
+                jobs.push_back(pool.submit(encode));
+            for (auto &j : jobs)
+                j.get();
+
+            for (std::uint32_t b = first; b < last; ++b) {
+                std::uint8_t *e = header.data() + fcb::HEADER_SIZE + static_cast<std::size_t>(b) * fcb::TABLE_ENTRY_SIZE;
+                fcb::BlockKind kind = kinds[b - first];
+                std::uint32_t size = 0;
+
+                if (kind == fcb::BlockKind::LZ) {
+                    size = static_cast<std::uint32_t>(packed[b - first].size());
+                    out.write(reinterpret_cast<const char *>(packed[b - first].data()), size);
+                } else if (kind == fcb::BlockKind::RAW) {
+                    size = block_length(disc_size, block_size, b);
+                    out.write(reinterpret_cast<const char *>(src.data() + static_cast<std::uint64_t>(b) * block_size), size);
+                    ++stats.raw_blocks;
+                } else {
+                    ++stats.zero_blocks;
+                }
+
+                put_le64(e, kind == fcb::BlockKind::ZERO ? 0 : cursor);
+                put_le32(e + 8, size);
+                put_le32(e + 12, static_cast<std::uint32_t>(kind));
+                cursor += size;
+            }
+
+            if (!out)
+                throw std::runtime_error("convert_to_fcb: failed writing: " + out_path);
+        }
+
+        out.seekp(0);
+        out.write(reinterpret_cast<const char *>(header.data()), static_cast<std::streamsize>(header.size()));
+        out.flush();
+        if (!out)
+            throw std::runtime_error("convert_to_fcb: failed writing: " + out_path);
+
+        stats.output_bytes = cursor;
+
+        LOG_INFO("Converted ", iso_path, " -> ", out_path, ": ", stats.blocks, " blocks, ",
+                 stats.zero_blocks, " zero, ", stats.raw_blocks, " stored raw");
+        return stats;
+    }
+
+} // namespace freecube::ISOLoader
@@ -0,0 +1,480 @@
+#include "util/hash.hpp"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    #include <cpuid.h>
+    #include <immintrin.h>
+    #define FREECUBE_HASH_X86 1     // CLMUL and SHA paths, picked at runtime
+#else
+    #define FREECUBE_HASH_X86 0
+#endif
+
+namespace freecube::util {
+
+    // ---- CRC-32 ----
+
+    namespace {
+        constexpr std::uint32_t CRC_POLY = 0xEDB88320u;    // Reflected 0x04C11DB7
+
+        struct CrcTables {
+            std::uint32_t t[8][256];
+
+            CrcTables() {
+                for (std::uint32_t i = 0; i < 256; i++) {
+                    std::uint32_t c = i;
+                    for (int k = 0; k < 8; k++)
+                        c = (c & 1) ? (c >> 1) ^ CRC_POLY : c >> 1;
+                    t[0][i] = c;
+                }
+                for (std::uint32_t i = 0; i < 256; i++) {
+                    for (int k = 1; k < 8; k++)
+                        t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+                }
+            }
+        };
+
+        const CrcTables &crc_tables() {
+            static const CrcTables tables;
+            return tables;
+        }
+
+        std::uint32_t crc_slice8(std::uint32_t crc, const std::uint8_t *p, std::size_t n) {
+            const auto &t = crc_tables().t;
+
+            while (n >= 8) {
+                crc ^= static_cast<std::uint32_t>(p[0]) | (static_cast<std::uint32_t>(p[1]) << 8) |
+                       (static_cast<std::uint32_t>(p[2]) << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+                const std::uint32_t hi = static_cast<std::uint32_t>(p[4]) | (static_cast<std::uint32_t>(p[5]) << 8) |
+                                         (static_cast<std::uint32_t>(p[6]) << 16) | (static_cast<std::uint32_t>(p[7]) << 24);
+                crc = t[7][crc & 0xFF] ^ t[6][(crc >> 8) & 0xFF] ^ t[5][(crc >> 16) & 0xFF] ^ t[4][crc >> 24] ^
+                      t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+                p += 8;
+                n -= 8;
+            }
+            while (n--)
+                crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xFF];
+            return crc;
+        }
+
+#if FREECUBE_HASH_X86
+        /*
+         * Folding with carry-less multiplies, after Intel's "Fast CRC Computation for Generic
+         * Polynomials Using PCLMULQDQ". Four 128-bit lanes are folded 64 bytes forward at a
+         * time, then into one lane, then Barrett-reduced to 32 bits. The constants are
+         * x^(4*128+32), x^(4*128-32), x^(128+32), x^(128-32), x^64 mod P, P and
+         * floor(x^64 / P), all bit-reflected.
+         *
+         * n must be at least 64 and a multiple of 16.
+         */
+        __attribute__((target("pclmul,sse4.1")))
+        inline __m128i load(const std::uint8_t *p) {
+            return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        }
+
+        // x times k, carried 128 (or 512) bits forward, plus the data it lands on
+        __attribute__((target("pclmul,sse4.1")))
+        inline __m128i fold(__m128i x, __m128i k, __m128i next) {
+            return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00), _mm_clmulepi64_si128(x, k, 0x11)), next);
+        }
+
+        __attribute__((target("pclmul,sse4.1")))
+        std::uint32_t crc_clmul(std::uint32_t crc, const std::uint8_t *p, std::size_t n) {
+            const __m128i k1k2 = _mm_set_epi64x(0x01C6E41596, 0x0154442BD4);
+            const __m128i k3k4 = _mm_set_epi64x(0x00CCAA009E, 0x01751997D0);
+            const __m128i k5 = _mm_set_epi64x(0, 0x0163CD6124);
+            const __m128i poly = _mm_set_epi64x(0x01F7011641, 0x01DB710641);
+            const __m128i low32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+            __m128i x1 = _mm_xor_si128(load(p), _mm_cvtsi32_si128(static_cast<int>(crc)));
+            __m128i x2 = load(p + 16);
+            __m128i x3 = load(p + 32);
+            __m128i x4 = load(p + 48);
+            p += 64;
+            n -= 64;
+
+            while (n >= 64) {
+                x1 = fold(x1, k1k2, load(p));
+                x2 = fold(x2, k1k2, load(p + 16));
+                x3 = fold(x3, k1k2, load(p + 32));
+                x4 = fold(x4, k1k2, load(p + 48));
+                p += 64;
+                n -= 64;
+            }
+
+            x1 = fold(x1, k3k4, x2);
+            x1 = fold(x1, k3k4, x3);
+            x1 = fold(x1, k3k4, x4);
+
+            while (n >= 16) {
+                x1 = fold(x1, k3k4, load(p));
+                p += 16;
+                n -= 16;
+            }
+
+            // 128 -> 64 bits
+            __m128i x2r = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+            x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2r);
+
+            // 64 -> 32 bits
+            x2r = _mm_srli_si128(x1, 4);
+            x1 = _mm_and_si128(x1, low32);
+            x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, k5, 0x00), x2r);
+
+            // Barrett reduction
+            x2r = _mm_and_si128(x1, low32);
+            x2r = _mm_clmulepi64_si128(x2r, poly, 0x10);
+            x2r = _mm_and_si128(x2r, low32);
+            x2r = _mm_clmulepi64_si128(x2r, poly, 0x00);
+            x1 = _mm_xor_si128(x1, x2r);
+
+            return static_cast<std::uint32_t>(_mm_extract_epi32(x1, 1));
+        }
+
+        bool has_clmul() {
+            static const bool supported = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+            return supported;
+        }
+#endif
+
+        // a * b modulo the CRC polynomial, both bit-reflected
+        std::uint32_t multmodp(std::uint32_t a, std::uint32_t b) {
+            std::uint32_t m = 1u << 31;
+            std::uint32_t p = 0;
+            for (;;) {
+                if (a & m) {
+                    p ^= b;
+                    if ((a & (m - 1)) == 0)
+                        break;
+                }
+                m >>= 1;
+                b = (b & 1) ? (b >> 1) ^ CRC_POLY : b >> 1;
+            }
+            return p;
+        }
+
+        // x^(8 * len) modulo the polynomial, by squaring
+        std::uint32_t x8nmodp(std::uint64_t len) {
+            std::uint32_t power = 1u << 23;     // x^8
+            std::uint32_t p = 1u << 31;         // x^0
+            while (len) {
+                if (len & 1)
+                    p = multmodp(power, p);
+                power = multmodp(power, power);
+                len >>= 1;
+            }
+            return p;
+        }
+    }
+
+    std::uint32_t Crc32::extend(std::uint32_t state, const void *data, std::size_t n) {
+        const auto *p = static_cast<const std::uint8_t *>(data);
+#if FREECUBE_HASH_X86
+        if (n >= 64 && has_clmul()) {
+            const std::size_t bulk = n & ~std::size_t(15);
+            state = crc_clmul(state, p, bulk);
+            p += bulk;
+            n -= bulk;
+        }
+#endif
+        return crc_slice8(state, p, n);
+    }
+
+    std::uint32_t Crc32::combine(std::uint32_t crc_a, std::uint32_t crc_b, std::uint64_t len_b) {
+        return multmodp(x8nmodp(len_b), crc_a) ^ crc_b;
+    }
+
+    bool Crc32::accelerated() {
+#if FREECUBE_HASH_X86
+        return has_clmul();
+#else
+        return false;
+#endif
+    }
+
+    // ---- MD5 / SHA-1 ----
+
+    namespace {
+        std::uint32_t rotl(std::uint32_t v, unsigned s) {
+            return (v << s) | (v >> (32 - s));
+        }
+
+        std::uint32_t le32(const std::uint8_t *p) {
+            return static_cast<std::uint32_t>(p[0]) | (static_cast<std::uint32_t>(p[1]) << 8) |
+                   (static_cast<std::uint32_t>(p[2]) << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+        }
+
+        std::uint32_t be32(const std::uint8_t *p) {
+            return (static_cast<std::uint32_t>(p[0]) << 24) | (static_cast<std::uint32_t>(p[1]) << 16) |
+                   (static_cast<std::uint32_t>(p[2]) << 8) | static_cast<std::uint32_t>(p[3]);
+        }
+
+        constexpr std::uint32_t MD5_K[64] = {
+            0xD76AA478, 0xE8C7B756, 0x242070DB, 0xC1BDCEEE, 0xF57C0FAF, 0x4787C62A, 0xA8304613, 0xFD469501,
+            0x698098D8, 0x8B44F7AF, 0xFFFF5BB1, 0x895CD7BE, 0x6B901122, 0xFD987193, 0xA679438E, 0x49B40821,
+            0xF61E2562, 0xC040B340, 0x265E5A51, 0xE9B6C7AA, 0xD62F105D, 0x02441453, 0xD8A1E681, 0xE7D3FBC8,
+            0x21E1CDE6, 0xC33707D6, 0xF4D50D87, 0x455A14ED, 0xA9E3E905, 0xFCEFA3F8, 0x676F02D9, 0x8D2A4C8A,
+            0xFFFA3942, 0x8771F681, 0x6D9D6122, 0xFDE5380C, 0xA4BEEA44, 0x4BDECFA9, 0xF6BB4B60, 0xBEBFBC70,
+            0x289B7EC6, 0xEAA127FA, 0xD4EF3085, 0x04881D05, 0xD9D4D039, 0xE6DB99E5, 0x1FA27CF8, 0xC4AC5665,
+            0xF4292244, 0x432AFF97, 0xAB9423A7, 0xFC93A039, 0x655B59C3, 0x8F0CCC92, 0xFFEFF47D, 0x85845DD1,
+            0x6FA87E4F, 0xFE2CE6E0, 0xA3014314, 0x4E0811A1, 0xF7537E82, 0xBD3AF235, 0x2AD7D2BB, 0xEB86D391,
+        };
+
+        constexpr unsigned MD5_S[16] = { 7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21 };
+
+        /*
+         * The rounds are templates on their index so every one is unrolled with its
+         * constants folded in. Instead of shuffling the working variables along after each
+         * round, each round gets them as a rotated view of one array.
+         */
+        template<int I>
+        inline void md5_round(std::uint32_t (&v)[4], const std::uint32_t (&m)[16]) {
+            std::uint32_t &a = v[(4 - I % 4) % 4];
+            const std::uint32_t b = v[(5 - I % 4) % 4], c = v[(6 - I % 4) % 4], d = v[(7 - I % 4) % 4];
+
+            std::uint32_t f;
+            int g;
+            if constexpr (I < 16) {
+                f = d ^ (b & (c ^ d));
+                g = I;
+            } else if constexpr (I < 32) {
+                f = c ^ (d & (b ^ c));
+                g = (5 * I + 1) & 15;
+            } else if constexpr (I < 48) {
+                f = b ^ c ^ d;
+                g = (3 * I + 5) & 15;
+            } else {
+                f = c ^ (b | ~d);
+                g = (7 * I) & 15;
+            }
+            a = b + rotl(a + f + MD5_K[I] + m[g], MD5_S[(I / 16) * 4 + I % 4]);
+        }
+
+        template<int... Is>
+        inline void md5_rounds(std::uint32_t (&v)[4], const std::uint32_t (&m)[16], std::integer_sequence<int, Is...>) {
+            (md5_round<Is>(v, m), ...);
+        }
+
+        template<int I>
+        inline void sha1_round(std::uint32_t (&v)[5], std::uint32_t (&w)[16]) {
+            const std::uint32_t a = v[(5 - I % 5) % 5];
+            std::uint32_t &b = v[(6 - I % 5) % 5];
+            const std::uint32_t c = v[(7 - I % 5) % 5], d = v[(8 - I % 5) % 5];
+            std::uint32_t &e = v[(9 - I % 5) % 5];
+
+            // Message schedule in a 16-word ring
+            if constexpr (I >= 16)
+                w[I & 15] = rotl(w[(I - 3) & 15] ^ w[(I - 8) & 15] ^ w[(I - 14) & 15] ^ w[I & 15], 1);
+
+            std::uint32_t f, k;
+            if constexpr (I < 20) {
+                f = d ^ (b & (c ^ d));
+                k = 0x5A827999;
+            } else if constexpr (I < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if constexpr (I < 60) {
+                f = (b & c) | (d & (b | c));
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            e += rotl(a, 5) + f + k + w[I & 15];     // Becomes the next round's a
+            b = rotl(b, 30);
+        }
+
+        template<int... Is>
+        inline void sha1_rounds(std::uint32_t (&v)[5], std::uint32_t (&w)[16], std::integer_sequence<int, Is...>) {
+            (sha1_round<Is>(v, w), ...);
+        }
+
+#if FREECUBE_HASH_X86
+        /*
+         * SHA extensions: four rounds per sha1rnds4, with the schedule computed by
+         * sha1msg1/sha1msg2 four words at a time. Group I covers rounds 4I..4I+3; E
+         * alternates between two registers and the message words rotate through four.
+         */
+        template<int I>
+        __attribute__((target("sha,ssse3,sse4.1")))
+        inline void sha1_group(__m128i &abcd, __m128i (&e)[2], __m128i (&msg)[4], const std::uint8_t *block) {
+            if constexpr (I < 4) {
+                const __m128i swap = _mm_set_epi64x(0x0001020304050607ll, 0x08090A0B0C0D0E0Fll);
+                msg[I] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(block + 16 * I)), swap);
+            }
+
+            __m128i &cur = e[I & 1];
+            if constexpr (I == 0)
+                cur = _mm_add_epi32(cur, msg[0]);
+            else
+                cur = _mm_sha1nexte_epu32(cur, msg[I & 3]);
+            e[(I + 1) & 1] = abcd;
+
+            if constexpr (I >= 3 && I <= 18)
+                msg[(I + 1) & 3] = _mm_sha1msg2_epu32(msg[(I + 1) & 3], msg[I & 3]);
+            abcd = _mm_sha1rnds4_epu32(abcd, cur, I / 5);
+            if constexpr (I >= 1 && I <= 16)
+                msg[(I + 3) & 3] = _mm_sha1msg1_epu32(msg[(I + 3) & 3], msg[I & 3]);
+            if constexpr (I >= 2 && I <= 17)
+                msg[(I + 2) & 3] = _mm_xor_si128(msg[(I + 2) & 3], msg[I & 3]);
+        }
+
+        template<int... Is>
+        __attribute__((target("sha,ssse3,sse4.1")))
+        inline void sha1_groups(__m128i &abcd, __m128i (&e)[2], __m128i (&msg)[4], const std::uint8_t *block,
+                                std::integer_sequence<int, Is...>) {
+            (sha1_group<Is>(abcd, e, msg, block), ...);
+        }
+
+        __attribute__((target("sha,ssse3,sse4.1")))
+        void sha1_blocks_ni(std::array<std::uint32_t, 5> &h, const std::uint8_t *p, std::size_t count) {
+            __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(h.data())), 0x1B);
+            __m128i e0 = _mm_set_epi32(static_cast<int>(h[4]), 0, 0, 0);
+
+            for (; count; count--, p += 64) {
+                const __m128i abcd_save = abcd;
+                const __m128i e_save = e0;
+                __m128i e[2] = { e0, e0 };
+                __m128i msg[4];
+
+                sha1_groups(abcd, e, msg, p, std::make_integer_sequence<int, 20>());
+
+                // Group 19 left the next E in e[0]
+                e0 = _mm_sha1nexte_epu32(e[0], e_save);
+                abcd = _mm_add_epi32(abcd, abcd_save);
+            }
+
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(h.data()), _mm_shuffle_epi32(abcd, 0x1B));
+            h[4] = static_cast<std::uint32_t>(_mm_extract_epi32(e0, 3));
+        }
+
+        bool has_sha_ni() {
+            static const bool supported = [] {
+                unsigned a, b, c, d;
+                return __get_cpuid_count(7, 0, &a, &b, &c, &d) && (b & (1u << 29)) &&
+                       __builtin_cpu_supports("ssse3") && __builtin_cpu_supports("sse4.1");
+            }();
+            return supported;
+        }
+#endif
+
+        // Buffer partial blocks, compress whole ones straight from the input
+        template<typename Compress>
+        void absorb(std::array<std::uint8_t, 64> &block, std::uint64_t &length, const void *data, std::size_t n,
+                    Compress compress) {
+            const auto *p = static_cast<const std::uint8_t *>(data);
+            std::size_t used = static_cast<std::size_t>(length & 63);
+            length += n;
+
+            if (used) {
+                const std::size_t take = std::min<std::size_t>(64 - used, n);
+                std::memcpy(block.data() + used, p, take);
+                p += take;
+                n -= take;
+                if (used + take < 64)
+                    return;
+                compress(block.data(), 1);
+            }
+            if (n >= 64)
+                compress(p, n / 64);
+            p += n & ~std::size_t(63);
+            std::memcpy(block.data(), p, n & 63);
+        }
+
+        // Message length in bits goes in the last 8 bytes of the final block
+        template<typename Compress>
+        void pad(std::array<std::uint8_t, 64> &block, std::uint64_t length, bool big_endian, Compress compress) {
+            std::size_t used = static_cast<std::size_t>(length & 63);
+            block[used++] = 0x80;
+            if (used > 56) {
+                std::memset(block.data() + used, 0, 64 - used);
+                compress(block.data(), 1);
+                used = 0;
+            }
+            std::memset(block.data() + used, 0, 56 - used);
+
+            const std::uint64_t bits = length * 8;
+            for (int i = 0; i < 8; i++)
+                block[56 + i] = static_cast<std::uint8_t>(bits >> (big_endian ? 56 - 8 * i : 8 * i));
+            compress(block.data(), 1);
+        }
+    }
+
+    Md5::Md5() : m_h{ 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476 } {}
+
+    void Md5::compress(const std::uint8_t *p, std::size_t count) {
+        for (; count; count--, p += 64) {
+            std::uint32_t m[16];
+            for (int i = 0; i < 16; i++)
+                m[i] = le32(p + 4 * i);
+
+            std::uint32_t v[4] = { m_h[0], m_h[1], m_h[2], m_h[3] };
+            md5_rounds(v, m, std::make_integer_sequence<int, 64>());
+
+            // 64 rounds rotate the view all the way round, so v is a, b, c, d again
+            for (int i = 0; i < 4; i++)
+                m_h[i] += v[i];
+        }
+    }
+
+    void Md5::update(const void *data, std::size_t n) {
+        absorb(m_block, m_length, data, n, [this](const std::uint8_t *p, std::size_t count) { compress(p, count); });
+    }
+
+    Md5::Digest Md5::finish() {
+        pad(m_block, m_length, false, [this](const std::uint8_t *p, std::size_t count) { compress(p, count); });
+
+        Digest out;
+        for (int i = 0; i < 16; i++)
+            out[i] = static_cast<std::uint8_t>(m_h[i / 4] >> (8 * (i % 4)));
+        return out;
+    }
+
+    Sha1::Sha1() : m_h{ 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 } {}
+
+    void Sha1::compress(const std::uint8_t *p, std::size_t count) {
+#if FREECUBE_HASH_X86
+        if (has_sha_ni()) {
+            sha1_blocks_ni(m_h, p, count);
+            return;
+        }
+#endif
+        for (; count; count--, p += 64) {
+            std::uint32_t w[16];
+            for (int i = 0; i < 16; i++)
+                w[i] = be32(p + 4 * i);
+
+            std::uint32_t v[5] = { m_h[0], m_h[1], m_h[2], m_h[3], m_h[4] };
+            sha1_rounds(v, w, std::make_integer_sequence<int, 80>());
+
+            // Likewise 80 rounds are a whole number of turns of five
+            for (int i = 0; i < 5; i++)
+                m_h[i] += v[i];
+        }
+    }
+
+    void Sha1::update(const void *data, std::size_t n) {
+        absorb(m_block, m_length, data, n, [this](const std::uint8_t *p, std::size_t count) { compress(p, count); });
+    }
+
+    Sha1::Digest Sha1::finish() {
+        pad(m_block, m_length, true, [this](const std::uint8_t *p, std::size_t count) { compress(p, count); });
+
+        Digest out;
+        for (int i = 0; i < 20; i++)
+            out[i] = static_cast<std::uint8_t>(m_h[i / 4] >> (24 - 8 * (i % 4)));
+        return out;
+    }
+
+    std::string to_hex(const std::uint8_t *data, std::size_t n) {
+        static const char digits[] = "0123456789abcdef";
+        std::string s(n * 2, '0');
+        for (std::size_t i = 0; i < n; i++) {
+            s[2 * i] = digits[data[i] >> 4];
+            s[2 * i + 1] = digits[data[i] & 15];
+        }
+        return s;
+    }
+
+} // namespace freecube::util
@@ -0,0 +1,1066 @@
+#include "cpu/interpreter.hpp"
+#include "cpu/paired_single.hpp"
+#include "memory/memory.hpp"
+#include "util/log.hpp"
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+namespace freecube::cpu {
+
+    // ---- Helpers ----
+
+    template<typename To, typename From>
+    static inline To bit_cast(From v) {
+        static_assert(sizeof(To) == sizeof(From), "bit_cast size mismatch");
+        To r;
+        std::memcpy(&r, &v, sizeof(To));
+        return r;
+    }
+
+    // All guest memory goes through these. slow_access is only set while retrying an
+    // instruction whose fastmem access faulted, so the branch is always predicted.
+    template<typename T>
+    static inline T load(CPUState &cpu, uint32_t ea) {
+        return cpu.slow_access ? cpu.mem->read_slow<T>(ea) : cpu.mem->read<T>(ea);
+    }
+
+    template<typename T>
+    static inline void store(CPUState &cpu, uint32_t ea, T value) {
+        if (cpu.slow_access)
+            cpu.mem->write_slow<T>(ea, value);
+        else
+            cpu.mem->write<T>(ea, value);
+    }
+
+    static inline uint32_t ea_d(const CPUState &cpu, const Instruction &inst) {
+        return (inst.rA ? cpu.gpr[inst.rA] : 0) + static_cast<uint32_t>(static_cast<int32_t>(inst.simm));
+    }
+
+    static inline uint32_t ea_x(const CPUState &cpu, const Instruction &inst) {
+        return (inst.rA ? cpu.gpr[inst.rA] : 0) + cpu.gpr[inst.rB];
+    }
+
+    static inline bool rc(const Instruction &inst) { return inst.raw & 1; }
+    static inline bool oe(const Instruction &inst) { return inst.raw & 0x400; }
+    static inline uint8_t rC(const Instruction &inst) { return (inst.raw >> 6) & 0x1F; }
+
+    static inline void set_cr_field(CPUState &cpu, unsigned field, uint32_t value) {
+        const unsigned shift = 28 - field * 4;
+        cpu.cr = (cpu.cr & ~(0xFu << shift)) | ((value & 0xF) << shift);
+        if (field == 0)
+            cpu.cr0_lazy = 0;
+    }
+
+    // Record forms only note the result, see CPUState::read_cr()
+    static inline void update_cr0(CPUState &cpu, uint32_t result) {
+        cpu.record_cr0(result);
+    }
+
+    static inline uint32_t xer_so(const CPUState &cpu) {
+        return cpu.xer_so_ov >> 1;
+    }
+
+    static inline void update_cr1(CPUState &cpu) {
+        set_cr_field(cpu, 1, cpu.fpscr >> 28);
+    }
+
+    static inline void set_ca(CPUState &cpu, bool ca) {
+        cpu.xer_ca = ca;
+    }
+
+    static inline uint32_t get_ca(const CPUState &cpu) {
+        return cpu.xer_ca;
+    }
+
+    static inline void set_ov(CPUState &cpu, bool ov) {
+        cpu.xer_so_ov = ov ? 3 : (cpu.xer_so_ov & 2);
+    }
+
+    static inline uint32_t rotl(uint32_t v, unsigned n) {
+        n &= 31;
+        return n ? (v << n) | (v >> (32 - n)) : v;
+    }
+
+    static inline uint32_t rot_mask(unsigned mb, unsigned me) {
+        const uint32_t m = (0xFFFFFFFFu >> mb) ^ (me >= 31 ? 0 : 0xFFFFFFFFu >> (me + 1));
+        return mb <= me ? m : ~m;
+    }
+
+    static inline uint32_t spr_number(const Instruction &inst) {
+        return ((inst.raw >> 16) & 0x1F) | (((inst.raw >> 11) & 0x1F) << 5);
+    }
+
+    static inline bool cr_bit(const CPUState &cpu, unsigned bit) {
+        return (cpu.read_cr() >> (31 - bit)) & 1;
+    }
+
+    // Shared by add/addc/adde/addze/addme and the subf family (which add ~rA)
+    static inline uint32_t add_with_carry(CPUState &cpu, const Instruction &inst, uint32_t a, uint32_t b,
+                                          uint32_t carry_in, bool set_carry) {
+        const uint64_t wide = static_cast<uint64_t>(a) + b + carry_in;
+        const uint32_t r = static_cast<uint32_t>(wide);
+
+        if (set_carry)
+            set_ca(cpu, wide >> 32);
+        if (oe(inst))
+            set_ov(cpu, ((a ^ r) & (b ^ r)) >> 31);
+        if (rc(inst))
+            update_cr0(cpu, r);
+        return r;
+    }
+
+    void raise_exception(CPUState &cpu, Exception ex, uint32_t return_pc, uint32_t srr1_cause) {
+        cpu.spr[spr::SRR0] = return_pc;
+        cpu.spr[spr::SRR1] = (cpu.msr & 0x87C0FFFF) | srr1_cause;
+
+        // Supervisor, external interrupts/FP/traces/translation off, endianness from ILE
+        const uint32_t ile = (cpu.msr >> 16) & 1;
+        cpu.msr = (cpu.msr & ~0x0004EF37u) | ile;
+
+        cpu.npc = static_cast<uint32_t>(ex) | ((cpu.msr & MSR_IP) ? 0xFFF00000 : 0);
+    }
+
+    // ---- Integer arithmetic ----
+
+    static void op_addi(CPUState &cpu, const Instruction &inst) {
+        cpu.gpr[inst.rD] = (inst.rA ? cpu.gpr[inst.rA] : 0) + static_cast<int32_t>(inst.simm);
+    }
+
+    static void op_addis(CPUState &cpu, const Instruction &inst) {
+        cpu.gpr[inst.rD] = (inst.rA ? cpu.gpr[inst.rA] : 0) + (static_cast<uint32_t>(inst.uimm) << 16);
+    }
+
+    static void op_addic(CPUState &cpu, const Instruction &inst) {
+        const uint32_t a = cpu.gpr[inst.rA];
+        const uint32_t r = a + static_cast<int32_t>(inst.simm);
+        set_ca(cpu, r < a);
+        cpu.gpr[inst.rD] = r;
+        if (inst.opcode == 13)
+            update_cr0(cpu, r);
+    }
+
+    static void op_subfic(CPUState &cpu, const Instruction &inst) {
+        const uint32_t a = cpu.gpr[inst.rA];
+        const uint32_t imm = static_cast<uint32_t>(static_cast<int32_t>(inst.simm));
+        const uint64_t wide = static_cast<uint64_t>(~a) + imm + 1;
+        set_ca(cpu, wide >> 32);
+        cpu.gpr[inst.rD] = static_cast<uint32_t>(wide);
+    }
+
+    static void op_mulli(CPUState &cpu, const Instruction &inst) {
+        // Low 32 bits are the same signed or not, and unsigned can't overflow
+        cpu.gpr[inst.rD] = cpu.gpr[inst.rA] * static_cast<uint32_t>(static_cast<int32_t>(inst.simm));
+    }
+
+    static void op_add(CPUState &cpu, const Instruction &inst) {
+        cpu.gpr[inst.rD] = add_with_carry(cpu, inst, cpu.gpr[inst.rA], cpu.gpr[inst.rB], 0, false);
+    }
+
+    static void op_addc(CPUState &cpu, const Instruction &inst) {
+        cpu.gpr[inst.rD] = add_with_carry(cpu, inst, cpu.gpr[inst.rA], cpu.gpr[inst.rB], 0, true);
+    }
+
+    static void op_adde(CPUState &cpu, const Instruction &inst) {
+        cpu.gpr[inst.rD] = add_with_carry(cpu, inst, cpu.gpr[inst.rA], cpu.gpr[inst.rB], get_ca(cpu), true);
+    }
+
+    static void op_addze(CPUState &cpu, const Instruction &inst) {
+        cpu.gpr[inst.rD] = add_with_carry(cpu, inst, cpu.gpr[inst.rA], 0, get_ca(cpu), true);
+    }
+
+    static void op_addme(CPUState &cpu, const Instruction &inst) {
+        cpu.gpr[inst.rD] = add_with_carry(cpu, inst, cpu.gpr[inst.rA], 0xFFFFFFFF, get_ca(cpu), true);
+    }
+
+    static void op_subf(CPUState &cpu, const Instruction &inst) {
+        cpu.gpr[inst.rD] = add_with_carry(cpu, inst, ~cpu.gpr[inst.rA], cpu.gpr[inst.rB], 1, false);
+    }
+
+    static void op_subfc(CPUState &cpu, const Instruction &inst) {
+        cpu.gpr[inst.rD] = add_with_carry(cpu, inst, ~cpu.gpr[inst.rA], cpu.gpr[inst.rB], 1, true);
+    }
+
+    static void op_subfe(CPUState &cpu, const Instruction &inst) {
+        cpu.gpr[inst.rD] = add_with_carry(cpu, inst, ~cpu.gpr[inst.rA], cpu.gpr[inst.rB], get_ca(cpu), true);
+    }
+
+    static void op_subfze(CPUState &cpu, const Instruction &inst) {
+        cpu.gpr[inst.rD] = add_with_carry(cpu, inst, ~cpu.gpr[inst.rA], 0, get_ca(cpu), true);
+    }
+
+    static void op_subfme(CPUState &cpu, const Instruction &inst) {
+        cpu.gpr[inst.rD] = add_with_carry(cpu, inst, ~cpu.gpr[inst.rA], 0xFFFFFFFF, get_ca(cpu), true);
+    }
+
+    static void op_neg(CPUState &cpu, const Instruction &inst) {
+        const uint32_t a = cpu.gpr[inst.rA];
+        const uint32_t r = ~a + 1;
+        if (oe(inst))
+            set_ov(cpu, a == 0x80000000);
+        if (rc(inst))
+            update_cr0(cpu, r);
+        cpu.gpr[inst.rD] = r;
+    }
+
+    static void op_mullw(CPUState &cpu, const Instruction &inst) {
+        const int64_t wide = static_cast<int64_t>(static_cast<int32_t>(cpu.gpr[inst.rA])) *
+                             static_cast<int32_t>(cpu.gpr[inst.rB]);
+        const uint32_t r = static_cast<uint32_t>(wide);
+        if (oe(inst))
+            set_ov(cpu, wide < std::numeric_limits<int32_t>::min() || wide > std::numeric_limits<int32_t>::max());
+        if (rc(inst))
+            update_cr0(cpu, r);
+        cpu.gpr[inst.rD] = r;
+    }
+
+    static void op_mulhw(CPUState &cpu, const Instruction &inst) {
+        const int64_t wide = static_cast<int64_t>(static_cast<int32_t>(cpu.gpr[inst.rA])) *
+                             static_cast<int32_t>(cpu.gpr[inst.rB]);
+        const uint32_t r = static_cast<uint32_t>(static_cast<uint64_t>(wide) >> 32);
+        if (rc(inst))
+            update_cr0(cpu, r);
+        cpu.gpr[inst.rD] = r;
+    }
+
+    static void op_mulhwu(CPUState &cpu, const Instruction &inst) {
+        const uint64_t wide = static_cast<uint64_t>(cpu.gpr[inst.rA]) * cpu.gpr[inst.rB];
+        const uint32_t r = static_cast<uint32_t>(wide >> 32);
+        if (rc(inst))
+            update_cr0(cpu, r);
+        cpu.gpr[inst.rD] = r;
+    }
+
+    static void op_divw(CPUState &cpu, const Instruction &inst) {
+        const int32_t a = static_cast<int32_t>(cpu.gpr[inst.rA]);
+        const int32_t b = static_cast<int32_t>(cpu.gpr[inst.rB]);
+        const bool overflow = b == 0 || (a == std::numeric_limits<int32_t>::min() && b == -1);
+
+        // Gekko leaves all ones for a negative dividend, zero otherwise
+        const uint32_t r = overflow ? (a < 0 ? 0xFFFFFFFF : 0) : static_cast<uint32_t>(a / b);
+        if (oe(inst))
+            set_ov(cpu, overflow);
+        if (rc(inst))
+            update_cr0(cpu, r);
+        cpu.gpr[inst.rD] = r;
+    }
+
+    static void op_divwu(CPUState &cpu, const Instruction &inst) {
+        const uint32_t a = cpu.gpr[inst.rA];
+        const uint32_t b = cpu.gpr[inst.rB];
+        const uint32_t r = b ? a / b : 0;
+        if (oe(inst))
+            set_ov(cpu, b == 0);
+        if (rc(inst))
+            update_cr0(cpu, r);
+        cpu.gpr[inst.rD] = r;
+    }
+
+    // ---- Compare ----
+
+    static inline uint32_t compare_signed(const CPUState &cpu, int32_t a, int32_t b) {
+        return (a < b ? 0x8 : a > b ? 0x4 : 0x2) | xer_so(cpu);
+    }
+
+    static inline uint32_t compare_unsigned(const CPUState &cpu, uint32_t a, uint32_t b) {
+        return (a < b ? 0x8 : a > b ? 0x4 : 0x2) | xer_so(cpu);
+    }
+
+    static void op_cmpi(CPUState &cpu, const Instruction &inst) {
+        set_cr_field(cpu, inst.rD >> 2, compare_signed(cpu, static_cast<int32_t>(cpu.gpr[inst.rA]), inst.simm));
+    }
+
+    static void op_cmpli(CPUState &cpu, const Instruction &inst) {
+        set_cr_field(cpu, inst.rD >> 2, compare_unsigned(cpu, cpu.gpr[inst.rA], inst.uimm));
+    }
+
+    static void op_cmp(CPUState &cpu, const Instruction &inst) {
+        set_cr_field(cpu, inst.rD >> 2, compare_signed(cpu, static_cast<int32_t>(cpu.gpr[inst.rA]),
+                                                       static_cast<int32_t>(cpu.gpr[inst.rB])));
+    }
+
+    static void op_cmpl(CPUState &cpu, const Instruction &inst) {
+        set_cr_field(cpu, inst.rD >> 2, compare_unsigned(cpu, cpu.gpr[inst.rA], cpu.gpr[inst.rB]));
+    }
+
+    // ---- Logical, shifts and rotates (rS is in the rD slot, the result goes to rA) ----
+
+    static void op_ori(CPUState &cpu, const Instruction &inst) {
+        cpu.gpr[inst.rA] = cpu.gpr[inst.rD] | inst.uimm;
+    }
+
+    static void op_oris(CPUState &cpu, const Instruction &inst) {
+        cpu.gpr[inst.rA] = cpu.gpr[inst.rD] | (static_cast<uint32_t>(inst.uimm) << 16);
+    }
+
+    static void op_xori(CPUState &cpu, const Instruction &inst) {
+        cpu.gpr[inst.rA] = cpu.gpr[inst.rD] ^ inst.uimm;
+    }
+
+    static void op_xoris(CPUState &cpu, const Instruction &inst) {
+        cpu.gpr[inst.rA] = cpu.gpr[inst.rD] ^ (static_cast<uint32_t>(inst.uimm) << 16);
+    }
+
+    static void op_andi_rc(CPUState &cpu, const Instruction &inst) {
+        const uint32_t r = cpu.gpr[inst.rD] & inst.uimm;
+        cpu.gpr[inst.rA] = r;
+        update_cr0(cpu, r);
+    }
+
+    static void op_andis_rc(CPUState &cpu, const Instruction &inst) {
+        const uint32_t r = cpu.gpr[inst.rD] & (static_cast<uint32_t>(inst.uimm) << 16);
+        cpu.gpr[inst.rA] = r;
+        update_cr0(cpu, r);
+    }
+
+    // X-form logical ops differ only in the operation
+    template<uint32_t (*Op)(uint32_t, uint32_t)>
+    static void op_logical(CPUState &cpu, const Instruction &inst) {
+        const uint32_t r = Op(cpu.gpr[inst.rD], cpu.gpr[inst.rB]);
+        cpu.gpr[inst.rA] = r;
+        if (rc(inst))
+            update_cr0(cpu, r);
+    }
+
+    static uint32_t l_and(uint32_t s, uint32_t b)  { return s & b; }
+    static uint32_t l_andc(uint32_t s, uint32_t b) { return s & ~b; }
+    static uint32_t l_or(uint32_t s, uint32_t b)   { return s | b; }
+    static uint32_t l_orc(uint32_t s, uint32_t b)  { return s | ~b; }
+    static uint32_t l_xor(uint32_t s, uint32_t b)  { return s ^ b; }
+    static uint32_t l_nor(uint32_t s, uint32_t b)  { return ~(s | b); }
+    static uint32_t l_nand(uint32_t s, uint32_t b) { return ~(s & b); }
+    static uint32_t l_eqv(uint32_t s, uint32_t b)  { return ~(s ^ b); }
+    static uint32_t l_slw(uint32_t s, uint32_t b)  { return (b & 0x20) ? 0 : s << (b & 0x1F); }
+    static uint32_t l_srw(uint32_t s, uint32_t b)  { return (b & 0x20) ? 0 : s >> (b & 0x1F); }
+
+    static void op_sraw(CPUState &cpu, const Instruction &inst) {
+        const int32_t s = static_cast<int32_t>(cpu.gpr[inst.rD]);
+        const uint32_t n = cpu.gpr[inst.rB] & 0x3F;
+        uint32_t r;
+        bool ca;
+
+        if (n & 0x20) {
+            r = s < 0 ? 0xFFFFFFFF : 0;
+            ca = s < 0;
+        } else {
+            r = static_cast<uint32_t>(s >> n);
+            ca = s < 0 && n && (static_cast<uint32_t>(s) << (32 - n)) != 0;
+        }
+
+        set_ca(cpu, ca);
+        cpu.gpr[inst.rA] = r;
+        if (rc(inst))
+            update_cr0(cpu, r);
+    }
+
+    static void op_srawi(CPUState &cpu, const Instruction &inst) {
+        const int32_t s = static_cast<int32_t>(cpu.gpr[inst.rD]);
+        const uint32_t n = inst.rB;
+        const uint32_t r = static_cast<uint32_t>(s >> n);
+
+        set_ca(cpu, s < 0 && n && (static_cast<uint32_t>(s) << (32 - n)) != 0);
+        cpu.gpr[inst.rA] = r;
+        if (rc(inst))
+            update_cr0(cpu, r);
+    }
+
+    static void op_cntlzw(CPUState &cpu, const Instruction &inst) {
+        const uint32_t s = cpu.gpr[inst.rD];
+        uint32_t n = 0;
+        while (n < 32 && !(s & (0x80000000u >> n)))
+            n++;
+        cpu.gpr[inst.rA] = n;
+        if (rc(inst))
+            update_cr0(cpu, n);
+    }
+
+    static void op_extsb(CPUState &cpu, const Instruction &inst) {
+        const uint32_t r = static_cast<uint32_t>(static_cast<int32_t>(static_cast<int8_t>(cpu.gpr[inst.rD])));
+        cpu.gpr[inst.rA] = r;
+        if (rc(inst))
+            update_cr0(cpu, r);
+    }
+
+    static void op_extsh(CPUState &cpu, const Instruction &inst) {
+        const uint32_t r = static_cast<uint32_t>(static_cast<int32_t>(static_cast<int16_t>(cpu.gpr[inst.rD])));
+        cpu.gpr[inst.rA] = r;
+        if (rc(inst))
+            update_cr0(cpu, r);
+    }
+
+    static void op_rlwinm(CPUState &cpu, const Instruction &inst) {
+        const uint32_t r = rotl(cpu.gpr[inst.rD], inst.rB) & rot_mask(rC(inst), (inst.raw >> 1) & 0x1F);
+        cpu.gpr[inst.rA] = r;
+        if (rc(inst))
+            update_cr0(cpu, r);
+    }
+
+    static void op_rlwnm(CPUState &cpu, const Instruction &inst) {
+        const uint32_t r = rotl(cpu.gpr[inst.rD], cpu.gpr[inst.rB]) & rot_mask(rC(inst), (inst.raw >> 1) & 0x1F);
+        cpu.gpr[inst.rA] = r;
+        if (rc(inst))
+            update_cr0(cpu, r);
+    }
+
+    static void op_rlwimi(CPUState &cpu, const Instruction &inst) {
+        const uint32_t m = rot_mask(rC(inst), (inst.raw >> 1) & 0x1F);
+        const uint32_t r = (rotl(cpu.gpr[inst.rD], inst.rB) & m) | (cpu.gpr[inst.rA] & ~m);
+        cpu.gpr[inst.rA] = r;
+        if (rc(inst))
+            update_cr0(cpu, r);
+    }
+
+    // ---- Branches ----
+
+    static void op_b(CPUState &cpu, const Instruction &inst) {
+        const int32_t li = static_cast<int32_t>((inst.raw & 0x03FFFFFC) << 6) >> 6;
+        const uint32_t target = (inst.raw & 2) ? static_cast<uint32_t>(li) : cpu.pc + li;
+        if (inst.raw & 1)
+            cpu.lr = cpu.pc + 4;
+        cpu.npc = target;
+    }
+
+    // BO is in the rD slot, BI in rA
+    static inline bool branch_taken(CPUState &cpu, const Instruction &inst, bool use_ctr) {
+        const uint32_t bo = inst.rD;
+
+        bool ctr_ok = true;
+        if (use_ctr && !(bo & 0x04)) {
+            cpu.ctr--;
+            ctr_ok = (cpu.ctr != 0) != static_cast<bool>(bo & 0x02);
+        }
+
+        const bool cond_ok = (bo & 0x10) || cr_bit(cpu, inst.rA) == static_cast<bool>(bo & 0x08);
+        return ctr_ok && cond_ok;
+    }
+
+    static void op_bc(CPUState &cpu, const Instruction &inst) {
+        if (branch_taken(cpu, inst, true)) {
+            const int32_t bd = static_cast<int16_t>(inst.raw & 0xFFFC);
+            cpu.npc = (inst.raw & 2) ? static_cast<uint32_t>(bd) : cpu.pc + bd;
+        }
+        if (inst.raw & 1)
+            cpu.lr = cpu.pc + 4;
+    }
+
+    static void op_bclr(CPUState &cpu, const Instruction &inst) {
+        const uint32_t target = cpu.lr & ~3u;
+        if (branch_taken(cpu, inst, true))
+            cpu.npc = target;
+        if (inst.raw & 1)
+            cpu.lr = cpu.pc + 4;
+    }
+
+    static void op_bcctr(CPUState &cpu, const Instruction &inst) {
+        if (branch_taken(cpu, inst, false))
+            cpu.npc = cpu.ctr & ~3u;
+        if (inst.raw & 1)
+            cpu.lr = cpu.pc + 4;
+    }
+
+    // ---- Condition register ----
+
+    template<bool (*Op)(bool, bool)>
+    static void op_crlogical(CPUState &cpu, const Instruction &inst) {
+        const bool r = Op(cr_bit(cpu, inst.rA), cr_bit(cpu, inst.rB));
+        const uint32_t bit = 0x80000000u >> inst.rD;
+        const uint32_t cr = cpu.read_cr();
+        cpu.write_cr(r ? (cr | bit) : (cr & ~bit));
+    }
+
+    static bool c_and(bool a, bool b)  { return a && b; }
+    static bool c_andc(bool a, bool b) { return a && !b; }
+    static bool c_or(bool a, bool b)   { return a || b; }
+    static bool c_orc(bool a, bool b)  { return a || !b; }
+    static bool c_xor(bool a, bool b)  { return a != b; }
+    static bool c_nor(bool a, bool b)  { return !(a || b); }
+    static bool c_nand(bool a, bool b) { return !(a && b); }
+    static bool c_eqv(bool a, bool b)  { return a == b; }
+
+    static void op_mcrf(CPUState &cpu, const Instruction &inst) {
+        set_cr_field(cpu, inst.rD >> 2, cpu.read_cr() >> (28 - (inst.rA >> 2) * 4));
+    }
+
+    static void op_mcrxr(CPUState &cpu, const Instruction &inst) {
+        set_cr_field(cpu, inst.rD >> 2, cpu.read_xer() >> 28);
+        cpu.xer_so_ov = 0;
+        cpu.xer_ca = 0;
+    }
+
+    static void op_mfcr(CPUState &cpu, const Instruction &inst) {
+        cpu.gpr[inst.rD] = cpu.read_cr();
+    }
+
+    static void op_mtcrf(CPUState &cpu, const Instruction &inst) {
+        const uint32_t crm = (inst.raw >> 12) & 0xFF;
+        uint32_t mask = 0;
+        for (unsigned i = 0; i < 8; i++) {
+            if (crm & (0x80 >> i))
+                mask |= 0xF0000000u >> (i * 4);
+        }
+        cpu.write_cr((cpu.read_cr() & ~mask) | (cpu.gpr[inst.rD] & mask));
+    }
+
+    // ---- Loads and stores (access first, registers after: see Handler) ----
+
+    template<typename Mem, bool Indexed, bool Update, bool Signed = false>
+    static void op_load(CPUState &cpu, const Instruction &inst) {
+        const uint32_t ea = Indexed ? ea_x(cpu, inst) : ea_d(cpu, inst);
+        const Mem v = load<Mem>(cpu, ea);
+        if constexpr (Update)
+            cpu.gpr[inst.rA] = ea;
+        if constexpr (Signed)
+            cpu.gpr[inst.rD] = static_cast<uint32_t>(static_cast<int32_t>(static_cast<std::make_signed_t<Mem>>(v)));
+        else
+            cpu.gpr[inst.rD] = v;
+    }
+
+    template<typename Mem, bool Indexed, bool Update>
+    static void op_store(CPUState &cpu, const Instruction &inst) {
+        const uint32_t ea = Indexed ? ea_x(cpu, inst) : ea_d(cpu, inst);
+        store<Mem>(cpu, ea, static_cast<Mem>(cpu.gpr[inst.rD]));
+        if constexpr (Update)
+            cpu.gpr[inst.rA] = ea;
+    }
+
+    static void op_lhbrx(CPUState &cpu, const Instruction &inst) {
+        cpu.gpr[inst.rD] = util::bswap(load<uint16_t>(cpu, ea_x(cpu, inst)));
+    }
+
+    static void op_lwbrx(CPUState &cpu, const Instruction &inst) {
+        cpu.gpr[inst.rD] = util::bswap(load<uint32_t>(cpu, ea_x(cpu, inst)));
+    }
+
+    static void op_sthbrx(CPUState &cpu, const Instruction &inst) {
+        store<uint16_t>(cpu, ea_x(cpu, inst), util::bswap(static_cast<uint16_t>(cpu.gpr[inst.rD])));
+    }
+
+    static void op_stwbrx(CPUState &cpu, const Instruction &inst) {
+        store<uint32_t>(cpu, ea_x(cpu, inst), util::bswap(cpu.gpr[inst.rD]));
+    }
+
+    static void op_lmw(CPUState &cpu, const Instruction &inst) {
+        uint32_t ea = ea_d(cpu, inst);
+        uint32_t values[32];
+        for (unsigned r = inst.rD; r < 32; r++, ea += 4)
+            values[r] = load<uint32_t>(cpu, ea);
+        for (unsigned r = inst.rD; r < 32; r++)
+            cpu.gpr[r] = values[r];
+    }
+
+    static void op_stmw(CPUState &cpu, const Instruction &inst) {
+        uint32_t ea = ea_d(cpu, inst);
+        for (unsigned r = inst.rD; r < 32; r++, ea += 4)
+            store<uint32_t>(cpu, ea, cpu.gpr[r]);
+    }
+
+    static void op_lwarx(CPUState &cpu, const Instruction &inst) {
+        const uint32_t ea = ea_x(cpu, inst);
+        const uint32_t v = load<uint32_t>(cpu, ea);
+        cpu.reserve = true;
+        cpu.reserve_address = ea;
+        cpu.gpr[inst.rD] = v;
+    }
+
+    static void op_stwcx(CPUState &cpu, const Instruction &inst) {
+        const uint32_t ea = ea_x(cpu, inst);
+        uint32_t f = xer_so(cpu);
+        if (cpu.reserve && cpu.reserve_address == ea) {
+            store<uint32_t>(cpu, ea, cpu.gpr[inst.rD]);
+            f |= 0x2;
+        }
+        cpu.reserve = false;
+        set_cr_field(cpu, 0, f);
+    }
+
+    static void op_dcbz(CPUState &cpu, const Instruction &inst) {
+        const uint32_t ea = ea_x(cpu, inst) & ~31u;
+        for (uint32_t i = 0; i < 32; i += 8)
+            store<uint64_t>(cpu, ea + i, 0);
+    }
+
+    static void op_icbi(CPUState &cpu, const Instruction &inst) {
+        if (cpu.on_icbi)
+            cpu.on_icbi(ea_x(cpu, inst));
+    }
+
+    // Cache hints and barriers, nothing to do without a cache model
+    static void op_nop(CPUState &, const Instruction &) {}
+
+    // ---- Floating point loads/stores ----
+
+    template<bool Indexed, bool Update>
+    static void op_lfs(CPUState &cpu, const Instruction &inst) {
+        const uint32_t ea = Indexed ? ea_x(cpu, inst) : ea_d(cpu, inst);
+        const float v = bit_cast<float>(load<uint32_t>(cpu, ea));
+        if constexpr (Update)
+            cpu.gpr[inst.rA] = ea;
+        cpu.fpr[inst.rD] = { v, v };
+    }
+
+    template<bool Indexed, bool Update>
+    static void op_lfd(CPUState &cpu, const Instruction &inst) {
+        const uint32_t ea = Indexed ? ea_x(cpu, inst) : ea_d(cpu, inst);
+        const uint64_t v = load<uint64_t>(cpu, ea);
+        if constexpr (Update)
+            cpu.gpr[inst.rA] = ea;
+        cpu.fpr[inst.rD].ps0 = bit_cast<double>(v);
+    }
+
+    template<bool Indexed, bool Update>
+    static void op_stfs(CPUState &cpu, const Instruction &inst) {
+        const uint32_t ea = Indexed ? ea_x(cpu, inst) : ea_d(cpu, inst);
+        store<uint32_t>(cpu, ea, bit_cast<uint32_t>(static_cast<float>(cpu.fpr[inst.rD].ps0)));
+        if constexpr (Update)
+            cpu.gpr[inst.rA] = ea;
+    }
+
+    template<bool Indexed, bool Update>
+    static void op_stfd(CPUState &cpu, const Instruction &inst) {
+        const uint32_t ea = Indexed ? ea_x(cpu, inst) : ea_d(cpu, inst);
+        store<uint64_t>(cpu, ea, bit_cast<uint64_t>(cpu.fpr[inst.rD].ps0));
+        if constexpr (Update)
+            cpu.gpr[inst.rA] = ea;
+    }
+
+    static void op_stfiwx(CPUState &cpu, const Instruction &inst) {
+        store<uint32_t>(cpu, ea_x(cpu, inst), static_cast<uint32_t>(bit_cast<uint64_t>(cpu.fpr[inst.rD].ps0)));
+    }
+
+    // ---- Floating point arithmetic (frD = rD, frA = rA, frB = rB, frC = rC) ----
+
+    // Single precision results go to both paired-single lanes, double ones only to ps0
+    template<bool Single>
+    static inline void fp_result(CPUState &cpu, const Instruction &inst, double r) {
+        if constexpr (Single) {
+            const double v = static_cast<float>(r);
+            cpu.fpr[inst.rD] = { v, v };
+        } else {
+            cpu.fpr[inst.rD].ps0 = r;
+        }
+        if (rc(inst))
+            update_cr1(cpu);
+    }
+
+    template<bool Single> static void op_fadd(CPUState &cpu, const Instruction &inst) {
+        fp_result<Single>(cpu, inst, cpu.fpr[inst.rA].ps0 + cpu.fpr[inst.rB].ps0);
+    }
+    template<bool Single> static void op_fsub(CPUState &cpu, const Instruction &inst) {
+        fp_result<Single>(cpu, inst, cpu.fpr[inst.rA].ps0 - cpu.fpr[inst.rB].ps0);
+    }
+    template<bool Single> static void op_fmul(CPUState &cpu, const Instruction &inst) {
+        fp_result<Single>(cpu, inst, cpu.fpr[inst.rA].ps0 * cpu.fpr[rC(inst)].ps0);
+    }
+    template<bool Single> static void op_fdiv(CPUState &cpu, const Instruction &inst) {
+        fp_result<Single>(cpu, inst, cpu.fpr[inst.rA].ps0 / cpu.fpr[inst.rB].ps0);
+    }
+    template<bool Single> static void op_fmadd(CPUState &cpu, const Instruction &inst) {
+        fp_result<Single>(cpu, inst, std::fma(cpu.fpr[inst.rA].ps0, cpu.fpr[rC(inst)].ps0, cpu.fpr[inst.rB].ps0));
+    }
+    template<bool Single> static void op_fmsub(CPUState &cpu, const Instruction &inst) {
+        fp_result<Single>(cpu, inst, std::fma(cpu.fpr[inst.rA].ps0, cpu.fpr[rC(inst)].ps0, -cpu.fpr[inst.rB].ps0));
+    }
+    template<bool Single> static void op_fnmadd(CPUState &cpu, const Instruction &inst) {
+        fp_result<Single>(cpu, inst, -std::fma(cpu.fpr[inst.rA].ps0, cpu.fpr[rC(inst)].ps0, cpu.fpr[inst.rB].ps0));
+    }
+    template<bool Single> static void op_fnmsub(CPUState &cpu, const Instruction &inst) {
+        fp_result<Single>(cpu, inst, -std::fma(cpu.fpr[inst.rA].ps0, cpu.fpr[rC(inst)].ps0, -cpu.fpr[inst.rB].ps0));
+    }
+
+    static void op_fres(CPUState &cpu, const Instruction &inst) {
+        fp_result<true>(cpu, inst, 1.0 / cpu.fpr[inst.rB].ps0);
+    }
+
+    static void op_frsqrte(CPUState &cpu, const Instruction &inst) {
+        fp_result<false>(cpu, inst, 1.0 / std::sqrt(cpu.fpr[inst.rB].ps0));
+    }
+
+    static void op_fsel(CPUState &cpu, const Instruction &inst) {
+        fp_result<false>(cpu, inst, cpu.fpr[inst.rA].ps0 >= 0.0 ? cpu.fpr[rC(inst)].ps0 : cpu.fpr[inst.rB].ps0);
+    }
+
+    static void op_fmr(CPUState &cpu, const Instruction &inst) {
+        fp_result<false>(cpu, inst, cpu.fpr[inst.rB].ps0);
+    }
+
+    static void op_fneg(CPUState &cpu, const Instruction &inst) {
+        fp_result<false>(cpu, inst, bit_cast<double>(bit_cast<uint64_t>(cpu.fpr[inst.rB].ps0) ^ (1ull << 63)));
+    }
+
+    static void op_fabs(CPUState &cpu, const Instruction &inst) {
+        fp_result<false>(cpu, inst, bit_cast<double>(bit_cast<uint64_t>(cpu.fpr[inst.rB].ps0) & ~(1ull << 63)));
+    }
+
+    static void op_fnabs(CPUState &cpu, const Instruction &inst) {
+        fp_result<false>(cpu, inst, bit_cast<double>(bit_cast<uint64_t>(cpu.fpr[inst.rB].ps0) | (1ull << 63)));
+    }
+
+    static void op_frsp(CPUState &cpu, const Instruction &inst) {
+        fp_result<true>(cpu, inst, cpu.fpr[inst.rB].ps0);
+    }
+
+    template<bool TowardZero>
+    static void op_fctiw(CPUState &cpu, const Instruction &inst) {
+        const double b = cpu.fpr[inst.rB].ps0;
+        int32_t r;
+        if (std::isnan(b) || b >= 2147483648.0)
+            r = std::numeric_limits<int32_t>::max();
+        else if (b < -2147483648.0)
+            r = std::numeric_limits<int32_t>::min();
+        else
+            r = static_cast<int32_t>(TowardZero ? std::trunc(b) : std::nearbyint(b));
+
+        // The integer lands in the low word, the high word reads as 0xFFF80000
+        cpu.fpr[inst.rD].ps0 = bit_cast<double>(0xFFF8000000000000ull | static_cast<uint32_t>(r));
+        if (rc(inst))
+            update_cr1(cpu);
+    }
+
+    static inline void fp_compare(CPUState &cpu, const Instruction &inst, double a, double b) {
+        const uint32_t c = (std::isnan(a) || std::isnan(b)) ? 0x1 : a < b ? 0x8 : a > b ? 0x4 : 0x2;
+
+        cpu.fpscr = (cpu.fpscr & ~0xF000u) | (c << 12);
+        set_cr_field(cpu, inst.rD >> 2, c);
+    }
+
+    static void op_fcmp(CPUState &cpu, const Instruction &inst) {
+        fp_compare(cpu, inst, cpu.fpr[inst.rA].ps0, cpu.fpr[inst.rB].ps0);
+    }
+
+    static void op_mffs(CPUState &cpu, const Instruction &inst) {
+        cpu.fpr[inst.rD].ps0 = bit_cast<double>(0xFFF8000000000000ull | cpu.fpscr);
+        if (rc(inst))
+            update_cr1(cpu);
+    }
+
+    static void op_mtfsf(CPUState &cpu, const Instruction &inst) {
+        const uint32_t fm = (inst.raw >> 17) & 0xFF;
+        uint32_t mask = 0;
+        for (unsigned i = 0; i < 8; i++) {
+            if (fm & (0x80 >> i))
+                mask |= 0xF0000000u >> (i * 4);
+        }
+        const uint32_t b = static_cast<uint32_t>(bit_cast<uint64_t>(cpu.fpr[inst.rB].ps0));
+        cpu.fpscr = (cpu.fpscr & ~mask) | (b & mask);
+        if (rc(inst))
+            update_cr1(cpu);
+    }
+
+    static void op_mtfsb0(CPUState &cpu, const Instruction &inst) {
+        cpu.fpscr &= ~(0x80000000u >> inst.rD);
+        if (rc(inst))
+            update_cr1(cpu);
+    }
+
+    static void op_mtfsb1(CPUState &cpu, const Instruction &inst) {
+        cpu.fpscr |= 0x80000000u >> inst.rD;
+        if (rc(inst))
+            update_cr1(cpu);
+    }
+
+    static void op_mtfsfi(CPUState &cpu, const Instruction &inst) {
+        const unsigned shift = 28 - (inst.rD >> 2) * 4;
+        cpu.fpscr = (cpu.fpscr & ~(0xFu << shift)) | (((inst.raw >> 12) & 0xF) << shift);
+        if (rc(inst))
+            update_cr1(cpu);
+    }
+
+    // ---- Paired singles (frD = rD, frA = rA, frB = rB, frC = rC) ----
+
+    static inline ps::Vec ps_reg(const CPUState &cpu, unsigned r) { return ps::load(cpu.fpr[r]); }
+
+    // Arithmetic results are rounded to single precision in both lanes
+    static inline void ps_result(CPUState &cpu, const Instruction &inst, ps::Vec r) {
+        ps::store(cpu.fpr[inst.rD], ps::round_single(r));
+        if (rc(inst))
+            update_cr1(cpu);
+    }
+
+    // Moves and sign ops copy the lanes as they are
+    static inline void ps_move(CPUState &cpu, const Instruction &inst, ps::Vec r) {
+        ps::store(cpu.fpr[inst.rD], r);
+        if (rc(inst))
+            update_cr1(cpu);
+    }
+
+    static void op_ps_add(CPUState &cpu, const Instruction &inst) {
+        ps_result(cpu, inst, ps::add(ps_reg(cpu, inst.rA), ps_reg(cpu, inst.rB)));
+    }
+    static void op_ps_sub(CPUState &cpu, const Instruction &inst) {
+        ps_result(cpu, inst, ps::sub(ps_reg(cpu, inst.rA), ps_reg(cpu, inst.rB)));
+    }
+    static void op_ps_mul(CPUState &cpu, const Instruction &inst) {
+        ps_result(cpu, inst, ps::mul(ps_reg(cpu, inst.rA), ps_reg(cpu, rC(inst))));
+    }
+    static void op_ps_div(CPUState &cpu, const Instruction &inst) {
+        ps_result(cpu, inst, ps::div(ps_reg(cpu, inst.rA), ps_reg(cpu, inst.rB)));
+    }
+    static void op_ps_madd(CPUState &cpu, const Instruction &inst) {
+        ps_result(cpu, inst, ps::madd(ps_reg(cpu, inst.rA), ps_reg(cpu, rC(inst)), ps_reg(cpu, inst.rB)));
+    }
+    static void op_ps_msub(CPUState &cpu, const Instruction &inst) {
+        ps_result(cpu, inst, ps::madd(ps_reg(cpu, inst.rA), ps_reg(cpu, rC(inst)), ps::neg(ps_reg(cpu, inst.rB))));
+    }
+    static void op_ps_nmadd(CPUState &cpu, const Instruction &inst) {
+        ps_result(cpu, inst, ps::neg(ps::madd(ps_reg(cpu, inst.rA), ps_reg(cpu, rC(inst)), ps_reg(cpu, inst.rB))));
+    }
+    static void op_ps_nmsub(CPUState &cpu, const Instruction &inst) {
+        ps_result(cpu, inst, ps::neg(ps::madd(ps_reg(cpu, inst.rA), ps_reg(cpu, rC(inst)), ps::neg(ps_reg(cpu, inst.rB)))));
+    }
+
+    // muls/madds scale both lanes of frA by one lane of frC
+    template<unsigned Lane>
+    static void op_ps_muls(CPUState &cpu, const Instruction &inst) {
+        const ps::Vec c = ps_reg(cpu, rC(inst));
+        ps_result(cpu, inst, ps::mul(ps_reg(cpu, inst.rA), Lane ? ps::splat1(c) : ps::splat0(c)));
+    }
+
+    template<unsigned Lane>
+    static void op_ps_madds(CPUState &cpu, const Instruction &inst) {
+        const ps::Vec c = ps_reg(cpu, rC(inst));
+        ps_result(cpu, inst, ps::madd(ps_reg(cpu, inst.rA), Lane ? ps::splat1(c) : ps::splat0(c), ps_reg(cpu, inst.rB)));
+    }
+
+    // sum0: ps0 = frA.ps0 + frB.ps1, ps1 = frC.ps1; sum1 puts the sum in ps1 and frC.ps0 in ps0
+    template<unsigned Lane>
+    static void op_ps_sum(CPUState &cpu, const Instruction &inst) {
+        const ps::Vec b = ps_reg(cpu, inst.rB);
+        const ps::Vec sum = ps::add(ps_reg(cpu, inst.rA), ps::merge10(b, b));
+        const ps::Vec c = ps_reg(cpu, rC(inst));
+        ps_result(cpu, inst, Lane ? ps::merge00(c, sum) : ps::merge01(sum, c));
+    }
+
+    static void op_ps_sel(CPUState &cpu, const Instruction &inst) {
+        ps_move(cpu, inst, ps::select(ps_reg(cpu, inst.rA), ps_reg(cpu, rC(inst)), ps_reg(cpu, inst.rB)));
+    }
+
+    static void op_ps_res(CPUState &cpu, const Instruction &inst) {
+        ps_result(cpu, inst, ps::div(ps::make(1.0, 1.0), ps_reg(cpu, inst.rB)));
+    }
+
+    static void op_ps_rsqrte(CPUState &cpu, const Instruction &inst) {
+        ps_result(cpu, inst, ps::div(ps::make(1.0, 1.0), ps::sqrt(ps_reg(cpu, inst.rB))));
+    }
+
+    static void op_ps_mr(CPUState &cpu, const Instruction &inst) { ps_move(cpu, inst, ps_reg(cpu, inst.rB)); }
+    static void op_ps_neg(CPUState &cpu, const Instruction &inst) { ps_move(cpu, inst, ps::neg(ps_reg(cpu, inst.rB))); }
+    static void op_ps_abs(CPUState &cpu, const Instruction &inst) { ps_move(cpu, inst, ps::abs(ps_reg(cpu, inst.rB))); }
+    static void op_ps_nabs(CPUState &cpu, const Instruction &inst) { ps_move(cpu, inst, ps::nabs(ps_reg(cpu, inst.rB))); }
+
+    static void op_ps_merge00(CPUState &cpu, const Instruction &inst) {
+        ps_move(cpu, inst, ps::merge00(ps_reg(cpu, inst.rA), ps_reg(cpu, inst.rB)));
+    }
+    static void op_ps_merge01(CPUState &cpu, const Instruction &inst) {
+        ps_move(cpu, inst, ps::merge01(ps_reg(cpu, inst.rA), ps_reg(cpu, inst.rB)));
+    }
+    static void op_ps_merge10(CPUState &cpu, const Instruction &inst) {
+        ps_move(cpu, inst, ps::merge10(ps_reg(cpu, inst.rA), ps_reg(cpu, inst.rB)));
+    }
+    static void op_ps_merge11(CPUState &cpu, const Instruction &inst) {
+        ps_move(cpu, inst, ps::merge11(ps_reg(cpu, inst.rA), ps_reg(cpu, inst.rB)));
+    }
+
+    template<unsigned Lane>
+    static void op_ps_cmp(CPUState &cpu, const Instruction &inst) {
+        const FPR &a = cpu.fpr[inst.rA];
+        const FPR &b = cpu.fpr[inst.rB];
+        fp_compare(cpu, inst, Lane ? a.ps1 : a.ps0, Lane ? b.ps1 : b.ps0);
+    }
+
+    // ---- Quantized loads/stores ----
+
+    static inline uint32_t load_element(CPUState &cpu, uint32_t ea, unsigned size) {
+        switch (size) {
+            case 1:  return load<uint8_t>(cpu, ea);
+            case 2:  return load<uint16_t>(cpu, ea);
+            default: return load<uint32_t>(cpu, ea);
+        }
+    }
+
+    static inline void store_element(CPUState &cpu, uint32_t ea, unsigned size, uint32_t v) {
+        switch (size) {
+            case 1:  store<uint8_t>(cpu, ea, static_cast<uint8_t>(v)); break;
+            case 2:  store<uint16_t>(cpu, ea, static_cast<uint16_t>(v)); break;
+            default: store<uint32_t>(cpu, ea, v); break;
+        }
+    }
+
+    // psq_l/psq_st carry W (one element) and the GQR index in bits 16/17-19 with a 12-bit
+    // displacement; the indexed forms have them in bits 21/22-24
+    template<bool Indexed>
+    static inline uint32_t psq_ea(const CPUState &cpu, const Instruction &inst) {
+        if constexpr (Indexed)
+            return ea_x(cpu, inst);
+        const int32_t d = static_cast<int32_t>(inst.raw << 20) >> 20;
+        return (inst.rA ? cpu.gpr[inst.rA] : 0) + static_cast<uint32_t>(d);
+    }
+
+    template<bool Indexed>
+    static inline bool psq_w(const Instruction &inst) { return (inst.raw >> (Indexed ? 10 : 15)) & 1; }
+
+    template<bool Indexed>
+    static inline uint32_t psq_gqr(const CPUState &cpu, const Instruction &inst) {
+        return cpu.spr[spr::GQR0 + ((inst.raw >> (Indexed ? 7 : 12)) & 7)];
+    }
+
+    template<bool Indexed, bool Update>
+    static void op_psq_l(CPUState &cpu, const Instruction &inst) {
+        const uint32_t ea = psq_ea<Indexed>(cpu, inst);
+        const uint32_t gqr = psq_gqr<Indexed>(cpu, inst);
+        const uint32_t type = (gqr >> 16) & 7;
+        const uint32_t scale = (gqr >> 24) & 0x3F;
+        const unsigned size = ps::QUANT_SIZE[type];
+        const bool one = psq_w<Indexed>(inst);
+
+        const uint32_t e0 = load_element(cpu, ea, size);
+        const uint32_t e1 = one ? 0 : load_element(cpu, ea + size, size);
+        if constexpr (Update)
+            cpu.gpr[inst.rA] = ea;
+
+        ps::Vec v = ps::dequantize(type, scale, e0, e1);
+        if (one)
+            v = ps::merge01(v, ps::make(1.0, 1.0));
+        ps::store(cpu.fpr[inst.rD], v);
+    }
+
+    template<bool Indexed, bool Update>
+    static void op_psq_st(CPUState &cpu, const Instruction &inst) {
+        const uint32_t ea = psq_ea<Indexed>(cpu, inst);
+        const uint32_t gqr = psq_gqr<Indexed>(cpu, inst);
+        const uint32_t type = gqr & 7;
+        const uint32_t scale = (gqr >> 8) & 0x3F;
+        const unsigned size = ps::QUANT_SIZE[type];
+
+        uint32_t e[2];
+        ps::quantize(ps_reg(cpu, inst.rD), type, scale, e);
+        store_element(cpu, ea, size, e[0]);
+        if (!psq_w<Indexed>(inst))
+            store_element(cpu, ea + size, size, e[1]);
+        if constexpr (Update)
+            cpu.gpr[inst.rA] = ea;
+    }
+
+    // ---- System ----
+
+    static void op_mfspr(CPUState &cpu, const Instruction &inst) {
+        const uint32_t n = spr_number(inst);
+        switch (n) {
+            case spr::XER: cpu.gpr[inst.rD] = cpu.read_xer(); break;
+            case spr::LR:  cpu.gpr[inst.rD] = cpu.lr;  break;
+            case spr::CTR: cpu.gpr[inst.rD] = cpu.ctr; break;
+            default:       cpu.gpr[inst.rD] = SprFile::implemented(n) ? cpu.spr[n] : 0; break;
+        }
+    }
+
+    static void op_mtspr(CPUState &cpu, const Instruction &inst) {
+        const uint32_t n = spr_number(inst);
+        const uint32_t v = cpu.gpr[inst.rD];
+        switch (n) {
+            case spr::XER: cpu.write_xer(v); break;
+            case spr::LR:  cpu.lr = v;  break;
+            case spr::CTR: cpu.ctr = v; break;
+            default:       cpu.spr[n] = v; break;    // TBL_W/TBU_W share the mftb slots
+        }
+    }
+
+    static void op_mftb(CPUState &cpu, const Instruction &inst) {
+        cpu.gpr[inst.rD] = cpu.spr[spr_number(inst) == spr::TBU ? spr::TBU : spr::TBL];
+    }
+
+    static void op_mfmsr(CPUState &cpu, const Instruction &inst) {
+        cpu.gpr[inst.rD] = cpu.msr;
+    }
+
+    static void op_mtmsr(CPUState &cpu, const Instruction &inst) {
+        cpu.msr = cpu.gpr[inst.rD];
+    }
+
+    static void op_mfsr(CPUState &cpu, const Instruction &inst) {
+        cpu.gpr[inst.rD] = cpu.sr[inst.rA & 0xF];
+    }
+
+    static void op_mtsr(CPUState &cpu, const Instruction &inst) {
+        cpu.sr[inst.rA & 0xF] = cpu.gpr[inst.rD];
+    }
+
+    static void op_mfsrin(CPUState &cpu, const Instruction &inst) {
+        cpu.gpr[inst.rD] = cpu.sr[cpu.gpr[inst.rB] >> 28];
+    }
+
+    static void op_mtsrin(CPUState &cpu, const Instruction &inst) {
+        cpu.sr[cpu.gpr[inst.rB] >> 28] = cpu.gpr[inst.rD];
+    }
+
+    static void op_sc(CPUState &cpu, const Instruction &) {
+        raise_exception(cpu, Exception::SYSCALL, cpu.pc + 4);
+    }
+
+    static void op_rfi(CPUState &cpu, const Instruction &) {
+        const uint32_t mask = 0x87C0FF73;
+        cpu.msr = ((cpu.msr & ~mask) | (cpu.spr[spr::SRR1] & mask)) & ~0x00040000u;
+        cpu.npc = cpu.spr[spr::SRR0] & ~3u;
+    }
+
+    static inline bool trap_condition(uint32_t to, uint32_t a, uint32_t b) {
+        const int32_t sa = static_cast<int32_t>(a), sb = static_cast<int32_t>(b);
+        return ((to & 0x10) && sa < sb) || ((to & 0x08) && sa > sb) || ((to & 0x04) && a == b) ||
+               ((to & 0x02) && a < b) || ((to & 0x01) && a > b);
+    }
+
+    static void op_tw(CPUState &cpu, const Instruction &inst) {
+        if (trap_condition(inst.rD, cpu.gpr[inst.rA], cpu.gpr[inst.rB]))
+            raise_exception(cpu, Exception::PROGRAM, cpu.pc, 0x20000);
+    }
+
+    static void op_twi(CPUState &cpu, const Instruction &inst) {
+        if (trap_condition(inst.rD, cpu.gpr[inst.rA], static_cast<uint32_t>(static_cast<int32_t>(inst.simm))))
+            raise_exception(cpu, Exception::PROGRAM, cpu.pc, 0x20000);
+    }
+
+    static void op_invalid(CPUState &cpu, const Instruction &inst) {
+        LOG_ERROR("Unimplemented instruction ", inst.raw, " (", isa::disassemble(inst.raw, cpu.pc), ") @ ", cpu.pc);
+        raise_exception(cpu, Exception::PROGRAM, cpu.pc, 0x80000);
+    }
+
+    // ---- Decoding ----
+
+    namespace {
+        // Indexed by isa::Op, expanded from the same list as the decode tables
+        constexpr Handler HANDLERS[] = {
+            op_invalid,
+#define FREECUBE_OP_HANDLER(id, mnemonic, form, primary, extended, operands, flags, handler) handler,
+            FREECUBE_GEKKO_OPCODES(FREECUBE_OP_HANDLER)
+#undef FREECUBE_OP_HANDLER
+        };
+
+        static_assert(std::size(HANDLERS) == static_cast<std::size_t>(isa::Op::COUNT), "HANDLERS out of step with isa::Op");
+    }
+
+    Instruction decode(uint32_t raw) {
+        Instruction inst{};
+        inst.raw = raw;
+        inst.op = isa::lookup(raw);
+        inst.opcode = static_cast<uint8_t>(raw >> 26);
+        inst.rD = static_cast<uint8_t>(isa::extract<isa::RD>(raw));
+        inst.rA = static_cast<uint8_t>(isa::extract<isa::RA>(raw));
+        inst.rB = static_cast<uint8_t>(isa::extract<isa::RB>(raw));
+        inst.simm = static_cast<int16_t>(isa::extract<isa::SIMM>(raw));
+        inst.uimm = static_cast<uint16_t>(isa::extract<isa::UIMM>(raw));
+        inst.flags = isa::spec(inst.op).flags;
+        inst.handler = HANDLERS[static_cast<std::size_t>(inst.op)];
+        return inst;
+    }
+
+    void execute(CPUState& cpu, const Instruction& inst) {
+        cpu.npc = cpu.pc + 4;
+        inst.handler(cpu, inst);
+        cpu.pc = cpu.npc;
+    }
+
+    void execute_slow(CPUState &cpu, const Instruction &inst) {
+        cpu.slow_access = true;
+        execute(cpu, inst);
+        cpu.slow_access = false;
+    }
+}
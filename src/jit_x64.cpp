@@ -0,0 +1,1094 @@
+#include "cpu/jit_x64.hpp"
+
+#if FREECUBE_JIT
+
+#include "cpu/block_cache.hpp"
+#include "cpu/interpreter.hpp"
+#include "cpu/x64_emitter.hpp"
+#include "util/endian.hpp"
+#include "util/log.hpp"
+#include "util/profile.hpp"
+#include <sys/mman.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+
+namespace freecube::cpu {
+
+    using namespace x64;
+    using isa::Op;
+
+    // Pinned while guest code runs (all callee-saved, so helper calls keep them)
+    constexpr Reg CPU    = RBX;     // CPUState *
+    constexpr Reg RAM    = R12;     // Host address of MEM1
+    constexpr Reg PAGES  = R13;     // Memory::page_flags()
+    constexpr Reg BUDGET = R14;     // Instructions left, signed
+
+    // Guest GPRs are cached in these. RAX/RCX/RDX are scratch.
+    constexpr Reg ALLOCATABLE[] = { RSI, RDI, R8, R9, R10, R11, RBP, R15 };
+    constexpr unsigned NUM_ALLOCATABLE = sizeof(ALLOCATABLE) / sizeof(ALLOCATABLE[0]);
+
+    // Saved around slow path calls: the caller-saved allocatable ones, plus RCX (holds
+    // the EA) and RDX to keep the stack 16-byte aligned
+    constexpr Reg SLOW_PATH_SAVED[] = { RCX, RDX, RSI, RDI, R8, R9, R10, R11 };
+
+    // Worst case for one block, checked before translating
+    constexpr std::size_t MAX_BLOCK_CODE = 256 * 1024;
+
+    static const CPUState s_probe{};
+
+    template<typename T>
+    static int32_t offset_in_cpu(const T &member) {
+        return static_cast<int32_t>(reinterpret_cast<const char *>(&member) - reinterpret_cast<const char *>(&s_probe));
+    }
+
+    #define CPU_OFFSET(field) offset_in_cpu(s_probe.field)
+
+    static int32_t gpr_offset(unsigned r) {
+        return CPU_OFFSET(gpr) + static_cast<int32_t>(r * sizeof(uint32_t));
+    }
+
+    // ---- Called from generated code ----
+
+    static uint32_t slow_read8(memory::Memory *mem, uint32_t address) { return mem->read_slow<uint8_t>(address); }
+    static uint32_t slow_read16(memory::Memory *mem, uint32_t address) { return mem->read_slow<uint16_t>(address); }
+    static uint32_t slow_read32(memory::Memory *mem, uint32_t address) { return mem->read_slow<uint32_t>(address); }
+
+    static void slow_write8(memory::Memory *mem, uint32_t address, uint32_t v) { mem->write_slow<uint8_t>(address, static_cast<uint8_t>(v)); }
+    static void slow_write16(memory::Memory *mem, uint32_t address, uint32_t v) { mem->write_slow<uint16_t>(address, static_cast<uint16_t>(v)); }
+    static void slow_write32(memory::Memory *mem, uint32_t address, uint32_t v) { mem->write_slow<uint32_t>(address, v); }
+
+    static void call_interpreter(CPUState *cpu, const Instruction *inst) {
+        // Generated code can't recover from a fastmem fault, so the handler takes the checked path
+        cpu->slow_access = true;
+        inst->handler(*cpu, *inst);
+        cpu->slow_access = false;
+    }
+
+    /**
+     * @brief Translates one block; lives only for the duration of Jit::compile()
+     */
+    class JitCompiler {
+    public:
+        struct Exit {
+            uint32_t target;
+            uint8_t *site;
+        };
+
+        JitCompiler(Jit &jit, uint8_t *code, std::size_t capacity) : m_jit(jit), e(code, capacity) {}
+
+        std::size_t translate(const Instruction *insts, uint32_t length, uint32_t address) {
+            if (is_idle_loop(insts, length, address)) {
+                m_idle_loop = address;
+                m_jit.m_stats.idle_loops++;
+                LOG_DEBUG("Idle loop @ ", address);
+            }
+
+            // Budget check: out of instructions means back to run() before doing anything
+            e.test64(BUDGET, BUDGET);
+            uint8_t *has_budget = e.jcc_forward(CC_G);
+            e.store_imm(CPU, CPU_OFFSET(pc), address);
+            e.jmp(m_jit.m_exit);
+            e.bind(has_budget);
+            e.alu64(ALU_SUB, BUDGET, length);
+
+            bool ended = false;
+            for (uint32_t k = 0; k < length; k++) {
+                const Instruction &inst = insts[k];
+                const uint32_t pc = address + k * 4;
+
+                if (translate_one(inst, pc)) {
+                    m_jit.m_stats.native++;
+                } else {
+                    fallback(inst, pc, inst.flags & INST_ENDS_BLOCK);
+                    m_jit.m_stats.fallbacks++;
+                }
+                unlock_all();
+
+                if (inst.flags & INST_ENDS_BLOCK)
+                    ended = true;
+            }
+
+            // Cut short by the length limit, carry on at the next instruction
+            if (!ended) {
+                flush();
+                exit_to(address + length * 4);
+            }
+
+            return e.size();
+        }
+
+        bool overflowed() const { return e.overflowed(); }
+        const std::vector<Exit> &exits() const { return m_exits; }
+
+    private:
+        struct Slot {
+            int8_t guest = -1;
+            bool dirty = false;
+            bool locked = false;
+            uint32_t stamp = 0;
+        };
+
+        Jit &m_jit;
+        Emitter e;
+        std::vector<Exit> m_exits;
+        std::optional<uint32_t> m_idle_loop;    // Start of this block, if it's an idle loop
+
+        Slot m_slots[NUM_ALLOCATABLE];
+        int8_t m_host_of[32] = { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                 -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 };
+        uint32_t m_clock = 0;
+
+        // ---- Register cache ----
+
+        // Host register holding guest rN, loading it unless it's about to be overwritten.
+        // Registers handed out stay put until the end of the instruction.
+        Reg bind(unsigned guest, bool load = true) {
+            int idx = m_host_of[guest];
+            if (idx < 0) {
+                idx = pick_slot();
+                m_slots[idx].guest = static_cast<int8_t>(guest);
+                m_slots[idx].dirty = false;
+                m_host_of[guest] = static_cast<int8_t>(idx);
+                if (load)
+                    e.load(ALLOCATABLE[idx], CPU, gpr_offset(guest));
+            }
+
+            m_slots[idx].locked = true;
+            m_slots[idx].stamp = ++m_clock;
+            return ALLOCATABLE[idx];
+        }
+
+        // For a register the instruction writes; bind all sources first
+        Reg bind_dest(unsigned guest) {
+            Reg r = bind(guest, false);
+            m_slots[m_host_of[guest]].dirty = true;
+            return r;
+        }
+
+        int pick_slot() {
+            int best = -1;
+            for (unsigned i = 0; i < NUM_ALLOCATABLE; i++) {
+                if (m_slots[i].guest < 0)
+                    return static_cast<int>(i);
+                if (!m_slots[i].locked && (best < 0 || m_slots[i].stamp < m_slots[best].stamp))
+                    best = static_cast<int>(i);
+            }
+
+            // At most three guest registers per instruction, so something is always unlocked
+            Slot &s = m_slots[best];
+            if (s.dirty)
+                e.store(CPU, gpr_offset(s.guest), ALLOCATABLE[best]);
+            m_host_of[s.guest] = -1;
+            s = Slot{};
+            return best;
+        }
+
+        void unlock_all() {
+            for (auto &s : m_slots)
+                s.locked = false;
+        }
+
+        // Write dirty registers back, keeping them cached
+        void flush() {
+            for (unsigned i = 0; i < NUM_ALLOCATABLE; i++) {
+                if (m_slots[i].guest >= 0 && m_slots[i].dirty) {
+                    e.store(CPU, gpr_offset(m_slots[i].guest), ALLOCATABLE[i]);
+                    m_slots[i].dirty = false;
+                }
+            }
+        }
+
+        // Write back and forget everything, for code that may change any GPR
+        void drop() {
+            flush();
+            for (auto &s : m_slots)
+                s = Slot{};
+            std::fill(std::begin(m_host_of), std::end(m_host_of), -1);
+        }
+
+        // ---- Exits ----
+
+        void exit_to(uint32_t target) {
+            // Going round an idle loop again changes nothing until the next event, so use
+            // up the budget; run() then returns as if the iterations had run
+            if (m_idle_loop && target == *m_idle_loop) {
+                e.test64(BUDGET, BUDGET);
+                uint8_t *overdrawn = e.jcc_forward(CC_LE);
+                e.mov64(BUDGET, uint64_t{ 0 });
+                e.bind(overdrawn);
+            }
+
+            e.store_imm(CPU, CPU_OFFSET(pc), target);
+            m_exits.push_back({ target, e.jmp(m_jit.m_exit) });
+        }
+
+        void exit_indirect(Reg target) {
+            e.store(CPU, CPU_OFFSET(pc), target);
+            e.jmp(m_jit.m_exit);
+        }
+
+        void fallback(const Instruction &inst, uint32_t pc, bool ends_block) {
+            drop();
+            e.store_imm(CPU, CPU_OFFSET(pc), pc);
+            e.store_imm(CPU, CPU_OFFSET(npc), pc + 4);
+            e.mov64(RDI, CPU);
+            e.mov64(RSI, reinterpret_cast<uint64_t>(&inst));
+            e.mov64(RAX, reinterpret_cast<uint64_t>(&call_interpreter));
+            e.call(RAX);
+
+            if (ends_block) {
+                e.load(RAX, CPU, CPU_OFFSET(npc));
+                exit_indirect(RAX);
+            }
+        }
+
+        // ---- Flags ----
+
+        // CR field from the host flags of a compare, plus XER[SO]
+        void set_cr_field(unsigned field, bool is_signed) {
+            e.setcc(is_signed ? CC_L : CC_B, RAX);
+            e.setcc(is_signed ? CC_G : CC_A, RCX);
+            e.setcc(CC_E, RDX);
+            e.movzx8(RAX, RAX);
+            e.shl(RAX, 3);
+            e.movzx8(RCX, RCX);
+            e.shl(RCX, 2);
+            e.alu(ALU_OR, RAX, RCX);
+            e.movzx8(RDX, RDX);
+            e.alu(ALU_ADD, RDX, RDX);
+            e.alu(ALU_OR, RAX, RDX);
+            e.load8z(RCX, CPU, CPU_OFFSET(xer_so_ov));
+            e.shr(RCX, 1);
+            e.alu(ALU_OR, RAX, RCX);
+
+            const uint8_t shift = static_cast<uint8_t>(28 - field * 4);
+            if (shift)
+                e.shl(RAX, shift);
+            e.load(RCX, CPU, CPU_OFFSET(cr));
+            e.alu(ALU_AND, RCX, ~(0xFu << shift));
+            e.alu(ALU_OR, RCX, RAX);
+            e.store(CPU, CPU_OFFSET(cr), RCX);
+            if (field == 0)
+                e.store8_imm(CPU, CPU_OFFSET(cr0_lazy), 0);
+        }
+
+        // Same as CPUState::record_cr0(), result in EAX
+        void record_cr0() {
+            e.store(CPU, CPU_OFFSET(cr0_result), RAX);
+            e.load8z(RCX, CPU, CPU_OFFSET(xer_so_ov));
+            e.alu(ALU_AND, RCX, 2u);
+            e.alu(ALU_OR, RCX, 1u);
+            e.store8(CPU, CPU_OFFSET(cr0_lazy), RCX);
+        }
+
+        void record(const Instruction &inst) {
+            if (inst.raw & 1)
+                record_cr0();
+        }
+
+        // Fold a pending record-form result into CR0 before the CR is read. Uses EAX/ECX/EDX.
+        void materialize_cr0() {
+            e.load8z(RDX, CPU, CPU_OFFSET(cr0_lazy));
+            e.test(RDX, RDX);
+            uint8_t *done = e.jcc_forward(CC_E);
+
+            e.alu_mem(ALU_CMP, CPU, CPU_OFFSET(cr0_result), 0);
+            e.setcc(CC_L, RAX);
+            e.setcc(CC_G, RCX);
+            e.movzx8(RAX, RAX);
+            e.shl(RAX, 3);
+            e.movzx8(RCX, RCX);
+            e.shl(RCX, 2);
+            e.alu(ALU_OR, RAX, RCX);
+            // EQ when neither LT nor GT
+            e.alu(ALU_CMP, RAX, 0u);
+            e.setcc(CC_E, RCX);
+            e.movzx8(RCX, RCX);
+            e.alu(ALU_ADD, RCX, RCX);
+            e.alu(ALU_OR, RAX, RCX);
+            e.shr(RDX, 1);
+            e.alu(ALU_OR, RAX, RDX);
+            e.shl(RAX, 28);
+
+            e.load(RCX, CPU, CPU_OFFSET(cr));
+            e.alu(ALU_AND, RCX, 0x0FFFFFFFu);
+            e.alu(ALU_OR, RCX, RAX);
+            e.store(CPU, CPU_OFFSET(cr), RCX);
+            e.store8_imm(CPU, CPU_OFFSET(cr0_lazy), 0);
+            e.bind(done);
+        }
+
+        // ---- Memory ----
+
+        // EA into ECX
+        void ea_d(const Instruction &inst) {
+            if (inst.rA) {
+                e.mov(RCX, bind(inst.rA));
+                if (inst.simm)
+                    e.alu(ALU_ADD, RCX, static_cast<uint32_t>(static_cast<int32_t>(inst.simm)));
+            } else {
+                e.mov(RCX, static_cast<uint32_t>(static_cast<int32_t>(inst.simm)));
+            }
+        }
+
+        void ea_x(const Instruction &inst) {
+            Reg b = bind(inst.rB);
+            if (inst.rA) {
+                e.mov(RCX, bind(inst.rA));
+                e.alu(ALU_ADD, RCX, b);
+            } else {
+                e.mov(RCX, b);
+            }
+        }
+
+        // Jumps to the slow path unless ECX is a MEM1 range; leaves the MEM1 offset in EAX
+        void check_ram(unsigned size, std::vector<uint8_t *> &to_slow) {
+            e.mov(RAX, RCX);
+            e.alu(ALU_AND, RAX, 0x3FFFFFFFu);
+            e.alu(ALU_CMP, RAX, memory::MEM1_SIZE - size);
+            to_slow.push_back(e.jcc_forward(CC_A));
+            // 0x40000000-0x7FFFFFFF isn't a RAM mirror
+            e.mov(RDX, RCX);
+            e.shr(RDX, 30);
+            e.alu(ALU_CMP, RDX, 1u);
+            to_slow.push_back(e.jcc_forward(CC_E));
+        }
+
+        void call_slow(const void *fn) {
+            for (Reg r : SLOW_PATH_SAVED)
+                e.push(r);
+            e.mov(RSI, RCX);
+            e.mov64(RDI, reinterpret_cast<uint64_t>(&m_jit.m_mem));
+            e.mov64(RAX, reinterpret_cast<uint64_t>(fn));
+            e.call(RAX);
+            for (int i = static_cast<int>(sizeof(SLOW_PATH_SAVED) / sizeof(Reg)) - 1; i >= 0; i--)
+                e.pop(SLOW_PATH_SAVED[i]);
+        }
+
+        // Loaded value ends up in EAX
+        void load(unsigned size, bool sign) {
+            std::vector<uint8_t *> to_slow;
+            check_ram(size, to_slow);
+
+            if (size == 4) {
+                e.load_idx(RAX, RAM, RAX);
+                e.bswap(RAX);
+            } else if (size == 2) {
+                e.load16z_idx(RAX, RAM, RAX);
+                e.rol16(RAX, 8);
+            } else {
+                e.load8z_idx(RAX, RAM, RAX);
+            }
+            uint8_t *done = e.jmp_forward();
+
+            for (uint8_t *j : to_slow)
+                e.bind(j);
+            call_slow(size == 4 ? reinterpret_cast<const void *>(&slow_read32)
+                    : size == 2 ? reinterpret_cast<const void *>(&slow_read16)
+                                : reinterpret_cast<const void *>(&slow_read8));
+
+            e.bind(done);
+            if (sign)
+                e.movsx16(RAX, RAX);
+        }
+
+        void store(unsigned size, Reg value) {
+            std::vector<uint8_t *> to_slow;
+            check_ram(size, to_slow);
+
+            // Stores straddling two pages take the slow path, so only one page's flags matter below
+            if (size > 1) {
+                e.mov(RDX, RAX);
+                e.alu(ALU_AND, RDX, memory::PAGE_SIZE - 1);
+                e.alu(ALU_CMP, RDX, memory::PAGE_SIZE - size);
+                to_slow.push_back(e.jcc_forward(CC_A));
+            }
+
+            // Stores to pages with translated code go the slow way, which invalidates
+            e.mov(RDX, RAX);
+            e.shr(RDX, memory::PAGE_SHIFT);
+            e.test8_idx_imm(PAGES, RDX, memory::Memory::PAGE_CODE);
+            to_slow.push_back(e.jcc_forward(CC_NE));
+            e.or8_idx_imm(PAGES, RDX, memory::Memory::PAGE_DIRTY);    // For save states
+
+            e.mov(RDX, value);
+            if (size == 4) {
+                e.bswap(RDX);
+                e.store_idx(RAM, RAX, RDX);
+            } else if (size == 2) {
+                e.rol16(RDX, 8);
+                e.store16_idx(RAM, RAX, RDX);
+            } else {
+                e.store8_idx(RAM, RAX, RDX);
+            }
+            uint8_t *done = e.jmp_forward();
+
+            for (uint8_t *j : to_slow)
+                e.bind(j);
+            // value may be RSI/RDI, grab it before call_slow loads the arguments
+            e.mov(RDX, value);
+            call_slow(size == 4 ? reinterpret_cast<const void *>(&slow_write32)
+                    : size == 2 ? reinterpret_cast<const void *>(&slow_write16)
+                                : reinterpret_cast<const void *>(&slow_write8));
+
+            e.bind(done);
+        }
+
+        void op_load(const Instruction &inst, bool indexed, bool update, unsigned size, bool sign) {
+            indexed ? ea_x(inst) : ea_d(inst);
+            load(size, sign);
+            if (update)
+                e.mov(bind_dest(inst.rA), RCX);
+            e.mov(bind_dest(inst.rD), RAX);
+        }
+
+        void op_store(const Instruction &inst, bool indexed, bool update, unsigned size) {
+            Reg value = bind(inst.rD);
+            indexed ? ea_x(inst) : ea_d(inst);
+            store(size, value);
+            if (update)
+                e.mov(bind_dest(inst.rA), RCX);
+        }
+
+        // ---- Branches ----
+
+        static bool reads_cr0(const Instruction &inst) {
+            return !(inst.rD & 0x10) && inst.rA < 4;
+        }
+
+        // EAX = branch taken. Returns false when it's unconditional and nothing was emitted.
+        bool branch_condition(const Instruction &inst, bool use_ctr) {
+            const uint32_t bo = inst.rD;
+            const bool check_ctr = use_ctr && !(bo & 0x04);
+            const bool check_cond = !(bo & 0x10);
+            if (!check_ctr && !check_cond)
+                return false;
+
+            e.mov(RAX, 1u);
+            if (check_ctr) {
+                e.alu_mem(ALU_SUB, CPU, CPU_OFFSET(ctr), 1);
+                e.setcc((bo & 0x02) ? CC_E : CC_NE, RDX);
+                e.movzx8(RDX, RDX);
+                e.alu(ALU_AND, RAX, RDX);
+            }
+            if (check_cond) {
+                e.load(RDX, CPU, CPU_OFFSET(cr));
+                e.test(RDX, 0x80000000u >> inst.rA);
+                e.setcc((bo & 0x08) ? CC_NE : CC_E, RDX);
+                e.movzx8(RDX, RDX);
+                e.alu(ALU_AND, RAX, RDX);
+            }
+            return true;
+        }
+
+        void op_b(const Instruction &inst, uint32_t pc) {
+            const int32_t li = static_cast<int32_t>((inst.raw & 0x03FFFFFC) << 6) >> 6;
+            const uint32_t target = (inst.raw & 2) ? static_cast<uint32_t>(li) : pc + li;
+            if (inst.raw & 1)
+                e.store_imm(CPU, CPU_OFFSET(lr), pc + 4);
+            flush();
+            exit_to(target);
+        }
+
+        void op_bc(const Instruction &inst, uint32_t pc) {
+            if (reads_cr0(inst))
+                materialize_cr0();
+
+            const int32_t bd = static_cast<int16_t>(inst.raw & 0xFFFC);
+            const uint32_t target = (inst.raw & 2) ? static_cast<uint32_t>(bd) : pc + bd;
+
+            const bool conditional = branch_condition(inst, true);
+            if (inst.raw & 1)
+                e.store_imm(CPU, CPU_OFFSET(lr), pc + 4);
+            flush();
+
+            if (!conditional) {
+                exit_to(target);
+                return;
+            }
+
+            e.test(RAX, RAX);
+            uint8_t *not_taken = e.jcc_forward(CC_E);
+            exit_to(target);
+            e.bind(not_taken);
+            exit_to(pc + 4);
+        }
+
+        // bclr/bcctr: target is read before LR is overwritten
+        void op_bc_indirect(const Instruction &inst, uint32_t pc, bool to_lr) {
+            if (reads_cr0(inst))
+                materialize_cr0();
+
+            e.load(RCX, CPU, to_lr ? CPU_OFFSET(lr) : CPU_OFFSET(ctr));
+            e.alu(ALU_AND, RCX, ~3u);
+
+            const bool conditional = branch_condition(inst, to_lr);
+            if (inst.raw & 1)
+                e.store_imm(CPU, CPU_OFFSET(lr), pc + 4);
+            flush();
+
+            if (!conditional) {
+                exit_indirect(RCX);
+                return;
+            }
+
+            e.test(RAX, RAX);
+            uint8_t *not_taken = e.jcc_forward(CC_E);
+            exit_indirect(RCX);
+            e.bind(not_taken);
+            exit_to(pc + 4);
+        }
+
+        // ---- Integer ----
+
+        // rD = rA op rB through EAX, so any of them may alias
+        void arith(const Instruction &inst, Alu op, bool swap) {
+            Reg a = bind(inst.rA);
+            Reg b = bind(inst.rB);
+            e.mov(RAX, swap ? b : a);
+            e.alu(op, RAX, swap ? a : b);
+            e.mov(bind_dest(inst.rD), RAX);
+            record(inst);
+        }
+
+        // rA = rS op rB (rS in the rD slot), optionally inverting rB first or the result after
+        void logical(const Instruction &inst, Alu op, bool invert_b, bool invert_result) {
+            Reg s = bind(inst.rD);
+            Reg b = bind(inst.rB);
+            if (invert_b) {
+                e.mov(RAX, b);
+                e.not_(RAX);
+                e.alu(op, RAX, s);
+            } else {
+                e.mov(RAX, s);
+                e.alu(op, RAX, b);
+            }
+            if (invert_result)
+                e.not_(RAX);
+            e.mov(bind_dest(inst.rA), RAX);
+            record(inst);
+        }
+
+        void logical_imm(const Instruction &inst, Alu op, uint32_t imm, bool rc) {
+            e.mov(RAX, bind(inst.rD));
+            e.alu(op, RAX, imm);
+            e.mov(bind_dest(inst.rA), RAX);
+            if (rc)
+                record_cr0();
+        }
+
+        void add_imm(const Instruction &inst, uint32_t imm) {
+            if (inst.rA) {
+                e.mov(RAX, bind(inst.rA));
+                e.alu(ALU_ADD, RAX, imm);
+            } else {
+                e.mov(RAX, imm);
+            }
+            e.mov(bind_dest(inst.rD), RAX);
+        }
+
+        void compare(const Instruction &inst, bool is_signed, bool immediate) {
+            Reg a = bind(inst.rA);
+            if (immediate)
+                e.alu(ALU_CMP, a, is_signed ? static_cast<uint32_t>(static_cast<int32_t>(inst.simm)) : inst.uimm);
+            else
+                e.alu(ALU_CMP, a, bind(inst.rB));
+            set_cr_field(inst.rD >> 2, is_signed);
+        }
+
+        bool translate_one(const Instruction &inst, uint32_t pc) {
+            // Overflow-enabled XO forms are left to the interpreter
+            if (isa::spec(inst.op).form == isa::XO_FORM && (inst.raw & 0x400))
+                return false;
+
+            switch (inst.op) {
+                case Op::MULLI:
+                    e.imul(RAX, bind(inst.rA), inst.simm);
+                    e.mov(bind_dest(inst.rD), RAX);
+                    return true;
+                case Op::CMPLI: compare(inst, false, true); return true;
+                case Op::CMPI:  compare(inst, true, true); return true;
+                case Op::CMP:   compare(inst, true, false); return true;
+                case Op::CMPL:  compare(inst, false, false); return true;
+                case Op::ADDI:  add_imm(inst, static_cast<uint32_t>(static_cast<int32_t>(inst.simm))); return true;
+                case Op::ADDIS: add_imm(inst, static_cast<uint32_t>(inst.uimm) << 16); return true;
+                case Op::ADD:   arith(inst, ALU_ADD, false); return true;
+                case Op::SUBF:  arith(inst, ALU_SUB, true); return true;
+                case Op::NEG:
+                    e.mov(RAX, bind(inst.rA));
+                    e.neg(RAX);
+                    e.mov(bind_dest(inst.rD), RAX);
+                    record(inst);
+                    return true;
+                case Op::MULLW: {
+                    Reg a = bind(inst.rA);
+                    Reg b = bind(inst.rB);
+                    e.mov(RAX, a);
+                    e.imul(RAX, b);
+                    e.mov(bind_dest(inst.rD), RAX);
+                    record(inst);
+                    return true;
+                }
+                case Op::BC:    op_bc(inst, pc); return true;
+                case Op::B:     op_b(inst, pc); return true;
+                case Op::BCLR:  op_bc_indirect(inst, pc, true); return true;
+                case Op::BCCTR: op_bc_indirect(inst, pc, false); return true;
+                case Op::RLWINM: {
+                    const unsigned mb = isa::extract<isa::MB>(inst.raw);
+                    const unsigned me = isa::extract<isa::ME>(inst.raw);
+                    const uint32_t m = (0xFFFFFFFFu >> mb) ^ (me >= 31 ? 0 : 0xFFFFFFFFu >> (me + 1));
+                    const uint32_t mask = mb <= me ? m : ~m;
+
+                    e.mov(RAX, bind(inst.rD));
+                    if (inst.rB)
+                        e.rol(RAX, inst.rB);
+                    if (mask != 0xFFFFFFFF)
+                        e.alu(ALU_AND, RAX, mask);
+                    e.mov(bind_dest(inst.rA), RAX);
+                    record(inst);
+                    return true;
+                }
+                case Op::ORI:      logical_imm(inst, ALU_OR, inst.uimm, false); return true;
+                case Op::ORIS:     logical_imm(inst, ALU_OR, static_cast<uint32_t>(inst.uimm) << 16, false); return true;
+                case Op::XORI:     logical_imm(inst, ALU_XOR, inst.uimm, false); return true;
+                case Op::XORIS:    logical_imm(inst, ALU_XOR, static_cast<uint32_t>(inst.uimm) << 16, false); return true;
+                case Op::ANDI_RC:  logical_imm(inst, ALU_AND, inst.uimm, true); return true;
+                case Op::ANDIS_RC: logical_imm(inst, ALU_AND, static_cast<uint32_t>(inst.uimm) << 16, true); return true;
+                case Op::AND:  logical(inst, ALU_AND, false, false); return true;
+                case Op::ANDC: logical(inst, ALU_AND, true, false); return true;
+                case Op::OR:   logical(inst, ALU_OR, false, false); return true;
+                case Op::ORC:  logical(inst, ALU_OR, true, false); return true;
+                case Op::XOR:  logical(inst, ALU_XOR, false, false); return true;
+                case Op::NOR:  logical(inst, ALU_OR, false, true); return true;
+                case Op::NAND: logical(inst, ALU_AND, false, true); return true;
+                case Op::EQV:  logical(inst, ALU_XOR, false, true); return true;
+                case Op::EXTSH:
+                case Op::EXTSB:
+                    e.mov(RAX, bind(inst.rD));
+                    inst.op == Op::EXTSH ? e.movsx16(RAX, RAX) : e.movsx8(RAX, RAX);
+                    e.mov(bind_dest(inst.rA), RAX);
+                    record(inst);
+                    return true;
+                case Op::MFCR:
+                    materialize_cr0();
+                    e.load(bind_dest(inst.rD), CPU, CPU_OFFSET(cr));
+                    return true;
+                case Op::MFSPR:
+                case Op::MTSPR: {
+                    const uint32_t n = isa::extract<isa::SPR>(inst.raw);
+                    int32_t off;
+                    if (n == spr::LR)       off = CPU_OFFSET(lr);
+                    else if (n == spr::CTR) off = CPU_OFFSET(ctr);
+                    else return false;      // XER is stored in pieces, leave it to the interpreter
+
+                    if (inst.op == Op::MFSPR)
+                        e.load(bind_dest(inst.rD), CPU, off);
+                    else
+                        e.store(CPU, off, bind(inst.rD));
+                    return true;
+                }
+                case Op::LWZ:   op_load(inst, false, false, 4, false); return true;
+                case Op::LWZU:  op_load(inst, false, true, 4, false); return true;
+                case Op::LBZ:   op_load(inst, false, false, 1, false); return true;
+                case Op::LBZU:  op_load(inst, false, true, 1, false); return true;
+                case Op::LHZ:   op_load(inst, false, false, 2, false); return true;
+                case Op::LHZU:  op_load(inst, false, true, 2, false); return true;
+                case Op::LHA:   op_load(inst, false, false, 2, true); return true;
+                case Op::LHAU:  op_load(inst, false, true, 2, true); return true;
+                case Op::LWZX:  op_load(inst, true, false, 4, false); return true;
+                case Op::LWZUX: op_load(inst, true, true, 4, false); return true;
+                case Op::LBZX:  op_load(inst, true, false, 1, false); return true;
+                case Op::LBZUX: op_load(inst, true, true, 1, false); return true;
+                case Op::LHZX:  op_load(inst, true, false, 2, false); return true;
+                case Op::LHZUX: op_load(inst, true, true, 2, false); return true;
+                case Op::LHAX:  op_load(inst, true, false, 2, true); return true;
+                case Op::STW:   op_store(inst, false, false, 4); return true;
+                case Op::STWU:  op_store(inst, false, true, 4); return true;
+                case Op::STB:   op_store(inst, false, false, 1); return true;
+                case Op::STBU:  op_store(inst, false, true, 1); return true;
+                case Op::STH:   op_store(inst, false, false, 2); return true;
+                case Op::STHU:  op_store(inst, false, true, 2); return true;
+                case Op::STWX:  op_store(inst, true, false, 4); return true;
+                case Op::STWUX: op_store(inst, true, true, 4); return true;
+                case Op::STBX:  op_store(inst, true, false, 1); return true;
+                case Op::STBUX: op_store(inst, true, true, 1); return true;
+                case Op::STHX:  op_store(inst, true, false, 2); return true;
+                case Op::STHUX: op_store(inst, true, true, 2); return true;
+                default: return false;
+            }
+        }
+    };
+
+    // ---- Jit ----
+
+    Jit::Jit(memory::Memory &mem, std::size_t code_size) : m_mem(mem), m_fast(FAST_ENTRIES, nullptr) {
+        void *p = mmap(nullptr, code_size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            LOG_CRITICAL("Failed to allocate JIT code buffer!");
+            throw std::runtime_error("Jit: failed to allocate executable memory");
+        }
+
+        m_code = static_cast<uint8_t *>(p);
+        m_code_size = code_size;
+
+        emit_stubs();
+        m_mem.set_code_write_hook([this](uint32_t offset, uint32_t size) { invalidate_ram(offset, size); });
+    }
+
+    Jit::~Jit() {
+        m_mem.set_code_write_hook(nullptr);
+        m_mem.clear_code_pages();
+        munmap(m_code, m_code_size);
+    }
+
+    void Jit::emit_stubs() {
+        Emitter e(m_code, m_code_size);
+        static const Reg saved[] = { RBX, RBP, R12, R13, R14, R15 };
+
+        // int64_t enter(CPUState *cpu, const uint8_t *entry, int64_t budget)
+        m_enter = reinterpret_cast<EnterFn>(e.ptr());
+        for (Reg r : saved)
+            e.push(r);
+        e.alu64(ALU_SUB, RSP, 8);     // Six pushes and the return address, realign to 16
+        e.mov64(CPU, RDI);
+        e.mov64(RAM, reinterpret_cast<uint64_t>(m_mem.ram()));
+        e.mov64(PAGES, reinterpret_cast<uint64_t>(m_mem.page_flags()));
+        e.mov64(BUDGET, RDX);
+        e.jmp(RSI);
+
+        // Blocks jump here with cpu.pc set; hands the remaining budget back
+        m_exit = e.ptr();
+        e.mov64(RAX, BUDGET);
+        e.alu64(ALU_ADD, RSP, 8);
+        for (int i = 5; i >= 0; i--)
+            e.pop(saved[i]);
+        e.ret();
+
+        m_stubs_end = (e.size() + 15) & ~std::size_t(15);
+        m_code_used = m_stubs_end;
+    }
+
+    void Jit::attach(CPUState &cpu) {
+        cpu.mem = &m_mem;
+        cpu.on_icbi = [this](uint32_t address) { invalidate(address & ~31u, 32); };
+    }
+
+    void Jit::link(uint32_t target, uint8_t *site, uint32_t source) {
+        m_links[target].push_back({ site, source });
+
+        auto it = m_blocks.find(target);
+        if (it != m_blocks.end()) {
+            Emitter::patch_jmp(site, it->second->entry);
+            m_stats.links++;
+        }
+    }
+
+    Jit::Block *Jit::compile(uint32_t pc) {
+        PROFILE_ZONE("Jit::compile");
+
+        const int64_t off = memory::Memory::ram_offset(pc);
+        if (off < 0 || (pc & 3))
+            return nullptr;
+
+        if (m_code_size - m_code_used < MAX_BLOCK_CODE) {
+            LOG_DEBUG("JIT code buffer full, flushing");
+            clear();
+            m_stats.flushes++;
+        }
+
+        const uint32_t start = static_cast<uint32_t>(off);
+        const uint32_t max_len = std::min<uint32_t>(BlockCache::MAX_BLOCK_INSTRUCTIONS, (memory::MEM1_SIZE - start) / 4);
+
+        Instruction scratch[BlockCache::MAX_BLOCK_INSTRUCTIONS];
+        uint32_t len = 0;
+        while (len < max_len) {
+            scratch[len] = decode(util::load_be<uint32_t>(m_mem.ram() + start + len * 4));
+            if (scratch[len++].flags & INST_ENDS_BLOCK)
+                break;
+        }
+
+        auto block = std::make_unique<Block>();
+        block->address = pc;
+        block->ram_offset = start;
+        block->length = len;
+        block->insts = std::make_unique<Instruction[]>(len);
+        std::copy(scratch, scratch + len, block->insts.get());
+        block->entry = m_code + m_code_used;
+
+        JitCompiler compiler(*this, block->entry, m_code_size - m_code_used);
+        const std::size_t size = compiler.translate(block->insts.get(), len, pc);
+        if (compiler.overflowed())
+            throw std::runtime_error("Jit: block too large for the code buffer");
+
+        m_code_used = (m_code_used + size + 15) & ~std::size_t(15);
+        m_stats.code_bytes = m_code_used;
+
+        m_mem.mark_code(pc, block->byte_size());
+        const uint32_t first_page = start >> memory::PAGE_SHIFT;
+        const uint32_t last_page = (start + block->byte_size() - 1) >> memory::PAGE_SHIFT;
+        for (uint32_t page = first_page; page <= last_page; page++)
+            m_page_blocks[page].push_back(pc);
+
+        Block *raw = block.get();
+        m_fast[(pc >> 2) & (FAST_ENTRIES - 1)] = raw;
+        m_blocks[pc] = std::move(block);
+        m_stats.compiled++;
+
+        // Exits that were waiting for this block can jump straight in now
+        auto waiting = m_links.find(pc);
+        if (waiting != m_links.end()) {
+            for (const Link &l : waiting->second) {
+                Emitter::patch_jmp(l.site, raw->entry);
+                m_stats.links++;
+            }
+        }
+
+        for (const auto &exit : compiler.exits()) {
+            raw->targets.push_back(exit.target);
+            link(exit.target, exit.site, pc);
+        }
+
+        LOG_TRACE("JIT block @ ", pc, " (", len, " instructions, ", size, " bytes)");
+        return raw;
+    }
+
+    Jit::Block *Jit::fetch(uint32_t pc) {
+        Block *b = m_fast[(pc >> 2) & (FAST_ENTRIES - 1)];
+        if (b && b->address == pc)
+            return b;
+
+        auto it = m_blocks.find(pc);
+        if (it != m_blocks.end()) {
+            m_fast[(pc >> 2) & (FAST_ENTRIES - 1)] = it->second.get();
+            return it->second.get();
+        }
+
+        return compile(pc);
+    }
+
+    void Jit::retire(uint32_t pc) {
+        auto it = m_blocks.find(pc);
+        if (it == m_blocks.end())
+            return;
+
+        Block *b = it->second.get();
+        Block *&slot = m_fast[(pc >> 2) & (FAST_ENTRIES - 1)];
+        if (slot == b)
+            slot = nullptr;
+
+        // Exits into this block go back to run() (and get relinked if it's translated again)
+        auto incoming = m_links.find(pc);
+        if (incoming != m_links.end()) {
+            for (const Link &l : incoming->second)
+                Emitter::patch_jmp(l.site, m_exit);
+        }
+
+        // Its own exits are dead code now
+        for (uint32_t target : b->targets) {
+            auto lit = m_links.find(target);
+            if (lit == m_links.end())
+                continue;
+            auto &list = lit->second;
+            list.erase(std::remove_if(list.begin(), list.end(), [pc](const Link &l) { return l.source == pc; }), list.end());
+            if (list.empty())
+                m_links.erase(lit);
+        }
+
+        const uint32_t first_page = b->ram_offset >> memory::PAGE_SHIFT;
+        const uint32_t last_page = (b->ram_offset + b->byte_size() - 1) >> memory::PAGE_SHIFT;
+        for (uint32_t page = first_page; page <= last_page; page++) {
+            auto pit = m_page_blocks.find(page);
+            if (pit == m_page_blocks.end())
+                continue;
+            auto &list = pit->second;
+            list.erase(std::remove(list.begin(), list.end(), pc), list.end());
+            if (list.empty())
+                m_page_blocks.erase(pit);
+        }
+
+        // The code stays in the buffer (it may be running), only the bookkeeping goes
+        m_retired.push_back(std::move(it->second));
+        m_blocks.erase(it);
+        m_stats.invalidated++;
+    }
+
+    void Jit::invalidate_ram(uint32_t offset, uint32_t size) {
+        if (size == 0 || m_blocks.empty())
+            return;
+
+        const uint64_t end = static_cast<uint64_t>(offset) + size;
+        const uint32_t first_page = offset >> memory::PAGE_SHIFT;
+        const uint32_t last_page = static_cast<uint32_t>((end - 1) >> memory::PAGE_SHIFT);
+
+        std::vector<uint32_t> doomed;
+        for (uint32_t page = first_page; page <= last_page; page++) {
+            auto pit = m_page_blocks.find(page);
+            if (pit == m_page_blocks.end())
+                continue;
+
+            for (uint32_t pc : pit->second) {
+                const Block &b = *m_blocks.at(pc);
+                if (b.ram_offset < end && offset < b.ram_offset + b.byte_size())
+                    doomed.push_back(pc);
+            }
+        }
+
+        for (uint32_t pc : doomed)
+            retire(pc);
+    }
+
+    void Jit::invalidate(uint32_t address, uint32_t size) {
+        const int64_t off = memory::Memory::ram_offset(address);
+        if (off >= 0)
+            invalidate_ram(static_cast<uint32_t>(off), size);
+    }
+
+    void Jit::clear() {
+        m_stats.invalidated += m_blocks.size();
+        for (auto &entry : m_blocks)
+            m_retired.push_back(std::move(entry.second));
+
+        m_blocks.clear();
+        m_page_blocks.clear();
+        m_links.clear();
+        std::fill(m_fast.begin(), m_fast.end(), nullptr);
+        m_mem.clear_code_pages();
+
+        m_code_used = m_stubs_end;
+        m_stats.code_bytes = m_code_used;
+    }
+
+    uint64_t Jit::run(CPUState &cpu, uint64_t budget) {
+        PROFILE_ZONE("Jit::run");
+
+        int64_t remaining = static_cast<int64_t>(budget);
+
+        while (remaining > 0) {
+            m_retired.clear();
+
+            Block *b = fetch(cpu.pc);
+            if (!b) {
+                LOG_ERROR("Can't fetch instructions @ ", cpu.pc, ", stopping");
+                break;
+            }
+
+            remaining = m_enter(&cpu, b->entry, remaining);
+        }
+
+        m_retired.clear();
+
+        const uint64_t executed = static_cast<uint64_t>(static_cast<int64_t>(budget) - remaining);
+        PROFILE_COUNTER("Instructions executed", executed);
+        PROFILE_COUNTER("Blocks compiled", m_stats.compiled);
+        return executed;
+    }
+
+    // ---- Lockstep verification ----
+
+    static std::string diff_state(const CPUState &jit, const CPUState &ref) {
+        char buf[96];
+        char name[16];
+        auto mismatch = [&](const char *what, uint64_t a, uint64_t b) {
+            std::snprintf(buf, sizeof(buf), "%s: jit=0x%llX interpreter=0x%llX", what,
+                          static_cast<unsigned long long>(a), static_cast<unsigned long long>(b));
+            return std::string(buf);
+        };
+
+        for (unsigned i = 0; i < 32; i++) {
+            if (jit.gpr[i] != ref.gpr[i]) {
+                std::snprintf(name, sizeof(name), "r%u", i);
+                return mismatch(name, jit.gpr[i], ref.gpr[i]);
+            }
+        }
+        for (unsigned i = 0; i < 32; i++) {
+            for (unsigned lane = 0; lane < 2; lane++) {
+                const double &a = lane ? jit.fpr[i].ps1 : jit.fpr[i].ps0;
+                const double &b = lane ? ref.fpr[i].ps1 : ref.fpr[i].ps0;
+                if (std::memcmp(&a, &b, sizeof(double)) != 0) {
+                    uint64_t x, y;
+                    std::memcpy(&x, &a, 8);
+                    std::memcpy(&y, &b, 8);
+                    std::snprintf(name, sizeof(name), "f%u.ps%u", i, lane);
+                    return mismatch(name, x, y);
+                }
+            }
+        }
+
+        if (jit.pc != ref.pc) return mismatch("pc", jit.pc, ref.pc);
+        if (jit.lr != ref.lr) return mismatch("lr", jit.lr, ref.lr);
+        if (jit.ctr != ref.ctr) return mismatch("ctr", jit.ctr, ref.ctr);
+        if (jit.read_xer() != ref.read_xer()) return mismatch("xer", jit.read_xer(), ref.read_xer());
+        if (jit.read_cr() != ref.read_cr()) return mismatch("cr", jit.read_cr(), ref.read_cr());
+        if (jit.msr != ref.msr) return mismatch("msr", jit.msr, ref.msr);
+        if (jit.fpscr != ref.fpscr) return mismatch("fpscr", jit.fpscr, ref.fpscr);
+
+        for (unsigned i = 0; i < 1024; i++) {
+            if (SprFile::implemented(i) && jit.spr[i] != ref.spr[i]) {
+                std::snprintf(name, sizeof(name), "spr%u", i);
+                return mismatch(name, jit.spr[i], ref.spr[i]);
+            }
+        }
+        return {};
+    }
+
+    LockstepReport run_lockstep(CPUState &cpu, memory::Memory &mem, uint64_t budget) {
+        LockstepReport report;
+
+        memory::Memory shadow;
+        std::memcpy(shadow.ram(), mem.ram(), memory::MEM1_SIZE);
+        std::memcpy(shadow.aram(), mem.aram(), memory::ARAM_SIZE);
+
+        Jit jit(mem);
+        jit.attach(cpu);
+
+        CPUState ref = cpu;
+        ref.mem = &shadow;
+        ref.on_icbi = nullptr;
+
+        while (report.instructions < budget) {
+            const uint32_t start = cpu.pc;
+
+            // A budget of one runs exactly one block
+            const uint64_t n = jit.run(cpu, 1);
+            if (n == 0)
+                break;
+
+            for (uint64_t i = 0; i < n; i++)
+                execute_slow(ref, decode(shadow.read_slow<uint32_t>(ref.pc)));
+
+            report.blocks++;
+            report.instructions += n;
+
+            std::string diff = diff_state(cpu, ref);
+            if (!diff.empty()) {
+                report.diverged = true;
+                report.pc = start;
+                report.detail = std::move(diff);
+                return report;
+            }
+        }
+
+        for (uint32_t off = 0; off < memory::MEM1_SIZE; off += memory::PAGE_SIZE) {
+            if (std::memcmp(mem.ram() + off, shadow.ram() + off, memory::PAGE_SIZE) == 0)
+                continue;
+
+            uint32_t at = off;
+            while (mem.ram()[at] == shadow.ram()[at])
+                at++;
+
+            char buf[96];
+            std::snprintf(buf, sizeof(buf), "RAM @ 0x%08X: jit=0x%02X interpreter=0x%02X", at, mem.ram()[at], shadow.ram()[at]);
+            report.diverged = true;
+            report.pc = cpu.pc;
+            report.detail = buf;
+            break;
+        }
+
+        return report;
+    }
+}
+
+#endif
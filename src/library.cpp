@@ -0,0 +1,338 @@
+#if !defined(_WIN32) && !defined(_WIN64)
+    #include <sys/stat.h>
+#endif
+
+#include "library/library.hpp"
+#include "loader/fcb.hpp"
+#include "state/serializer.hpp"
+#include "util/log.hpp"
+#include "util/profile.hpp"
+#include "util/thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+
+namespace freecube::library {
+
+    namespace {
+        namespace fs = std::filesystem;
+
+        constexpr std::uint8_t MAGIC[4] = { 'F', 'C', 'L', 'B' };
+        constexpr std::size_t HEADER_BYTES = 0x460;     // boot.bin, then bi2.bin up to its country code
+        constexpr std::size_t CHUNK = 32;               // Images per job
+
+        std::uint32_t be32(const std::uint8_t *p) {
+            return (static_cast<std::uint32_t>(p[0]) << 24) | (static_cast<std::uint32_t>(p[1]) << 16) |
+                   (static_cast<std::uint32_t>(p[2]) << 8) | static_cast<std::uint32_t>(p[3]);
+        }
+
+        bool is_image(const fs::path &path) {
+            std::string ext = path.extension().string();
+            std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+            return ext == ".iso" || ext == ".gcm" || ext == ".fcb";
+        }
+
+        // False (with the reason in info.error) if the file can't be stat'ed. On a rescan this
+        // is all the work done per image, so POSIX hosts get size and mtime from one stat()
+        bool stat_file(const std::string &path, GameInfo &info) {
+#if !defined(_WIN32) && !defined(_WIN64)
+            struct stat st;
+            if (::stat(path.c_str(), &st) != 0) {
+                info.error = "can't stat: " + std::error_code(errno, std::generic_category()).message();
+                return false;
+            }
+    #if defined(__APPLE__)
+            const auto &mtime = st.st_mtimespec;
+    #else
+            const auto &mtime = st.st_mtim;
+    #endif
+            info.file_size = static_cast<std::uint64_t>(st.st_size);
+            info.mtime = static_cast<std::int64_t>(mtime.tv_sec) * 1000000000 + mtime.tv_nsec;
+            return true;
+#else
+            std::error_code ec;
+            info.file_size = fs::file_size(path, ec);
+            if (!ec)
+                info.mtime = static_cast<std::int64_t>(fs::last_write_time(path, ec).time_since_epoch().count());
+            if (ec) {
+                info.error = "can't stat: " + ec.message();
+                return false;
+            }
+            return true;
+#endif
+        }
+
+        // Same checks as ISOImage::validate()
+        const char *check_header(const std::uint8_t *h, std::uint64_t disc_size) {
+            if (disc_size % 0x8000 != 0)
+                return "invalid size (not a multiple of 32kb)";
+            if (disc_size < HEADER_BYTES)
+                return "too small for boot.bin";
+            if (h[0] != 'G' && h[0] != 'D')
+                return "invalid boot.bin magic";
+            for (std::size_t i = 0; i < 6; i++) {
+                if (h[i] < 0x20 || h[i] > 0x7E)
+                    return "invalid game ID";
+            }
+            return nullptr;
+        }
+
+        void write_entry(state::StateWriter &w, const GameInfo &g) {
+            w.string(g.path);
+            w.u64(g.file_size);
+            w.u64(static_cast<std::uint64_t>(g.mtime));
+            w.boolean(g.ok);
+            w.string(g.error);
+            w.boolean(g.compressed);
+            w.u64(g.disc_size);
+            w.string(g.game_id);
+            w.u8(g.disc_number);
+            w.u8(g.version);
+            w.string(g.title);
+            w.u32(g.region);
+            w.u32(g.dol_offset);
+            w.u32(g.fst_offset);
+            w.u32(g.fst_size);
+        }
+
+        GameInfo read_entry(state::StateReader &r) {
+            GameInfo g;
+            g.path = r.string();
+            g.file_size = r.u64();
+            g.mtime = static_cast<std::int64_t>(r.u64());
+            g.ok = r.boolean();
+            g.error = r.string();
+            g.compressed = r.boolean();
+            g.disc_size = r.u64();
+            g.game_id = r.string();
+            g.disc_number = r.u8();
+            g.version = r.u8();
+            g.title = r.string();
+            g.region = r.u32();
+            g.dol_offset = r.u32();
+            g.fst_offset = r.u32();
+            g.fst_size = r.u32();
+            return g;
+        }
+    }
+
+    GameInfo read_game_info(const std::string &path) {
+        GameInfo info;
+        info.path = path;
+        if (!stat_file(path, info))
+            return info;
+
+        std::uint8_t header[HEADER_BYTES] = {};
+        try {
+            std::ifstream f(path, std::ios::binary);
+            if (!f) {
+                info.error = "failed to open";
+                return info;
+            }
+            f.read(reinterpret_cast<char *>(header), sizeof(header));
+            info.disc_size = info.file_size;
+
+            // Compressed images: just the block table and the first block, no read-ahead workers
+            if (static_cast<std::size_t>(f.gcount()) >= sizeof(ISOLoader::fcb::MAGIC) &&
+                std::memcmp(header, ISOLoader::fcb::MAGIC, sizeof(ISOLoader::fcb::MAGIC)) == 0) {
+                ISOLoader::FCBOptions options;
+                options.cache_blocks = 1;
+                options.read_ahead = 0;
+                const ISOLoader::FCBImage fcb(path, options);
+
+                std::memset(header, 0, sizeof(header));
+                fcb.read(0, header, sizeof(header));
+                info.compressed = true;
+                info.disc_size = fcb.size();
+            }
+        } catch (const std::exception &e) {
+            info.error = e.what();
+            return info;
+        }
+
+        if (const char *error = check_header(header, info.disc_size)) {
+            info.error = error;
+            return info;
+        }
+
+        info.game_id.assign(reinterpret_cast<const char *>(header), 6);
+        info.disc_number = header[0x06];
+        info.version = header[0x07];
+
+        const auto *title = reinterpret_cast<const char *>(header + 0x20);
+        info.title.assign(title, std::find(title, title + 0x3E0, '\0'));
+        info.title.erase(info.title.find_last_not_of(' ') + 1);
+
+        info.dol_offset = be32(header + 0x420);
+        info.fst_offset = be32(header + 0x424);
+        info.fst_size = be32(header + 0x428);
+        info.region = be32(header + 0x440 + 0x18);
+        info.ok = true;
+        return info;
+    }
+
+    LibraryCache::LibraryCache(std::string path) : m_path(std::move(path)) {
+        std::ifstream f(m_path, std::ios::binary | std::ios::ate);
+        if (!f)
+            return;
+
+        std::vector<std::uint8_t> data(static_cast<std::size_t>(std::max<std::streamoff>(f.tellg(), 0)));
+        f.seekg(0);
+        if (!f.read(reinterpret_cast<char *>(data.data()), static_cast<std::streamsize>(data.size())))
+            return;
+
+        try {
+            state::StateReader r(data.data(), data.size());
+            std::uint8_t magic[4];
+            r.bytes(magic, sizeof(magic));
+            if (std::memcmp(magic, MAGIC, sizeof(magic)) != 0 || r.u32() != VERSION) {
+                LOG_WARN("Library cache ", m_path, " is from another version, rebuilding it");
+                return;
+            }
+
+            const std::uint32_t count = r.u32();
+            for (std::uint32_t i = 0; i < count; i++) {
+                GameInfo g = read_entry(r);
+                m_entries.emplace(g.path, std::move(g));
+            }
+        } catch (const std::exception &) {
+            LOG_WARN("Library cache ", m_path, " is truncated, rebuilding it");
+            m_entries.clear();
+        }
+    }
+
+    const GameInfo *LibraryCache::find(const std::string &path, std::uint64_t file_size, std::int64_t mtime) const {
+        auto it = m_entries.find(path);
+        if (it == m_entries.end() || it->second.file_size != file_size || it->second.mtime != mtime)
+            return nullptr;
+        return &it->second;
+    }
+
+    void LibraryCache::retain(const std::vector<GameInfo> &keep) {
+        std::unordered_map<std::string, GameInfo> kept;
+        kept.reserve(keep.size());
+        for (const GameInfo &g : keep) {
+            auto it = m_entries.find(g.path);
+            if (it != m_entries.end())
+                kept.emplace(it->first, std::move(it->second));
+        }
+        m_entries = std::move(kept);
+    }
+
+    void LibraryCache::save() const {
+        state::StateWriter w;
+        w.bytes(MAGIC, sizeof(MAGIC));
+        w.u32(VERSION);
+        w.u32(static_cast<std::uint32_t>(m_entries.size()));
+        for (const auto &[path, g] : m_entries)
+            write_entry(w, g);
+
+        // Never leave a half-written cache behind
+        const std::string tmp = m_path + ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char *>(w.data().data()), static_cast<std::streamsize>(w.data().size()));
+            if (!out)
+                throw std::runtime_error("library: failed to write " + tmp);
+        }
+
+        std::error_code ec;
+        fs::rename(tmp, m_path, ec);
+        if (ec)
+            throw std::runtime_error("library: failed to replace " + m_path + ": " + ec.message());
+    }
+
+    std::vector<GameInfo> scan(const std::vector<std::string> &roots, LibraryCache &cache, std::size_t threads,
+                               ScanStats *stats) {
+        PROFILE_ZONE("library::scan");
+
+        std::mutex lock;
+        std::vector<GameInfo> found;
+        std::vector<GameInfo> fresh;        // Headers read this time, for the cache
+        std::atomic<std::size_t> failed{ 0 };
+
+        // The cache is only read until the pool is idle
+        auto describe = [&](const std::vector<std::string> &paths) {
+            std::vector<GameInfo> hits, reads;
+            for (const std::string &path : paths) {
+                GameInfo info;
+                info.path = path;
+                const bool stat_ok = stat_file(path, info);
+
+                if (const GameInfo *cached = stat_ok ? cache.find(path, info.file_size, info.mtime) : nullptr) {
+                    hits.push_back(*cached);
+                } else if (stat_ok) {
+                    reads.push_back(read_game_info(path));
+                } else {
+                    reads.push_back(std::move(info));
+                }
+            }
+
+            std::lock_guard<std::mutex> guard(lock);
+            for (GameInfo &g : hits) {
+                failed += !g.ok;
+                found.push_back(std::move(g));
+            }
+            for (GameInfo &g : reads) {
+                failed += !g.ok;
+                found.push_back(g);
+                fresh.push_back(std::move(g));
+            }
+        };
+
+        util::ThreadPool pool(threads);
+
+        // Each directory is a job, subdirectories are posted as they turn up
+        std::function<void(const fs::path &)> walk = [&](const fs::path &dir) {
+            std::error_code ec;
+            std::vector<std::string> images;
+
+            // Spelled out so a failed step reports through ec; operator++ would throw, and
+            // an exception escaping a pool job ends the process
+            fs::directory_iterator it(dir, ec);
+            for (; !ec && it != fs::directory_iterator(); it.increment(ec)) {
+                const fs::directory_entry &entry = *it;
+                std::error_code type_ec;
+                if (entry.is_directory(type_ec) && !entry.is_symlink(type_ec)) {
+                    pool.post([&walk, sub = entry.path()] { walk(sub); });
+                } else if (entry.is_regular_file(type_ec) && is_image(entry.path())) {
+                    images.push_back(entry.path().string());
+                    if (images.size() == CHUNK) {
+                        pool.post([&describe, chunk = std::move(images)] { describe(chunk); });
+                        images.clear();
+                    }
+                }
+            }
+            if (ec)
+                LOG_WARN("Library: failed to scan ", dir.string(), ": ", ec.message());
+            if (!images.empty())
+                describe(images);
+        };
+
+        for (const std::string &root : roots)
+            pool.post([&walk, root] { walk(root); });
+        pool.wait_idle();
+
+        for (const GameInfo &g : fresh)
+            cache.store(g);
+        cache.retain(found);
+
+        std::sort(found.begin(), found.end(), [](const GameInfo &a, const GameInfo &b) { return a.path < b.path; });
+
+        if (stats) {
+            stats->images = found.size();
+            stats->read = fresh.size();
+            stats->cached = found.size() - fresh.size();
+            stats->failed = failed;
+        }
+        return found;
+    }
+
+} // namespace freecube::library
@@ -0,0 +1,313 @@
+#include "util/log.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace freecube::util {
+
+    namespace {
+        // One per logging thread: that thread is the only producer, the writer the only consumer
+        struct Ring {
+            std::unique_ptr<LogRecord[]> slots{ new LogRecord[AsyncLog::RING_SLOTS] };
+            alignas(64) std::atomic<std::uint64_t> head{0};     // Next slot the owner fills
+            alignas(64) std::atomic<std::uint64_t> tail{0};     // Next slot the writer reads
+            std::atomic<std::uint64_t> dropped{0};
+            std::atomic<bool> orphaned{false};                  // Owner thread has exited
+        };
+
+        struct Entry {
+            std::int64_t time_ns;
+            bool to_stderr;
+            std::string text;
+        };
+
+        using Clock = std::chrono::system_clock;
+
+        Clock::time_point to_time_point(std::int64_t ns) {
+            return Clock::time_point(std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds(ns)));
+        }
+
+        template<typename T>
+        T read_raw(const std::uint8_t* p) {
+            T v;
+            std::memcpy(&v, p, sizeof(T));
+            return v;
+        }
+
+        void format_args(std::ostringstream& oss, const LogRecord& rec) {
+            const std::uint8_t* p = rec.payload;
+            const std::uint8_t* end = rec.payload + rec.size;
+
+            while (p < end) {
+                switch (*p++) {
+                    case LogRecord::U8:
+                        detail::stream_hex(oss, read_raw<std::uint8_t>(p), 1);
+                        p += 1;
+                        break;
+                    case LogRecord::U16:
+                        detail::stream_hex(oss, read_raw<std::uint16_t>(p), 2);
+                        p += 2;
+                        break;
+                    case LogRecord::U32:
+                        detail::stream_hex(oss, read_raw<std::uint32_t>(p), 4);
+                        p += 4;
+                        break;
+                    case LogRecord::U64:
+                        detail::stream_hex(oss, read_raw<std::uint64_t>(p), 8);
+                        p += 8;
+                        break;
+                    case LogRecord::F64:
+                        oss << read_raw<double>(p);
+                        p += sizeof(double);
+                        break;
+                    case LogRecord::PTR:
+                        oss << read_raw<const void*>(p);
+                        p += sizeof(const void*);
+                        break;
+                    case LogRecord::STR: {
+                        const auto len = read_raw<std::uint16_t>(p);
+                        oss.write(reinterpret_cast<const char*>(p + sizeof(len)), len);
+                        p += sizeof(len) + len;
+                        break;
+                    }
+                    case LogRecord::HEAP_STR: {
+                        char* str = read_raw<char*>(p);
+                        const auto len = read_raw<std::uint32_t>(p + sizeof(str));
+                        oss.write(str, len);
+                        delete[] str;
+                        p += sizeof(str) + sizeof(len);
+                        break;
+                    }
+                    case LogRecord::MANIP:
+                        oss << read_raw<LogRecord::Manipulator>(p);
+                        p += sizeof(LogRecord::Manipulator);
+                        break;
+                    case LogRecord::TRUNCATED:
+                    default:
+                        oss << " [truncated]";
+                        p = end;
+                        break;
+                }
+            }
+        }
+
+        class Writer {
+        public:
+            ~Writer() {
+                detail::async_log_running.store(false, std::memory_order_relaxed);
+                shutdown();
+            }
+
+            void start() {
+                std::lock_guard<std::mutex> lock(m_lock);
+                if (m_thread.joinable())
+                    return;
+                m_stopping = false;
+                m_thread = std::thread([this] { run(); });
+            }
+
+            void shutdown() {
+                {
+                    std::lock_guard<std::mutex> lock(m_lock);
+                    if (!m_thread.joinable())
+                        return;
+                    m_stopping = true;
+                }
+                m_wake.notify_one();
+                m_thread.join();
+            }
+
+            void flush() {
+                std::unique_lock<std::mutex> lock(m_lock);
+                if (!m_thread.joinable())
+                    return;
+
+                // Only a pass that starts after this request is guaranteed to see our records
+                const std::uint64_t target = ++m_flush_requested;
+                m_wake.notify_one();
+                m_done.wait(lock, [&] { return m_flush_done >= target; });
+            }
+
+            void add(std::shared_ptr<Ring> ring) {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_rings.push_back(std::move(ring));
+            }
+
+            // Wake the writer before its next poll (a ring is filling up)
+            void nudge() { m_wake.notify_one(); }
+
+            std::uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+        private:
+            std::mutex m_lock;                          // Guards everything but the rings' contents
+            std::condition_variable m_wake;
+            std::condition_variable m_done;
+            std::thread m_thread;
+            std::vector<std::shared_ptr<Ring>> m_rings;
+            bool m_stopping = false;
+            std::uint64_t m_flush_requested = 0;
+            std::uint64_t m_flush_done = 0;
+            std::atomic<std::uint64_t> m_dropped{0};
+
+            // Format everything queued in `ring` into `batch` and hand the slots back
+            std::uint64_t drain(Ring& ring, std::vector<Entry>& batch, std::ostringstream& oss) {
+                static const std::ios defaults(nullptr);
+
+                const std::uint64_t head = ring.head.load(std::memory_order_acquire);
+                const std::uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+                for (std::uint64_t i = tail; i != head; i++) {
+                    const LogRecord& rec = ring.slots[i % AsyncLog::RING_SLOTS];
+
+                    // Manipulators in the arguments mustn't leak into the next message
+                    oss.str(std::string());
+                    oss.clear();
+                    oss.copyfmt(defaults);
+
+                    detail::stream_prefix(oss, rec.level, to_time_point(rec.time_ns), rec.file, rec.line);
+                    format_args(oss, rec);
+                    oss << "\n";
+                    batch.push_back({ rec.time_ns, rec.level >= LogLevel::FC_ERROR, oss.str() });
+                }
+                ring.tail.store(head, std::memory_order_release);
+                return ring.dropped.exchange(0, std::memory_order_relaxed);
+            }
+
+            void run() {
+                std::vector<Entry> batch;
+                std::vector<std::shared_ptr<Ring>> rings;
+                std::ostringstream oss;
+                std::string out, err;
+
+                for (;;) {
+                    std::uint64_t flush_target;
+                    bool stopping;
+                    {
+                        std::lock_guard<std::mutex> lock(m_lock);
+                        flush_target = m_flush_requested;
+                        stopping = m_stopping;
+
+                        // Rings whose thread is gone are dropped once they've been emptied
+                        m_rings.erase(std::remove_if(m_rings.begin(), m_rings.end(), [](const auto& r) {
+                            return r->orphaned.load(std::memory_order_acquire) &&
+                                   r->tail.load(std::memory_order_relaxed) == r->head.load(std::memory_order_acquire);
+                        }), m_rings.end());
+                        rings = m_rings;
+                    }
+
+                    batch.clear();
+                    std::uint64_t dropped = 0;
+                    for (auto& ring : rings)
+                        dropped += drain(*ring, batch, oss);
+
+                    // Each ring is in order already, this interleaves the threads
+                    std::stable_sort(batch.begin(), batch.end(), [](const Entry& a, const Entry& b) {
+                        return a.time_ns < b.time_ns;
+                    });
+
+                    out.clear();
+                    err.clear();
+                    for (const auto& e : batch)
+                        (e.to_stderr ? err : out) += e.text;
+
+                    if (dropped) {
+                        m_dropped.fetch_add(dropped, std::memory_order_relaxed);
+                        oss.str(std::string());
+                        oss.clear();
+                        detail::stream_prefix(oss, LogLevel::FC_WARN, Clock::now(), __FILE__, __LINE__);
+                        oss << "Log rings overflowed, dropped ";
+                        detail::stream_hex(oss, dropped, sizeof(dropped));
+                        oss << " messages\n";
+                        out += oss.str();
+                    }
+
+                    if (!out.empty()) {
+                        std::cout.write(out.data(), static_cast<std::streamsize>(out.size()));
+                        std::cout.flush();
+                    }
+                    if (!err.empty()) {
+                        std::cerr.write(err.data(), static_cast<std::streamsize>(err.size()));
+                        std::cerr.flush();
+                    }
+
+                    std::unique_lock<std::mutex> lock(m_lock);
+                    m_flush_done = flush_target;
+                    m_done.notify_all();
+
+                    if (batch.empty() && !dropped) {
+                        if (stopping)
+                            break;
+                        m_wake.wait_for(lock, std::chrono::milliseconds(5), [&] {
+                            return m_stopping || m_flush_requested != m_flush_done;
+                        });
+                    }
+                }
+            }
+        };
+
+        Writer& writer() {
+            static Writer w;
+            return w;
+        }
+
+        // Registers this thread's ring on first use; marks it orphaned when the thread exits
+        struct LocalRing {
+            std::shared_ptr<Ring> ring;
+
+            ~LocalRing() {
+                if (ring)
+                    ring->orphaned.store(true, std::memory_order_release);
+            }
+
+            Ring& get() {
+                if (!ring) {
+                    ring = std::make_shared<Ring>();
+                    writer().add(ring);
+                }
+                return *ring;
+            }
+        };
+
+        thread_local LocalRing t_ring;
+    }
+
+    void AsyncLog::start() {
+        writer().start();
+        detail::async_log_running.store(true, std::memory_order_relaxed);
+    }
+
+    void AsyncLog::stop() {
+        detail::async_log_running.store(false, std::memory_order_relaxed);
+        writer().shutdown();
+    }
+
+    void AsyncLog::flush() {
+        writer().flush();
+    }
+
+    std::uint64_t AsyncLog::dropped() {
+        return writer().dropped();
+    }
+
+    LogRecord* AsyncLog::begin() {
+        Ring& ring = t_ring.get();
+        const std::uint64_t head = ring.head.load(std::memory_order_relaxed);
+        if (head - ring.tail.load(std::memory_order_acquire) >= RING_SLOTS) {
+            ring.dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        return &ring.slots[head % RING_SLOTS];
+    }
+
+    void AsyncLog::commit() {
+        Ring& ring = *t_ring.ring;
+        const std::uint64_t head = ring.head.load(std::memory_order_relaxed) + 1;
+        ring.head.store(head, std::memory_order_release);
+
+        if (head - ring.tail.load(std::memory_order_relaxed) == RING_SLOTS / 2)
+            writer().nudge();
+    }
+}
@@ -0,0 +1,163 @@
+#include "util/lz.hpp"
+#include <array>
+#include <cstring>
+
+namespace freecube::util::lz {
+
+    static constexpr std::size_t MIN_MATCH = 4;
+    static constexpr std::size_t MAX_DISTANCE = 0xFFFF;
+
+    // Keep the tail as literals so the match finder never reads past the input
+    static constexpr std::size_t LAST_LITERALS = 5;
+    static constexpr unsigned HASH_BITS = 14;
+
+    static std::uint32_t read32(const std::uint8_t *p) {
+        std::uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    static std::uint32_t hash32(std::uint32_t v) {
+        return (v * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    static void put_length(std::vector<std::uint8_t> &out, std::size_t len) {
+        while (len >= 255) {
+            out.push_back(255);
+            len -= 255;
+        }
+        out.push_back(static_cast<std::uint8_t>(len));
+    }
+
+    static void put_sequence(std::vector<std::uint8_t> &out, const std::uint8_t *literals, std::size_t lit_len,
+                             std::size_t distance, std::size_t match_len) {
+        std::size_t ml = match_len ? match_len - MIN_MATCH : 0;
+
+        std::uint8_t token = static_cast<std::uint8_t>((lit_len >= 15 ? 15 : lit_len) << 4);
+        if (match_len)
+            token |= static_cast<std::uint8_t>(ml >= 15 ? 15 : ml);
+        out.push_back(token);
+
+        if (lit_len >= 15)
+            put_length(out, lit_len - 15);
+
+        out.insert(out.end(), literals, literals + lit_len);
+
+        if (!match_len)
+            return;
+
+        out.push_back(static_cast<std::uint8_t>(distance & 0xFF));
+        out.push_back(static_cast<std::uint8_t>(distance >> 8));
+
+        if (ml >= 15)
+            put_length(out, ml - 15);
+    }
+
+    std::size_t compress(const std::uint8_t *src, std::size_t n, std::vector<std::uint8_t> &out) {
+        out.clear();
+        out.reserve(compress_bound(n));
+
+        // Positions are stored +1 so 0 means "empty"
+        thread_local std::array<std::uint32_t, 1u << HASH_BITS> table;
+        table.fill(0);
+
+        std::size_t anchor = 0;
+        std::size_t ip = 0;
+        std::size_t misses = 0;
+
+        if (n > MIN_MATCH + LAST_LITERALS) {
+            const std::size_t limit = n - LAST_LITERALS - MIN_MATCH;
+
+            while (ip <= limit) {
+                std::uint32_t seq = read32(src + ip);
+                std::uint32_t &slot = table[hash32(seq)];
+                std::size_t cand = slot;
+                slot = static_cast<std::uint32_t>(ip + 1);
+
+                if (cand == 0 || ip - (cand - 1) > MAX_DISTANCE || read32(src + cand - 1) != seq) {
+                    // Step faster through data that doesn't compress
+                    ip += 1 + (misses++ >> 6);
+                    continue;
+                }
+
+                std::size_t ref = cand - 1;
+                std::size_t len = MIN_MATCH;
+                while (ip + len < n - LAST_LITERALS && src[ref + len] == src[ip + len])
+                    ++len;
+
+                put_sequence(out, src + anchor, ip - anchor, ip - ref, len);
+
+                ip += len;
+                anchor = ip;
+                misses = 0;
+            }
+        }
+
+        put_sequence(out, src + anchor, n - anchor, 0, 0);
+        return out.size();
+    }
+
+    static bool get_length(const std::uint8_t *&ip, const std::uint8_t *end, std::size_t &len) {
+        std::uint8_t b;
+        do {
+            if (ip >= end)
+                return false;
+            b = *ip++;
+            len += b;
+        } while (b == 255);
+        return true;
+    }
+
+    bool decompress(const std::uint8_t *src, std::size_t n, std::uint8_t *dst, std::size_t dst_len) {
+        const std::uint8_t *ip = src;
+        const std::uint8_t *const iend = src + n;
+        std::size_t op = 0;
+
+        while (ip < iend) {
+            std::uint8_t token = *ip++;
+
+            std::size_t lit_len = token >> 4;
+            if (lit_len == 15 && !get_length(ip, iend, lit_len))
+                return false;
+
+            if (lit_len > static_cast<std::size_t>(iend - ip) || lit_len > dst_len - op)
+                return false;
+
+            std::memcpy(dst + op, ip, lit_len);
+            ip += lit_len;
+            op += lit_len;
+
+            // Literal-only sequence ends the stream
+            if (ip == iend)
+                break;
+
+            if (iend - ip < 2)
+                return false;
+
+            std::size_t distance = static_cast<std::size_t>(ip[0]) | (static_cast<std::size_t>(ip[1]) << 8);
+            ip += 2;
+
+            std::size_t match_len = token & 0x0F;
+            if (match_len == 15 && !get_length(ip, iend, match_len))
+                return false;
+            match_len += MIN_MATCH;
+
+            if (distance == 0 || distance > op || match_len > dst_len - op)
+                return false;
+
+            // Overlapping copies are how runs get encoded, so go byte by byte when they overlap
+            std::uint8_t *out = dst + op;
+            const std::uint8_t *ref = out - distance;
+            if (distance >= match_len) {
+                std::memcpy(out, ref, match_len);
+            } else {
+                for (std::size_t i = 0; i < match_len; ++i)
+                    out[i] = ref[i];
+            }
+            op += match_len;
+        }
+
+        return op == dst_len;
+    }
+
+} // namespace freecube::util::lz
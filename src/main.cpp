@@ -7,13 +7,54 @@
 #endif
 
 #include "util/log.hpp"
-#include "util/macros.hpp"
+#include "util/profile.hpp"
 #include "loader/loader.hpp"
 #include "dol/dol_loader.hpp"
+#include "dol/elf_loader.hpp"
+#include "dol/validate.hpp"
+#include "cpu/engine.hpp"
+#include "cpu/jit_x64.hpp"
+#include "timing/scheduler.hpp"
+#include "state/save_state.hpp"
+#include "state/rewind.hpp"
+#include "batch/batch.hpp"
+#include "loader/verify.hpp"
+#include "library/library.hpp"
+#include <chrono>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <optional>
 #include <string>
 #include <cstring>
+#include <algorithm>
+#include <cctype>
+#include <limits>
+
+namespace {
+    // The whole of value as a number, decimal or 0x hex. std::stoull alone throws on
+    // "abc" and quietly takes "12abc" or "-1"
+    bool parse_number(const std::string &value, uint64_t &out) {
+        if (value.empty() || !std::isdigit(static_cast<unsigned char>(value[0])))
+            return false;
+        try {
+            size_t used = 0;
+            const uint64_t n = std::stoull(value, &used, 0);
+            if (used != value.size())
+                return false;
+            out = n;
+            return true;
+        } catch (const std::exception &) {
+            return false;
+        }
+    }
+
+    int invalid_value(const std::string &arg) {
+        const size_t eq = arg.find('=');
+        LOG_CRITICAL("Invalid value for ", arg.substr(0, eq), ": ", arg.substr(eq + 1));
+        return -1;
+    }
+}
 
 int main(int argc, char **argv) {
     using namespace freecube::ISOLoader;
@@ -25,77 +66,428 @@ int main(int argc, char **argv) {
 
 
     std::string iso_path;
+    std::string dol_path;
+    std::string elf_path;
+    std::string compress_path;
+    StorageMode storage = StorageMode::MAPPED;
+    uint64_t run_budget = 0;
+    std::string cpu_mode = "jit";
+    std::string profile_path;
+    std::string load_state_path;
+    std::string save_state_path;
+    uint64_t rewind_budget_mib = 0;
+    uint64_t rewind_interval = 6;
+    uint64_t rewind_back = 0;
+    std::string batch_path;
+    std::string batch_out = "batch.json";
+    unsigned batch_jobs = 0;
+    bool verify = false;
+    std::vector<std::string> library_roots;
+    std::string library_cache = "library.fcl";
+    std::vector<std::string> verify_expected;
 
     for (int i = 1; i < argc; i++) {
         std::string arg = argv[i];
+        uint64_t number = 0;
+
+        // For numeric flags: parse what follows the '=' into number, false if it isn't one
+        auto numeric = [&](uint64_t max = std::numeric_limits<uint64_t>::max()) {
+            return parse_number(arg.substr(arg.find('=') + 1), number) && number <= max;
+        };
+
         if (arg.rfind("--iso=", 0) == 0) {
             iso_path = arg.substr(6);
         } else if (arg == "--iso" && i + 1 < argc) {
             // Next arg is the path (it has to be)
             iso_path = argv[++i];
+        } else if (arg.rfind("--dol=", 0) == 0) {
+            // Boot a DOL file directly instead of a disc
+            dol_path = arg.substr(6);
+        } else if (arg.rfind("--elf=", 0) == 0) {
+            // Same for a PowerPC ELF, as homebrew toolchains link them
+            elf_path = arg.substr(6);
+        } else if (arg.rfind("--compress=", 0) == 0) {
+            compress_path = arg.substr(11);
+        } else if (arg == "--no-mmap") {
+            storage = StorageMode::BUFFERED;
+        } else if (arg.rfind("--run=", 0) == 0) {
+            // Instruction budget to execute from the entry point
+            if (!numeric())
+                return invalid_value(arg);
+            run_budget = number;
+        } else if (arg.rfind("--frames=", 0) == 0) {
+            // Same as --run, in 1/60 s of guest time
+            if (!numeric(std::numeric_limits<uint64_t>::max() / freecube::timing::FRAME_CYCLES))
+                return invalid_value(arg);
+            run_budget = number * freecube::timing::FRAME_CYCLES;
+        } else if (arg.rfind("--cpu=", 0) == 0) {
+            // interpreter, jit, or verify (JIT checked against the interpreter)
+            cpu_mode = arg.substr(6);
+        } else if (arg == "--async-log") {
+            // Format and write log lines on a background thread
+            freecube::util::AsyncLog::start();
+        } else if (arg.rfind("--load-state=", 0) == 0) {
+            // Start --run from a save state instead of the entry point
+            load_state_path = arg.substr(13);
+        } else if (arg.rfind("--save-state=", 0) == 0) {
+            // Save the machine once --run is done
+            save_state_path = arg.substr(13);
+        } else if (arg.rfind("--rewind=", 0) == 0) {
+            // Keep recent states to step back through, in at most this many MiB
+            if (!numeric(std::numeric_limits<uint64_t>::max() >> 20))
+                return invalid_value(arg);
+            rewind_budget_mib = number;
+        } else if (arg.rfind("--rewind-interval=", 0) == 0) {
+            // Frames between rewind captures
+            if (!numeric())
+                return invalid_value(arg);
+            rewind_interval = std::max<uint64_t>(1, number);
+        } else if (arg.rfind("--rewind-back=", 0) == 0) {
+            // Once --run is done, step back this many rewind captures
+            if (!numeric())
+                return invalid_value(arg);
+            rewind_back = number;
+        } else if (arg.rfind("--batch=", 0) == 0) {
+            // Headless: run every image in a directory or manifest, no --iso
+            batch_path = arg.substr(8);
+        } else if (arg.rfind("--batch-out=", 0) == 0) {
+            batch_out = arg.substr(12);
+        } else if (arg.rfind("--jobs=", 0) == 0) {
+            // Batch, --verify or --library threads, one per hardware thread by default
+            if (!numeric(std::numeric_limits<unsigned>::max()))
+                return invalid_value(arg);
+            batch_jobs = static_cast<unsigned>(number);
+        } else if (arg == "--verify" || arg.rfind("--verify=", 0) == 0) {
+            // Hash the image instead of booting it, checking against any comma-separated digests given
+            verify = true;
+            for (size_t pos = 8; pos < arg.size(); ) {
+                const size_t end = std::min(arg.find(',', pos + 1), arg.size());
+                if (end > pos + 1)
+                    verify_expected.push_back(arg.substr(pos + 1, end - pos - 1));
+                pos = end;
+            }
+        } else if (arg.rfind("--library=", 0) == 0) {
+            // List the games under these comma-separated directories, no --iso
+            for (size_t pos = 9; pos < arg.size(); ) {
+                const size_t end = std::min(arg.find(',', pos + 1), arg.size());
+                if (end > pos + 1)
+                    library_roots.push_back(arg.substr(pos + 1, end - pos - 1));
+                pos = end;
+            }
+        } else if (arg.rfind("--library-cache=", 0) == 0) {
+            library_cache = arg.substr(16);
+        } else if (arg.rfind("--profile=", 0) == 0) {
+            // Chrome trace of everything up to exit
+            profile_path = arg.substr(10);
+        }
+    }
+
+    freecube::util::ProfileCapture profile(profile_path);
+
+    if (!batch_path.empty()) {
+        freecube::batch::Options options;
+        options.budget = run_budget;
+        options.engine = cpu_mode == "interpreter" ? freecube::cpu::EngineKind::INTERPRETER : freecube::cpu::EngineKind::JIT;
+        options.storage = storage;
+        options.workers = batch_jobs;
+
+        try {
+            const auto images = freecube::batch::collect_images(batch_path);
+            LOG_INFO("Batch: ", images.size(), " images, ", run_budget, " instructions each");
+
+            const auto start = std::chrono::steady_clock::now();
+            const auto results = freecube::batch::run(images, options);
+            const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            std::ofstream out(batch_out, std::ios::trunc);
+            freecube::batch::write_json(out, results, options, wall);
+            if (!out)
+                throw std::runtime_error("failed to write " + batch_out);
+
+            const auto booted = std::count_if(results.begin(), results.end(), [](const auto &r) { return r.ok; });
+            LOG_INFO("Batch: ", booted, " of ", results.size(), " images booted, results in ", batch_out);
+            return booted == static_cast<std::ptrdiff_t>(results.size()) ? 0 : 1;
+        } catch (const std::exception &e) {
+            LOG_ERROR("Batch failed: ", e.what());
+            return -1;
         }
     }
 
-    if (iso_path.empty()) {
-        LOG_CRITICAL("No ISO file specified!");
-        LOG_INFO("Use: freecube --iso=\"path/to/data.iso\"");
+    if (!library_roots.empty()) {
+        try {
+            const auto start = std::chrono::steady_clock::now();
+            freecube::library::LibraryCache cache(library_cache);
+            freecube::library::ScanStats stats;
+            const auto games = freecube::library::scan(library_roots, cache, batch_jobs, &stats);
+            cache.save();
+            const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            for (const auto &game : games) {
+                if (game.ok) {
+                    LOG_INFO(game.game_id, "  ", game.title, "  ", game.path);
+                } else {
+                    LOG_WARN("Not a GameCube image: ", game.path, " (", game.error, ")");
+                }
+            }
+
+            char summary[128];
+            snprintf(summary, sizeof(summary), "%zu images (%zu cached, %zu read, %zu rejected) in %.1f ms",
+                     stats.images, stats.cached, stats.read, stats.failed, wall * 1000);
+            LOG_INFO("Library: ", summary);
+            return 0;
+        } catch (const std::exception &e) {
+            LOG_ERROR("Library scan failed: ", e.what());
+            return -1;
+        }
+    }
+
+    if (iso_path.empty() && dol_path.empty() && elf_path.empty()) {
+        LOG_CRITICAL("No ISO, DOL or ELF file specified!");
+        LOG_INFO("Use: freecube --iso=\"path/to/data.iso\" (or --dol=, --elf=)");
         return -1;
     }
 
-    ISOImage iso(iso_path);
+    const auto boot_start = std::chrono::steady_clock::now();
+
+    // What gets booted: the disc's DOL, or an executable mapped straight from its file
+    std::unique_ptr<ISOImage> iso;
+    freecube::util::MappedFile exe_file;
+    std::vector<uint8_t> dol_copy;
+    freecube::util::ByteSpan dol_data;
+
+    if (!iso_path.empty()) {
+        // Conversion only, nothing gets booted
+        if (!compress_path.empty()) {
+            try {
+                auto stats = convert_to_fcb(iso_path, compress_path);
+                LOG_INFO("Wrote ", compress_path, " (", stats.output_bytes, " of ", stats.input_bytes, " bytes)");
+            } catch (const std::exception& e) {
+                LOG_ERROR("Failed to convert image: ", e.what());
+                return -1;
+            }
+            return 0;
+        }
+
+        iso = std::make_unique<ISOImage>(iso_path, storage);
 
-    // Basic DOL header info 
-    const auto dol_data = iso.get_dol();
-    LOG_INFO("DOL Size: ", dol_data.size());
+        // Verification only, nothing gets booted
+        if (verify) {
+            try {
+                const auto start = std::chrono::steady_clock::now();
+                const DiscDigests digests = hash_image(*iso, batch_jobs);
+                const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
-    std::string hex_dump;
-    for (size_t i = 0; i < min(size_t(32), dol_data.size()); i++) {
-        char buf[4];
-        snprintf(buf, sizeof(buf), "%02X ", dol_data[i]);
-        hex_dump += buf;
+                char crc[9];
+                snprintf(crc, sizeof(crc), "%08x", digests.crc32);
+                LOG_INFO("CRC-32: ", crc);
+                LOG_INFO("MD5:    ", freecube::util::to_hex(digests.md5));
+                LOG_INFO("SHA-1:  ", freecube::util::to_hex(digests.sha1));
+                char rate[64];
+                snprintf(rate, sizeof(rate), "%.1f MiB in %.3f s", iso->size() / 1048576.0, wall);
+                LOG_INFO("Hashed ", rate);
+
+                bool all_match = true;
+                for (const std::string &expected : verify_expected) {
+                    const bool match = digest_matches(digests, expected);
+                    if (match) {
+                        LOG_INFO("Digest ", expected, " matches");
+                    } else {
+                        LOG_ERROR("Digest ", expected, " does not match");
+                    }
+                    all_match &= match;
+                }
+                return all_match ? 0 : 1;
+            } catch (const std::exception& e) {
+                LOG_ERROR("Failed to verify image: ", e.what());
+                return -1;
+            }
+        }
+
+        // Mapped images hand the DOL out in place, compressed ones need a copy
+        dol_data = iso->dol_span();
+        if (dol_data.empty()) {
+            dol_copy = iso->get_dol();
+            dol_data = dol_copy;
+        }
+    } else {
+        const std::string &exe_path = dol_path.empty() ? elf_path : dol_path;
+        try {
+            exe_file = freecube::util::MappedFile(exe_path);
+        } catch (const std::exception& e) {
+            LOG_ERROR("Failed to open executable: ", e.what());
+            return -1;
+        }
+        dol_data = exe_file.bytes();
     }
-    LOG_INFO("DOL Header (32bytes): ", hex_dump);
 
-    // Begin parsing actual header data
     try {
-        DOLLoader dol(dol_data);
-        const auto& image = dol.image();
-        
-        LOG_INFO("DOL parsed successfully!");
+        freecube::memory::Memory memory;
+        uint32_t entry_point = 0;
+
+        if (!elf_path.empty()) {
+            ELFLoader elf(exe_file.bytes());
+            elf.load_into(memory);
+            entry_point = elf.image().entry_point;
+            LOG_INFO("ELF placed in guest RAM, ", elf.image().segments.size(), " segments.");
+
+            char ep_buf[32];
+            snprintf(ep_buf, sizeof(ep_buf), "0x%08X", entry_point);
+            LOG_INFO("Entry point: ", ep_buf);
+        } else {
+            // Basic DOL header info 
+            LOG_INFO("DOL Size: ", dol_data.size());
+
+            std::string hex_dump;
+            for (size_t i = 0; i < std::min(size_t(32), dol_data.size()); i++) {
+                char buf[4];
+                snprintf(buf, sizeof(buf), "%02X ", dol_data[i]);
+                hex_dump += buf;
+            }
+            LOG_INFO("DOL Header (32bytes): ", hex_dump);
+
+            // Begin parsing actual header data. A raw DOL has nothing vouching for it, so its
+            // header is checked before anything is placed; the loader reuses the parse
+            std::optional<DOLLoader> dol;
+            if (!dol_path.empty()) {
+                DolHeader header;
+                if (!readDolHeader(dol_data, header))
+                    throw std::runtime_error("DOL header is truncated");
+                const DolValidationResult check = validateDol(header, dol_data.size());
+                if (check.status != DolStatus::OK)
+                    throw std::runtime_error(check.message);
+                dol.emplace(dol_data, header);
+            } else {
+                dol.emplace(dol_data);
+            }
+            const auto& image = dol->image();
+
+            LOG_INFO("DOL parsed successfully!");
+
+            dol->load_into(memory);
+            entry_point = image.entry_point;
+            LOG_INFO("DOL placed in guest RAM.");
+
+            char ep_buf[32];
+            snprintf(ep_buf, sizeof(ep_buf), "0x%08X", image.entry_point);
+            LOG_INFO("Entry point: ", ep_buf);
         
-        char ep_buf[32];
-        snprintf(ep_buf, sizeof(ep_buf), "0x%08X", image.entry_point);
-        LOG_INFO("Entry point: ", ep_buf);
+            char bss_buf[128];
+            snprintf(bss_buf, sizeof(bss_buf), "0x%08X - 0x%08X (size: 0x%X)", 
+                     image.bss_address, 
+                     image.bss_address + image.bss_size,
+                     image.bss_size);
+            LOG_INFO("BSS: ", bss_buf);
         
-        char bss_buf[128];
-        snprintf(bss_buf, sizeof(bss_buf), "0x%08X - 0x%08X (size: 0x%X)", 
-                 image.bss_address, 
-                 image.bss_address + image.bss_size,
-                 image.bss_size);
-        LOG_INFO("BSS: ", bss_buf);
+            // Log text sections
+            for (size_t i = 0; i < image.text.size(); i++) {
+                if (image.text[i].size > 0) {
+                    char text_buf[64];
+                    snprintf(text_buf, sizeof(text_buf), "Text[%zu]: 0x%08X (size: 0x%X)", 
+                             i, image.text[i].load_address, image.text[i].size);
+                    LOG_DEBUG(text_buf);
+                }
+            }
         
-        // Log text sections
-        for (size_t i = 0; i < image.text.size(); i++) {
-            if (image.text[i].size > 0) {
-                char text_buf[64];
-                snprintf(text_buf, sizeof(text_buf), "Text[%zu]: 0x%08X (size: 0x%X)", 
-                         i, image.text[i].load_address, image.text[i].size);
-                LOG_DEBUG(text_buf);
+            // Log data sections
+            for (size_t i = 0; i < image.data.size(); i++) {
+                if (image.data[i].size > 0) {
+                    char data_buf[64];
+                    snprintf(data_buf, sizeof(data_buf), "Data[%zu]: 0x%08X (size: 0x%X)", 
+                             i, image.data[i].load_address, image.data[i].size);
+                    LOG_DEBUG(data_buf);
+                }
             }
         }
-        
-        // Log data sections
-        for (size_t i = 0; i < image.data.size(); i++) {
-            if (image.data[i].size > 0) {
-                char data_buf[64];
-                snprintf(data_buf, sizeof(data_buf), "Data[%zu]: 0x%08X (size: 0x%X)", 
-                         i, image.data[i].load_address, image.data[i].size);
-                LOG_DEBUG(data_buf);
+
+        char boot_buf[32];
+        snprintf(boot_buf, sizeof(boot_buf), "%.0f us", std::chrono::duration<double, std::micro>(
+                 std::chrono::steady_clock::now() - boot_start).count());
+        LOG_INFO("Ready to run after ", boot_buf);
+
+        if (run_budget) {
+            freecube::cpu::CPUState cpu;
+            cpu.reset();
+
+            cpu.pc = entry_point;
+            cpu.gpr[1] = 0x816FFFF0;    // Stack at the top of MEM1, where the IPL leaves it
+
+            if (cpu_mode == "verify") {
+#if FREECUBE_JIT
+                auto report = freecube::cpu::run_lockstep(cpu, memory, run_budget);
+                if (report.diverged) {
+                    LOG_ERROR("JIT diverged from the interpreter in block @ ", report.pc, ": ", report.detail);
+                    // The block as the guest sees it now
+                    uint32_t pc = report.pc;
+                    for (int i = 0; i < 256 && freecube::memory::Memory::ram_offset(pc) >= 0; i++, pc += 4) {
+                        const uint32_t raw = memory.read<uint32_t>(pc);
+                        LOG_ERROR("  ", pc, ": ", freecube::cpu::isa::disassemble(raw, pc));
+                        if (freecube::cpu::isa::spec(freecube::cpu::isa::lookup(raw)).flags & freecube::cpu::INST_ENDS_BLOCK)
+                            break;
+                    }
+                    return -1;
+                }
+                LOG_INFO("JIT matched the interpreter over ", report.instructions, " instructions (", report.blocks, " blocks)");
+#else
+                LOG_ERROR("No JIT for this host, nothing to verify");
+                return -1;
+#endif
+            } else {
+                auto kind = cpu_mode == "interpreter" ? freecube::cpu::EngineKind::INTERPRETER : freecube::cpu::EngineKind::JIT;
+                auto engine = freecube::cpu::make_engine(kind, memory);
+                engine->attach(cpu);
+
+                freecube::timing::Scheduler scheduler;
+
+                freecube::state::StateManager states(memory);
+                states.add_section("cpu", 1,
+                    [&](freecube::state::StateWriter &w) { freecube::state::save_cpu(w, cpu); },
+                    [&](freecube::state::StateReader &r, uint32_t) { freecube::state::load_cpu(r, cpu); });
+                states.add_section("scheduler", 1,
+                    [&](freecube::state::StateWriter &w) { scheduler.save_state(w); },
+                    [&](freecube::state::StateReader &r, uint32_t) { scheduler.load_state(r); });
+
+                if (!load_state_path.empty()) {
+                    states.restore(*states.read(load_state_path));
+                    LOG_INFO("Loaded state from ", load_state_path, ", resuming @ ", cpu.pc);
+                }
+
+                std::unique_ptr<freecube::state::RewindBuffer> rewind;
+                if (rewind_budget_mib) {
+                    rewind = std::make_unique<freecube::state::RewindBuffer>(states, rewind_budget_mib << 20);
+                    rewind->capture();
+                }
+
+                // With rewind on, stop every interval to capture
+                const uint64_t chunk = rewind ? rewind_interval * freecube::timing::FRAME_CYCLES : run_budget;
+                uint64_t executed = 0;
+                while (executed < run_budget) {
+                    const uint64_t want = std::min(chunk, run_budget - executed);
+                    const uint64_t ran = freecube::cpu::run_scheduled(*engine, cpu, scheduler, want);
+                    executed += ran;
+                    if (rewind)
+                        rewind->capture();
+                    if (ran < want)
+                        break;
+                }
+                LOG_INFO("Executed ", executed, " instructions, stopped @ ", cpu.pc);
+
+                if (rewind) {
+                    LOG_INFO("Rewind holds ", rewind->depth(), " captures in ", rewind->bytes() >> 10, " KiB");
+                    if (rewind_back) {
+                        const size_t stepped = rewind->rewind(rewind_back);
+                        LOG_INFO("Stepped back ", stepped, " captures, now @ ", cpu.pc);
+                    }
+                }
+
+                if (!save_state_path.empty()) {
+                    states.write(*states.capture(), save_state_path);
+                    LOG_INFO("Saved state to ", save_state_path);
+                }
             }
         }
         
     } catch (const std::exception& e) {
-        LOG_ERROR("Failed to parse DOL: ", e.what());
+        LOG_ERROR("Failed to boot: ", e.what());
         return -1;
     }
 
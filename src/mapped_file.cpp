@@ -0,0 +1,153 @@
+#if defined(_WIN32) || defined(_WIN64)
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <Windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#include "util/mapped_file.hpp"
+#include "util/log.hpp"
+#include <stdexcept>
+#include <utility>
+
+namespace freecube::util {
+
+#if defined(_WIN32) || defined(_WIN64)
+
+    MappedFile::MappedFile(const std::string &path) {
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            throw std::runtime_error("MappedFile: failed to open file: " + path);
+
+        LARGE_INTEGER sz;
+        if (!GetFileSizeEx(file, &sz) || sz.QuadPart <= 0) {
+            CloseHandle(file);
+            throw std::runtime_error("MappedFile: File is empty: " + path);
+        }
+
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) {
+            CloseHandle(file);
+            throw std::runtime_error("MappedFile: failed to map file: " + path);
+        }
+
+        void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!view) {
+            CloseHandle(mapping);
+            CloseHandle(file);
+            throw std::runtime_error("MappedFile: failed to map file: " + path);
+        }
+
+        m_file = file;
+        m_mapping = mapping;
+        m_data = static_cast<const std::uint8_t *>(view);
+        m_size = static_cast<std::size_t>(sz.QuadPart);
+    }
+
+    void MappedFile::prefetch(std::size_t offset, std::size_t len) const noexcept {
+        if (!m_data || offset >= m_size)
+            return;
+        if (len > m_size - offset)
+            len = m_size - offset;
+
+        WIN32_MEMORY_RANGE_ENTRY range;
+        range.VirtualAddress = const_cast<std::uint8_t *>(m_data + offset);
+        range.NumberOfBytes = len;
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    }
+
+    void MappedFile::close() noexcept {
+        if (m_data)
+            UnmapViewOfFile(m_data);
+        if (m_mapping)
+            CloseHandle(static_cast<HANDLE>(m_mapping));
+        if (m_file)
+            CloseHandle(static_cast<HANDLE>(m_file));
+
+        m_data = nullptr;
+        m_size = 0;
+        m_mapping = nullptr;
+        m_file = nullptr;
+    }
+
+#else
+
+    MappedFile::MappedFile(const std::string &path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("MappedFile: failed to open file: " + path);
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+            ::close(fd);
+            throw std::runtime_error("MappedFile: File is empty: " + path);
+        }
+
+        // MAP_SHARED so other instances mapping the same image share page cache
+        void *view = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+
+        // The mapping keeps its own reference to the file
+        ::close(fd);
+
+        if (view == MAP_FAILED)
+            throw std::runtime_error("MappedFile: failed to map file: " + path);
+
+        m_data = static_cast<const std::uint8_t *>(view);
+        m_size = static_cast<std::size_t>(st.st_size);
+
+        LOG_TRACE("Mapped ", path, " (", m_size, " bytes)");
+    }
+
+    void MappedFile::prefetch(std::size_t offset, std::size_t len) const noexcept {
+        if (!m_data || offset >= m_size)
+            return;
+        if (len > m_size - offset)
+            len = m_size - offset;
+
+        // madvise wants a page-aligned start
+        static const std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        std::size_t start = offset & ~(page - 1);
+        madvise(const_cast<std::uint8_t *>(m_data + start), len + (offset - start), MADV_WILLNEED);
+    }
+
+    void MappedFile::close() noexcept {
+        if (m_data)
+            munmap(const_cast<std::uint8_t *>(m_data), m_size);
+
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+#endif
+
+    MappedFile::~MappedFile() {
+        close();
+    }
+
+    MappedFile::MappedFile(MappedFile &&other) noexcept {
+        *this = std::move(other);
+    }
+
+    MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+        if (this != &other) {
+            close();
+            std::swap(m_data, other.m_data);
+            std::swap(m_size, other.m_size);
+#if defined(_WIN32) || defined(_WIN64)
+            std::swap(m_file, other.m_file);
+            std::swap(m_mapping, other.m_mapping);
+#endif
+        }
+        return *this;
+    }
+
+} // namespace freecube::util
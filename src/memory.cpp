@@ -0,0 +1,310 @@
+#if defined(_WIN32) || defined(_WIN64)
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <Windows.h>
+#else
+    #include <fcntl.h>
+    #include <signal.h>
+    #include <sys/mman.h>
+    #include <unistd.h>
+    #if defined(__linux__)
+        #include <sys/syscall.h>
+    #endif
+#endif
+
+#include "memory/memory.hpp"
+#include "util/log.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+namespace freecube::memory {
+
+#if FREECUBE_FASTMEM
+
+    // Every live arena, so the handler can tell our faults from real crashes.
+    // Plain atomics because the handler can't take locks.
+    static constexpr std::size_t MAX_ARENAS = 256;
+    static std::array<std::atomic<std::uintptr_t>, MAX_ARENAS> s_arenas{};
+
+    static thread_local FaultGuard *t_guard = nullptr;
+
+    static struct sigaction s_prev_segv;
+    static struct sigaction s_prev_bus;
+    static std::once_flag s_handler_once;
+
+    struct FaultHandler {
+        static void on_fault(int sig, siginfo_t *info, void *ctx) {
+            auto addr = reinterpret_cast<std::uintptr_t>(info->si_addr);
+
+            for (auto &slot : s_arenas) {
+                std::uintptr_t base = slot.load(std::memory_order_acquire);
+                if (base == 0 || addr < base || addr >= base + GUEST_SPACE)
+                    continue;
+
+                if (FaultGuard *g = t_guard) {
+                    g->m_fault_address = static_cast<std::uint32_t>(addr - base);
+                    siglongjmp(g->env, 1);
+                }
+                break;
+            }
+
+            // Not a guest access we can recover from, hand it to whoever was there before us
+            struct sigaction &prev = sig == SIGBUS ? s_prev_bus : s_prev_segv;
+            if (prev.sa_flags & SA_SIGINFO) {
+                prev.sa_sigaction(sig, info, ctx);
+            } else if (prev.sa_handler == SIG_DFL || prev.sa_handler == SIG_IGN) {
+                // Returning re-runs the faulting access, which now gets the default action
+                signal(sig, SIG_DFL);
+            } else {
+                prev.sa_handler(sig);
+            }
+        }
+
+        static void install() {
+            struct sigaction sa;
+            std::memset(&sa, 0, sizeof(sa));
+            sa.sa_sigaction = on_fault;
+            // NODEFER: we leave the handler by siglongjmp, SIGSEGV mustn't stay blocked
+            sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+            sigemptyset(&sa.sa_mask);
+
+            sigaction(SIGSEGV, &sa, &s_prev_segv);
+            sigaction(SIGBUS, &sa, &s_prev_bus);
+        }
+    };
+
+    FaultGuard::FaultGuard() noexcept : m_prev(t_guard) {
+        t_guard = this;
+    }
+
+    FaultGuard::~FaultGuard() {
+        t_guard = m_prev;
+    }
+
+    static int create_backing(std::size_t size) {
+    #if defined(__linux__)
+        int fd = static_cast<int>(syscall(SYS_memfd_create, "freecube-mem", 0));
+    #else
+        // No memfd, use a POSIX shm object and unlink it straight away
+        std::string name = "/freecube-mem-" + std::to_string(getpid()) + "-" +
+                           std::to_string(reinterpret_cast<std::uintptr_t>(&size));
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd >= 0)
+            shm_unlink(name.c_str());
+    #endif
+        if (fd < 0)
+            return -1;
+
+        if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    Memory::Memory() {
+        std::call_once(s_handler_once, FaultHandler::install);
+
+        m_shm_fd = create_backing(static_cast<std::size_t>(MEM1_SIZE) + ARAM_SIZE);
+        if (m_shm_fd < 0) {
+            LOG_CRITICAL("Failed to create guest memory backing!");
+            throw std::runtime_error("Memory: failed to create shared memory backing");
+        }
+
+        // Guest space, then ARAM right after it
+        m_reserved = static_cast<std::size_t>(GUEST_SPACE) + ARAM_SIZE;
+        void *res = mmap(nullptr, m_reserved, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (res == MAP_FAILED) {
+            ::close(m_shm_fd);
+            LOG_CRITICAL("Failed to reserve the guest address space!");
+            throw std::runtime_error("Memory: failed to reserve address space");
+        }
+        m_base = static_cast<std::uint8_t *>(res);
+
+        auto map_view = [&](std::uint64_t guest, std::size_t size, off_t backing_off) {
+            void *p = mmap(m_base + guest, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+                           m_shm_fd, backing_off);
+            if (p == MAP_FAILED) {
+                munmap(m_base, m_reserved);
+                ::close(m_shm_fd);
+                LOG_CRITICAL("Failed to map a guest memory view!");
+                throw std::runtime_error("Memory: failed to map guest view");
+            }
+        };
+
+        map_view(0, MEM1_SIZE, 0);
+        map_view(CACHED_BASE, MEM1_SIZE, 0);
+        map_view(UNCACHED_BASE, MEM1_SIZE, 0);
+        map_view(GUEST_SPACE, ARAM_SIZE, MEM1_SIZE);
+
+        m_ram = m_base;
+        m_aram = m_base + GUEST_SPACE;
+
+        bool registered = false;
+        for (auto &slot : s_arenas) {
+            std::uintptr_t expected = 0;
+            if (slot.compare_exchange_strong(expected, reinterpret_cast<std::uintptr_t>(m_base))) {
+                registered = true;
+                break;
+            }
+        }
+
+        if (!registered)
+            LOG_WARN("Too many guest memory arenas, faults in this one won't be recovered");
+
+        LOG_TRACE("Fastmem arena at ", static_cast<const void *>(m_base));
+    }
+
+    Memory::~Memory() {
+        for (auto &slot : s_arenas) {
+            std::uintptr_t expected = reinterpret_cast<std::uintptr_t>(m_base);
+            if (slot.compare_exchange_strong(expected, 0))
+                break;
+        }
+
+        munmap(m_base, m_reserved);
+        ::close(m_shm_fd);
+    }
+
+#else
+
+    // No mirroring on Windows yet: one allocation, every access takes the checked path
+    Memory::Memory() {
+        m_reserved = static_cast<std::size_t>(MEM1_SIZE) + ARAM_SIZE;
+        void *p = VirtualAlloc(nullptr, m_reserved, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        if (!p) {
+            LOG_CRITICAL("Failed to allocate guest memory!");
+            throw std::runtime_error("Memory: failed to allocate guest memory");
+        }
+
+        m_ram = static_cast<std::uint8_t *>(p);
+        m_aram = m_ram + MEM1_SIZE;
+    }
+
+    Memory::~Memory() {
+        VirtualFree(m_ram, 0, MEM_RELEASE);
+    }
+
+#endif
+
+    void Memory::copy_to_guest(std::uint32_t address, const void *src, std::size_t size) {
+        if (size == 0)
+            return;
+
+        std::uint8_t *p = host_ptr(address, size);
+        if (!p)
+            throw std::out_of_range("Memory: copy outside guest RAM");
+        std::memcpy(p, src, size);
+        note_range(static_cast<std::uint32_t>(p - m_ram), static_cast<std::uint32_t>(size));
+    }
+
+    void Memory::fill(std::uint32_t address, std::uint8_t value, std::size_t size) {
+        if (size == 0)
+            return;
+
+        std::uint8_t *p = host_ptr(address, size);
+        if (!p)
+            throw std::out_of_range("Memory: fill outside guest RAM");
+        std::memset(p, value, size);
+        note_range(static_cast<std::uint32_t>(p - m_ram), static_cast<std::uint32_t>(size));
+    }
+
+    void Memory::map_mmio(std::uint32_t base, std::uint32_t size, MMIORead read, MMIOWrite write) {
+        m_mmio.push_back({ base, size, std::move(read), std::move(write) });
+    }
+
+    void Memory::clear() {
+        std::memset(m_ram, 0, MEM1_SIZE);
+        std::memset(m_aram, 0, ARAM_SIZE);
+        note_range(0, MEM1_SIZE);
+        note_aram_write(0, ARAM_SIZE);
+    }
+
+    void Memory::mark_code(std::uint32_t address, std::uint32_t size) {
+        std::int64_t off = ram_offset(address);
+        if (off < 0 || size == 0)
+            return;
+
+        std::uint64_t end = std::min<std::uint64_t>(static_cast<std::uint64_t>(off) + size, MEM1_SIZE);
+        for (std::uint64_t page = static_cast<std::uint64_t>(off) >> PAGE_SHIFT; page <= (end - 1) >> PAGE_SHIFT; ++page)
+            m_page_flags[page] |= PAGE_CODE;
+    }
+
+    void Memory::clear_code_pages() {
+        for (auto &f : m_page_flags)
+            f &= static_cast<std::uint8_t>(~PAGE_CODE);
+    }
+
+    void Memory::note_range(std::uint32_t offset, std::uint32_t size) {
+        bool code = false;
+        for (std::uint32_t page = offset >> PAGE_SHIFT; page <= (offset + size - 1) >> PAGE_SHIFT; ++page) {
+            code |= (m_page_flags[page] & PAGE_CODE) != 0;
+            m_page_flags[page] |= PAGE_DIRTY;
+        }
+        if (code)
+            code_written(offset, size);
+    }
+
+    void Memory::note_aram_write(std::uint32_t offset, std::uint32_t size) {
+        if (size == 0 || offset >= ARAM_SIZE)
+            return;
+        const std::uint32_t last = std::min<std::uint64_t>(static_cast<std::uint64_t>(offset) + size, ARAM_SIZE) - 1;
+        for (std::uint32_t page = offset >> PAGE_SHIFT; page <= last >> PAGE_SHIFT; ++page)
+            m_aram_dirty[page] = PAGE_DIRTY;
+    }
+
+    void Memory::take_dirty_pages(std::vector<std::uint32_t> &ram_pages, std::vector<std::uint32_t> &aram_pages,
+                                  std::uint8_t channel) {
+        ram_pages.clear();
+        aram_pages.clear();
+
+        for (std::uint32_t page = 0; page < MEM1_SIZE / PAGE_SIZE; page++) {
+            if (m_page_flags[page] & channel) {
+                m_page_flags[page] &= static_cast<std::uint8_t>(~channel);
+                ram_pages.push_back(page);
+            }
+        }
+        for (std::uint32_t page = 0; page < ARAM_SIZE / PAGE_SIZE; page++) {
+            if (m_aram_dirty[page] & channel) {
+                m_aram_dirty[page] &= static_cast<std::uint8_t>(~channel);
+                aram_pages.push_back(page);
+            }
+        }
+    }
+
+    void Memory::code_written(std::uint32_t offset, std::uint32_t size) {
+        if (m_code_write_hook)
+            m_code_write_hook(offset, size);
+    }
+
+    std::uint32_t Memory::mmio_read(std::uint32_t address, unsigned size) {
+        for (const auto &r : m_mmio) {
+            if (address - r.base < r.size && r.read)
+                return r.read(address, size);
+        }
+
+        LOG_WARN("Unmapped guest read @ ", address);
+        return 0;
+    }
+
+    void Memory::mmio_write(std::uint32_t address, std::uint32_t value, unsigned size) {
+        for (const auto &r : m_mmio) {
+            if (address - r.base < r.size && r.write) {
+                r.write(address, value, size);
+                return;
+            }
+        }
+
+        LOG_WARN("Unmapped guest write @ ", address);
+    }
+
+} // namespace freecube::memory
@@ -0,0 +1,186 @@
+#include "util/profile.hpp"
+#include "util/log.hpp"
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace freecube::util {
+
+    namespace {
+        // Only the owning thread appends; count and next are published for the writer
+        struct Chunk {
+            static constexpr std::size_t EVENTS = 4096;
+
+            ProfileEvent events[EVENTS];
+            std::atomic<std::size_t> count{0};
+            std::atomic<Chunk*> next{nullptr};
+        };
+
+        struct ThreadBuffer {
+            std::uint32_t tid;
+            std::atomic<const char*> name{nullptr};
+            Chunk head;
+            Chunk* tail = &head;                // Owner thread only
+
+            ~ThreadBuffer() {
+                Chunk* c = head.next.load(std::memory_order_relaxed);
+                while (c) {
+                    Chunk* next = c->next.load(std::memory_order_relaxed);
+                    delete c;
+                    c = next;
+                }
+            }
+
+            void push(const ProfileEvent& event) {
+                std::size_t n = tail->count.load(std::memory_order_relaxed);
+                if (n == Chunk::EVENTS) {
+                    Chunk* c = new Chunk;
+                    tail->next.store(c, std::memory_order_release);
+                    tail = c;
+                    n = 0;
+                }
+                tail->events[n] = event;
+                tail->count.store(n + 1, std::memory_order_release);
+            }
+        };
+
+        // Buffers outlive their threads so a capture can be written after workers exit
+        struct Registry {
+            std::mutex lock;
+            std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+            std::int64_t start_ns = 0;
+        };
+
+        Registry& registry() {
+            static Registry r;
+            return r;
+        }
+
+        ThreadBuffer& local_buffer() {
+            thread_local ThreadBuffer* buffer = nullptr;
+            if (!buffer) {
+                Registry& r = registry();
+                std::lock_guard<std::mutex> lock(r.lock);
+                r.buffers.push_back(std::make_unique<ThreadBuffer>());
+                buffer = r.buffers.back().get();
+                buffer->tid = static_cast<std::uint32_t>(r.buffers.size());
+            }
+            return *buffer;
+        }
+
+        void write_json_string(std::string& out, const char* s) {
+            out += '"';
+            for (; *s; s++) {
+                const char c = *s;
+                if (c == '"' || c == '\\') {
+                    out += '\\';
+                    out += c;
+                } else if (static_cast<unsigned char>(c) < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04X", c);
+                    out += buf;
+                } else {
+                    out += c;
+                }
+            }
+            out += '"';
+        }
+
+        // Chrome wants microseconds; keep the ns as the fraction
+        void write_us(std::string& out, std::int64_t ns) {
+            char buf[32];
+            std::snprintf(buf, sizeof(buf), "%lld.%03lld", static_cast<long long>(ns / 1000),
+                          static_cast<long long>(ns % 1000));
+            out += buf;
+        }
+    }
+
+    void Profiler::start() {
+        registry().start_ns = now_ns();
+        detail::profile_running.store(true, std::memory_order_relaxed);
+    }
+
+    void Profiler::record(const ProfileEvent& event) {
+        local_buffer().push(event);
+    }
+
+    void Profiler::set_thread_name(const char* name) {
+        local_buffer().name.store(name, std::memory_order_relaxed);
+    }
+
+    bool Profiler::write_chrome_trace(const std::string& path) {
+        detail::profile_running.store(false, std::memory_order_relaxed);
+
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.lock);
+
+        std::string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+        std::size_t events = 0;
+        const char* sep = "";
+        char buf[64];
+
+        for (const auto& buffer : r.buffers) {
+            if (const char* name = buffer->name.load(std::memory_order_relaxed)) {
+                std::snprintf(buf, sizeof(buf), "%s{\"ph\":\"M\",\"pid\":1,\"tid\":%u,", sep, buffer->tid);
+                out += buf;
+                out += "\"name\":\"thread_name\",\"args\":{\"name\":";
+                write_json_string(out, name);
+                out += "}}";
+                sep = ",\n";
+            }
+
+            for (const Chunk* c = &buffer->head; c; c = c->next.load(std::memory_order_acquire)) {
+                const std::size_t count = c->count.load(std::memory_order_acquire);
+                for (std::size_t i = 0; i < count; i++) {
+                    const ProfileEvent& e = c->events[i];
+                    out += sep;
+                    out += "{\"name\":";
+                    write_json_string(out, e.name);
+                    std::snprintf(buf, sizeof(buf), ",\"pid\":1,\"tid\":%u,\"ts\":", buffer->tid);
+                    out += buf;
+                    write_us(out, e.start_ns - r.start_ns);
+
+                    if (e.kind == ProfileEvent::ZONE) {
+                        out += ",\"ph\":\"X\",\"dur\":";
+                        write_us(out, e.value);
+                        out += '}';
+                    } else {
+                        std::snprintf(buf, sizeof(buf), ",\"ph\":\"C\",\"args\":{\"value\":%lld}}",
+                                      static_cast<long long>(e.value));
+                        out += buf;
+                    }
+                    sep = ",\n";
+                    events++;
+                }
+            }
+        }
+        out += "\n]}\n";
+
+        std::ofstream f(path, std::ios::binary | std::ios::trunc);
+        if (!f || !f.write(out.data(), static_cast<std::streamsize>(out.size()))) {
+            LOG_ERROR("Failed to write profile to ", path);
+            return false;
+        }
+
+        LOG_INFO("Wrote ", events, " profile events to ", path);
+        return true;
+    }
+
+    ProfileCapture::ProfileCapture(std::string path) : m_path(std::move(path)) {
+        if (m_path.empty())
+            return;
+
+#if !FREECUBE_PROFILE
+        LOG_WARN("Built with FREECUBE_PROFILER=OFF, the profile will be empty");
+#endif
+        Profiler::set_thread_name("main");
+        Profiler::start();
+    }
+
+    ProfileCapture::~ProfileCapture() {
+        if (!m_path.empty())
+            Profiler::write_chrome_trace(m_path);
+    }
+}
@@ -0,0 +1,202 @@
+#include "state/rewind.hpp"
+#include "util/log.hpp"
+#include "util/lz.hpp"
+#include "util/profile.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace freecube::state {
+
+    namespace {
+        constexpr std::size_t COMPRESS_BATCH = 64;     // Deltas per background job
+
+        bool all_zero(const std::uint8_t *p) {
+            static const std::uint8_t zero[memory::PAGE_SIZE] = {};
+            return std::memcmp(p, zero, memory::PAGE_SIZE) == 0;
+        }
+
+        void xor_into(std::uint8_t *dst, const std::uint8_t *src) {
+            for (std::size_t i = 0; i < memory::PAGE_SIZE; i += sizeof(std::uint64_t)) {
+                std::uint64_t a, b;
+                std::memcpy(&a, dst + i, sizeof(a));
+                std::memcpy(&b, src + i, sizeof(b));
+                a ^= b;
+                std::memcpy(dst + i, &a, sizeof(a));
+            }
+        }
+    }
+
+    RewindBuffer::RewindBuffer(StateManager &states, std::size_t budget, std::size_t threads)
+        : m_states(states), m_budget(budget) {
+        m_pool = std::make_unique<util::ThreadPool>(std::max<std::size_t>(1, threads));
+    }
+
+    RewindBuffer::~RewindBuffer() {
+        m_pool.reset();
+    }
+
+    std::uint8_t *RewindBuffer::live_page(std::uint32_t page) {
+        memory::Memory &mem = m_states.memory();
+        if (page < fcs::RAM_PAGES)
+            return mem.ram() + (static_cast<std::size_t>(page) << memory::PAGE_SHIFT);
+        return mem.aram() + (static_cast<std::size_t>(page - fcs::RAM_PAGES) << memory::PAGE_SHIFT);
+    }
+
+    void RewindBuffer::write_back(std::uint32_t page) {
+        memory::Memory &mem = m_states.memory();
+        const std::uint8_t *src = m_shadow.data() + (static_cast<std::size_t>(page) << memory::PAGE_SHIFT);
+
+        // Through Memory, so translated code is dropped and save states see the change
+        if (page < fcs::RAM_PAGES) {
+            mem.copy_to_guest(page << memory::PAGE_SHIFT, src, memory::PAGE_SIZE);
+        } else {
+            std::memcpy(live_page(page), src, memory::PAGE_SIZE);
+            mem.note_aram_write((page - fcs::RAM_PAGES) << memory::PAGE_SHIFT, memory::PAGE_SIZE);
+        }
+    }
+
+    std::size_t RewindBuffer::entry_bytes(const Entry &e) {
+        std::size_t n = 0;
+        for (const Section &s : e.sections)
+            n += s.data.size();
+        for (const Delta &d : e.deltas)
+            n += d.bytes.size();
+        return n;
+    }
+
+    void RewindBuffer::capture() {
+        PROFILE_ZONE("RewindBuffer::capture");
+
+        // The last capture's deltas are compressed by now, so trimming counts their real size
+        trim();
+
+        memory::Memory &mem = m_states.memory();
+        mem.take_dirty_pages(m_dirty_ram, m_dirty_aram, memory::Memory::PAGE_DIRTY_REWIND);
+
+        Entry entry;
+        entry.sections = m_states.save_sections();
+
+        if (m_shadow.empty()) {
+            // The oldest capture needs no delta, only something to XOR the next one against
+            m_shadow.resize(static_cast<std::size_t>(fcs::PAGES) << memory::PAGE_SHIFT);
+            std::memcpy(m_shadow.data(), mem.ram(), memory::MEM1_SIZE);
+            std::memcpy(m_shadow.data() + memory::MEM1_SIZE, mem.aram(), memory::ARAM_SIZE);
+        } else {
+            auto add = [&](std::uint32_t page) {
+                std::uint8_t *shadow = m_shadow.data() + (static_cast<std::size_t>(page) << memory::PAGE_SHIFT);
+                const std::uint8_t *live = live_page(page);
+
+                Delta d{ page, false, std::vector<std::uint8_t>(shadow, shadow + memory::PAGE_SIZE) };
+                xor_into(d.bytes.data(), live);
+                if (all_zero(d.bytes.data()))
+                    return;     // Stored the same bytes back
+                std::memcpy(shadow, live, memory::PAGE_SIZE);
+                entry.deltas.push_back(std::move(d));
+            };
+            for (std::uint32_t p : m_dirty_ram)
+                add(p);
+            for (std::uint32_t p : m_dirty_aram)
+                add(fcs::RAM_PAGES + p);
+        }
+
+        m_entries.push_back(std::move(entry));
+
+        // Nothing touches the deltas again before wait(), and the deque keeps them in place
+        std::vector<Delta> &deltas = m_entries.back().deltas;
+        for (std::size_t first = 0; first < deltas.size(); first += COMPRESS_BATCH) {
+            Delta *begin = deltas.data() + first;
+            Delta *end = deltas.data() + std::min(deltas.size(), first + COMPRESS_BATCH);
+            m_pool->post([begin, end] {
+                std::vector<std::uint8_t> packed;
+                for (Delta *d = begin; d != end; d++) {
+                    const std::size_t n = util::lz::compress(d->bytes.data(), memory::PAGE_SIZE, packed);
+                    if (n < memory::PAGE_SIZE) {
+                        d->bytes.assign(packed.begin(), packed.begin() + n);
+                        d->packed = true;
+                    }
+                }
+            });
+        }
+
+        LOG_TRACE("Rewind capture ", m_entries.size(), ": ", deltas.size(), " pages changed");
+    }
+
+    std::size_t RewindBuffer::bytes() {
+        wait();
+        std::size_t n = 0;
+        for (const Entry &e : m_entries)
+            n += entry_bytes(e);
+        return n;
+    }
+
+    void RewindBuffer::trim() {
+        std::size_t held = bytes();
+        while (held > m_budget && m_entries.size() > 1) {
+            held -= entry_bytes(m_entries.front());
+            m_entries.pop_front();
+
+            // There's nothing older left to step back to, so the new oldest needs no delta
+            Entry &front = m_entries.front();
+            held -= entry_bytes(front);
+            front.deltas = {};
+            held += entry_bytes(front);
+        }
+    }
+
+    std::size_t RewindBuffer::rewind(std::size_t steps) {
+        PROFILE_ZONE("RewindBuffer::rewind");
+
+        if (m_entries.empty())
+            throw std::runtime_error("rewind: nothing captured yet");
+        steps = std::min(steps, m_entries.size() - 1);
+
+        wait();
+
+        memory::Memory &mem = m_states.memory();
+        std::vector<std::uint8_t> touched(fcs::PAGES, 0);
+
+        // Back to the newest capture: whatever was written since comes from the shadow
+        mem.take_dirty_pages(m_dirty_ram, m_dirty_aram, memory::Memory::PAGE_DIRTY_REWIND);
+        for (std::uint32_t p : m_dirty_ram)
+            touched[p] = 1;
+        for (std::uint32_t p : m_dirty_aram)
+            touched[fcs::RAM_PAGES + p] = 1;
+
+        // Then undo one capture at a time, newest first
+        std::uint8_t buf[memory::PAGE_SIZE];
+        for (std::size_t i = 0; i < steps; i++) {
+            for (const Delta &d : m_entries.back().deltas) {
+                const std::uint8_t *x = d.bytes.data();
+                if (d.packed) {
+                    if (!util::lz::decompress(d.bytes.data(), d.bytes.size(), buf, sizeof(buf)))
+                        throw std::runtime_error("rewind: corrupt delta");
+                    x = buf;
+                }
+                xor_into(m_shadow.data() + (static_cast<std::size_t>(d.page) << memory::PAGE_SHIFT), x);
+                touched[d.page] = 1;
+            }
+            m_entries.pop_back();
+        }
+
+        std::uint32_t written = 0;
+        for (std::uint32_t p = 0; p < fcs::PAGES; p++) {
+            if (touched[p]) {
+                write_back(p);
+                written++;
+            }
+        }
+
+        // Memory matches the shadow again
+        mem.take_dirty_pages(m_dirty_ram, m_dirty_aram, memory::Memory::PAGE_DIRTY_REWIND);
+        m_states.load_sections(m_entries.back().sections);
+
+        LOG_DEBUG("Rewound ", steps, " captures: ", written, " pages written");
+        return steps;
+    }
+
+    void RewindBuffer::wait() {
+        m_pool->wait_idle();
+    }
+
+} // namespace freecube::state
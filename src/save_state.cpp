@@ -0,0 +1,450 @@
+#include "state/save_state.hpp"
+#include "cpu/core.hpp"
+#include "util/log.hpp"
+#include "util/lz.hpp"
+#include "util/profile.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+
+namespace freecube::state {
+
+    namespace {
+        constexpr std::size_t COMPRESS_BATCH = 64;     // Pages per background job
+
+        bool all_zero(const std::uint8_t *p) {
+            static const std::uint8_t zero[memory::PAGE_SIZE] = {};
+            return std::memcmp(p, zero, memory::PAGE_SIZE) == 0;
+        }
+
+        std::uint64_t rotl(std::uint64_t x, int r) {
+            return (x << r) | (x >> (64 - r));
+        }
+    }
+
+    std::uint64_t page_checksum(const std::uint8_t *page) {
+        // Two independent multiply-rotate lanes over 64-bit words, then a final avalanche
+        constexpr std::uint64_t K1 = 0x9E3779B185EBCA87ull;
+        constexpr std::uint64_t K2 = 0xC2B2AE3D27D4EB4Full;
+        std::uint64_t a = K1, b = K2;
+        for (std::size_t i = 0; i < memory::PAGE_SIZE; i += 16) {
+            std::uint64_t w0, w1;
+            std::memcpy(&w0, page + i, 8);
+            std::memcpy(&w1, page + i + 8, 8);
+            a = rotl(a ^ (w0 * K2), 31) * K1;
+            b = rotl(b ^ (w1 * K1), 29) * K2;
+        }
+
+        std::uint64_t h = a ^ rotl(b, 32);
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ull;
+        return h ^ (h >> 33);
+    }
+
+    void Page::decode(std::uint8_t *dst) const {
+        switch (kind) {
+        case fcs::PageKind::ZERO:
+            std::memset(dst, 0, memory::PAGE_SIZE);
+            return;
+        case fcs::PageKind::RAW:
+            if (size() != memory::PAGE_SIZE)
+                break;
+            std::memcpy(dst, data(), memory::PAGE_SIZE);
+            return;
+        case fcs::PageKind::LZ:
+            if (!util::lz::decompress(data(), size(), dst, memory::PAGE_SIZE))
+                break;
+            return;
+        }
+        throw std::runtime_error("save state: corrupt page");
+    }
+
+    std::uint64_t Snapshot::fresh_bytes() const {
+        for (const auto &job : m_compressing)
+            job.wait();
+
+        std::uint64_t n = 0;
+        for (std::uint32_t i : m_fresh) {
+            if (const PageRef &p = m_pages[i])
+                n += p->size();
+        }
+        return n;
+    }
+
+    StateManager::StateManager(memory::Memory &mem, std::size_t threads) : m_mem(mem) {
+        // Random start, so states from different runs never claim to be each other's base
+        std::random_device rd;
+        m_next_id = ((static_cast<std::uint64_t>(rd()) << 32) | rd()) | 1;
+
+        m_pool = std::make_unique<util::ThreadPool>(std::max<std::size_t>(1, threads));
+    }
+
+    StateManager::~StateManager() {
+        m_pool.reset();
+    }
+
+    void StateManager::add_section(std::string name, std::uint32_t version, SaveFn save, LoadFn load) {
+        m_sections.push_back({ std::move(name), version, std::move(save), std::move(load) });
+    }
+
+    std::vector<Section> StateManager::save_sections() const {
+        std::vector<Section> sections;
+        for (const Registered &s : m_sections) {
+            StateWriter w;
+            s.save(w);
+            sections.push_back({ s.name, s.version, w.take() });
+        }
+        return sections;
+    }
+
+    void StateManager::check_sections(const std::vector<Section> &sections) const {
+        for (const Section &s : sections) {
+            auto it = std::find_if(m_sections.begin(), m_sections.end(), [&](const Registered &r) { return r.name == s.name; });
+            if (it != m_sections.end() && s.version > it->version)
+                throw std::runtime_error("save state: section " + s.name + " is version " + std::to_string(s.version) +
+                                         ", newer than this build reads");
+        }
+    }
+
+    void StateManager::load_sections(const std::vector<Section> &sections) {
+        check_sections(sections);
+        for (const Section &s : sections) {
+            auto it = std::find_if(m_sections.begin(), m_sections.end(), [&](const Registered &r) { return r.name == s.name; });
+            if (it == m_sections.end()) {
+                LOG_WARN("Save state has a section nothing here reads: ", s.name);
+                continue;
+            }
+            StateReader r(s.data.data(), s.data.size());
+            it->load(r, s.version);
+        }
+    }
+
+    std::uint8_t *StateManager::page_memory(std::uint32_t page) {
+        if (page < fcs::RAM_PAGES)
+            return m_mem.ram() + (static_cast<std::size_t>(page) << memory::PAGE_SHIFT);
+        return m_mem.aram() + (static_cast<std::size_t>(page - fcs::RAM_PAGES) << memory::PAGE_SHIFT);
+    }
+
+    std::shared_ptr<const Snapshot> StateManager::capture() {
+        PROFILE_ZONE("StateManager::capture");
+
+        auto snap = std::make_shared<Snapshot>();
+        snap->m_id = m_next_id++;
+
+        m_mem.take_dirty_pages(m_dirty_ram, m_dirty_aram, memory::Memory::PAGE_DIRTY_STATE);
+
+        std::vector<std::uint32_t> pages;
+        if (m_current.empty()) {
+            m_current.assign(fcs::PAGES, nullptr);
+            pages.resize(fcs::PAGES);
+            for (std::uint32_t i = 0; i < fcs::PAGES; i++)
+                pages[i] = i;
+        } else {
+            pages = m_dirty_ram;
+            for (std::uint32_t p : m_dirty_aram)
+                pages.push_back(fcs::RAM_PAGES + p);
+        }
+
+        snap->m_pages = m_current;
+
+        // Copy now, checksum and compress in the background. StateManager reads these pages
+        // only after wait(), the snapshot's own fresh_bytes() after its jobs
+        std::vector<std::shared_ptr<Page>> batch;
+        auto flush = [&] {
+            snap->m_compressing.push_back(m_pool->submit([batch = std::move(batch)] {
+                std::vector<std::uint8_t> packed;
+                for (const auto &page : batch) {
+                    page->checksum = page_checksum(page->stored.data());
+                    const std::size_t n = util::lz::compress(page->stored.data(), memory::PAGE_SIZE, packed);
+                    if (n < memory::PAGE_SIZE) {
+                        page->stored = std::vector<std::uint8_t>(packed.begin(), packed.begin() + n);
+                        page->kind = fcs::PageKind::LZ;
+                    }
+                }
+            }).share());
+            batch.clear();
+        };
+
+        snap->m_fresh = pages;
+        for (std::uint32_t i : pages) {
+            const std::uint8_t *src = page_memory(i);
+            if (all_zero(src)) {
+                snap->m_pages[i] = nullptr;
+            } else {
+                auto page = std::make_shared<Page>();
+                page->kind = fcs::PageKind::RAW;
+                page->stored.assign(src, src + memory::PAGE_SIZE);
+                snap->m_pages[i] = page;
+                batch.push_back(std::move(page));
+                if (batch.size() == COMPRESS_BATCH)
+                    flush();
+            }
+        }
+        if (!batch.empty())
+            flush();
+
+        m_current = snap->m_pages;
+
+        snap->m_sections = save_sections();
+
+        LOG_DEBUG("Captured state ", snap->m_id, ": ", snap->fresh_pages(), " pages changed");
+        return snap;
+    }
+
+    bool StateManager::page_matches(std::uint32_t page, const PageRef &ref) {
+        const std::uint8_t *live = page_memory(page);
+        return ref ? page_checksum(live) == ref->checksum : all_zero(live);
+    }
+
+    void StateManager::write_page(std::uint32_t page, const PageRef &ref) {
+        std::uint8_t buf[memory::PAGE_SIZE];
+        if (ref)
+            ref->decode(buf);
+        else
+            std::memset(buf, 0, sizeof(buf));
+
+        if (page < fcs::RAM_PAGES) {
+            // Through copy_to_guest() so translated code on the page is dropped
+            m_mem.copy_to_guest(page << memory::PAGE_SHIFT, buf, sizeof(buf));
+        } else {
+            std::memcpy(page_memory(page), buf, sizeof(buf));
+        }
+    }
+
+    std::uint32_t StateManager::restore(const Snapshot &snapshot) {
+        PROFILE_ZONE("StateManager::restore");
+
+        check_sections(snapshot.sections());
+
+        wait();
+        m_mem.take_dirty_pages(m_dirty_ram, m_dirty_aram, memory::Memory::PAGE_DIRTY_STATE);
+
+        // Candidates are anything written since memory last matched m_current, and wherever
+        // the snapshot differs from it; every page before the first capture or restore
+        std::vector<std::uint8_t> stale(fcs::PAGES, m_current.empty() ? 1 : 0);
+        for (std::uint32_t p : m_dirty_ram)
+            stale[p] = 1;
+        for (std::uint32_t p : m_dirty_aram)
+            stale[fcs::RAM_PAGES + p] = 1;
+
+        // Of those, only the ones memory doesn't already hold are decoded and written
+        std::uint32_t checked = 0, written = 0;
+        for (std::uint32_t i = 0; i < fcs::PAGES; i++) {
+            const PageRef &ref = snapshot.m_pages[i];
+            if (!stale[i] && m_current[i] == ref)
+                continue;
+            checked++;
+            if (!page_matches(i, ref)) {
+                write_page(i, ref);
+                written++;
+            }
+        }
+
+        // What we just wrote is the snapshot, not a change since it
+        m_mem.take_dirty_pages(m_dirty_ram, m_dirty_aram, memory::Memory::PAGE_DIRTY_STATE);
+        m_current = snapshot.m_pages;
+
+        load_sections(snapshot.sections());
+
+        LOG_DEBUG("Restored state ", snapshot.id(), ": ", checked, " pages checked, ", written, " written");
+        return written;
+    }
+
+    void StateManager::write(const Snapshot &snapshot, const std::string &path, const Snapshot *base) {
+        PROFILE_ZONE("StateManager::write");
+        wait();
+
+        // Without a base, pages missing from the file are zero
+        std::vector<std::uint32_t> stored;
+        for (std::uint32_t i = 0; i < fcs::PAGES; i++) {
+            const PageRef &p = snapshot.m_pages[i];
+            if (base ? p != base->m_pages[i] : p != nullptr)
+                stored.push_back(i);
+        }
+
+        StateWriter w;
+        w.bytes(fcs::MAGIC, sizeof(fcs::MAGIC));
+        w.u32(fcs::VERSION);
+        w.u64(snapshot.id());
+        w.u64(base ? base->id() : 0);
+        w.u32(static_cast<std::uint32_t>(snapshot.sections().size()));
+        w.u32(static_cast<std::uint32_t>(stored.size()));
+
+        for (const Section &s : snapshot.sections()) {
+            w.string(s.name);
+            w.u32(s.version);
+            w.u64(s.data.size());
+            w.bytes(s.data.data(), s.data.size());
+        }
+
+        for (std::uint32_t i : stored) {
+            const PageRef &p = snapshot.m_pages[i];
+            w.u32(i);
+            w.u32(p ? p->size() : 0);
+            w.u32(static_cast<std::uint32_t>(p ? p->kind : fcs::PageKind::ZERO));
+            w.u64(p ? p->checksum : 0);
+        }
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out)
+            throw std::runtime_error("save state: failed to open output: " + path);
+
+        out.write(reinterpret_cast<const char *>(w.data().data()), static_cast<std::streamsize>(w.data().size()));
+        std::uint64_t total = w.data().size();
+        for (std::uint32_t i : stored) {
+            if (const PageRef &p = snapshot.m_pages[i]) {
+                out.write(reinterpret_cast<const char *>(p->data()), p->size());
+                total += p->size();
+            }
+        }
+
+        out.flush();
+        if (!out)
+            throw std::runtime_error("save state: failed writing: " + path);
+
+        LOG_DEBUG("Wrote state ", snapshot.id(), " to ", path, ": ", stored.size(), " pages, ", total, " bytes");
+    }
+
+    std::shared_ptr<const Snapshot> StateManager::read(const std::string &path, const Snapshot *base) {
+        PROFILE_ZONE("StateManager::read");
+
+        auto file = std::make_shared<util::MappedFile>(path);
+        StateReader r(file->data(), file->size());
+
+        std::uint8_t magic[4];
+        r.bytes(magic, sizeof(magic));
+        if (std::memcmp(magic, fcs::MAGIC, sizeof(magic)) != 0)
+            throw std::runtime_error("save state: bad magic: " + path);
+        if (r.u32() != fcs::VERSION)
+            throw std::runtime_error("save state: unsupported version: " + path);
+
+        auto snap = std::make_shared<Snapshot>();
+        snap->m_id = r.u64();
+        const std::uint64_t base_id = r.u64();
+        const std::uint32_t section_count = r.u32();
+        const std::uint32_t page_count = r.u32();
+
+        if (base_id) {
+            if (!base || base->id() != base_id)
+                throw std::runtime_error("save state: " + path + " only holds changes to state " +
+                                         std::to_string(base_id) + ", which wasn't given");
+            snap->m_pages = base->m_pages;
+        } else {
+            snap->m_pages.assign(fcs::PAGES, nullptr);
+        }
+
+        for (std::uint32_t i = 0; i < section_count; i++) {
+            Section s;
+            s.name = r.string();
+            s.version = r.u32();
+            const std::uint64_t size = r.u64();
+            if (size > r.remaining())
+                throw std::runtime_error("save state: section " + s.name + " is truncated: " + path);
+            s.data.resize(static_cast<std::size_t>(size));
+            r.bytes(s.data.data(), s.data.size());
+            snap->m_sections.push_back(std::move(s));
+        }
+
+        if (page_count > fcs::PAGES || static_cast<std::uint64_t>(page_count) * fcs::PAGE_ENTRY_SIZE > r.remaining())
+            throw std::runtime_error("save state: invalid page table: " + path);
+
+        std::uint64_t cursor = file->size() - r.remaining() + static_cast<std::uint64_t>(page_count) * fcs::PAGE_ENTRY_SIZE;
+        for (std::uint32_t i = 0; i < page_count; i++) {
+            const std::uint32_t index = r.u32();
+            const std::uint32_t size = r.u32();
+            const std::uint32_t kind = r.u32();
+            const std::uint64_t checksum = r.u64();
+
+            if (index >= fcs::PAGES || kind > static_cast<std::uint32_t>(fcs::PageKind::LZ) || size > memory::PAGE_SIZE ||
+                cursor + size > file->size())
+                throw std::runtime_error("save state: invalid page entry: " + path);
+
+            if (kind == static_cast<std::uint32_t>(fcs::PageKind::ZERO)) {
+                snap->m_pages[index] = nullptr;
+                snap->m_fresh.push_back(index);
+                continue;
+            }
+
+            auto page = std::make_shared<Page>();
+            page->kind = static_cast<fcs::PageKind>(kind);
+            page->mapped = file->data() + cursor;
+            page->mapped_size = size;
+            page->file = file;
+            page->checksum = checksum;
+            snap->m_pages[index] = std::move(page);
+            snap->m_fresh.push_back(index);
+            cursor += size;
+        }
+
+        LOG_DEBUG("Read state ", snap->m_id, " from ", path, ": ", page_count, " pages");
+        return snap;
+    }
+
+    void StateManager::wait() {
+        m_pool->wait_idle();
+    }
+
+    // ---- CPU ----
+
+    void save_cpu(StateWriter &w, const cpu::CPUState &cpu) {
+        w.u32(cpu.pc);
+        w.u32(cpu.lr);
+        w.u32(cpu.ctr);
+        w.u32(cpu.read_cr());
+        w.u32(cpu.read_xer());
+        w.u32(cpu.msr);
+        w.u32(cpu.fpscr);
+        w.boolean(cpu.reserve);
+        w.u32(cpu.reserve_address);
+        w.boolean(cpu.dec_pending);
+
+        for (uint32_t r : cpu.gpr)
+            w.u32(r);
+        for (const cpu::FPR &f : cpu.fpr) {
+            w.f64(f.ps0);
+            w.f64(f.ps1);
+        }
+        for (uint32_t r : cpu.sr)
+            w.u32(r);
+
+        // By SPR number; the read and write ports of a register both get written
+        for (uint32_t n = 0; n < 1024; n++) {
+            if (cpu::SprFile::implemented(n))
+                w.u32(cpu.spr[n]);
+        }
+    }
+
+    void load_cpu(StateReader &r, cpu::CPUState &cpu) {
+        cpu.pc = r.u32();
+        cpu.npc = cpu.pc;
+        cpu.lr = r.u32();
+        cpu.ctr = r.u32();
+        cpu.write_cr(r.u32());
+        cpu.write_xer(r.u32());
+        cpu.msr = r.u32();
+        cpu.fpscr = r.u32();
+        cpu.reserve = r.boolean();
+        cpu.reserve_address = r.u32();
+        cpu.dec_pending = r.boolean();
+        cpu.slow_access = false;
+
+        for (uint32_t &reg : cpu.gpr)
+            reg = r.u32();
+        for (cpu::FPR &f : cpu.fpr) {
+            f.ps0 = r.f64();
+            f.ps1 = r.f64();
+        }
+        for (uint32_t &reg : cpu.sr)
+            reg = r.u32();
+
+        for (uint32_t n = 0; n < 1024; n++) {
+            if (cpu::SprFile::implemented(n))
+                cpu.spr[n] = r.u32();
+        }
+    }
+
+} // namespace freecube::state
@@ -0,0 +1,213 @@
+#include "timing/scheduler.hpp"
+#include "state/serializer.hpp"
+#include "util/log.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace freecube::timing {
+
+    EventType Scheduler::register_event(std::string name, EventCallback callback) {
+        m_types.push_back({ std::move(name), std::move(callback) });
+        return static_cast<EventType>(m_types.size() - 1);
+    }
+
+    EventId Scheduler::schedule_at(EventType type, uint64_t cycle, uint64_t userdata) {
+        if (type >= m_types.size())
+            throw std::out_of_range("Scheduler: unregistered event type");
+
+        uint32_t slot;
+        if (!m_free.empty()) {
+            slot = m_free.back();
+            m_free.pop_back();
+        } else {
+            slot = static_cast<uint32_t>(m_slots.size());
+            m_slots.push_back({ 0, 0, 0, 0, 1, NOT_QUEUED });
+        }
+
+        Slot &s = m_slots[slot];
+        s.cycle = std::max(cycle, m_now);
+        s.order = m_order++;
+        s.userdata = userdata;
+        s.type = type;
+
+        m_heap.push_back(slot);
+        s.heap_index = static_cast<uint32_t>(m_heap.size() - 1);
+        sift_up(s.heap_index);
+
+        return (static_cast<uint64_t>(s.generation) << 32) | slot;
+    }
+
+    const Scheduler::Slot *Scheduler::find(EventId id) const {
+        const uint32_t slot = static_cast<uint32_t>(id);
+        if (slot >= m_slots.size())
+            return nullptr;
+        const Slot &s = m_slots[slot];
+        if (s.generation != static_cast<uint32_t>(id >> 32) || s.heap_index == NOT_QUEUED)
+            return nullptr;
+        return &s;
+    }
+
+    bool Scheduler::cancel(EventId id) {
+        if (!find(id))
+            return false;
+        remove(static_cast<uint32_t>(id));
+        return true;
+    }
+
+    void Scheduler::cancel_all(EventType type) {
+        for (uint32_t slot = 0; slot < m_slots.size(); slot++) {
+            if (m_slots[slot].heap_index != NOT_QUEUED && m_slots[slot].type == type)
+                remove(slot);
+        }
+    }
+
+    bool Scheduler::is_scheduled(EventId id) const {
+        return find(id) != nullptr;
+    }
+
+    uint64_t Scheduler::cycle_of(EventId id) const {
+        const Slot *s = find(id);
+        return s ? s->cycle : NO_EVENT;
+    }
+
+    void Scheduler::advance(uint64_t cycles) {
+        const uint64_t target = m_now + cycles;
+
+        while (!m_heap.empty() && m_slots[m_heap.front()].cycle <= target) {
+            const uint32_t slot = m_heap.front();
+            const Slot s = m_slots[slot];
+            remove(slot);
+
+            m_now = s.cycle;
+            const Type &type = m_types[s.type];
+            LOG_TRACE("Event ", type.name, " @ cycle ", s.cycle);
+            if (type.callback)
+                type.callback(s.userdata, static_cast<int64_t>(target - s.cycle));
+        }
+
+        m_now = target;
+    }
+
+    void Scheduler::save_state(state::StateWriter &w) const {
+        w.u64(m_now);
+        w.u64(m_order);
+
+        w.u32(static_cast<uint32_t>(m_slots.size()));
+        for (const Slot &s : m_slots) {
+            w.u32(s.generation);
+            w.boolean(s.heap_index != NOT_QUEUED);
+            if (s.heap_index == NOT_QUEUED)
+                continue;
+            w.string(m_types[s.type].name);
+            w.u64(s.cycle);
+            w.u64(s.order);
+            w.u64(s.userdata);
+        }
+
+        // The free list order decides which ids the next schedule() calls hand out
+        w.u32(static_cast<uint32_t>(m_free.size()));
+        for (uint32_t slot : m_free)
+            w.u32(slot);
+    }
+
+    void Scheduler::load_state(state::StateReader &r) {
+        const uint64_t now = r.u64();
+        const uint64_t order = r.u64();
+
+        std::vector<Slot> slots(r.u32());
+        for (Slot &s : slots) {
+            s = { 0, 0, 0, 0, r.u32(), NOT_QUEUED };
+            if (!r.boolean())
+                continue;
+            const std::string name = r.string();
+            auto it = std::find_if(m_types.begin(), m_types.end(), [&](const Type &t) { return t.name == name; });
+            if (it == m_types.end())
+                throw std::runtime_error("Scheduler: save state has an event nothing registered: " + name);
+            s.type = static_cast<EventType>(it - m_types.begin());
+            s.cycle = r.u64();
+            s.order = r.u64();
+            s.userdata = r.u64();
+            s.heap_index = 0;   // Queued below
+        }
+
+        std::vector<uint32_t> free(r.u32());
+        for (uint32_t &slot : free) {
+            slot = r.u32();
+            if (slot >= slots.size() || slots[slot].heap_index != NOT_QUEUED)
+                throw std::runtime_error("Scheduler: save state has a corrupt free list");
+        }
+
+        m_slots = std::move(slots);
+        m_free = std::move(free);
+        m_now = now;
+        m_order = order;
+
+        // The heap's shape may differ from the saved one, but (cycle, order) fixes the firing order
+        m_heap.clear();
+        for (uint32_t slot = 0; slot < m_slots.size(); slot++) {
+            if (m_slots[slot].heap_index == NOT_QUEUED)
+                continue;
+            m_heap.push_back(slot);
+            sift_up(static_cast<uint32_t>(m_heap.size() - 1));
+        }
+    }
+
+    bool Scheduler::before(uint32_t a, uint32_t b) const {
+        const Slot &x = m_slots[a];
+        const Slot &y = m_slots[b];
+        return x.cycle != y.cycle ? x.cycle < y.cycle : x.order < y.order;
+    }
+
+    void Scheduler::place(uint32_t heap_index, uint32_t slot) {
+        m_heap[heap_index] = slot;
+        m_slots[slot].heap_index = heap_index;
+    }
+
+    void Scheduler::sift_up(uint32_t i) {
+        const uint32_t slot = m_heap[i];
+        while (i > 0) {
+            const uint32_t parent = (i - 1) / 2;
+            if (!before(slot, m_heap[parent]))
+                break;
+            place(i, m_heap[parent]);
+            i = parent;
+        }
+        place(i, slot);
+    }
+
+    void Scheduler::sift_down(uint32_t i) {
+        const uint32_t slot = m_heap[i];
+        const uint32_t n = static_cast<uint32_t>(m_heap.size());
+        for (;;) {
+            uint32_t child = 2 * i + 1;
+            if (child >= n)
+                break;
+            if (child + 1 < n && before(m_heap[child + 1], m_heap[child]))
+                child++;
+            if (!before(m_heap[child], slot))
+                break;
+            place(i, m_heap[child]);
+            i = child;
+        }
+        place(i, slot);
+    }
+
+    void Scheduler::remove(uint32_t slot) {
+        Slot &s = m_slots[slot];
+        const uint32_t i = s.heap_index;
+        const uint32_t last = m_heap.back();
+        m_heap.pop_back();
+
+        if (last != slot) {
+            place(i, last);
+            // The moved slot can belong either above or below its new position
+            sift_up(i);
+            sift_down(m_slots[last].heap_index);
+        }
+
+        s.heap_index = NOT_QUEUED;
+        s.generation++;
+        m_free.push_back(slot);
+    }
+
+} // namespace freecube::timing
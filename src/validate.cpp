@@ -13,7 +13,7 @@ namespace freecube::dol {
                 uint32_t(p[3]);
     }
 
-    bool readDolHeader(const std::vector<uint8_t> &data, DolHeader &out) {
+    bool readDolHeader(util::ByteSpan data, DolHeader &out) {
         if (data.size() < 0x100) {
             LOG_CRITICAL("DOL header is smaller than 0x100!");
             return false;
@@ -53,7 +53,7 @@ namespace freecube::dol {
             if (size == 0) return true;
             if (off == 0) return false;
             if (off >= filesize) return false;
-            if (off + size > filesize) return false;
+            if (uint64_t(off) + size > filesize) return false;
             return true;
         };
 
@@ -88,9 +88,10 @@ namespace freecube::dol {
             }
         }
 
-        if (!entry_ok)
+        if (!entry_ok) {
             LOG_TRACE("Entrypoint is not valid.");
             return {DolStatus::EntryPointInvalid, "Entrypoint is not in a text section."};
+        }
 
         LOG_TRACE("DOL is OK.");
         return {DolStatus::OK, "Valid DOL file."};
@@ -0,0 +1,110 @@
+#include "loader/verify.hpp"
+#include "util/profile.hpp"
+#include "util/thread_pool.hpp"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace freecube::ISOLoader {
+
+    namespace {
+        constexpr std::size_t WINDOW = 32 * 1024 * 1024;
+        constexpr std::size_t MIN_CRC_PIECE = 1024 * 1024;     // Smaller isn't worth a job
+    }
+
+    DiscDigests hash_image(const ISOImage &iso, std::size_t threads) {
+        PROFILE_ZONE("ISOLoader::hash_image");
+
+        if (threads == 0)
+            threads = util::ThreadPool::default_threads();
+        threads = std::max<std::size_t>(threads, 2);
+        const std::size_t crc_threads = std::max<std::size_t>(threads - 2, 1);
+
+        util::ThreadPool pool(threads);
+        util::Md5 md5;
+        util::Sha1 sha1;
+        std::uint32_t crc = 0;
+
+        // Flat images are hashed in place, compressed ones through two buffers taking turns
+        const util::ByteSpan flat = iso.data();
+        std::vector<std::uint8_t> buffers[2];
+        auto load = [&](std::uint64_t offset, int slot) -> util::ByteSpan {
+            const std::size_t len = static_cast<std::size_t>(std::min<std::uint64_t>(WINDOW, iso.size() - offset));
+            if (!flat.empty()) {
+                iso.prefetch(offset, len);
+                return util::ByteSpan(flat.data() + offset, len);
+            }
+            buffers[slot].resize(len);
+            iso.read(offset, buffers[slot].data(), len);
+            return util::ByteSpan(buffers[slot].data(), len);
+        };
+
+        util::ByteSpan window = iso.size() ? load(0, 0) : util::ByteSpan();
+        int slot = 0;
+        for (std::uint64_t offset = 0; offset < iso.size(); ) {
+            const std::uint8_t *p = window.data();
+            const std::size_t n = window.size();
+
+            std::vector<std::future<void>> jobs;
+            jobs.push_back(pool.submit([&md5, p, n] { md5.update(p, n); }));
+            jobs.push_back(pool.submit([&sha1, p, n] { sha1.update(p, n); }));
+
+            const std::size_t pieces = std::clamp<std::size_t>(n / MIN_CRC_PIECE, 1, crc_threads);
+            std::vector<std::future<std::uint32_t>> crcs;
+            for (std::size_t i = 0; i < pieces; i++) {
+                const std::size_t first = n * i / pieces;
+                const std::size_t last = n * (i + 1) / pieces;
+                crcs.push_back(pool.submit([p, first, last] { return util::Crc32::compute(p + first, last - first); }));
+            }
+
+            // Bring in the next window while this one hashes
+            util::ByteSpan next;
+            if (offset + n < iso.size())
+                next = load(offset + n, slot ^ 1);
+
+            for (std::size_t i = 0; i < pieces; i++) {
+                const std::size_t len = n * (i + 1) / pieces - n * i / pieces;
+                crc = util::Crc32::combine(crc, crcs[i].get(), len);
+            }
+            for (auto &job : jobs)
+                job.get();
+
+            offset += n;
+            window = next;
+            slot ^= 1;
+        }
+
+        DiscDigests out;
+        out.crc32 = crc;
+        out.md5 = md5.finish();
+        out.sha1 = sha1.finish();
+        return out;
+    }
+
+    bool digest_matches(const DiscDigests &digests, const std::string &expected) {
+        std::string hex = expected;
+        std::transform(hex.begin(), hex.end(), hex.begin(), [](unsigned char c) { return std::tolower(c); });
+
+        if (!std::all_of(hex.begin(), hex.end(), [](unsigned char c) { return std::isxdigit(c); }))
+            throw std::runtime_error("verify: not a hex digest: " + expected);
+
+        switch (hex.size()) {
+        case 8:
+            return hex == util::to_hex(std::array<std::uint8_t, 4>{
+                static_cast<std::uint8_t>(digests.crc32 >> 24), static_cast<std::uint8_t>(digests.crc32 >> 16),
+                static_cast<std::uint8_t>(digests.crc32 >> 8), static_cast<std::uint8_t>(digests.crc32) });
+        case 32:
+            return hex == util::to_hex(digests.md5);
+        case 40:
+            return hex == util::to_hex(digests.sha1);
+        default:
+            throw std::runtime_error("verify: expected a CRC-32, MD5 or SHA-1 digest, got " +
+                                     std::to_string(hex.size()) + " digits: " + expected);
+        }
+    }
+
+} // namespace freecube::ISOLoader
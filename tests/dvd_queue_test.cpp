@@ -0,0 +1,121 @@
+// DVD read queue: completions arrive in drive order, and guest RAM only changes on delivery
+
+#include "test.hpp"
+#include "dvd/dvd_queue.hpp"
+#include "loader/disc_gen.hpp"
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <vector>
+
+using namespace freecube;
+
+namespace {
+    constexpr std::uint32_t BASE = 0x80100000u;     // Destinations: the big read, then one slot per small one
+    constexpr std::uint32_t BIG = 0x800000;
+    constexpr std::uint32_t SLOT = 0x1000;
+    constexpr std::uint32_t SMALL_READS = 31;
+    constexpr std::uint32_t SPAN = BIG + SLOT * SMALL_READS;
+    constexpr std::uint8_t UNTOUCHED = 0xA5;
+
+    std::uint32_t slot(std::size_t i) {
+        return i == 0 ? BASE : BASE + BIG + static_cast<std::uint32_t>(i - 1) * SLOT;
+    }
+
+    struct Read {
+        std::uint64_t disc_offset;
+        std::uint32_t length;
+    };
+
+    bool untouched(memory::Memory &mem, std::uint32_t address, std::uint32_t length) {
+        const std::uint8_t *p = mem.host_ptr(address, length);
+        for (std::uint32_t i = 0; i < length; i++) {
+            if (p[i] != UNTOUCHED)
+                return false;
+        }
+        return true;
+    }
+
+    bool matches(memory::Memory &mem, const ISOLoader::ISOImage &image, const Read &r, std::uint32_t address) {
+        std::vector<std::uint8_t> want(r.length);
+        image.read(r.disc_offset, want.data(), r.length);
+        return std::memcmp(mem.host_ptr(address, r.length), want.data(), r.length) == 0;
+    }
+}
+
+int main() {
+    const auto iso_path = std::filesystem::temp_directory_path() / "freecube_test_dvd.iso";
+    ISOLoader::DiscSpec spec;
+    spec.files = 128;
+    spec.max_file_size = 256 * 1024;
+    ISOLoader::generate_disc(spec, iso_path.string());
+
+    {
+        ISOLoader::ISOImage image(iso_path.string());
+        memory::Memory mem;
+
+        // A big read first so the small ones behind it tend to finish on the host before it does
+        std::vector<Read> reads = { { 0, BIG } };
+        for (std::uint32_t i = 1; i <= SMALL_READS; i++)
+            reads.push_back({ (i * 0x9E37ull * 0x20) % (image.size() - SLOT), 0x20 * (i + 1) });
+
+        dvd::QueueOptions options;
+        options.threads = 4;
+        options.prefetch_blocks = 0;
+        dvd::DVDReadQueue queue(image, mem, options);
+
+        mem.fill(BASE, UNTOUCHED, SPAN);
+
+        std::vector<std::uint64_t> ids, delivered;
+        std::vector<std::uint64_t> ready(reads.size());
+        for (std::size_t i = 0; i < reads.size(); i++) {
+            const std::uint32_t address = slot(i);
+            ids.push_back(queue.submit(reads[i].disc_offset, address, reads[i].length, 0,
+                                       [&, i, address](const dvd::ReadResult &r) {
+                // Delivered reads have landed, the ones after this are still untouched
+                CHECK(r.id == ids[i]);
+                CHECK(r.bytes_read == reads[i].length);
+                CHECK(matches(mem, image, reads[i], address));
+                for (std::size_t j = i + 1; j < reads.size(); j++)
+                    CHECK(untouched(mem, slot(j), reads[j].length));
+                ready[i] = r.ready_cycle;
+                delivered.push_back(r.id);
+            }));
+        }
+
+        // In order even when a later read is done on the host first
+        while (queue.pending() != 0)
+            queue.poll(~0ull);
+
+        CHECK(delivered == ids);
+        for (std::size_t i = 1; i < ready.size(); i++)
+            CHECK(ready[i - 1] < ready[i]);
+
+        // Done on the host but not due: nothing is visible until the drive would finish
+        mem.fill(BASE, UNTOUCHED, SPAN);
+        delivered.clear();
+        ids.clear();
+        const std::uint64_t now = 1000000;
+        ids.push_back(queue.submit(reads[1].disc_offset, slot(1), reads[1].length, now,
+                                   [&](const dvd::ReadResult &r) { delivered.push_back(r.id); }));
+        queue.wait_host_idle();
+
+        const std::uint64_t due = *queue.next_ready_cycle();
+        CHECK(due > now);
+        CHECK(queue.poll(due - 1) == 0);
+        CHECK(delivered.empty());
+        CHECK(untouched(mem, slot(1), reads[1].length));
+
+        CHECK(queue.poll(due) == 1);
+        CHECK(delivered == ids);
+        CHECK(matches(mem, image, reads[1], slot(1)));
+
+        // Destinations outside RAM are refused up front
+        CHECK_THROWS(std::out_of_range, queue.submit(0, 0xCC000000u, 0x20, now, nullptr));
+        CHECK(queue.pending() == 0);
+    }
+
+    std::filesystem::remove(iso_path);
+    return test::result();
+}
@@ -0,0 +1,132 @@
+// .fcb block tables: every entry has to point inside the file and fit its block
+
+#include "test.hpp"
+#include "loader/disc_gen.hpp"
+#include "loader/fcb.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+using namespace freecube;
+using namespace freecube::ISOLoader;
+
+namespace {
+    const std::filesystem::path TMP = std::filesystem::temp_directory_path();
+
+    std::vector<std::uint8_t> read_file(const std::filesystem::path &path) {
+        std::ifstream in(path, std::ios::binary);
+        return std::vector<std::uint8_t>(std::istreambuf_iterator<char>(in), {});
+    }
+
+    void write_file(const std::filesystem::path &path, const std::vector<std::uint8_t> &bytes) {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    }
+
+    void put_le32(std::uint8_t *p, std::uint32_t v) {
+        for (int i = 0; i < 4; i++)
+            p[i] = static_cast<std::uint8_t>(v >> (8 * i));
+    }
+
+    void put_le64(std::uint8_t *p, std::uint64_t v) {
+        put_le32(p, static_cast<std::uint32_t>(v));
+        put_le32(p + 4, static_cast<std::uint32_t>(v >> 32));
+    }
+
+    std::uint32_t get_le32(const std::uint8_t *p) {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+    }
+
+    // Index of the first block stored with the given kind
+    std::uint32_t find_block(const std::vector<std::uint8_t> &fcb, fcb::BlockKind kind) {
+        const std::uint32_t count = get_le32(fcb.data() + 0x0C);
+        for (std::uint32_t i = 0; i < count; i++) {
+            if (get_le32(fcb.data() + fcb::HEADER_SIZE + i * fcb::TABLE_ENTRY_SIZE + 12) == static_cast<std::uint32_t>(kind))
+                return i;
+        }
+        return count;
+    }
+
+    // A copy of the image with one table entry rewritten, which must be refused on open
+    void check_rejected(const std::vector<std::uint8_t> &good, std::uint32_t block, std::uint64_t offset,
+                        std::uint32_t size, fcb::BlockKind kind) {
+        std::vector<std::uint8_t> bad = good;
+        std::uint8_t *e = bad.data() + fcb::HEADER_SIZE + block * fcb::TABLE_ENTRY_SIZE;
+        put_le64(e, offset);
+        put_le32(e + 8, size);
+        put_le32(e + 12, static_cast<std::uint32_t>(kind));
+
+        const auto path = TMP / "freecube_test_bad.fcb";
+        write_file(path, bad);
+        CHECK_THROWS(std::runtime_error, FCBImage image(path.string()));
+        std::filesystem::remove(path);
+    }
+}
+
+int main() {
+    const auto iso_path = TMP / "freecube_test_fcb.iso";
+    const auto fcb_path = TMP / "freecube_test_fcb.fcb";
+
+    // Pattern-filled files for LZ blocks, zero padding for ZERO ones
+    DiscSpec spec;
+    spec.files = 64;
+    generate_disc(spec, iso_path.string());
+    convert_to_fcb(iso_path.string(), fcb_path.string(), fcb::DEFAULT_BLOCK_SIZE, 1);
+
+    const std::vector<std::uint8_t> iso = read_file(iso_path);
+    const std::vector<std::uint8_t> good = read_file(fcb_path);
+    const std::uint64_t file_size = good.size();
+
+    // The untouched image opens and reads back what was converted
+    {
+        FCBImage image(fcb_path.string());
+        CHECK(image.size() == iso.size());
+        std::vector<std::uint8_t> back(iso.size());
+        CHECK(image.read(0, back.data(), back.size()) == iso.size());
+        CHECK(back == iso);
+    }
+
+    // Read-ahead on a small streaming reader: each block is decoded once, mostly ahead of it
+    {
+        FCBOptions options;
+        options.read_ahead = 4;
+        options.threads = 2;
+        FCBImage image(fcb_path.string(), options);
+
+        std::vector<std::uint8_t> back(iso.size());
+        for (std::size_t off = 0; off < back.size(); off += 0x800)
+            image.read(off, back.data() + off, std::min<std::size_t>(0x800, back.size() - off));
+        CHECK(back == iso);
+
+        const FCBImage::CacheStats stats = image.stats();
+        CHECK(stats.prefetches > 0);
+        CHECK(stats.prefetches + stats.misses <= image.block_count());
+    }
+
+    const std::uint32_t lz = find_block(good, fcb::BlockKind::LZ);
+    CHECK(lz < get_le32(good.data() + 0x0C));
+
+    // Offsets that wrap a 64-bit offset + size back into the file
+    check_rejected(good, lz, ~std::uint64_t(0) - 16 + 2, 16, fcb::BlockKind::LZ);
+    check_rejected(good, lz, ~std::uint64_t(0), 1, fcb::BlockKind::LZ);
+    check_rejected(good, lz, ~std::uint64_t(0) - fcb::DEFAULT_BLOCK_SIZE + 2, fcb::DEFAULT_BLOCK_SIZE, fcb::BlockKind::RAW);
+
+    // Plainly past the end, or ending just past it
+    check_rejected(good, lz, file_size + 1, 1, fcb::BlockKind::LZ);
+    check_rejected(good, lz, file_size - 8, 16, fcb::BlockKind::LZ);
+
+    // Sizes that don't fit the block: RAW must be exactly one block, LZ smaller than one
+    check_rejected(good, lz, fcb::HEADER_SIZE, fcb::DEFAULT_BLOCK_SIZE - 1, fcb::BlockKind::RAW);
+    check_rejected(good, lz, fcb::HEADER_SIZE, fcb::DEFAULT_BLOCK_SIZE, fcb::BlockKind::LZ);
+    check_rejected(good, lz, fcb::HEADER_SIZE, 0, fcb::BlockKind::LZ);
+
+    // Not a kind at all
+    check_rejected(good, lz, fcb::HEADER_SIZE, 16, static_cast<fcb::BlockKind>(7));
+
+    std::filesystem::remove(iso_path);
+    std::filesystem::remove(fcb_path);
+    return test::result();
+}
@@ -0,0 +1,374 @@
+// JIT against the interpreter: random programs must leave both in the same state
+//
+// Programs are built from inline encodings: blocks of random integer, logical, rotate,
+// compare, CR/XER and load/store instructions, joined by every kind of branch the JIT
+// compiles (b, bc, bl/blr, bctr, bcctr, bclr, bdnz loops). Ops the JIT hands to the
+// interpreter (carrying arithmetic, divides, rlwimi, CR logic, byte-reversed and
+// multiple-word accesses...) are mixed in. Branches only go forward, or back to the
+// top of a counted loop, and the program ends in a `b .` that soaks up the budget.
+
+#include "test.hpp"
+#include "cpu/core.hpp"
+#include "cpu/jit_x64.hpp"
+#include "memory/memory.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#if FREECUBE_JIT
+
+using namespace freecube;
+
+namespace {
+    constexpr uint32_t CODE = 0x80010000u;
+    constexpr uint32_t DATA = 0x80400000u;      // r1 points here, r2 near here for update forms
+    constexpr uint32_t DATA_SIZE = 0x2000;
+
+    // ---- Encodings ----
+
+    uint32_t d_form(uint32_t op, uint32_t rt, uint32_t ra, uint32_t imm) {
+        return op << 26 | rt << 21 | ra << 16 | (imm & 0xFFFF);
+    }
+
+    uint32_t x_form(uint32_t rt, uint32_t ra, uint32_t rb, uint32_t xo, bool rc = false) {
+        return 31u << 26 | rt << 21 | ra << 16 | rb << 11 | xo << 1 | rc;
+    }
+
+    uint32_t xo_form(uint32_t rt, uint32_t ra, uint32_t rb, bool oe, uint32_t xo, bool rc) {
+        return 31u << 26 | rt << 21 | ra << 16 | rb << 11 | uint32_t(oe) << 10 | xo << 1 | rc;
+    }
+
+    uint32_t m_form(uint32_t op, uint32_t rs, uint32_t ra, uint32_t sh, uint32_t mb, uint32_t me, bool rc) {
+        return op << 26 | rs << 21 | ra << 16 | sh << 11 | mb << 6 | me << 1 | rc;
+    }
+
+    uint32_t xl_form(uint32_t bt, uint32_t ba, uint32_t bb, uint32_t xo, bool lk = false) {
+        return 19u << 26 | bt << 21 | ba << 16 | bb << 11 | xo << 1 | lk;
+    }
+
+    uint32_t spr_form(uint32_t xo, uint32_t rt, uint32_t spr) {
+        return x_form(rt, spr & 0x1F, spr >> 5, xo);
+    }
+
+    uint32_t b_to(uint32_t from, uint32_t to, bool lk = false) {
+        return 18u << 26 | ((to - from) & 0x03FFFFFC) | lk;
+    }
+
+    uint32_t bc_to(uint32_t bo, uint32_t bi, uint32_t from, uint32_t to) {
+        return 16u << 26 | bo << 21 | bi << 16 | ((to - from) & 0xFFFC);
+    }
+
+    uint32_t mtspr(uint32_t spr, uint32_t rs) { return spr_form(467, rs, spr); }
+    uint32_t mfspr(uint32_t spr, uint32_t rt) { return spr_form(339, rt, spr); }
+
+    // lis/ori pair, always two words so branch layout can be planned ahead
+    void load_imm(std::vector<uint32_t> &out, uint32_t r, uint32_t value) {
+        out.push_back(d_form(15, r, 0, value >> 16));
+        out.push_back(d_form(24, r, r, value));
+    }
+
+    constexpr uint32_t SPR_XER = 1, SPR_LR = 8, SPR_CTR = 9;
+
+    // ---- Generator ----
+
+    // r1 and r2 hold data pointers and r31 an index, so random results go to r3-r30
+    class Generator {
+    public:
+        explicit Generator(uint64_t seed) : m_rng(seed) {}
+
+        uint32_t next(uint32_t n) { return static_cast<uint32_t>(m_rng() % n); }
+        bool coin() { return next(2) != 0; }
+        uint32_t dst() { return 3 + next(28); }
+        uint32_t src() { return next(32); }
+
+        // One data op, with whatever setup it needs, appended to out
+        void op(std::vector<uint32_t> &out) {
+            static constexpr uint32_t XO_ARITH[] = { 266, 40, 10, 8, 138, 136, 202, 200, 234, 232, 104, 235, 491, 459 };
+            static constexpr uint32_t LOGICAL[] = { 28, 60, 444, 412, 316, 124, 476, 284, 24, 536, 792 };
+            static constexpr uint32_t CR_LOGIC[] = { 257, 449, 193, 225, 33, 129, 417, 289 };
+            static constexpr uint32_t D_ARITH[] = { 14, 15, 12, 13, 8, 7 };
+            static constexpr uint32_t UNARY[] = { 954, 922, 26 };
+            static constexpr uint32_t READ_SPRS[] = { SPR_XER, SPR_LR, SPR_CTR };
+
+            switch (next(20)) {
+            case 0:     // addi, addis, addic, addic., subfic, mulli
+                out.push_back(d_form(D_ARITH[next(std::size(D_ARITH))], dst(), src(), next(0x10000)));
+                break;
+            case 1:     // ori, oris, xori, xoris, andi., andis.
+                out.push_back(d_form(24 + next(6), src(), dst(), next(0x10000)));
+                break;
+            case 2:
+            case 3:
+                out.push_back(xo_form(dst(), src(), src(), coin(), XO_ARITH[next(std::size(XO_ARITH))], coin()));
+                break;
+            case 4:     // mulhw, mulhwu have no OE
+                out.push_back(xo_form(dst(), src(), src(), false, coin() ? 75 : 11, coin()));
+                break;
+            case 5:
+            case 6:
+                out.push_back(x_form(src(), dst(), src(), LOGICAL[next(std::size(LOGICAL))], coin()));
+                break;
+            case 7:     // extsb, extsh, cntlzw, srawi
+                if (coin())
+                    out.push_back(x_form(src(), dst(), 0, UNARY[next(std::size(UNARY))], coin()));
+                else
+                    out.push_back(x_form(src(), dst(), next(32), 824, coin()));
+                break;
+            case 8:     // rlwinm, rlwimi, rlwnm
+                switch (next(3)) {
+                case 0: out.push_back(m_form(21, src(), dst(), next(32), next(32), next(32), coin())); break;
+                case 1: out.push_back(m_form(20, src(), dst(), next(32), next(32), next(32), coin())); break;
+                default: out.push_back(m_form(23, src(), dst(), src(), next(32), next(32), coin())); break;
+                }
+                break;
+            case 9:     // cmp, cmpl, cmpi, cmpli into any field
+                switch (next(4)) {
+                case 0: out.push_back(x_form(next(8) << 2, src(), src(), 0)); break;
+                case 1: out.push_back(x_form(next(8) << 2, src(), src(), 32)); break;
+                case 2: out.push_back(d_form(11, next(8) << 2, src(), next(0x10000))); break;
+                default: out.push_back(d_form(10, next(8) << 2, src(), next(0x10000))); break;
+                }
+                break;
+            case 10:    // CR logic, mcrf, mcrxr
+                switch (next(3)) {
+                case 0: out.push_back(xl_form(next(32), next(32), next(32), CR_LOGIC[next(std::size(CR_LOGIC))])); break;
+                case 1: out.push_back(xl_form(next(8) << 2, next(8) << 2, 0, 0)); break;
+                default: out.push_back(x_form(next(8) << 2, 0, 0, 512)); break;
+                }
+                break;
+            case 11:    // mfcr, mtcrf
+                if (coin())
+                    out.push_back(x_form(dst(), 0, 0, 19));
+                else
+                    out.push_back(31u << 26 | src() << 21 | next(256) << 12 | 144u << 1);
+                break;
+            case 12:    // XER in, XER/LR/CTR out
+                if (coin())
+                    out.push_back(mtspr(SPR_XER, src()));
+                else
+                    out.push_back(mfspr(READ_SPRS[next(std::size(READ_SPRS))], dst()));
+                break;
+            case 13:
+            case 14: {  // lwz, lbz, lhz, lha, stw, stb, sth off r1
+                static constexpr uint32_t OPS[] = { 32, 34, 40, 42, 36, 38, 44 };
+                static constexpr uint32_t SIZE[] = { 4, 1, 2, 2, 4, 1, 2 };
+                const uint32_t i = next(std::size(OPS));
+                const uint32_t rt = i >= 4 ? src() : dst();     // Stores last
+                out.push_back(d_form(OPS[i], rt, 1, next(0x1000) & ~(SIZE[i] - 1)));
+                break;
+            }
+            case 15: {  // lwzu, lbzu, lhzu, lhau, stwu, stbu, sthu through r2
+                static constexpr uint32_t OPS[] = { 33, 35, 41, 43, 37, 39, 45 };
+                const uint32_t i = next(std::size(OPS));
+                load_imm(out, 2, DATA + 0x100 + (next(0xE00) & ~3u));
+                out.push_back(d_form(OPS[i], i >= 4 ? src() : dst(), 2, (next(0x200) - 0x100) & ~3u));
+                break;
+            }
+            case 16: {  // indexed off r1 + r31, byte-reversed ones included
+                static constexpr uint32_t LOADS[] = { 23, 87, 279, 343, 534, 790 };
+                static constexpr uint32_t STORES[] = { 151, 215, 407, 662, 918 };
+                out.push_back(d_form(14, 31, 0, next(0x1000) & ~3u));
+                if (coin())
+                    out.push_back(x_form(dst(), 1, 31, LOADS[next(std::size(LOADS))]));
+                else
+                    out.push_back(x_form(src(), 1, 31, STORES[next(std::size(STORES))]));
+                break;
+            }
+            case 17: {  // indexed with update through r2 + r31
+                static constexpr uint32_t LOADS[] = { 55, 119, 311, 375 };
+                static constexpr uint32_t STORES[] = { 183, 247, 439 };
+                load_imm(out, 2, DATA + 0x100 + (next(0xE00) & ~3u));
+                out.push_back(d_form(14, 31, 0, (next(0x200) - 0x100) & ~3u));
+                if (coin())
+                    out.push_back(x_form(dst(), 2, 31, LOADS[next(std::size(LOADS))]));
+                else
+                    out.push_back(x_form(src(), 2, 31, STORES[next(std::size(STORES))]));
+                break;
+            }
+            case 18:    // lmw, stmw of the top few registers, off r1
+                if (coin())
+                    out.push_back(d_form(46, 28 + next(3), 1, next(0x800) & ~3u));
+                else
+                    out.push_back(d_form(47, 28 + next(4), 1, next(0x800) & ~3u));
+                break;
+            default:    // A few plain moves so values get reused
+                out.push_back(x_form(src(), dst(), 0, 444) | (src() << 11));
+                break;
+            }
+        }
+
+        std::vector<uint32_t> body(uint32_t max_ops) {
+            std::vector<uint32_t> words;
+            const uint32_t n = 1 + next(max_ops);
+            for (uint32_t i = 0; i < n; i++)
+                op(words);
+            return words;
+        }
+
+        /**
+         * @brief A program at CODE: blocks joined by branches, then the subroutines
+         */
+        std::vector<uint32_t> program(uint32_t blocks) {
+            enum Kind { FALL, B, BC, BL, BCTR, BCCTR, BCLR, LOOP, KINDS };
+
+            struct Block {
+                Kind kind;
+                std::vector<uint32_t> body;
+                uint32_t target = 0;        // Block index, or subroutine index for BL
+                uint32_t bo = 0, bi = 0, loops = 0;
+                uint32_t address = 0;
+            };
+
+            // Conditional BO values, decrementing forms included; bcctr can't decrement
+            static constexpr uint32_t BO[] = { 0, 2, 4, 8, 10, 12, 16, 18, 20, 5, 13 };
+            static constexpr uint32_t BO_NO_CTR[] = { 4, 12, 20, 5, 13 };
+
+            std::vector<Block> plan(blocks);
+            std::vector<std::vector<uint32_t>> subs;
+            for (uint32_t i = 0; i < blocks; i++) {
+                Block &b = plan[i];
+                b.kind = static_cast<Kind>(next(KINDS));
+                b.body = body(12);
+                b.target = std::min(blocks, i + 1 + next(3));
+                b.bi = next(32);
+                if (b.kind == BCCTR)
+                    b.bo = BO_NO_CTR[next(std::size(BO_NO_CTR))];
+                else
+                    b.bo = BO[next(std::size(BO))];
+                if (b.kind == BL) {
+                    b.target = static_cast<uint32_t>(subs.size());
+                    subs.push_back(body(8));
+                }
+                b.loops = 1 + next(8);
+            }
+
+            // Terminator sizes are fixed, so addresses are known before encoding
+            auto tail = [](Kind k) -> uint32_t {
+                switch (k) {
+                case FALL:  return 0;
+                case B:
+                case BC:
+                case BL:    return 1;
+                case LOOP:  return 2 + 1;       // li/mtctr before the body, bdnz after
+                default:    return 2 + 1 + 1;   // lis/ori, mtctr or mtlr, the branch
+                }
+            };
+
+            uint32_t pc = CODE;
+            for (Block &b : plan) {
+                b.address = pc;
+                pc += 4 * static_cast<uint32_t>(b.body.size() + tail(b.kind));
+            }
+            const uint32_t end = pc;            // The `b .`
+            std::vector<uint32_t> sub_address;
+            pc += 4;
+            for (const auto &s : subs) {
+                sub_address.push_back(pc);
+                pc += 4 * static_cast<uint32_t>(s.size() + 1);
+            }
+            auto block_address = [&](uint32_t i) { return i < blocks ? plan[i].address : end; };
+
+            std::vector<uint32_t> out;
+            auto here = [&] { return CODE + 4 * static_cast<uint32_t>(out.size()); };
+            for (const Block &b : plan) {
+                const uint32_t to = block_address(b.target);
+                switch (b.kind) {
+                case LOOP: {
+                    out.push_back(d_form(14, 31, 0, b.loops));
+                    out.push_back(mtspr(SPR_CTR, 31));
+                    const uint32_t top = here();
+                    out.insert(out.end(), b.body.begin(), b.body.end());
+                    out.push_back(bc_to(16, 0, here(), top));
+                    break;
+                }
+                case BCTR:
+                case BCCTR:
+                case BCLR:
+                    out.insert(out.end(), b.body.begin(), b.body.end());
+                    load_imm(out, 31, to);
+                    out.push_back(mtspr(b.kind == BCLR ? SPR_LR : SPR_CTR, 31));
+                    if (b.kind == BCTR)
+                        out.push_back(xl_form(20, 0, 0, 528));
+                    else
+                        out.push_back(xl_form(b.bo, b.bi, 0, b.kind == BCCTR ? 528 : 16));
+                    break;
+                default:
+                    out.insert(out.end(), b.body.begin(), b.body.end());
+                    if (b.kind == B)
+                        out.push_back(b_to(here(), to));
+                    else if (b.kind == BC)
+                        out.push_back(bc_to(b.bo, b.bi, here(), to));
+                    else if (b.kind == BL)
+                        out.push_back(b_to(here(), sub_address[b.target], true));
+                    break;
+                }
+            }
+
+            out.push_back(b_to(here(), here()));
+            for (const auto &s : subs) {
+                out.insert(out.end(), s.begin(), s.end());
+                out.push_back(xl_form(20, 0, 0, 16));   // blr
+            }
+            return out;
+        }
+
+    private:
+        std::mt19937_64 m_rng;
+    };
+
+    // Fresh memory and registers for one seed, then both engines over the same program
+    bool run_seed(uint64_t seed) {
+        Generator gen(seed);
+        const std::vector<uint32_t> program = gen.program(48);
+
+        memory::Memory mem;
+        for (std::size_t i = 0; i < program.size(); i++)
+            mem.write_slow<uint32_t>(CODE + static_cast<uint32_t>(i) * 4, program[i]);
+        for (uint32_t i = 0; i < DATA_SIZE; i += 4)
+            mem.write_slow<uint32_t>(DATA + i, static_cast<uint32_t>(gen.next(0xFFFFFFFFu)));
+
+        cpu::CPUState cpu;
+        cpu.reset();
+        for (uint32_t &r : cpu.gpr)
+            r = gen.next(0xFFFFFFFFu) >> (gen.next(4) * 8);
+        cpu.gpr[1] = DATA;
+        cpu.gpr[2] = DATA;
+        cpu.write_cr(gen.next(0xFFFFFFFFu));
+        cpu.write_xer(gen.next(0xFFFFFFFFu) & 0xE000007Fu);
+        cpu.lr = gen.next(0xFFFFFFFFu);
+        cpu.ctr = gen.next(16);
+        cpu.pc = CODE;
+
+        // Loops run at most 8 times, so this covers the program and spins a while at the end
+        const uint64_t budget = program.size() * 8 + 64;
+        const cpu::LockstepReport report = cpu::run_lockstep(cpu, mem, budget);
+
+        CHECK(!report.diverged);
+        CHECK(report.instructions == budget);
+        if (report.diverged) {
+            std::fprintf(stderr, "seed %llu: diverged in block @ 0x%08X: %s\n",
+                         static_cast<unsigned long long>(seed), report.pc, report.detail.c_str());
+        }
+        return !report.diverged;
+    }
+}
+
+int main() {
+    for (uint64_t seed = 1; seed <= 32; seed++) {
+        if (!run_seed(seed))
+            break;
+    }
+    return test::result();
+}
+
+#else
+
+int main() {
+    std::puts("No JIT for this host, nothing to test");
+    return 0;
+}
+
+#endif
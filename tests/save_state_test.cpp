@@ -0,0 +1,85 @@
+// Save states: a restore only writes the pages memory doesn't already hold
+
+#include "test.hpp"
+#include "memory/memory.hpp"
+#include "state/save_state.hpp"
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+using namespace freecube;
+
+namespace {
+    constexpr std::uint32_t PAGES_USED = 64;
+
+    // Compressible but page-unique contents in MEM1 and ARAM
+    void fill(memory::Memory &mem, std::uint32_t seed) {
+        for (std::uint32_t p = 0; p < PAGES_USED; p++) {
+            const std::uint32_t address = memory::CACHED_BASE + p * memory::PAGE_SIZE * 3;
+            for (std::uint32_t i = 0; i < memory::PAGE_SIZE; i += 4)
+                mem.write<std::uint32_t>(address + i, seed + p * 0x100 + (i >> 6));
+        }
+        std::memset(mem.aram() + memory::PAGE_SIZE * 5, static_cast<int>(seed), memory::PAGE_SIZE);
+    }
+
+    bool same_memory(const memory::Memory &a, const memory::Memory &b) {
+        return std::memcmp(a.ram(), b.ram(), memory::MEM1_SIZE) == 0 &&
+               std::memcmp(a.aram(), b.aram(), memory::ARAM_SIZE) == 0;
+    }
+}
+
+int main() {
+    const std::string path = (std::filesystem::temp_directory_path() / "freecube_test_state.fcs").string();
+
+    memory::Memory mem;
+    state::StateManager states(mem, 2);
+    fill(mem, 1);
+
+    // Compression happens after capture() returns; fresh_bytes() waits for it
+    auto snap = states.capture();
+    CHECK(snap->fresh_pages() == state::fcs::PAGES);
+    const std::uint64_t packed = snap->fresh_bytes();
+    CHECK(packed > 0);
+    CHECK(packed < std::uint64_t(PAGES_USED + 1) * memory::PAGE_SIZE);
+    states.wait();
+    CHECK(snap->fresh_bytes() == packed);
+
+    states.write(*snap, path);
+
+    // Nothing changed since the capture: nothing to write, from memory or from the file
+    CHECK(states.restore(*snap) == 0);
+    CHECK(states.restore(*states.read(path)) == 0);
+
+    // Every page in use changed: all of them are written back, and into a zeroed machine too
+    fill(mem, 2);
+    mem.write<std::uint32_t>(memory::CACHED_BASE + 0x10, 0x12345678);
+    CHECK(states.restore(*states.read(path)) == PAGES_USED + 1);
+    {
+        memory::Memory fresh;
+        state::StateManager other(fresh);
+        CHECK(other.restore(*other.read(path)) == PAGES_USED + 1);
+        CHECK(same_memory(mem, fresh));
+
+        // One RAM page and the ARAM page differ: those two, and only those
+        fresh.write<std::uint32_t>(memory::CACHED_BASE + memory::PAGE_SIZE * 3, 0);
+        std::memset(fresh.aram() + memory::PAGE_SIZE * 5, 0, memory::PAGE_SIZE);
+        CHECK(other.restore(*other.read(path)) == 2);
+        CHECK(same_memory(mem, fresh));
+    }
+
+    // A file from another version is refused
+    state::StateWriter w;
+    w.bytes(state::fcs::MAGIC, sizeof(state::fcs::MAGIC));
+    w.u32(state::fcs::VERSION - 1);
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char *>(w.data().data()), static_cast<std::streamsize>(w.data().size()));
+    }
+    CHECK_THROWS(std::runtime_error, states.read(path));
+
+    std::filesystem::remove(path);
+    return test::result();
+}
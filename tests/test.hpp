@@ -0,0 +1,43 @@
+#pragma once
+
+// Just enough of a harness for the tests in this directory: each test is its own
+// executable, CHECK logs every failed condition and main() returns test::result().
+
+#include <cstdio>
+#include <exception>
+
+namespace freecube::test {
+
+    inline int &failures() {
+        static int count = 0;
+        return count;
+    }
+
+    inline void check(bool ok, const char *expr, const char *file, int line) {
+        if (!ok) {
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, expr);
+            failures()++;
+        }
+    }
+
+    inline int result() {
+        if (failures())
+            std::fprintf(stderr, "%d check(s) failed\n", failures());
+        return failures() ? 1 : 0;
+    }
+}
+
+#define CHECK(cond) ::freecube::test::check(static_cast<bool>(cond), #cond, __FILE__, __LINE__)
+
+// Passes if stmt throws E (or something derived from it)
+#define CHECK_THROWS(E, stmt)                                                             \
+    do {                                                                                  \
+        bool thrown_ = false;                                                             \
+        try {                                                                             \
+            stmt;                                                                         \
+        } catch (const E &) {                                                             \
+            thrown_ = true;                                                               \
+        } catch (...) {                                                                   \
+        }                                                                                 \
+        ::freecube::test::check(thrown_, "throws " #E ": " #stmt, __FILE__, __LINE__);    \
+    } while (0)